@@ -0,0 +1,372 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include "persistent_db.hpp"
+
+struct BulkLoadConfig {
+    std::string db_path = "cache.db";
+    bool input_sorted = false;           // keys arrive in ascending order, skips the sort
+    size_t threads = 0;                  // sort threads, 0 picks hardware_concurrency
+    size_t memory_bytes = 256 << 20;     // pairs buffered before a sorted run is spilled to disk
+    size_t rows_per_transaction = 100000;
+    std::string temp_dir = ".";          // where spilled runs go
+};
+
+struct BulkLoadResult {
+    bool ok = false;
+    uint64_t rows = 0;       // rows written, after dropping duplicate keys
+    uint64_t bytes = 0;      // key + value bytes written
+    size_t runs = 0;         // sorted runs spilled to disk
+    double sort_seconds = 0; // parsing and sorting, until the first row can be inserted
+    double total_seconds = 0;
+
+    double rowsPerSecond() const { return total_seconds > 0 ? rows / total_seconds : 0; }
+    double megabytesPerSecond() const { return total_seconds > 0 ? bytes / total_seconds / (1 << 20) : 0; }
+};
+
+/// Loads large numbers of pairs straight into the SQLite file, bypassing FIFOCache
+///
+/// Pairs are buffered up to memory_bytes, sorted by key with several threads and spilled to a temp
+/// file as a sorted run. finish() merges the runs and inserts the result in key order, in large
+/// transactions, so the key index is only ever appended to, and rebuilds the access metadata
+/// indexes once at the end (see SQLiteDB::set_bulk_mode). When a key occurs more than once the
+/// last occurrence wins, as with put().
+///
+/// Meant for initial ingestion: caches already open on the database are not updated, and snapshots
+/// taken before the load are invalidated by the changed database file.
+class BulkLoader {
+private:
+    using Pair = std::pair<std::string, std::string>;
+
+    BulkLoadConfig config;
+    std::vector<Pair> buffer;
+    size_t buffered_bytes = 0;
+    std::vector<std::string> run_paths;
+    bool failed = false;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static constexpr size_t PAIR_OVERHEAD = sizeof(Pair) + 32; // allocator and string headers, roughly
+
+    /// Sorted run on disk, read back sequentially during the merge
+    struct RunReader {
+        FILE* file = nullptr;
+        Pair current;
+
+        bool next() {
+            uint32_t lengths[2];
+            if (std::fread(lengths, sizeof(lengths), 1, file) != 1) {
+                return false;
+            }
+            current.first.resize(lengths[0]);
+            current.second.resize(lengths[1]);
+            return std::fread(&current.first[0], 1, lengths[0], file) == lengths[0] &&
+                   std::fread(&current.second[0], 1, lengths[1], file) == lengths[1];
+        }
+    };
+
+    size_t threadCount() const {
+        size_t threads = config.threads ? config.threads : std::thread::hardware_concurrency();
+        return std::max<size_t>(1, threads);
+    }
+
+    /// Stable sort of the buffer by key, in parallel slices merged pairwise
+    void sortBuffer() {
+        size_t slices = std::min(threadCount(), std::max<size_t>(1, buffer.size() / 65536));
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= slices; i++) {
+            bounds.push_back(buffer.size() * i / slices);
+        }
+        auto by_key = [](const Pair& a, const Pair& b) { return a.first < b.first; };
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < slices; i++) {
+            workers.emplace_back([&, i]() { std::stable_sort(buffer.begin() + bounds[i], buffer.begin() + bounds[i + 1], by_key); });
+        }
+        std::stable_sort(buffer.begin(), buffer.begin() + bounds[1], by_key);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        // neighbouring slices are merged in parallel too, halving the slice count each round
+        for (size_t width = 1; width < slices; width *= 2) {
+            workers.clear();
+            for (size_t i = 0; i + width < slices; i += 2 * width) {
+                size_t first = bounds[i];
+                size_t middle = bounds[i + width];
+                size_t last = bounds[std::min(i + 2 * width, slices)];
+                workers.emplace_back([&, first, middle, last]() {
+                    std::inplace_merge(buffer.begin() + first, buffer.begin() + middle, buffer.begin() + last, by_key);
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+    }
+
+    void spillRun() {
+        if (!config.input_sorted) {
+            sortBuffer();
+        }
+        std::string path = config.temp_dir + "/kvs_bulk_" + std::to_string(getpid()) + "_" +
+                           std::to_string(run_paths.size()) + ".run";
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Cannot write " << path << ": " << std::strerror(errno) << std::endl;
+            failed = true;
+            return;
+        }
+        run_paths.push_back(path);
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        bool ok = true;
+        for (const auto& [key, value] : buffer) {
+            uint32_t lengths[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+            ok = ok && std::fwrite(lengths, sizeof(lengths), 1, file) == 1 &&
+                 std::fwrite(key.data(), 1, key.size(), file) == key.size() &&
+                 std::fwrite(value.data(), 1, value.size(), file) == value.size();
+        }
+        if (std::fclose(file) != 0 || !ok) {
+            std::cerr << "Cannot write " << path << std::endl;
+            failed = true;
+        }
+        buffer.clear();
+        buffered_bytes = 0;
+    }
+
+    void removeRuns() {
+        for (const auto& path : run_paths) {
+            std::remove(path.c_str());
+        }
+        run_paths.clear();
+    }
+
+    /// Feeds the sorted, deduplicated pairs to `emit`, merging the spilled runs with a heap
+    /// Equal keys are ordered by run, and within a run by input order, so the last one seen wins
+    template <typename Emit>
+    bool mergeRuns(Emit&& emit) {
+        std::vector<RunReader> readers(run_paths.size());
+        auto cleanup = [&]() {
+            for (auto& reader : readers) {
+                if (reader.file) std::fclose(reader.file);
+            }
+        };
+        // min-heap on (key, run index)
+        auto later = [&readers](size_t a, size_t b) {
+            int order = readers[a].current.first.compare(readers[b].current.first);
+            return order != 0 ? order > 0 : a > b;
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+        for (size_t i = 0; i < readers.size(); i++) {
+            readers[i].file = std::fopen(run_paths[i].c_str(), "rb");
+            if (!readers[i].file) {
+                cleanup();
+                return false;
+            }
+            std::setvbuf(readers[i].file, nullptr, _IOFBF, 1 << 20);
+            if (readers[i].next()) {
+                heap.push(i);
+            }
+        }
+
+        Pair pending;
+        bool has_pending = false;
+        while (!heap.empty()) {
+            size_t run = heap.top();
+            heap.pop();
+            if (has_pending && pending.first != readers[run].current.first) {
+                emit(std::move(pending));
+            }
+            pending = std::move(readers[run].current);
+            has_pending = true;
+            if (readers[run].next()) {
+                heap.push(run);
+            }
+        }
+        if (has_pending) {
+            emit(std::move(pending));
+        }
+        cleanup();
+        return true;
+    }
+
+public:
+    explicit BulkLoader(const BulkLoadConfig& config) : config(config) {}
+
+    ~BulkLoader() {
+        removeRuns();
+    }
+
+    BulkLoader(const BulkLoader&) = delete;
+    BulkLoader& operator=(const BulkLoader&) = delete;
+
+    /// Buffers one pair, pairs with empty keys are skipped
+    void add(std::string key, std::string value) {
+        if (key.empty() || failed) {
+            return;
+        }
+        buffered_bytes += key.size() + value.size() + PAIR_OVERHEAD;
+        buffer.emplace_back(std::move(key), std::move(value));
+        if (buffered_bytes >= config.memory_bytes) {
+            spillRun();
+        }
+    }
+
+    /// Writes everything added so far to the database
+    BulkLoadResult finish() {
+        BulkLoadResult result;
+        if (failed) {
+            removeRuns();
+            return result;
+        }
+        if (!run_paths.empty() && !buffer.empty()) {
+            spillRun(); // everything goes through the merge once something was spilled
+        } else if (!config.input_sorted) {
+            sortBuffer();
+        }
+        result.runs = run_paths.size();
+        if (failed) {
+            removeRuns();
+            return result;
+        }
+        result.sort_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        SQLiteDB db(config.db_path);
+        db.set_bulk_mode(true);
+
+        // the merge produces the next transaction while SQLite commits the previous one
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::vector<Pair>> batches;
+        bool producer_done = false;
+        bool insert_ok = true;
+        std::thread inserter([&]() {
+            while (true) {
+                std::vector<Pair> batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() { return !batches.empty() || producer_done; });
+                    if (batches.empty()) {
+                        return;
+                    }
+                    batch = std::move(batches.front());
+                    batches.pop_front();
+                }
+                changed.notify_all();
+                bool ok = db.put_many_to_db(batch);
+                std::lock_guard<std::mutex> lock(mutex);
+                insert_ok = insert_ok && ok;
+            }
+        });
+
+        std::vector<Pair> batch;
+        batch.reserve(config.rows_per_transaction);
+        auto flush = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return batches.size() < 2; });
+            batches.push_back(std::move(batch));
+            batch = {};
+            batch.reserve(config.rows_per_transaction);
+            lock.unlock();
+            changed.notify_all();
+        };
+        auto emit = [&](Pair&& pair) {
+            result.rows++;
+            result.bytes += pair.first.size() + pair.second.size();
+            batch.push_back(std::move(pair));
+            if (batch.size() >= config.rows_per_transaction) {
+                flush();
+            }
+        };
+
+        bool merged = true;
+        if (run_paths.empty()) {
+            // a single in-memory run, deduplicated in place
+            for (size_t i = 0; i < buffer.size(); i++) {
+                if (i + 1 < buffer.size() && buffer[i + 1].first == buffer[i].first) {
+                    continue;
+                }
+                emit(std::move(buffer[i]));
+            }
+            buffer.clear();
+        } else {
+            merged = mergeRuns(emit);
+        }
+        if (!batch.empty()) {
+            flush();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            producer_done = true;
+        }
+        changed.notify_all();
+        inserter.join();
+        removeRuns();
+
+        bool restored = db.set_bulk_mode(false);
+        result.ok = merged && insert_ok && restored;
+        result.total_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return result;
+    }
+
+    /// Appends one line of the bulk load text format, including the newline, see parseLine
+    static void formatLine(const std::string& key, const std::string& value, std::string& out) {
+        auto escape = [&out](const std::string& text) {
+            for (char c : text) {
+                switch (c) {
+                case '\t': out += "\\t"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\\': out += "\\\\"; break;
+                default: out.push_back(c);
+                }
+            }
+        };
+        escape(key);
+        out.push_back('\t');
+        escape(value);
+        out.push_back('\n');
+    }
+
+    /// Parses one line of the bulk load text format: key TAB value, where \t, \n, \r and \\ inside
+    /// keys and values are written as escapes (the same convention as PostgreSQL COPY)
+    /// @returns false if the line has no tab or a bad escape
+    static bool parseLine(const std::string& line, std::string& key, std::string& value) {
+        key.clear();
+        value.clear();
+        std::string* out = &key;
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            if (c == '\t') {
+                if (out == &value) {
+                    return false;
+                }
+                out = &value;
+            } else if (c == '\\') {
+                if (++i == line.size()) {
+                    return false;
+                }
+                switch (line[i]) {
+                case 't': out->push_back('\t'); break;
+                case 'n': out->push_back('\n'); break;
+                case 'r': out->push_back('\r'); break;
+                case '\\': out->push_back('\\'); break;
+                default: return false;
+                }
+            } else {
+                out->push_back(c);
+            }
+        }
+        return out == &value;
+    }
+};
@@ -0,0 +1,236 @@
+#pragma once
+#include <memory_resource>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+/// Huge page and NUMA aware memory for the private cache's entries and index (see
+/// CacheConfig::huge_pages), and the accounting behind CacheConfig::bound_memory.
+/// Nothing here links against libnuma, the policy calls are made directly.
+namespace memory {
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+inline size_t roundUpToHugePage(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/// Number of NUMA nodes, 1 on machines or kernels without NUMA
+inline int nodeCount() {
+    static const int count = []() {
+        std::ifstream online("/sys/devices/system/node/online"); // e.g. "0" or "0-1"
+        std::string ranges;
+        if (!(online >> ranges)) {
+            return 1;
+        }
+        int highest = 0;
+        size_t start = 0;
+        while (start < ranges.size()) {
+            size_t end = ranges.find(',', start);
+            std::string range = ranges.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            size_t dash = range.find('-');
+            highest = std::max(highest, std::atoi(range.c_str() + (dash == std::string::npos ? 0 : dash + 1)));
+            start = end == std::string::npos ? ranges.size() : end + 1;
+        }
+        return highest + 1;
+    }();
+    return count;
+}
+
+/// Sets the memory policy of a range that hasn't been touched yet
+/// node >= 0 prefers that node, -1 interleaves pages over all nodes. No-op on single node machines.
+inline void bindToNode(void* address, size_t size, int node) {
+    int nodes = nodeCount();
+    if (nodes <= 1 || node >= nodes) {
+        return;
+    }
+    unsigned long mask = 0;
+    int mode = MPOL_INTERLEAVE;
+    if (node >= 0) {
+        mask = 1UL << node;
+        mode = MPOL_PREFERRED;
+    } else {
+        mask = nodes >= 64 ? ~0UL : (1UL << nodes) - 1;
+    }
+    if (syscall(SYS_mbind, address, size, mode, &mask, sizeof(mask) * 8, 0) != 0) {
+        std::cerr << "mbind failed, entry memory is not NUMA bound" << std::endl;
+    }
+}
+
+/// Maps `size` bytes, a multiple of HUGE_PAGE_SIZE, preferably backed by huge pages
+/// Tries the explicit huge page pool (MAP_HUGETLB) first; without reserved huge pages it falls
+/// back to a 2MB aligned anonymous mapping marked for transparent huge pages.
+/// @returns nullptr if the memory can't be mapped at all
+inline void* mapHuge(size_t size, bool& explicit_huge_pages) {
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (address != MAP_FAILED) {
+        explicit_huge_pages = true;
+        return address;
+    }
+    explicit_huge_pages = false;
+
+    // over-allocate so a 2MB boundary can be picked, then trim both ends
+    size_t padded = size + HUGE_PAGE_SIZE;
+    void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    size_t tail = start + padded - (aligned + size);
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + size), tail);
+    }
+    address = reinterpret_cast<void*>(aligned);
+    madvise(address, size, MADV_HUGEPAGE);
+    return address;
+}
+
+/// Upstream resource handing out memory from huge page backed chunks
+///
+/// Small blocks are carved from CHUNK_SIZE chunks with a bump pointer and only returned when the
+/// resource is destroyed; it is meant to sit under a pool resource that recycles them. Blocks of
+/// LARGE_BLOCK bytes or more get their own mapping and are unmapped on deallocation.
+/// Not thread safe, like std::pmr::unsynchronized_pool_resource.
+class HugePageResource : public std::pmr::memory_resource {
+private:
+    static constexpr size_t CHUNK_SIZE = 8 * HUGE_PAGE_SIZE;
+    static constexpr size_t LARGE_BLOCK = HUGE_PAGE_SIZE / 2;
+
+    int numa_node;
+    std::vector<std::pair<void*, size_t>> chunks;
+    char* next = nullptr;
+    size_t remaining = 0;
+    size_t mapped = 0;
+    bool explicit_huge = true;
+
+    void* mapChunk(size_t size) {
+        bool explicit_huge_pages;
+        void* address = mapHuge(size, explicit_huge_pages);
+        if (!address) {
+            throw std::bad_alloc();
+        }
+        explicit_huge = explicit_huge && explicit_huge_pages;
+        bindToNode(address, size, numa_node);
+        mapped += size;
+        return address;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if (bytes >= LARGE_BLOCK) {
+            return mapChunk(roundUpToHugePage(bytes));
+        }
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+        if (!next || padding + bytes > remaining) {
+            void* chunk = mapChunk(CHUNK_SIZE);
+            chunks.emplace_back(chunk, CHUNK_SIZE);
+            next = static_cast<char*>(chunk);
+            remaining = CHUNK_SIZE;
+            padding = 0;
+        }
+        void* block = next + padding;
+        next += padding + bytes;
+        remaining -= padding + bytes;
+        return block;
+    }
+
+    void do_deallocate(void* block, size_t bytes, size_t) override {
+        if (bytes >= LARGE_BLOCK) {
+            size_t size = roundUpToHugePage(bytes);
+            munmap(block, size);
+            mapped -= size;
+        }
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    /// @param numa_node node the memory is bound to, -1 interleaves it over all nodes
+    explicit HugePageResource(int numa_node = -1) : numa_node(numa_node) {}
+
+    ~HugePageResource() override {
+        for (auto& [address, size] : chunks) {
+            munmap(address, size);
+        }
+    }
+
+    HugePageResource(const HugePageResource&) = delete;
+    HugePageResource& operator=(const HugePageResource&) = delete;
+
+    /// Bytes currently mapped
+    size_t bytesMapped() const { return mapped; }
+
+    /// True while every mapping came from the explicit huge page pool rather than THP
+    bool explicitHugePages() const { return explicit_huge && mapped > 0; }
+};
+
+/// Counts the memory its allocations occupy in the upstream resource
+///
+/// Over the default resource, which is glibc malloc, a block occupies malloc_usable_size plus the
+/// chunk header. Over a pool the pool's block rounding isn't visible, requests are counted rounded
+/// up to 8 bytes. Not thread safe, callers serialize allocations as for the upstream pool.
+class AccountingResource : public std::pmr::memory_resource {
+private:
+    static constexpr size_t MALLOC_HEADER = sizeof(size_t);
+    static constexpr size_t MALLOC_MIN_CHUNK = 4 * sizeof(size_t);
+
+    std::pmr::memory_resource* upstream;
+    const bool malloc_backed;
+    size_t used = 0;
+
+    size_t occupied(void* block, size_t bytes) const {
+        return malloc_backed ? malloc_usable_size(block) + MALLOC_HEADER : (bytes + 7) & ~size_t(7);
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        void* block = upstream->allocate(bytes, alignment);
+        used += occupied(block, bytes);
+        return block;
+    }
+
+    void do_deallocate(void* block, size_t bytes, size_t alignment) override {
+        used -= occupied(block, bytes);
+        upstream->deallocate(block, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit AccountingResource(std::pmr::memory_resource* upstream)
+        : upstream(upstream), malloc_backed(upstream == std::pmr::new_delete_resource()) {}
+
+    AccountingResource(const AccountingResource&) = delete;
+    AccountingResource& operator=(const AccountingResource&) = delete;
+
+    /// Memory held by live allocations
+    size_t bytes() const { return used; }
+
+    /// Memory an allocation of `bytes` is expected to occupy, before it is made
+    size_t footprint(size_t bytes) const {
+        if (!malloc_backed) {
+            return (bytes + 7) & ~size_t(7);
+        }
+        return std::max(MALLOC_MIN_CHUNK, (bytes + MALLOC_HEADER + 15) & ~size_t(15));
+    }
+};
+
+} // namespace memory
@@ -0,0 +1,215 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// Binary snapshot of resident cache entries, used by FIFOCache::save_snapshot/load_snapshot
+///
+/// Layout (host byte order):
+///   Header
+///   entry_count records: u32 key length, u32 value length, key bytes, value bytes (oldest first)
+///   entry_count u64 record offsets, so loaders can split the records between threads
+///
+/// The header records the size and modification time of the database file at save time. A snapshot
+/// is only loaded while the database is unchanged, otherwise it could resurrect stale values.
+namespace snapshot {
+
+static constexpr uint64_t MAGIC = 0x3150414e5353564bULL; // "KVSSNAP1" read as a little endian u64
+static constexpr uint32_t VERSION = 1;
+
+struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t entry_count;
+    uint64_t index_offset;
+    uint64_t db_size;
+    int64_t db_mtime_ns;
+};
+
+/// Identity of the database file contents, see Header
+struct DbFingerprint {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+
+    static DbFingerprint of(const std::string& db_path) {
+        DbFingerprint fingerprint;
+        struct stat st;
+        if (stat(db_path.c_str(), &st) == 0) {
+            fingerprint.size = static_cast<uint64_t>(st.st_size);
+            fingerprint.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        }
+        return fingerprint;
+    }
+};
+
+/// Streams records to `path`, atomically replacing it once complete
+class Writer {
+private:
+    std::string path;
+    std::string temp_path;
+    FILE* file = nullptr;
+    std::vector<uint64_t> offsets;
+    uint64_t position = 0;
+    bool failed = false;
+
+    void write(const void* data, size_t size) {
+        if (!failed && size > 0 && std::fwrite(data, 1, size, file) != size) {
+            failed = true;
+        }
+        position += size;
+    }
+
+public:
+    explicit Writer(const std::string& path) : path(path), temp_path(path + ".tmp") {
+        file = std::fopen(temp_path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Cannot write snapshot " << temp_path << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        Header placeholder{};
+        write(&placeholder, sizeof(placeholder));
+    }
+
+    ~Writer() {
+        if (file) { // finish() was not called
+            std::fclose(file);
+            std::remove(temp_path.c_str());
+        }
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    bool isOpen() const { return file != nullptr; }
+
+    void add(std::string_view key, std::string_view value) {
+        offsets.push_back(position);
+        uint32_t lengths[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+        write(lengths, sizeof(lengths));
+        write(key.data(), key.size());
+        write(value.data(), value.size());
+    }
+
+    /// Writes the offset table and header, syncs, and renames the file into place
+    bool finish(const DbFingerprint& fingerprint) {
+        if (!file) {
+            return false;
+        }
+        Header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.entry_count = offsets.size();
+        header.index_offset = position;
+        header.db_size = fingerprint.size;
+        header.db_mtime_ns = fingerprint.mtime_ns;
+        write(offsets.data(), offsets.size() * sizeof(uint64_t));
+
+        bool ok = !failed && std::fseek(file, 0, SEEK_SET) == 0 &&
+                  std::fwrite(&header, 1, sizeof(header), file) == sizeof(header) &&
+                  std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::cerr << "Cannot write snapshot " << path << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+/// Maps a snapshot and decodes its records with `threads` threads
+/// String is std::string or another basic_string<char>, e.g. the cache's std::pmr::string
+/// @returns false if the file is missing, malformed, or was taken from a different database state
+template <typename String>
+bool read(const std::string& path, const DbFingerprint& fingerprint, size_t threads,
+          std::vector<std::pair<String, String>>& entries) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapped, size, MADV_WILLNEED);
+    const char* data = static_cast<const char*>(mapped);
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    bool valid = header.magic == MAGIC && header.version == VERSION &&
+                 header.index_offset <= size && header.entry_count <= (size - header.index_offset) / sizeof(uint64_t);
+    if (valid && (header.db_size != fingerprint.size || header.db_mtime_ns != fingerprint.mtime_ns)) {
+        std::cerr << "Snapshot " << path << " is older than the database, ignoring it" << std::endl;
+        valid = false;
+    }
+    if (!valid) {
+        munmap(mapped, size);
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(header.entry_count);
+    entries.assign(count, {});
+    threads = std::max<size_t>(1, std::min(threads, count / 1024 + 1));
+    std::vector<char> slice_ok(threads, 1);
+    auto decode = [&](size_t slice) {
+        size_t begin = count * slice / threads;
+        size_t end = count * (slice + 1) / threads;
+        for (size_t i = begin; i < end; i++) {
+            uint64_t offset;
+            std::memcpy(&offset, data + header.index_offset + i * sizeof(uint64_t), sizeof(offset));
+            uint32_t lengths[2];
+            if (offset < sizeof(Header) || offset + sizeof(lengths) > header.index_offset) {
+                slice_ok[slice] = 0;
+                return;
+            }
+            std::memcpy(lengths, data + offset, sizeof(lengths));
+            uint64_t key_start = offset + sizeof(lengths);
+            if (key_start + lengths[0] + lengths[1] > header.index_offset) {
+                slice_ok[slice] = 0;
+                return;
+            }
+            entries[i].first.assign(data + key_start, lengths[0]);
+            entries[i].second.assign(data + key_start + lengths[0], lengths[1]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t slice = 1; slice < threads; slice++) {
+        workers.emplace_back(decode, slice);
+    }
+    decode(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    munmap(mapped, size);
+
+    if (std::find(slice_ok.begin(), slice_ok.end(), 0) != slice_ok.end()) {
+        std::cerr << "Snapshot " << path << " is corrupt, ignoring it" << std::endl;
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+} // namespace snapshot
@@ -0,0 +1,202 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include "persistent_db.hpp"
+
+/// One change made through a FIFOCache, numbered from 1 in the order it was made
+struct WatchEvent {
+    uint64_t seq;
+    std::string key;
+    ChangeOp op;
+};
+
+/// A page of FIFOCache::read_changes
+struct ChangePage {
+    std::vector<WatchEvent> events;
+    uint64_t next = 0;   // cursor for the next call
+    bool missed = false; // events after the given cursor were dropped from the buffer, re-read the state
+};
+
+/// Recent changes of a FIFOCache, for watchers and cursor readers (see CacheConfig::watch_buffer_events)
+///
+/// publish() appends to a bounded buffer under one mutex, so writers never run callbacks; only the
+/// first change after an idle period wakes the dispatcher thread. The dispatcher lets changes gather
+/// for BATCH_WINDOW, takes everything published since its last round as one batch and passes each
+/// watcher the events for its key or prefix. When it falls more than the buffer behind, the dropped
+/// events are lost and every watcher is told so. Cursor readers page through the same buffer at
+/// their own pace and learn the same way that they fell behind.
+class ChangeFeed {
+public:
+    /// events is empty and missed true if only dropped events concerned the watcher
+    using Callback = std::function<void(const std::vector<WatchEvent>& events, bool missed)>;
+
+    static constexpr std::chrono::milliseconds BATCH_WINDOW{1};
+
+private:
+    struct Watcher {
+        uint64_t id;
+        std::string key;
+        bool prefix;
+        Callback callback;
+        bool removed = false; // set by unwatch() under dispatch_mutex, or from a callback
+    };
+
+    const size_t capacity;
+    std::deque<WatchEvent> events; // oldest first, consecutive seqs
+    uint64_t next_seq = 1;
+    uint64_t dispatched = 0;       // last seq handed to the watchers
+    std::vector<std::shared_ptr<Watcher>> watchers;
+    uint64_t next_watcher = 1;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::mutex dispatch_mutex;     // held while callbacks run, so unwatch() can wait them out
+    std::thread dispatcher;
+    bool idle = false;             // the dispatcher waits for a change
+    bool stop = false;
+
+    static bool matches(const std::string& key, const std::string& pattern, bool prefix) {
+        return prefix ? key.compare(0, pattern.size(), pattern) == 0 : key == pattern;
+    }
+
+    uint64_t firstSeqLocked() const {
+        return events.empty() ? next_seq : events.front().seq;
+    }
+
+    void runDispatcher() {
+        std::vector<WatchEvent> batch, matched;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            idle = true;
+            wake.wait(lock, [this]() { return stop || (!watchers.empty() && dispatched + 1 < next_seq); });
+            idle = false;
+            if (stop || wake.wait_for(lock, BATCH_WINDOW, [this]() { return stop; })) {
+                return;
+            }
+            uint64_t first = firstSeqLocked();
+            bool missed = dispatched + 1 < first;
+            batch.assign(events.begin() + (std::max(dispatched + 1, first) - first), events.end());
+            dispatched = next_seq - 1;
+            auto current = watchers;
+            {
+                // taken before mutex is released, so an unwatch() that misses `current` waits for the batch
+                std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex);
+                lock.unlock();
+                for (const auto& watcher : current) {
+                    if (watcher->removed) {
+                        continue; // removed by an earlier callback of this batch
+                    }
+                    matched.clear();
+                    for (const WatchEvent& event : batch) {
+                        if (matches(event.key, watcher->key, watcher->prefix)) {
+                            matched.push_back(event);
+                        }
+                    }
+                    if (!matched.empty() || missed) {
+                        watcher->callback(matched, missed);
+                    }
+                }
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    explicit ChangeFeed(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {
+        dispatcher = std::thread(&ChangeFeed::runDispatcher, this);
+    }
+
+    ~ChangeFeed() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        dispatcher.join();
+    }
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    void publish(const std::string& key, ChangeOp op) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (events.size() == capacity) {
+                events.pop_front();
+            }
+            events.push_back(WatchEvent{next_seq++, key, op});
+            if (watchers.empty() || !idle) {
+                return;
+            }
+        }
+        wake.notify_one();
+    }
+
+    /// Calls callback on the dispatcher thread with the changes of key, or of every key starting
+    /// with it if prefix is set, made from now on
+    /// @returns the id to pass to unwatch()
+    uint64_t watch(const std::string& key, Callback callback, bool prefix = false) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (watchers.empty()) {
+            dispatched = next_seq - 1; // nobody was told about earlier changes, nobody needs them
+        }
+        watchers.push_back(std::make_shared<Watcher>(Watcher{next_watcher, key, prefix, std::move(callback)}));
+        return next_watcher++;
+    }
+
+    /// Removes a watcher. Outside of callbacks it also waits for a running callback to finish, so
+    /// the callback isn't called once this returns. From a callback, the removed watcher is skipped
+    /// for the rest of the batch.
+    /// @returns false if there is no such watcher
+    bool unwatch(uint64_t id) {
+        std::shared_ptr<Watcher> removed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find_if(watchers.begin(), watchers.end(),
+                                   [id](const auto& watcher) { return watcher->id == id; });
+            if (it == watchers.end()) {
+                return false;
+            }
+            removed = *it;
+            watchers.erase(it);
+        }
+        if (std::this_thread::get_id() == dispatcher.get_id()) {
+            removed->removed = true; // the dispatcher holds dispatch_mutex while callbacks run
+        } else {
+            std::lock_guard<std::mutex> dispatch_lock(dispatch_mutex);
+            removed->removed = true;
+        }
+        return true;
+    }
+
+    /// Cursor of the latest change, read_changes(cursor(), ...) returns later changes only
+    uint64_t cursor() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return next_seq - 1;
+    }
+
+    /// Changes after `after`, up to limit of them scanned, those of keys starting with prefix kept
+    ChangePage read(uint64_t after, size_t limit, const std::string& prefix = "") const {
+        ChangePage page;
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t first = firstSeqLocked();
+        page.missed = after + 1 < first;
+        page.next = std::max(after, first - 1);
+        for (size_t i = page.next + 1 - first; i < events.size() && limit > 0; i++, limit--) {
+            const WatchEvent& event = events[i];
+            page.next = event.seq;
+            if (matches(event.key, prefix, true)) {
+                page.events.push_back(event);
+            }
+        }
+        return page;
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <sqlite3.h>
+#include "bulk_loader.hpp"
+#include "value_log.hpp"
+
+/// Parallel export of a database file that no one else writes to, typically a copy made with
+/// SQLiteDB::backup_to, in the text format read by kv_bulk_load (see BulkLoader::parseLine)
+namespace backup {
+
+struct ExportResult {
+    bool ok = false;
+    uint64_t rows = 0;
+    uint64_t bytes = 0; // bytes written to the export file
+    double seconds = 0;
+};
+
+/// Exports the unexpired rows of the database at db_path to out_path
+/// Separated values are read from the value log copied next to it (db_path + ".vlog.N").
+/// The rowid range is cut into chunks that `threads` read-only connections export to part files in
+/// parallel; the parts are then joined in rowid order and renamed into place.
+inline ExportResult exportDatabase(const std::string& db_path, const std::string& out_path, size_t threads) {
+    auto started = std::chrono::steady_clock::now();
+    ExportResult result;
+    threads = std::max<size_t>(1, threads);
+
+    sqlite3* db;
+    if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return result;
+    }
+    int64_t min_rowid = 0, max_rowid = -1;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT min(rowid), max(rowid) FROM cache_data;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            min_rowid = sqlite3_column_int64(stmt, 0);
+            max_rowid = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return result;
+    }
+    sqlite3_close(db);
+
+    // a few chunks per thread so one slow range doesn't hold up the others
+    size_t chunks = max_rowid >= min_rowid
+                        ? std::min<uint64_t>(threads * 4, static_cast<uint64_t>(max_rowid - min_rowid) / 1024 + 1)
+                        : 0;
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<std::string> part_paths(chunks);
+    std::vector<uint64_t> part_rows(chunks, 0);
+    std::vector<char> part_ok(chunks, 0);
+    std::atomic<size_t> next_chunk{0};
+    ValueLog value_log(db_path + ".vlog.", 1);
+
+    auto worker = [&]() {
+        sqlite3* reader;
+        if (sqlite3_open_v2(db_path.c_str(), &reader, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            sqlite3_close(reader);
+            return;
+        }
+        sqlite3_stmt* select;
+        const char* sql = "SELECT d.key, d.value, d.vlog_file, d.vlog_offset, d.vlog_length "
+                          "FROM cache_data d LEFT JOIN cache_expiry e ON e.key = d.key "
+                          "WHERE d.rowid BETWEEN ?1 AND ?2 AND (e.expires_at IS NULL OR e.expires_at > ?3);";
+        if (sqlite3_prepare_v2(reader, sql, -1, &select, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(reader) << std::endl;
+            sqlite3_close(reader);
+            return;
+        }
+        std::string line;
+        std::string value;
+        for (size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+            uint64_t span = static_cast<uint64_t>(max_rowid - min_rowid) + 1;
+            int64_t first = min_rowid + static_cast<int64_t>(span * chunk / chunks);
+            int64_t last = min_rowid + static_cast<int64_t>(span * (chunk + 1) / chunks) - 1;
+            part_paths[chunk] = out_path + ".part" + std::to_string(chunk);
+            FILE* part = std::fopen(part_paths[chunk].c_str(), "wb");
+            if (!part) {
+                continue;
+            }
+            std::setvbuf(part, nullptr, _IOFBF, 1 << 20);
+            sqlite3_bind_int64(select, 1, first);
+            sqlite3_bind_int64(select, 2, last);
+            sqlite3_bind_int64(select, 3, now);
+            bool ok = true;
+            while (ok && sqlite3_step(select) == SQLITE_ROW) {
+                line.clear();
+                if (sqlite3_column_type(select, 2) != SQLITE_NULL) {
+                    ValueLog::Pointer pointer{static_cast<uint32_t>(sqlite3_column_int64(select, 2)),
+                                              static_cast<uint64_t>(sqlite3_column_int64(select, 3)),
+                                              static_cast<uint32_t>(sqlite3_column_int64(select, 4))};
+                    ok = value_log.read(pointer, value);
+                } else {
+                    value.assign(reinterpret_cast<const char*>(sqlite3_column_text(select, 1)), sqlite3_column_bytes(select, 1));
+                }
+                BulkLoader::formatLine(
+                    std::string(reinterpret_cast<const char*>(sqlite3_column_text(select, 0)), sqlite3_column_bytes(select, 0)),
+                    value, line);
+                ok = ok && std::fwrite(line.data(), 1, line.size(), part) == line.size();
+                part_rows[chunk]++;
+            }
+            sqlite3_reset(select);
+            part_ok[chunk] = std::fclose(part) == 0 && ok;
+        }
+        sqlite3_finalize(select);
+        sqlite3_close(reader);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, chunks); i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    std::string temp_path = out_path + ".tmp";
+    FILE* out = std::fopen(temp_path.c_str(), "wb");
+    bool ok = out != nullptr && std::find(part_ok.begin(), part_ok.end(), 0) == part_ok.end();
+    std::vector<char> buffer(1 << 20);
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+        FILE* part = ok ? std::fopen(part_paths[chunk].c_str(), "rb") : nullptr;
+        if (part) {
+            size_t read;
+            while (ok && (read = std::fread(buffer.data(), 1, buffer.size(), part)) > 0) {
+                ok = std::fwrite(buffer.data(), 1, read, out) == read;
+                result.bytes += read;
+            }
+            std::fclose(part);
+        } else {
+            ok = false;
+        }
+        std::remove(part_paths[chunk].c_str());
+        result.rows += part_rows[chunk];
+    }
+    if (out) {
+        ok = std::fclose(out) == 0 && ok;
+    }
+    if (!ok || std::rename(temp_path.c_str(), out_path.c_str()) != 0) {
+        std::cerr << "Cannot write " << out_path << std::endl;
+        std::remove(temp_path.c_str());
+        return result;
+    }
+    result.ok = true;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return result;
+}
+
+} // namespace backup
@@ -1,139 +1,2707 @@
+#pragma once
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
+#include <optional>
+#include <list>
 #include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <climits>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <shared_mutex>
 #include <thread>
+#include <tuple>
+#include <memory_resource>
+#include <string_view>
 #include "persistent_db.hpp"
+#include "partitioned_db.hpp"
+#include "shared_cache_segment.hpp"
+#include "cache_snapshot.hpp"
+#include "db_backup.hpp"
+#include "cache_memory.hpp"
+#include "large_object_segment.hpp"
+#include "flash_cache.hpp"
+#include "victim_cache.hpp"
+#include "change_feed.hpp"
+
+/// Which entry FIFOCache evicts when it needs space (private mode)
+enum class EvictionPolicy {
+    Fifo,     // the oldest inserted entry
+    Adaptive, // ARC-style: recency and frequency clocks, sized by hits on recently evicted keys
+    GreedyDual, // GDSF: the entry with the least DB read time saved per byte, weighted by its reads
+};
+
+/// Construction options for FIFOCache
+struct CacheConfig {
+    std::string db_path = "cache.db";
+    size_t max_size = 50; // bytes
+    std::string shared_segment;      // POSIX shared memory name, processes passing the same name share one cache
+    size_t shared_segment_bytes = 0; // entry memory when creating the segment, 0 picks 2 * max_size + 1MB
+    std::string snapshot_path;       // if set, loaded on construction and saved on destruction (private mode)
+    bool track_reads = true;         // keep read_count/last_read of each row up to date in the database
+    uint32_t read_sample_rate = 16;  // with track_reads: 1 in N reads is counted, with weight N
+    size_t warmup_rows = 0;          // if non-zero, start_warmup(warmup_rows, warmup_order) on construction
+    WarmupOrder warmup_order = WarmupOrder::RecentlyWritten;
+    bool huge_pages = false;         // keep entries and index in huge page backed memory (private mode)
+    int numa_node = -1;              // with huge_pages: node that memory is bound to, -1 interleaves all nodes
+    size_t l0_entries = 0;           // per-thread near cache slots (rounded up to a power of two), 0 disables it
+    size_t l0_max_entry_bytes = 1024; // larger entries are not copied into the near cache
+    size_t evict_low_free_bytes = 0;  // if non-zero, a background thread starts evicting once less is free
+    size_t evict_high_free_bytes = 0; // ... and evicts until this much is free (at least the low watermark)
+    bool bound_memory = false;       // max_size bounds the memory entries occupy, not only key and value bytes (private mode)
+    EvictionPolicy policy = EvictionPolicy::Fifo; // private mode, a shared segment is always FIFO
+    size_t large_segment_bytes = 0;  // if non-zero, large values are cached in a segment of this budget (private mode)
+    size_t large_value_bytes = 64 * 1024; // ... values of at least this size, or too big for max_size, go there
+    size_t value_log_threshold = 0;  // if non-zero, values of at least this size are stored in a value log, not the table (private mode without invalidate_interval_ms)
+    size_t value_log_segment_bytes = 64 << 20; // ... size at which a log segment is sealed
+    std::string flash_path;          // if set, evicted entries go to a cache file here before they are dropped (private mode)
+    size_t flash_bytes = 256 << 20;  // ... its size
+    bool flash_direct_io = false;    // ... read and written with O_DIRECT, bypassing the page cache
+    size_t victim_bytes = 0;         // if non-zero, evicted entries are kept compressed in this much memory first (private mode)
+    size_t change_log_rows = 0;      // if non-zero, writes are logged in the database's change_log for followers, keeping about this many
+    std::string follow_db_path;      // if set, the cache follows the change_log of that database into db_path (private mode)
+    unsigned follow_interval_ms = 20; // ... how often it polls the log
+    unsigned invalidate_interval_ms = 0; // if non-zero, keys other processes change in db_path are dropped from this cache, checked this often (private mode)
+    size_t watch_buffer_events = 0; // if non-zero, changes made through this cache are kept for watch() and read_changes(), this many at most
+    size_t db_partitions = 1;       // database files keys are spread over by hash, each with its own writer thread (see PartitionedDB)
+};
+
+/// Progress of a cache warm-up, see FIFOCache::start_warmup
+struct WarmupProgress {
+    size_t rows_loaded = 0;
+    size_t bytes_loaded = 0;
+    size_t target_rows = 0;
+    bool done = false;
+};
+
+/// Snapshot of the counters kept by FIFOCache
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t current_size = 0; // key and value bytes, or occupied memory with CacheConfig::bound_memory
+    size_t max_size = 0;
+    size_t huge_page_bytes = 0; // mapped for entries with CacheConfig::huge_pages
+    uint64_t l0_hits = 0;       // part of hits, served by a thread's near cache (CacheConfig::l0_entries)
+    uint64_t background_evictions = 0; // part of evictions, made by the evictor thread
+    uint64_t inline_evictions = 0;     // part of evictions, made by inserts that found the cache full
+    uint64_t max_inline_evict_loop = 0; // most entries a single insert had to evict
+    size_t recency_bytes = 0;   // EvictionPolicy::Adaptive: entries read at most once since they were cached
+    size_t frequency_bytes = 0; // ... entries read again while cached
+    size_t recency_target = 0;  // ... bytes the recency segment may keep before it gives way
+    uint64_t ghost_hits = 0;    // ... misses on keys the policy had evicted recently
+    uint64_t hit_bytes = 0;     // value bytes served from memory
+    uint64_t miss_bytes = 0;    // value bytes read from the database on misses
+    uint64_t fetch_micros = 0;  // time spent reading misses from the database
+    uint64_t saved_fetch_micros = 0; // database read time hits saved, each hit counted at its entry's fetch time
+    uint64_t value_log_bytes = 0;         // value log segment files (CacheConfig::value_log_threshold)
+    uint64_t value_log_garbage_bytes = 0; // ... records of overwritten or removed values, not collected yet
+    size_t large_entries = 0;   // values in the large-object segment (CacheConfig::large_segment_bytes)
+    size_t large_bytes = 0;     // ... their bytes, not part of current_size
+    uint64_t large_evictions = 0;
+    size_t flash_entries = 0;       // evicted entries held by the flash cache (CacheConfig::flash_path)
+    uint64_t flash_hits = 0;        // ... part of misses, served from it instead of the database
+    uint64_t flash_bytes_written = 0;
+    uint64_t flash_dropped = 0;     // ... evicted entries it turned away while its writer was busy
+    size_t victim_entries = 0;      // evicted entries kept compressed (CacheConfig::victim_bytes)
+    size_t victim_bytes = 0;        // ... their compressed size, keys included
+    size_t victim_raw_bytes = 0;    // ... their size before compression
+    uint64_t victim_hits = 0;       // ... part of misses, served from it instead of flash or the database
+    int64_t replication_applied_seq = 0; // CacheConfig::follow_db_path: last change_log seq applied here
+    int64_t replication_source_seq = 0;  // ... last seq the source had logged when it was polled
+    int64_t replication_lag_ms = 0;      // ... age of the oldest change not applied yet, 0 once caught up
+    uint64_t invalidated_keys = 0;       // CacheConfig::invalidate_interval_ms: keys dropped for changes of other processes
+    uint64_t invalidation_resets = 0;    // ... times the whole cache was dropped, having fallen behind the trimmed change_log
+};
+
+/// One key lock stripe: a process-local mutex, or a process-shared one when the cache lives in a
+/// SharedCacheSegment, so writers in different processes also serialize per key
+class StripeLock {
+private:
+    std::mutex local;
+    pthread_mutex_t* shared = nullptr;
+
+public:
+    void attach(pthread_mutex_t* mutex) { shared = mutex; }
+
+    void lock() {
+        if (shared) SharedCacheSegment::lockRobust(shared);
+        else local.lock();
+    }
+
+    void unlock() {
+        if (shared) pthread_mutex_unlock(shared);
+        else local.unlock();
+    }
+};
 
 class FIFOCache {
 private:
-    size_t current_size = 0;
-    const size_t MAX_SIZE = 50; //bytes
+    size_t current_size = 0; // key and value bytes of the cached entries
+    const size_t MAX_SIZE; //bytes
     int capacity;
 
-    std::unordered_map<std::string, std::string> cache; // cache holds the keys and values
-    std::queue<std::string> queue; // fifo queue holds the keys in the cache
-    SQLiteDB db; // persistent storage
-    
-    mutable std::shared_mutex cache_mutex;
+    // entry memory, all allocations from it happen under the cache_mutex write lock
+    std::unique_ptr<memory::HugePageResource> huge_memory;
+    std::unique_ptr<std::pmr::unsynchronized_pool_resource> entry_pool;
+    std::unique_ptr<memory::AccountingResource> accounting; // with bound_memory, MAX_SIZE bounds its bytes()
+
+    using CacheString = std::pmr::string;
+    struct CacheKeyHash {
+        // not noexcept on purpose: libstdc++ then keeps each node's hash, as it does for std::string keys
+        size_t operator()(const CacheString& key) const { return std::hash<std::string_view>{}(key); }
+    };
+    enum class Segment : uint8_t { Recent, Frequent };
+
+    /// Cached value, with the bookkeeping of the adaptive policy
+    struct CacheEntry {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        CacheString value;
+        mutable std::atomic<bool> referenced{false}; // read since the clock hand last passed, set under the read lock
+        Segment segment = Segment::Recent;
+        mutable std::atomic<uint32_t> reads{1}; // GreedyDual: reads while cached, counted under the read lock
+        float fetch_us = 0;                     // how long reading the value from the DB took
+        double priority = 0;                    // GreedyDual: priority of its current heap slot
+        uint64_t slot = 0;                      // FIFO/Adaptive: id of its current clock slot
+
+        explicit CacheEntry(const allocator_type& alloc = {}) : value(alloc) {}
+        CacheEntry(std::string_view value, const allocator_type& alloc = {}) : value(value.data(), value.size(), alloc) {}
+        CacheEntry(CacheString&& value, const allocator_type& alloc = {}) : value(std::move(value), alloc) {}
+        CacheEntry(const CacheEntry& other, const allocator_type& alloc = {})
+            : value(other.value, alloc), referenced(other.referenced.load()), segment(other.segment),
+              reads(other.reads.load()), fetch_us(other.fetch_us), priority(other.priority), slot(other.slot) {}
+        CacheEntry(CacheEntry&& other, const allocator_type& alloc = {})
+            : value(std::move(other.value), alloc), referenced(other.referenced.load()), segment(other.segment),
+              reads(other.reads.load()), fetch_us(other.fetch_us), priority(other.priority), slot(other.slot) {}
+    };
+    using CacheMap = std::pmr::unordered_map<CacheString, CacheEntry, CacheKeyHash>;
+
+    /// A key's place on a clock. Dropping an entry leaves its slot behind; the slot is stale once its
+    /// id is not the entry's, also after the key was cached again, and is skipped
+    struct ClockSlot {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        CacheString key;
+        uint64_t id;
+
+        ClockSlot(std::string_view key, uint64_t id, const allocator_type& alloc = {})
+            : key(key.data(), key.size(), alloc), id(id) {}
+        ClockSlot(CacheString&& key, uint64_t id, const allocator_type& alloc = {}) : key(std::move(key), alloc), id(id) {}
+        ClockSlot(const ClockSlot& other, const allocator_type& alloc = {}) : key(other.key, alloc), id(other.id) {}
+        ClockSlot(ClockSlot&& other, const allocator_type& alloc = {}) : key(std::move(other.key), alloc), id(other.id) {}
+        ClockSlot& operator=(const ClockSlot&) = default;
+        ClockSlot& operator=(ClockSlot&&) = default;
+    };
+    using KeyQueue = std::queue<ClockSlot, std::pmr::deque<ClockSlot>>;
+    CacheMap cache; // cache holds the keys and values
+    KeyQueue queue; // fifo queue holds the keys in the cache, the recency clock with EvictionPolicy::Adaptive
+    uint64_t next_slot = 0; // last clock slot id handed out, guarded by cache_mutex
+
+    // EvictionPolicy::Adaptive, a byte sized CAR (clock with adaptive replacement), all guarded by cache_mutex:
+    // new entries join the recency clock, entries read again are moved to the frequency clock when the hand
+    // passes them, and evicted keys are remembered in ghost lists. A miss on a ghost grows the segment that
+    // would have kept the key, by moving recent_target.
+    const EvictionPolicy policy;
+    KeyQueue frequent; // keys of the frequency clock
+    struct Ghost {
+        bool frequent = false;
+        size_t charge = 0;
+        std::pmr::list<const CacheString*>::iterator slot;
+    };
+    std::pmr::unordered_map<CacheString, Ghost, CacheKeyHash> ghosts;
+    std::pmr::list<const CacheString*> recent_ghosts, frequent_ghosts; // keys in `ghosts`, oldest first
+    size_t recent_bytes = 0, frequent_bytes = 0; // charges of the cached entries per segment
+    size_t recent_ghost_bytes = 0, frequent_ghost_bytes = 0;
+    size_t recent_target = 0;
+    uint64_t ghost_hits = 0;
+
+    // EvictionPolicy::GreedyDual (GDSF), guarded by cache_mutex: an entry is priced at
+    // inflation + reads * fetch_us / charge and the cheapest is evicted, its price becoming the new
+    // inflation so long unread entries age out. Reads only bump the entry's counter under the read
+    // lock; a heap slot priced at fewer reads is repriced when it comes to the top. Slots whose price
+    // no longer matches their entry are stale and skipped.
+    struct CostSlot {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        double priority;
+        uint32_t reads;
+        CacheString key;
+
+        CostSlot(double priority, uint32_t reads, std::string_view key, const allocator_type& alloc = {})
+            : priority(priority), reads(reads), key(key.data(), key.size(), alloc) {}
+        CostSlot(const CostSlot& other, const allocator_type& alloc = {})
+            : priority(other.priority), reads(other.reads), key(other.key, alloc) {}
+        CostSlot(CostSlot&& other, const allocator_type& alloc = {})
+            : priority(other.priority), reads(other.reads), key(std::move(other.key), alloc) {}
+        CostSlot& operator=(const CostSlot&) = default;
+        CostSlot& operator=(CostSlot&&) = default;
+
+        bool operator>(const CostSlot& other) const { return priority > other.priority; }
+    };
+    struct CostHeap : std::priority_queue<CostSlot, std::pmr::vector<CostSlot>, std::greater<CostSlot>> {
+        using priority_queue::priority_queue;
+
+        const std::pmr::vector<CostSlot>& slots() const { return c; }
+
+        void clear() { c.clear(); }
+
+        template <typename Stale>
+        void removeIf(Stale stale) {
+            c.erase(std::remove_if(c.begin(), c.end(), stale), c.end());
+            std::make_heap(c.begin(), c.end(), comp);
+        }
+    };
+    CostHeap cost_heap;
+    double inflation = 0;
+    std::atomic<double> average_fetch_us{0}; // fetch time assumed for values that were written, not read
+    PartitionedDB db; // persistent storage
+    std::string db_path;
+    std::string snapshot_path;
+    std::unique_ptr<SharedCacheSegment> shared; // replaces cache and queue in shared mode
+    std::unique_ptr<LargeObjectSegment> large;  // values isLarge() keeps out of cache, private mode
+    const size_t large_value_bytes;
+    std::unique_ptr<VictimCache> victims;       // compressed evicted entries, before the flash cache, private mode
+    std::unique_ptr<FlashCache> flash;          // second level for evicted entries, private mode
+    std::unique_ptr<ChangeFeed> feed;           // recent changes for watchers, CacheConfig::watch_buffer_events
+    
+    mutable std::shared_mutex cache_mutex;
+    
+    // serializes writers of the same key so DB and cache see updates in the same order
+    static constexpr size_t KEY_LOCK_STRIPES = 64;
+    std::array<StripeLock, KEY_LOCK_STRIPES> key_locks;
+    
+    std::unordered_map<std::string, int64_t> expiry; // key -> deadline (unix time in ms)
+    std::mutex expiry_mutex;
+    std::atomic<size_t> expiring_keys{0}; // lets get() skip the expiry check when no key has a TTL
+
+    // compare-and-swap versions, handed out on first request and dropped by every write of the key
+    static constexpr size_t MAX_VERSIONED_KEYS = 1 << 20; // all are dropped beyond this, pending CAS fail
+    std::unordered_map<std::string, uint64_t> versions; // key -> version
+    std::mutex version_mutex;
+    uint64_t next_version = 1; // guarded by version_mutex, 0 means "no version"
+    std::atomic<size_t> versioned_keys{0}; // lets writes skip version_mutex when no key has a version
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> hit_bytes{0};
+    std::atomic<uint64_t> miss_bytes{0};
+    std::atomic<uint64_t> fetch_ns{0};
+    std::atomic<uint64_t> saved_fetch_ns{0};
+    uint64_t evictions = 0; // guarded by cache_mutex
+    uint64_t background_evictions = 0; // guarded by cache_mutex
+    uint64_t max_inline_evict_loop = 0; // guarded by cache_mutex
+
+    // background evictor, keeps between evict_low and evict_high bytes free so inserts rarely evict
+    static constexpr size_t EVICTOR_BATCH = 64; // entries evicted per cache_mutex hold
+    const size_t evict_low;
+    const size_t evict_high;
+    std::thread evictor;
+    std::mutex evictor_mutex;
+    std::condition_variable evictor_wake;
+    std::atomic<bool> evictor_requested{false};
+    bool evictor_stop = false; // guarded by evictor_mutex
+
+    // sampled reads are counted in memory, a background thread adds them to the rows'
+    // read_count/last_read every READ_FLUSH_INTERVAL or once READ_FLUSH_THRESHOLD keys are pending
+    static constexpr size_t READ_STRIPES = 16;
+    static constexpr size_t READ_FLUSH_THRESHOLD = 65536; // distinct pending keys
+    static constexpr std::chrono::seconds READ_FLUSH_INTERVAL{1};
+    struct ReadStripe {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::pair<uint64_t, int64_t>> pending; // key -> (reads, last read)
+    };
+    const bool track_reads;
+    const uint32_t read_sample_rate;
+    std::array<ReadStripe, READ_STRIPES> read_stripes;
+    std::atomic<size_t> pending_reads{0};
+    std::mutex flush_mutex;
+    std::thread read_flusher;
+    std::mutex read_flusher_mutex;
+    std::condition_variable read_flusher_wake;
+    bool read_flusher_stop = false; // guarded by read_flusher_mutex
+
+    static constexpr size_t WARMUP_BATCH_ROWS = 1024;
+    std::thread warmup_thread;
+    std::atomic<bool> warmup_cancel{false};
+    std::atomic<bool> warmup_done{false};
+    std::atomic<size_t> warmup_rows_loaded{0};
+    std::atomic<size_t> warmup_bytes_loaded{0};
+    std::atomic<size_t> warmup_target{0};
+
+    // follower of another database's change_log (CacheConfig::follow_db_path). Changes only name
+    // keys, each batch is applied by reading the keys' current state from the source, so applying
+    // a change twice is harmless and the position is saved after the batch
+    static constexpr size_t REPLICATION_BATCH = 1000;
+    std::unique_ptr<SQLiteDB> source;
+    std::string source_path;
+    std::chrono::milliseconds follow_interval{20};
+    std::mutex replication_mutex; // one poll at a time
+    std::thread follower;
+    std::mutex follower_mutex;
+    std::condition_variable follower_wake;
+    bool follower_stop = false; // guarded by follower_mutex
+    std::atomic<int64_t> applied_seq{-1}; // -1 until the first full copy
+    std::atomic<int64_t> source_seq{0};
+    std::atomic<int64_t> lag_ms{0};
+
+    // cross-process invalidation (CacheConfig::invalidate_interval_ms). Every partition's
+    // data_version is polled; once another connection committed, the keys its change_log names
+    // since the last poll are dropped, under their key locks, so a miss can't cache a value read
+    // before the change. Own writes are logged too, and dropped along with the others.
+    static constexpr size_t INVALIDATION_LOG_ROWS = 100000; // change_log_rows if not set
+    std::mutex invalidation_mutex; // one poll at a time, guards the two vectors
+    std::vector<int64_t> invalidated_seq;     // per partition, last change_log seq handled
+    std::vector<int64_t> seen_data_version;   // per partition
+    std::chrono::milliseconds invalidate_interval{0};
+    std::thread invalidator;
+    std::mutex invalidator_mutex;
+    std::condition_variable invalidator_wake;
+    bool invalidator_stop = false; // guarded by invalidator_mutex
+    std::atomic<uint64_t> invalidated_keys{0};
+    std::atomic<uint64_t> invalidation_resets{0};
+
+    // one version per key lock stripe, bumped under the key lock once a write to the stripe is
+    // visible in the cache; cached copies taken at an older version are stale (L0 slots, warmBatch)
+    struct alignas(64) StripeEpoch {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<StripeEpoch, KEY_LOCK_STRIPES> epochs;
+
+    // per-thread near cache: a direct-mapped table of recently read entries for each thread that
+    // reads from this cache, so repeated hot reads touch only thread local memory and the epochs
+    struct L0Slot {
+        std::string key;
+        std::string value;
+        uint64_t epoch = 0;
+        int64_t deadline = 0; // 0 if the key had no TTL when it was copied
+        float fetch_us = 0;
+        bool valid = false;
+    };
+    struct L0Table {
+        std::vector<L0Slot> slots;
+        // only written by the owning thread
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> hit_bytes{0};
+        std::atomic<uint64_t> saved_fetch_ns{0};
+        explicit L0Table(size_t size) : slots(size) {}
+    };
+    static inline std::atomic<uint64_t> next_instance_id{1};
+    const uint64_t instance_id = next_instance_id++;
+    const bool l0_enabled; // private mode only, see useL0
+    const size_t l0_mask;  // slots - 1
+    const size_t l0_max_entry_bytes;
+    std::vector<std::shared_ptr<L0Table>> l0_tables; // every thread's table, for stats()
+    mutable std::mutex l0_mutex;
+
+    // the stripe of a key must be the same in every process sharing a segment, so no std::hash
+    static size_t stripeOf(const std::string& key) {
+        return SharedCacheSegment::hashKey(key) % KEY_LOCK_STRIPES;
+    }
+
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        size_t power = 1;
+        while (power < n) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    /// Writes by other processes don't bump this process's epochs, so shared mode has no near cache
+    bool useL0() const {
+        return l0_enabled && !shared;
+    }
+
+    uint64_t epochOf(size_t stripe) const {
+        return epochs[stripe].value.load(std::memory_order_acquire);
+    }
+
+    /// Invalidates copies of key's stripe, caller must hold the key lock and have updated the cache
+    void bumpEpoch(const std::string& key) {
+        epochs[stripeOf(key)].value.fetch_add(1, std::memory_order_release);
+        if (versioned_keys.load(std::memory_order_relaxed) > 0) { // set under the key lock we hold
+            std::lock_guard<std::mutex> lock(version_mutex);
+            versioned_keys -= versions.erase(key);
+        }
+    }
+
+    /// The key's compare-and-swap version, a new one if it has none since its last write
+    /// Caller must hold the key lock
+    uint64_t versionLocked(const std::string& key) {
+        std::lock_guard<std::mutex> lock(version_mutex);
+        auto found = versions.find(key);
+        if (found != versions.end()) {
+            return found->second;
+        }
+        if (versions.size() >= MAX_VERSIONED_KEYS) {
+            versions.clear();
+        }
+        versions.emplace(key, next_version);
+        versioned_keys = versions.size();
+        return next_version++;
+    }
+
+    /// Tells watchers about a change, after it is visible to readers
+    void notifyChange(const std::string& key, ChangeOp op) {
+        if (feed) {
+            feed->publish(key, op);
+        }
+    }
+
+    /// This thread's near cache table, created on first use
+    L0Table& l0Table() {
+        struct ThreadTables {
+            uint64_t last_id = 0;
+            L0Table* last = nullptr;
+            std::unordered_map<uint64_t, std::shared_ptr<L0Table>> tables; // cache instance -> table
+        };
+        thread_local ThreadTables local;
+        if (local.last_id == instance_id) {
+            return *local.last;
+        }
+        auto& table = local.tables[instance_id];
+        if (!table) {
+            // drop the tables of caches that have been destroyed since, they hold the last reference
+            for (auto it = local.tables.begin(); it != local.tables.end();) {
+                it = it->second && it->second.use_count() == 1 ? local.tables.erase(it) : std::next(it);
+            }
+            table = std::make_shared<L0Table>(l0_mask + 1);
+            std::lock_guard<std::mutex> lock(l0_mutex);
+            l0_tables.push_back(table);
+        }
+        local.last_id = instance_id;
+        local.last = table.get();
+        return *table;
+    }
+
+    /// Serves key from this thread's near cache if its copy is still current
+    template <typename F>
+    bool l0Lookup(const std::string& key, uint64_t hash, F&& fn) {
+        L0Table& table = l0Table();
+        L0Slot& slot = table.slots[(hash / KEY_LOCK_STRIPES) & l0_mask];
+        if (!slot.valid || slot.key != key || slot.epoch != epochOf(hash % KEY_LOCK_STRIPES)) {
+            return false;
+        }
+        if (slot.deadline != 0 && slot.deadline <= nowMillis()) {
+            slot.valid = false; // the regular path removes the key
+            return false;
+        }
+        auto add = [](std::atomic<uint64_t>& counter, uint64_t amount) {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        };
+        add(table.hits, 1);
+        add(table.hit_bytes, slot.value.size());
+        add(table.saved_fetch_ns, static_cast<uint64_t>(slot.fetch_us * 1000));
+        fn(slot.value);
+        return true;
+    }
+
+    /// Copies a value read at stripe version `epoch` into this thread's near cache
+    void l0Fill(const std::string& key, uint64_t hash, uint64_t epoch, std::string_view value, float fetch_us) {
+        if (key.size() + value.size() > l0_max_entry_bytes) {
+            return;
+        }
+        int64_t deadline = 0;
+        if (expiring_keys.load(std::memory_order_relaxed) != 0) {
+            std::lock_guard<std::mutex> lock(expiry_mutex);
+            auto it = expiry.find(key);
+            deadline = it != expiry.end() ? it->second : 0;
+        }
+        L0Slot& slot = l0Table().slots[(hash / KEY_LOCK_STRIPES) & l0_mask];
+        slot.key.assign(key);
+        slot.value.assign(value.data(), value.size());
+        slot.epoch = epoch;
+        slot.deadline = deadline;
+        slot.fetch_us = fetch_us;
+        slot.valid = true;
+    }
+
+    /// Lookup key for `cache`, reused by each thread so finding a key doesn't allocate
+    static const CacheString& probe(const std::string& key) {
+        thread_local CacheString buffer(std::pmr::new_delete_resource());
+        buffer.assign(key.data(), key.size());
+        return buffer;
+    }
+
+    std::pmr::memory_resource* entryMemory() const {
+        if (accounting) {
+            return accounting.get();
+        }
+        return entry_pool ? static_cast<std::pmr::memory_resource*>(entry_pool.get()) : std::pmr::new_delete_resource();
+    }
+
+    /// Bytes counted against MAX_SIZE, caller must hold cache_mutex
+    size_t usedLocked() const {
+        return accounting ? accounting->bytes() : current_size;
+    }
+
+    /// Bytes an entry is counted with: key and value, or with bound_memory the memory it is expected
+    /// to occupy. That is its hash node (next pointer, key and value, cached hash), a bucket, a queue
+    /// slot, and heap blocks for the key, its queue copy and the value once they outgrow the small
+    /// string buffer. Container growth such as a rehash is only seen once it happens.
+    size_t chargeOf(size_t key_size, size_t value_size) const {
+        if (!accounting) {
+            return key_size + value_size;
+        }
+        static const size_t small_string = std::string().capacity();
+        auto heap = [this](size_t size) { return size > small_string ? accounting->footprint(size + 1) : 0; };
+        size_t node = sizeof(void*) + sizeof(CacheMap::value_type) + sizeof(size_t);
+        return accounting->footprint(node) + sizeof(void*) + sizeof(ClockSlot) + 2 * heap(key_size) +
+               heap(value_size);
+    }
+
+    /// True if a pair belongs in the large-object segment rather than the small-entry cache
+    bool isLarge(size_t key_size, size_t value_size) const {
+        return large && (key_size + value_size >= large_value_bytes || chargeOf(key_size, value_size) > MAX_SIZE);
+    }
+
+    /// With bound_memory, evicts until the cache is within MAX_SIZE, keeping at least one entry
+    /// Caller must hold the cache_mutex write lock
+    size_t trimLocked() {
+        size_t evicted = 0;
+        while (accounting && accounting->bytes() > MAX_SIZE && cache.size() > 1 && canEvictLocked()) {
+            evicted += evictOneLocked();
+        }
+        return evicted;
+    }
+
+    bool adaptive() const {
+        return policy == EvictionPolicy::Adaptive;
+    }
+
+    size_t& segmentBytes(Segment segment) {
+        return segment == Segment::Recent ? recent_bytes : frequent_bytes;
+    }
+
+    bool greedyDual() const {
+        return policy == EvictionPolicy::GreedyDual;
+    }
+
+    /// Notes a read of a cached entry for the eviction policy, safe under the cache read lock
+    void noteRead(const CacheEntry& entry) const {
+        if (adaptive() && !entry.referenced.load(std::memory_order_relaxed)) {
+            entry.referenced.store(true, std::memory_order_relaxed);
+        } else if (greedyDual()) {
+            entry.reads.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// Counts a hit that returned `bytes` and saved a database read of fetch_us
+    void countHit(size_t bytes, float fetch_us) {
+        hits.fetch_add(1, std::memory_order_relaxed);
+        hit_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        saved_fetch_ns.fetch_add(static_cast<uint64_t>(fetch_us * 1000), std::memory_order_relaxed);
+    }
+
+    /// Counts `keys` database reads that started at `started` and returned `bytes`
+    /// @returns the time each read took in microseconds, also folded into average_fetch_us
+    float countFetch(std::chrono::steady_clock::time_point started, size_t keys, size_t bytes) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+        fetch_ns.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+        miss_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        float fetch_us = static_cast<float>(ns) / 1000 / std::max<size_t>(1, keys);
+        double average = average_fetch_us.load(std::memory_order_relaxed); // racing updates may drop a sample
+        average_fetch_us.store(average == 0 ? fetch_us : average * 0.98 + fetch_us * 0.02, std::memory_order_relaxed);
+        return fetch_us;
+    }
+
+    /// get_from_db, timed for the statistics and the cost of the cached entry
+    std::pair<bool, std::string> fetchFromDb(const std::string& key, float& fetch_us) {
+        auto started = std::chrono::steady_clock::now();
+        auto result = db.get_from_db(key);
+        fetch_us = countFetch(started, 1, result.second.size());
+        return result;
+    }
+
+    /// Gives a GreedyDual entry its priority and a heap slot, caller must hold the cache_mutex write lock
+    /// Entries cost at least a microsecond, so values that were never read from the DB still rank by
+    /// reads and size
+    void priceLocked(CacheMap::iterator it) {
+        CacheEntry& entry = it->second;
+        uint32_t reads = entry.reads.load(std::memory_order_relaxed);
+        double cost = std::max(1.0f, entry.fetch_us);
+        double priority = inflation + reads * cost / chargeOf(it->first.size(), entry.value.size());
+        entry.priority = priority;
+        cost_heap.emplace(priority, reads, it->first);
+        if (cost_heap.size() > 2 * cache.size() + 1024) {
+            cost_heap.removeIf([this](const CostSlot& slot) { return staleLocked(slot); });
+        }
+    }
+
+    bool staleLocked(const CostSlot& slot) const {
+        auto it = cache.find(slot.key);
+        return it == cache.end() || it->second.priority != slot.priority;
+    }
+
+    /// Takes the cheapest slot off the GreedyDual heap, caller must hold the cache_mutex write lock
+    /// @returns true if an entry was evicted, false for a stale slot or one repriced for its reads
+    bool evictCheapestLocked() {
+        const CostSlot& cheapest = cost_heap.top();
+        auto it = cache.find(cheapest.key);
+        if (it == cache.end() || it->second.priority != cheapest.priority) {
+            cost_heap.pop();
+            return false;
+        }
+        if (it->second.reads.load(std::memory_order_relaxed) != cheapest.reads) {
+            cost_heap.pop();
+            priceLocked(it);
+            return false;
+        }
+        inflation = cheapest.priority;
+        cost_heap.pop();
+        demoteLocked(it);
+        unlinkLocked(it);
+        evictions++;
+        return true;
+    }
+
+    /// Puts a newly cached entry on its segment's clock, or prices it for GreedyDual. Caller must hold
+    /// the cache_mutex write lock. fetch_us < 0 means the entry wasn't read from the DB, it is then
+    /// assumed to cost the average read. slot_key, if given, is moved into the clock instead of copying the key
+    void linkLocked(CacheMap::iterator it, Segment segment, float fetch_us = -1, CacheString* slot_key = nullptr) {
+        if (!ghosts.empty()) {
+            auto ghost = ghosts.find(it->first);
+            if (ghost != ghosts.end()) {
+                forgetGhostLocked(ghost);
+            }
+        }
+        it->second.segment = segment;
+        it->second.fetch_us = fetch_us < 0 ? static_cast<float>(average_fetch_us.load(std::memory_order_relaxed)) : fetch_us;
+        KeyQueue& clock = segment == Segment::Recent ? queue : frequent;
+        if (greedyDual()) {
+            priceLocked(it);
+        } else {
+            it->second.slot = ++next_slot;
+            if (slot_key) {
+                clock.emplace(std::move(*slot_key), next_slot);
+            } else {
+                clock.emplace(it->first, next_slot);
+            }
+            if (queue.size() + frequent.size() > 2 * cache.size() + 1024) {
+                compactClocksLocked();
+            }
+        }
+        current_size += it->first.size() + it->second.value.size();
+        segmentBytes(segment) += chargeOf(it->first.size(), it->second.value.size());
+        trimGhostsLocked();
+    }
+
+    bool staleLocked(const ClockSlot& slot) const {
+        auto it = cache.find(slot.key);
+        return it == cache.end() || it->second.slot != slot.id;
+    }
+
+    /// Drops the stale slots of both clocks, keeping the order of the others
+    /// Caller must hold the cache_mutex write lock
+    void compactClocksLocked() {
+        for (KeyQueue* clock : {&queue, &frequent}) {
+            for (size_t n = clock->size(); n > 0; n--) {
+                if (!staleLocked(clock->front())) {
+                    clock->push(std::move(clock->front()));
+                }
+                clock->pop();
+            }
+        }
+    }
+
+    static uint64_t flashHash(std::string_view key) {
+        return std::hash<std::string_view>{}(key);
+    }
+
+    /// Copies an entry that is being evicted to the victim cache, or the flash cache without one; victims
+    /// pushed out of the victim cache move on to flash. Caller must hold the cache_mutex write lock
+    void demoteLocked(CacheMap::iterator it) {
+        if (victims) {
+            victims->insert(it->first, it->second.value, [this](std::string_view key, std::string_view value) {
+                if (flash) {
+                    flash->insert(key, flashHash(key), value);
+                }
+            });
+        } else if (flash) {
+            flash->insert(it->first, flashHash(it->first), it->second.value);
+        }
+    }
+
+    /// Drops key's copies in the victim and flash caches. Caller must hold the cache_mutex write lock,
+    /// which orders this against demoteLocked() of an older value
+    void forgetDemotedLocked(const std::string& key) {
+        if (victims) {
+            victims->erase(key);
+        }
+        if (flash) {
+            flash->erase(flashHash(key));
+        }
+    }
+
+    /// Looks an evicted entry up in the victim and flash caches, caller must hold the key lock
+    bool fetchDemoted(const std::string& key, std::string& out) {
+        return (victims && victims->take(key, out)) || (flash && flash->lookup(key, flashHash(key), out));
+    }
+
+    /// Drops a cached entry, its clock slot goes stale. Caller must hold the cache_mutex write lock
+    void unlinkLocked(CacheMap::iterator it) {
+        current_size -= it->first.size() + it->second.value.size();
+        segmentBytes(it->second.segment) -= chargeOf(it->first.size(), it->second.value.size());
+        cache.erase(it);
+    }
+
+    /// Forgets the clocks, ghosts and heap slots, for a cache that was emptied
+    /// Caller must hold the cache_mutex write lock
+    void clearPolicyLocked() {
+        while (!queue.empty()) {
+            queue.pop();
+        }
+        while (!frequent.empty()) {
+            frequent.pop();
+        }
+        cost_heap.clear();
+        ghosts.clear();
+        recent_ghosts.clear();
+        frequent_ghosts.clear();
+        recent_ghost_bytes = 0;
+        frequent_ghost_bytes = 0;
+    }
+
+    /// Looks key up in the ghost lists before it is cached again and adapts recent_target
+    /// A ghost from the recency clock means that clock was too small, one from the frequency clock
+    /// the opposite; the step grows with the ratio of the ghost lists, as in ARC
+    /// @returns the segment the key should join
+    Segment adaptLocked(const std::string& key) {
+        if (!adaptive() || ghosts.empty()) {
+            return Segment::Recent;
+        }
+        auto ghost = ghosts.find(probe(key));
+        if (ghost == ghosts.end()) {
+            return Segment::Recent;
+        }
+        ghost_hits++;
+        size_t charge = ghost->second.charge;
+        if (!ghost->second.frequent) {
+            double ratio = recent_ghost_bytes > 0 ? double(frequent_ghost_bytes) / recent_ghost_bytes : 0;
+            size_t step = std::max(charge, static_cast<size_t>(charge * ratio));
+            recent_target = std::min(MAX_SIZE, recent_target + step);
+        } else {
+            double ratio = frequent_ghost_bytes > 0 ? double(recent_ghost_bytes) / frequent_ghost_bytes : 0;
+            size_t step = std::max(charge, static_cast<size_t>(charge * ratio));
+            recent_target -= std::min(recent_target, step);
+        }
+        forgetGhostLocked(ghost);
+        return Segment::Frequent;
+    }
+
+    void rememberGhostLocked(CacheString&& key, bool from_frequent, size_t charge) {
+        auto [ghost, inserted] = ghosts.try_emplace(std::move(key));
+        if (!inserted) {
+            return;
+        }
+        auto& list = from_frequent ? frequent_ghosts : recent_ghosts;
+        ghost->second.frequent = from_frequent;
+        ghost->second.charge = charge;
+        ghost->second.slot = list.insert(list.end(), &ghost->first);
+        (from_frequent ? frequent_ghost_bytes : recent_ghost_bytes) += charge;
+        trimGhostsLocked();
+    }
+
+    void forgetGhostLocked(decltype(ghosts)::iterator ghost) {
+        auto& list = ghost->second.frequent ? frequent_ghosts : recent_ghosts;
+        (ghost->second.frequent ? frequent_ghost_bytes : recent_ghost_bytes) -= ghost->second.charge;
+        list.erase(ghost->second.slot);
+        ghosts.erase(ghost);
+    }
+
+    /// Keeps the recency clock and its ghosts within MAX_SIZE, and everything within twice that
+    void trimGhostsLocked() {
+        while (!recent_ghosts.empty() && recent_bytes + recent_ghost_bytes > MAX_SIZE) {
+            forgetGhostLocked(ghosts.find(*recent_ghosts.front()));
+        }
+        while (!frequent_ghosts.empty() &&
+               recent_bytes + frequent_bytes + recent_ghost_bytes + frequent_ghost_bytes > 2 * MAX_SIZE) {
+            forgetGhostLocked(ghosts.find(*frequent_ghosts.front()));
+        }
+    }
+
+    static std::unique_ptr<std::pmr::unsynchronized_pool_resource> makePool(memory::HugePageResource* upstream) {
+        if (!upstream) {
+            return nullptr;
+        }
+        std::pmr::pool_options options;
+        options.largest_required_pool_block = 64 * 1024; // larger values get their own blocks upstream
+        return std::make_unique<std::pmr::unsynchronized_pool_resource>(options, upstream);
+    }
+
+    StripeLock& lockFor(const std::string& key) {
+        return key_locks[stripeOf(key)];
+    }
+
+    /// Holds the key locks of several keys, taken in stripe order so concurrent batches can't deadlock
+    class MultiKeyLock {
+    private:
+        FIFOCache& owner;
+        std::vector<size_t> stripes;
+
+    public:
+        template <typename Keys, typename KeyOf>
+        MultiKeyLock(FIFOCache& owner, const Keys& keys, KeyOf key_of) : owner(owner) {
+            for (const auto& item : keys) {
+                stripes.push_back(stripeOf(key_of(item)));
+            }
+            std::sort(stripes.begin(), stripes.end());
+            stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+            for (size_t stripe : stripes) {
+                owner.key_locks[stripe].lock();
+            }
+        }
+
+        ~MultiKeyLock() {
+            for (auto it = stripes.rbegin(); it != stripes.rend(); ++it) {
+                owner.key_locks[*it].unlock();
+            }
+        }
+
+        MultiKeyLock(const MultiKeyLock&) = delete;
+        MultiKeyLock& operator=(const MultiKeyLock&) = delete;
+    };
+
+    /// get_many() after the expiry checks, expired keys are reported missing. With keys_locked the
+    /// caller holds every key's lock, otherwise the locks of the keys missing from memory are taken here
+    std::vector<std::pair<bool, std::string>> lookupMany(const std::vector<std::string>& keys,
+                                                         const std::vector<bool>& expired, bool keys_locked) {
+        std::vector<std::pair<bool, std::string>> results(keys.size(), {false, ""});
+        std::vector<size_t> missing;
+
+        size_t cached_bytes = 0;
+        double saved_us = 0;
+        if (shared) {
+            double fetch_us = average_fetch_us.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (expired[i]) {
+                    continue;
+                }
+                if (shared->lookup(keys[i], &results[i].second)) {
+                    results[i].first = true;
+                    cached_bytes += results[i].second.size();
+                    saved_us += fetch_us;
+                } else {
+                    missing.push_back(i);
+                }
+            }
+        } else {
+            std::shared_lock<std::shared_mutex> cache_lock(cache_mutex); // read lock
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (expired[i]) {
+                    continue;
+                }
+                auto it = cache.find(probe(keys[i]));
+                if (it != cache.end()) {
+                    results[i] = {true, std::string(it->second.value)};
+                    noteRead(it->second);
+                    cached_bytes += it->second.value.size();
+                    saved_us += it->second.fetch_us;
+                } else {
+                    missing.push_back(i);
+                }
+            }
+        }
+        if (large) {
+            auto in_large = [&](size_t i) {
+                float fetch_us;
+                if (!large->lookup(keys[i], &results[i].second, &fetch_us)) {
+                    return false;
+                }
+                results[i].first = true;
+                cached_bytes += results[i].second.size();
+                saved_us += fetch_us;
+                return true;
+            };
+            missing.erase(std::remove_if(missing.begin(), missing.end(), in_large), missing.end());
+        }
+        hits += keys.size() - missing.size();
+        hit_bytes += cached_bytes;
+        saved_fetch_ns += static_cast<uint64_t>(saved_us * 1000);
+        misses += missing.size();
+
+        if (!missing.empty()) {
+            std::optional<MultiKeyLock> locks;
+            if (!keys_locked) {
+                locks.emplace(*this, missing, [&keys](size_t i) -> const std::string& { return keys[i]; });
+            }
+            if (victims || flash) {
+                auto demoted = [&](size_t i) {
+                    if (!fetchDemoted(keys[i], results[i].second)) {
+                        return false;
+                    }
+                    results[i].first = true;
+                    insertToCache(keys[i], results[i].second);
+                    return true;
+                };
+                missing.erase(std::remove_if(missing.begin(), missing.end(), demoted), missing.end());
+            }
+            std::vector<std::string> db_keys;
+            db_keys.reserve(missing.size());
+            for (size_t i : missing) {
+                db_keys.push_back(keys[i]);
+            }
+            auto started = std::chrono::steady_clock::now();
+            auto found = db.get_many_from_db(db_keys);
+            size_t found_bytes = 0;
+            for (const auto& pair : found) {
+                found_bytes += pair.second.size();
+            }
+            // the batch's time, split evenly
+            float fetch_us = db_keys.empty() ? 0 : countFetch(started, db_keys.size(), found_bytes);
+            for (size_t i : missing) {
+                auto it = found.find(keys[i]);
+                if (it == found.end()) {
+                    continue;
+                }
+                if (shared) {
+                    if (!fillShared(keys[i], it->second)) {
+                        continue;
+                    }
+                } else {
+                    insertToCache(keys[i], it->second, fetch_us);
+                }
+                results[i] = {true, it->second};
+            }
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (results[i].first) {
+                recordRead(keys[i]);
+            }
+        }
+        return results;
+    }
+
+
+    static int64_t nowMillis() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool isExpired(const std::string& key) {
+        if (shared) {
+            // deadlines set by any process are kept in the shared entries
+            int64_t deadline = 0;
+            return shared->hasTtls() && shared->lookup(key, nullptr, &deadline) && deadline != 0 &&
+                   deadline <= nowMillis();
+        }
+        if (expiring_keys.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(expiry_mutex);
+        auto it = expiry.find(key);
+        return it != expiry.end() && it->second <= nowMillis();
+    }
+
+    bool isExpired(const CacheString& key) {
+        return (shared || expiring_keys.load(std::memory_order_relaxed) != 0) && isExpired(std::string(key));
+    }
+
+    void clearExpiry(const std::string& key) {
+        if (shared) {
+            if (shared->hasTtls()) {
+                shared->setDeadline(key, 0);
+                db.clear_expiry(key); // the key may have a TTL without being cached here
+            }
+            return;
+        }
+        if (expiring_keys.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        bool had_ttl = false;
+        {
+            std::lock_guard<std::mutex> lock(expiry_mutex);
+            if (expiry.erase(key) > 0) {
+                expiring_keys--;
+                had_ttl = true;
+            }
+        }
+        if (had_ttl) {
+            db.clear_expiry(key);
+        }
+    }
+
+    /// Cache then DB lookup that fills the cache on a DB hit
+    /// Caller must hold the key lock so a concurrent put can't be overwritten by the stale DB value
+    std::pair<bool, std::string> lookupLocked(const std::string& key) {
+        if (shared) {
+            return lookupSharedLocked(key);
+        }
+        {
+            std::shared_lock<std::shared_mutex> cache_lock(cache_mutex);
+            auto it = cache.find(probe(key));
+            if (it != cache.end()) {
+                noteRead(it->second);
+                return {true, std::string(it->second.value)};
+            }
+        }
+        if (large) {
+            std::pair<bool, std::string> result{false, ""};
+            if (large->lookup(key, &result.second)) {
+                result.first = true;
+                return result;
+            }
+        }
+        {
+            std::pair<bool, std::string> result{false, ""};
+            if (fetchDemoted(key, result.second)) {
+                result.first = true;
+                insertToCache(key, result.second); // moves it back to memory
+                return result;
+            }
+        }
+        float fetch_us;
+        auto value_opt = fetchFromDb(key, fetch_us);
+        if (value_opt.first) {
+            insertToCache(key, value_opt.second, fetch_us);
+        }
+        return value_opt;
+    }
+    
+    /// lookupLocked() for shared mode
+    std::pair<bool, std::string> lookupSharedLocked(const std::string& key) {
+        std::pair<bool, std::string> result{false, ""};
+        if (shared->lookup(key, &result.second)) {
+            result.first = true;
+            return result;
+        }
+        float fetch_us;
+        result = fetchFromDb(key, fetch_us);
+        if (result.first && !fillShared(key, result.second)) {
+            return {false, ""};
+        }
+        return result;
+    }
+
+    /// Caches a DB hit in shared mode together with its deadline, caller must hold the key lock
+    /// The deadline may have been set by another process, so it is read from the DB
+    /// @returns false if the key has expired, it is removed then
+    bool fillShared(const std::string& key, const std::string& value) {
+        int64_t deadline = shared->hasTtls() ? db.get_expiry(key) : 0;
+        if (deadline != 0 && deadline <= nowMillis()) {
+            removeLocked(key);
+            return false;
+        }
+        shared->insert(key, value, deadline);
+        return true;
+    }
+
+    /// Removes key from DB and cache, caller must hold the key lock
+    bool removeLocked(const std::string& key) {
+        bool removed_from_db = db.remove_from_db(key); // remove from DB
+        bool removed_from_cache = false;
+        clearExpiry(key);
+        if (shared) {
+            bool removed = shared->erase(key) || removed_from_db;
+            bumpEpoch(key);
+            if (removed) {
+                notifyChange(key, ChangeOp::Remove);
+            }
+            return removed;
+        }
+        
+        // Remove from cache
+        {
+            std::unique_lock<std::shared_mutex> cache_lock(cache_mutex); // write lock
+            auto it = cache.find(probe(key));
+            if (it != cache.end()) {
+                unlinkLocked(it); // remove from cache
+                removed_from_cache = true; 
+            }
+            if (large && large->erase(key)) {
+                removed_from_cache = true;
+            }
+            forgetDemotedLocked(key); // the clock slot went stale with the entry
+        }
+        bumpEpoch(key);
+        if (removed_from_db || removed_from_cache) {
+            notifyChange(key, ChangeOp::Remove);
+        }
+        
+        return removed_from_db || removed_from_cache; // a record can only be in db (not in cache) or both 
+    }
+    
+    /// Drops key's cached value without touching the database, caller must hold the key lock
+    void dropCachedLocked(const std::string& key) {
+        if (shared) {
+            shared->erase(key);
+            return;
+        }
+        {
+            std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+            auto it = cache.find(probe(key));
+            if (it != cache.end()) {
+                unlinkLocked(it); // its clock slot goes stale
+            }
+            forgetDemotedLocked(key);
+        }
+        if (large) {
+            large->erase(key);
+        }
+    }
+
+    /// Drops key if its TTL has passed
+    /// @returns true if the key was expired
+    bool expireIfDue(const std::string& key) {
+        if (!isExpired(key)) {
+            return false;
+        }
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (!isExpired(key)) {
+            return false; // rewritten while we waited for the lock
+        }
+        removeLocked(key);
+        return true;
+    }
+
+    void recordRead(const std::string& key) {
+        if (!track_reads) {
+            return;
+        }
+        if (read_sample_rate > 1) {
+            // xorshift, so keys read in a regular pattern are sampled fairly
+            thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ std::hash<std::thread::id>{}(std::this_thread::get_id());
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            if (state % read_sample_rate != 0) {
+                return;
+            }
+        }
+        int64_t now = nowMillis();
+        ReadStripe& stripe = read_stripes[std::hash<std::string>{}(key) % READ_STRIPES];
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            auto& entry = stripe.pending[key];
+            if (entry.first == 0) {
+                pending_reads++;
+            }
+            entry.first += read_sample_rate;
+            entry.second = now;
+        }
+        if (pending_reads.load(std::memory_order_relaxed) == READ_FLUSH_THRESHOLD) {
+            read_flusher_wake.notify_one();
+        }
+    }
+
+    void runReadFlusher() {
+        std::unique_lock<std::mutex> lock(read_flusher_mutex);
+        while (!read_flusher_stop) {
+            read_flusher_wake.wait_for(lock, READ_FLUSH_INTERVAL, [this]() {
+                return read_flusher_stop || pending_reads.load(std::memory_order_relaxed) >= READ_FLUSH_THRESHOLD;
+            });
+            lock.unlock();
+            flushReads();
+            lock.lock();
+        }
+    }
+
+    /// Writes the pending read counts to the database
+    void flushReads() {
+        std::lock_guard<std::mutex> flush_lock(flush_mutex);
+        std::vector<std::tuple<std::string, uint64_t, int64_t>> reads;
+        for (auto& stripe : read_stripes) {
+            std::unordered_map<std::string, std::pair<uint64_t, int64_t>> pending;
+            {
+                std::lock_guard<std::mutex> lock(stripe.mutex);
+                pending.swap(stripe.pending);
+            }
+            for (auto& [key, entry] : pending) {
+                reads.emplace_back(key, entry.first, entry.second);
+            }
+        }
+        if (reads.empty()) {
+            return;
+        }
+        pending_reads -= reads.size();
+        db.record_reads(reads);
+    }
+
+    /// Caches one page of warm-up rows that aren't cached yet
+    /// Stops without evicting anything once the cache is full
+    /// @returns false once the warm-up should stop
+    bool warmBatch(std::vector<WarmupRow>& rows, const std::array<uint64_t, KEY_LOCK_STRIPES>& read_epochs,
+                   size_t max_rows) {
+        MultiKeyLock locks(*this, rows, [](const WarmupRow& row) -> const std::string& { return row.key; });
+        bool changed = std::any_of(rows.begin(), rows.end(), [&](const WarmupRow& row) {
+            size_t stripe = stripeOf(row.key);
+            return epochOf(stripe) != read_epochs[stripe];
+        });
+        if (changed) {
+            // a writer committed after the page was read, reload it so no stale value gets cached
+            std::vector<std::string> keys;
+            keys.reserve(rows.size());
+            for (const auto& row : rows) {
+                keys.push_back(row.key);
+            }
+            auto current = db.get_many_from_db(keys);
+            rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                      [&current](const WarmupRow& row) { return current.count(row.key) == 0; }),
+                       rows.end());
+            for (auto& row : rows) {
+                row.value = std::move(current[row.key]);
+            }
+        }
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                  [this](const WarmupRow& row) { return isExpired(row.key); }),
+                   rows.end());
+
+        if (shared) {
+            for (const auto& row : rows) {
+                if (warmup_rows_loaded.load(std::memory_order_relaxed) >= max_rows) {
+                    return false;
+                }
+                if (shared->lookup(row.key)) {
+                    continue;
+                }
+                size_t size = row.key.size() + row.value.size();
+                if (shared->currentSize() + size > shared->maxSize()) {
+                    return false;
+                }
+                if (fillShared(row.key, row.value)) {
+                    warmup_rows_loaded++;
+                    warmup_bytes_loaded += size;
+                }
+            }
+            return true;
+        }
+
+        std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+        for (auto& row : rows) {
+            if (warmup_rows_loaded.load(std::memory_order_relaxed) >= max_rows) {
+                return false;
+            }
+            size_t size = row.key.size() + row.value.size();
+            if (cache.count(probe(row.key)) > 0) {
+                continue;
+            }
+            if (usedLocked() + chargeOf(row.key.size(), row.value.size()) > MAX_SIZE) {
+                return false;
+            }
+            linkLocked(cache.emplace(row.key, row.value).first, Segment::Recent);
+            warmup_rows_loaded++;
+            warmup_bytes_loaded += size;
+        }
+        return true;
+    }
+
+    void runWarmup(size_t max_rows, WarmupOrder order, std::function<void(const WarmupProgress&)> on_progress) {
+        if (order != WarmupOrder::RecentlyWritten) {
+            flushReads();
+        }
+        int64_t after_sort_key = INT64_MAX;
+        int64_t after_rowid = INT64_MAX;
+        while (!warmup_cancel.load(std::memory_order_relaxed)) {
+            std::array<uint64_t, KEY_LOCK_STRIPES> read_epochs;
+            for (size_t stripe = 0; stripe < KEY_LOCK_STRIPES; stripe++) {
+                read_epochs[stripe] = epochOf(stripe);
+            }
+            auto rows = db.warmup_batch(order, after_sort_key, after_rowid, WARMUP_BATCH_ROWS);
+            if (rows.empty()) {
+                break;
+            }
+            bool last_page = rows.size() < WARMUP_BATCH_ROWS;
+            after_sort_key = rows.back().sort_key;
+            after_rowid = rows.back().rowid;
+            bool more = warmBatch(rows, read_epochs, max_rows);
+            if (!more || last_page) {
+                break;
+            }
+            if (on_progress) {
+                on_progress(warmup_progress());
+            }
+        }
+        warmup_done = true;
+        if (on_progress) {
+            on_progress(warmup_progress());
+        }
+    }
+
+    bool canEvictLocked() const {
+        return !queue.empty() || !frequent.empty() || !cost_heap.empty();
+    }
+
+    /// Advances the eviction policy by one slot, caller must hold the cache_mutex write lock
+    /// FIFO pops the oldest queue slot. The adaptive policy moves the hand of the recency clock while
+    /// it holds more than recent_target bytes, otherwise the hand of the frequency clock.
+    /// GreedyDual takes the cheapest entry off its heap instead.
+    /// @returns true if an entry was evicted, false for a stale slot or an entry given a second chance
+    bool evictOneLocked() {
+        if (greedyDual()) {
+            return evictCheapestLocked();
+        }
+        bool from_recent = !queue.empty() &&
+                           (!adaptive() || frequent.empty() || recent_bytes >= std::max<size_t>(1, recent_target));
+        KeyQueue& clock = from_recent ? queue : frequent;
+        // skip slots of entries dropped since, or cached again with a newer slot
+        auto oldest_it = cache.find(clock.front().key);
+        if (oldest_it == cache.end() || oldest_it->second.slot != clock.front().id) {
+            clock.pop();
+            return false;
+        }
+        CacheEntry& entry = oldest_it->second;
+        size_t charge = chargeOf(oldest_it->first.size(), entry.value.size());
+        if (adaptive() && entry.referenced.load(std::memory_order_relaxed)) {
+            // read since the hand last passed: goes to the back of the frequency clock
+            entry.referenced.store(false, std::memory_order_relaxed);
+            if (from_recent) {
+                recent_bytes -= charge;
+                frequent_bytes += charge;
+                entry.segment = Segment::Frequent;
+            }
+            frequent.push(std::move(clock.front()));
+            clock.pop();
+            return false;
+        }
+        if (adaptive()) {
+            rememberGhostLocked(std::move(clock.front().key), !from_recent, charge);
+        }
+        clock.pop();
+        demoteLocked(oldest_it);
+        unlinkLocked(oldest_it);
+        evictions++;
+        return true;
+    }
+
+    void runEvictor() {
+        std::unique_lock<std::mutex> lock(evictor_mutex);
+        while (!evictor_stop) {
+            evictor_wake.wait(lock, [this]() { return evictor_stop || evictor_requested.load(); });
+            evictor_requested = false;
+            lock.unlock();
+            makeHeadroom();
+            lock.lock();
+        }
+    }
+
+    /// Evicts until evict_high bytes are free, in batches so readers and writers get the lock in between
+    void makeHeadroom() {
+        size_t target = MAX_SIZE > evict_high ? MAX_SIZE - evict_high : 0;
+        while (true) {
+            std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+            if (usedLocked() <= target || !canEvictLocked()) {
+                return;
+            }
+            for (size_t evicted = 0; evicted < EVICTOR_BATCH && usedLocked() > target && canEvictLocked();) {
+                if (evictOneLocked()) {
+                    evicted++;
+                    background_evictions++;
+                }
+            }
+        }
+    }
+
+    /// Wakes the evictor if an insert left less than evict_low bytes free
+    void requestHeadroom(size_t size_after_insert) {
+        if (!evictor.joinable() || size_after_insert + evict_low <= MAX_SIZE || evictor_requested.exchange(true)) {
+            return;
+        }
+        { std::lock_guard<std::mutex> lock(evictor_mutex); } // the evictor is waiting or will see the request
+        evictor_wake.notify_one();
+    }
+
+    /// Stores key's deadline (unix ms), caller must hold the key lock
+    void setDeadlineLocked(const std::string& key, int64_t deadline) {
+        db.set_expiry(key, deadline);
+        if (shared) {
+            shared->noteTtl();
+            shared->setDeadline(key, deadline);
+            notifyChange(key, ChangeOp::Expiry);
+            return;
+        }
+        rememberDeadline(key, deadline);
+        bumpEpoch(key); // near cache copies don't know the new deadline
+        notifyChange(key, ChangeOp::Expiry);
+    }
+
+    /// Private mode: the in-memory copy of a deadline expireIfDue checks
+    void rememberDeadline(const std::string& key, int64_t deadline) {
+        std::lock_guard<std::mutex> lock(expiry_mutex);
+        if (expiry.insert_or_assign(key, deadline).second) {
+            expiring_keys++;
+        }
+    }
+
+    /// Writes the pair to the database and the cache, caller must hold the key lock
+    /// With a positive TTL the value and its deadline are written together, so no reader in this or
+    /// another process sees the new value without it; otherwise the key's TTL is cleared
+    void storeLocked(const std::string& key, const std::string& value, long long milliseconds) {
+        if (milliseconds <= 0) {
+            db.put_to_db(key, value);
+            clearExpiry(key);
+            insertToCache(key, value);
+        } else {
+            int64_t now = nowMillis();
+            int64_t deadline = milliseconds > INT64_MAX - now ? INT64_MAX : now + milliseconds;
+            db.put_with_expiry(key, value, deadline);
+            if (shared) {
+                shared->noteTtl();
+                shared->insert(key, value, deadline);
+            } else {
+                rememberDeadline(key, deadline); // before the value is visible
+                insertToCache(key, value);
+            }
+        }
+        bumpEpoch(key);
+        notifyChange(key, ChangeOp::Put);
+    }
+
+    /// Copies key's deadline from the source, 0 clears it
+    void applyDeadline(const std::string& key, int64_t deadline) {
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (deadline == 0) {
+            clearExpiry(key);
+            notifyChange(key, ChangeOp::Expiry);
+        } else {
+            setDeadlineLocked(key, deadline);
+        }
+    }
+
+    /// Copies the current state of the keys in changes from the source, values before deadlines
+    void applyChanges(const std::vector<Change>& changes) {
+        std::vector<std::string> written, timed;
+        std::unordered_set<std::string> seen_written, seen_timed;
+        for (const Change& change : changes) {
+            if (change.op == ChangeOp::Expiry) {
+                if (seen_timed.insert(change.key).second) {
+                    timed.push_back(change.key);
+                }
+            } else if (seen_written.insert(change.key).second) {
+                written.push_back(change.key);
+            }
+        }
+        auto values = source->get_many_from_db(written);
+        std::vector<std::pair<std::string, std::string>> pairs;
+        pairs.reserve(values.size());
+        for (const std::string& key : written) {
+            auto it = values.find(key);
+            if (it == values.end()) {
+                remove(key);
+            } else {
+                pairs.emplace_back(key, std::move(it->second));
+            }
+        }
+        put_many(pairs);
+        for (const std::string& key : timed) {
+            applyDeadline(key, source->get_expiry(key));
+        }
+    }
+
+    /// Copies the source's whole table and deadlines, for a first sync or a follower that fell
+    /// behind the trimmed change_log; changes logged meanwhile are replayed afterwards
+    /// @param last the source's last logged change, read before the copy starts
+    void resyncLocked(int64_t last) {
+        std::unordered_set<std::string> source_keys;
+        uint64_t cursor = 0;
+        do {
+            auto page = source->scan_db(cursor, REPLICATION_BATCH);
+            cursor = page.first;
+            auto values = source->get_many_from_db(page.second);
+            std::vector<std::pair<std::string, std::string>> pairs(std::make_move_iterator(values.begin()),
+                                                                   std::make_move_iterator(values.end()));
+            put_many(pairs);
+            source_keys.insert(page.second.begin(), page.second.end());
+        } while (cursor != 0);
+
+        std::vector<std::string> stale;
+        cursor = 0;
+        do {
+            auto page = db.scan_db(cursor, REPLICATION_BATCH);
+            cursor = page.first;
+            for (std::string& key : page.second) {
+                if (source_keys.count(key) == 0) {
+                    stale.push_back(std::move(key));
+                }
+            }
+        } while (cursor != 0);
+        for (const std::string& key : stale) {
+            remove(key);
+        }
+
+        std::unordered_map<std::string, int64_t> deadlines;
+        for (auto& [key, deadline] : source->load_expiries()) {
+            deadlines.emplace(key, deadline);
+        }
+        for (const auto& [key, deadline] : db.load_expiries()) {
+            if (deadlines.count(key) == 0) {
+                applyDeadline(key, 0);
+            }
+        }
+        for (const auto& [key, deadline] : deadlines) {
+            applyDeadline(key, deadline);
+        }
+        db.set_replication_position(source_path, last);
+        applied_seq = last;
+    }
+
+    /// Applies the source's new changes, caller must hold replication_mutex
+    /// @returns true if every change the source had logged is applied
+    bool pollSourceLocked() {
+        auto [first, last] = source->change_log_bounds();
+        source_seq = last;
+        if (applied_seq < 0 || applied_seq + 1 < first) {
+            resyncLocked(last);
+        }
+        while (true) {
+            std::vector<Change> changes = source->read_changes(applied_seq, REPLICATION_BATCH);
+            if (changes.empty()) {
+                break;
+            }
+            lag_ms = std::max<int64_t>(0, nowMillis() - changes.front().changed_at);
+            applyChanges(changes);
+            int64_t applied = changes.back().seq;
+            db.set_replication_position(source_path, applied);
+            applied_seq = applied;
+            source_seq = std::max(source_seq.load(), applied);
+            if (changes.size() < REPLICATION_BATCH) {
+                break;
+            }
+        }
+        lag_ms = 0;
+        return applied_seq >= last;
+    }
+
+    void runFollower() {
+        std::unique_lock<std::mutex> lock(follower_mutex);
+        while (!follower_stop) {
+            lock.unlock();
+            catch_up();
+            lock.lock();
+            follower_wake.wait_for(lock, follow_interval, [this]() { return follower_stop; });
+        }
+    }
+
+    /// Drops the keys another process changed from every cache level, reloading their deadlines
+    void invalidateChanges(const std::vector<Change>& changes) {
+        struct Invalidation {
+            ChangeOp last_op;
+            bool timed; // a deadline changed
+        };
+        std::vector<std::string> keys;
+        std::unordered_map<std::string, Invalidation> invalidations;
+        for (const Change& change : changes) {
+            auto [it, inserted] = invalidations.try_emplace(change.key, Invalidation{change.op, false});
+            if (inserted) {
+                keys.push_back(change.key);
+            }
+            it->second.last_op = change.op;
+            it->second.timed = it->second.timed || change.op == ChangeOp::Expiry;
+        }
+        for (const std::string& key : keys) {
+            const Invalidation& invalidation = invalidations[key];
+            std::lock_guard<StripeLock> key_lock(lockFor(key));
+            dropCachedLocked(key);
+            if (invalidation.timed || expiring_keys.load(std::memory_order_relaxed) > 0) {
+                int64_t deadline = db.get_expiry(key);
+                std::lock_guard<std::mutex> lock(expiry_mutex);
+                if (deadline == 0) {
+                    expiring_keys -= expiry.erase(key);
+                } else if (expiry.insert_or_assign(key, deadline).second) {
+                    expiring_keys++;
+                }
+            }
+            bumpEpoch(key);
+            notifyChange(key, invalidation.last_op);
+            invalidated_keys++;
+        }
+    }
+
+    /// Drops everything cached and reloads the deadlines, for a cache that missed trimmed changes or
+    /// can't tell which keys changed
+    void dropAllCached() {
+        for (auto& stripe : key_locks) {
+            stripe.lock();
+        }
+        {
+            // demotions run under the cache lock, so nothing reaches the lower levels meanwhile
+            std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+            while (!cache.empty()) {
+                unlinkLocked(cache.begin());
+            }
+            clearPolicyLocked(); // rather than leaving every slot and ghost stale
+            if (victims) {
+                victims->clear();
+            }
+            if (flash) {
+                flash->clear();
+            }
+        }
+        if (large) {
+            large->clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(expiry_mutex);
+            expiry.clear();
+            for (auto& [key, deadline] : db.load_expiries()) {
+                expiry[key] = deadline;
+            }
+            expiring_keys = expiry.size();
+        }
+        for (size_t i = 0; i < KEY_LOCK_STRIPES; i++) {
+            epochs[i].value.fetch_add(1, std::memory_order_release);
+        }
+        {
+            std::lock_guard<std::mutex> lock(version_mutex);
+            versions.clear(); // any key may have changed
+            versioned_keys = 0;
+        }
+        for (auto it = key_locks.rbegin(); it != key_locks.rend(); ++it) {
+            it->unlock();
+        }
+        invalidation_resets++;
+    }
+
+    /// Handles what other connections committed to each partition since the last poll
+    void pollInvalidationsLocked() {
+        for (size_t i = 0; i < db.partitions(); i++) {
+            SQLiteDB& partition = db.partition(i);
+            int64_t version = partition.data_version();
+            if (version == seen_data_version[i]) {
+                continue;
+            }
+            seen_data_version[i] = version;
+            auto [first, last] = partition.change_log_bounds();
+            if (invalidated_seq[i] + 1 < first) {
+                dropAllCached();
+                invalidated_seq[i] = last;
+                continue;
+            }
+            while (true) {
+                std::vector<Change> changes = partition.read_changes(invalidated_seq[i], REPLICATION_BATCH);
+                if (changes.empty()) {
+                    break;
+                }
+                invalidateChanges(changes);
+                invalidated_seq[i] = changes.back().seq;
+                if (changes.size() < REPLICATION_BATCH) {
+                    break;
+                }
+            }
+            // Commits that change nothing logged, like read counts, are expected. With the triggers
+            // gone, though, nothing tells which keys changed.
+            if (!partition.change_log_enabled()) {
+                dropAllCached();
+            }
+        }
+    }
+
+    void runInvalidator() {
+        std::unique_lock<std::mutex> lock(invalidator_mutex);
+        while (!invalidator_stop) {
+            lock.unlock();
+            sync_invalidations();
+            lock.lock();
+            invalidator_wake.wait_for(lock, invalidate_interval, [this]() { return invalidator_stop; });
+        }
+    }
+
+    /// Only one process may append to a value log, so it is off in shared mode
+    static ValueLogOptions valueLogOptions(const CacheConfig& config) {
+        ValueLogOptions options;
+        // only one process may append to a value log, and both modes share the file between processes
+        bool shared_file = !config.shared_segment.empty() || config.invalidate_interval_ms > 0;
+        options.threshold = shared_file ? 0 : config.value_log_threshold;
+        options.segment_bytes = config.value_log_segment_bytes;
+        return options;
+    }
+
+    /// Fingerprint of all database files, total size and latest mtime, for snapshots
+    snapshot::DbFingerprint dbFingerprint() const {
+        snapshot::DbFingerprint fingerprint;
+        for (size_t i = 0; i < db.partitions(); i++) {
+            auto partition = snapshot::DbFingerprint::of(PartitionedDB::partitionPath(db_path, i, db.partitions()));
+            fingerprint.size += partition.size;
+            fingerprint.mtime_ns = std::max(fingerprint.mtime_ns, partition.mtime_ns);
+        }
+        return fingerprint;
+    }
+
+    static bool parseInteger(const std::string& text, long long& out) {
+        if (text.empty()) {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
     
 public:
-    FIFOCache() : capacity(INT_MAX) {} // cache can hold any number of keys (constrained by MAX_SIZE)
+    FIFOCache() : FIFOCache(CacheConfig{}) {} // cache can hold any number of keys (constrained by MAX_SIZE)
+
+    explicit FIFOCache(const CacheConfig& config)
+        : MAX_SIZE(config.max_size), capacity(INT_MAX),
+          huge_memory(config.huge_pages && config.shared_segment.empty()
+                          ? std::make_unique<memory::HugePageResource>(config.numa_node) : nullptr),
+          entry_pool(makePool(huge_memory.get())),
+          accounting(config.bound_memory && config.shared_segment.empty()
+                         ? std::make_unique<memory::AccountingResource>(
+                               entry_pool ? static_cast<std::pmr::memory_resource*>(entry_pool.get())
+                                          : std::pmr::new_delete_resource())
+                         : nullptr),
+          cache(entryMemory()), queue(std::pmr::polymorphic_allocator<ClockSlot>(entryMemory())),
+          policy(config.policy), frequent(std::pmr::polymorphic_allocator<ClockSlot>(entryMemory())),
+          ghosts(entryMemory()), recent_ghosts(entryMemory()), frequent_ghosts(entryMemory()),
+          cost_heap(std::pmr::polymorphic_allocator<CostSlot>(entryMemory())),
+          db(config.db_path, config.db_partitions, valueLogOptions(config)), db_path(config.db_path), snapshot_path(config.snapshot_path),
+          large(config.large_segment_bytes > 0 && config.shared_segment.empty()
+                    ? std::make_unique<LargeObjectSegment>(config.large_segment_bytes) : nullptr),
+          large_value_bytes(config.large_value_bytes),
+          victims(config.victim_bytes > 0 && config.shared_segment.empty()
+                      ? std::make_unique<VictimCache>(config.victim_bytes) : nullptr),
+          flash(!config.flash_path.empty() && config.shared_segment.empty()
+                    ? std::make_unique<FlashCache>(config.flash_path, config.flash_bytes, 1 << 20, config.flash_direct_io)
+                    : nullptr),
+          feed(config.watch_buffer_events > 0 ? std::make_unique<ChangeFeed>(config.watch_buffer_events) : nullptr),
+          evict_low(config.evict_low_free_bytes),
+          evict_high(std::max(config.evict_low_free_bytes, config.evict_high_free_bytes)),
+          track_reads(config.track_reads),
+          read_sample_rate(std::max<uint32_t>(1, config.read_sample_rate)),
+          l0_enabled(config.l0_entries > 0), l0_mask(roundUpToPowerOfTwo(config.l0_entries) - 1),
+          l0_max_entry_bytes(config.l0_max_entry_bytes) {
+        if (track_reads) {
+            read_flusher = std::thread(&FIFOCache::runReadFlusher, this);
+        }
+        if (!config.shared_segment.empty()) {
+            shared = std::make_unique<SharedCacheSegment>(config.shared_segment, config.max_size,
+                                                          config.shared_segment_bytes);
+            if (shared->isOpen()) {
+                for (size_t i = 0; i < KEY_LOCK_STRIPES; i++) {
+                    key_locks[i].attach(shared->keyLock(i));
+                }
+                if (shared->created() && !db.load_expiries().empty()) {
+                    shared->noteTtl();
+                }
+                if (config.warmup_rows > 0) {
+                    start_warmup(config.warmup_rows, config.warmup_order);
+                }
+                return;
+            }
+            std::cerr << "Falling back to a private cache" << std::endl;
+            shared.reset();
+        }
+        for (auto& [key, deadline] : db.load_expiries()) {
+            expiry[key] = deadline;
+        }
+        expiring_keys = expiry.size();
+
+        size_t log_rows = config.change_log_rows == 0 && config.invalidate_interval_ms > 0 ? INVALIDATION_LOG_ROWS
+                                                                                             : config.change_log_rows;
+        if (log_rows > 0) {
+            db.set_change_log(log_rows); // never turned off here, other processes may rely on it
+        }
+        if (config.invalidate_interval_ms > 0) {
+            // nothing is cached yet, so only later changes matter
+            for (size_t i = 0; i < db.partitions(); i++) {
+                seen_data_version.push_back(db.partition(i).data_version());
+                invalidated_seq.push_back(db.partition(i).change_log_bounds().second);
+            }
+        }
+
+        if (!snapshot_path.empty()) {
+            load_snapshot(snapshot_path);
+        }
+        if (!config.follow_db_path.empty()) {
+            source = std::make_unique<SQLiteDB>(config.follow_db_path);
+            source_path = config.follow_db_path;
+            follow_interval = std::chrono::milliseconds(std::max(1u, config.follow_interval_ms));
+            applied_seq = db.get_replication_position(source_path);
+            follower = std::thread(&FIFOCache::runFollower, this);
+        }
+        if (config.invalidate_interval_ms > 0) {
+            invalidate_interval = std::chrono::milliseconds(config.invalidate_interval_ms);
+            invalidator = std::thread(&FIFOCache::runInvalidator, this);
+        }
+        if (evict_low > 0) {
+            evictor = std::thread(&FIFOCache::runEvictor, this);
+        }
+        if (config.warmup_rows > 0) {
+            start_warmup(config.warmup_rows, config.warmup_order);
+        }
+    }
+
+    ~FIFOCache() {
+        if (invalidator.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(invalidator_mutex);
+                invalidator_stop = true;
+            }
+            invalidator_wake.notify_one();
+            invalidator.join();
+        }
+        if (follower.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(follower_mutex);
+                follower_stop = true;
+            }
+            follower_wake.notify_one();
+            follower.join();
+        }
+        warmup_cancel = true;
+        if (warmup_thread.joinable()) {
+            warmup_thread.join();
+        }
+        if (evictor.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(evictor_mutex);
+                evictor_stop = true;
+            }
+            evictor_wake.notify_one();
+            evictor.join();
+        }
+        if (read_flusher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(read_flusher_mutex);
+                read_flusher_stop = true;
+            }
+            read_flusher_wake.notify_one();
+            read_flusher.join();
+        }
+        flushReads();
+        if (!snapshot_path.empty()) {
+            save_snapshot(snapshot_path);
+        }
+    }
     
     /// GET method for accessing elements from key-value store
-    /// Checks cache first, then database. Caches database hits
+    /// Checks the thread's near cache (if enabled), then cache, then database. Caches database hits
     /// @returns (key, value) pair if found, ("", "") otherwise
     std::pair<std::string, std::string> get(const std::string& key) {
+        std::string value;
+        uint64_t hash = 0, epoch = 0;
+        bool near = useL0();
+        if (near) {
+            hash = SharedCacheSegment::hashKey(key);
+            if (l0Lookup(key, hash, [&value](const std::string& cached) { value = cached; })) {
+                recordRead(key);
+                return std::make_pair(key, std::move(value));
+            }
+        }
+        if (expireIfDue(key)) {
+            misses++;
+            return {"", ""};
+        }
+        if (near) {
+            epoch = epochOf(hash % KEY_LOCK_STRIPES); // before the value is read, so a racing write invalidates it
+        }
+
         // Check cache
-        {
+        bool cached = false;
+        float fetch_us = 0;
+        if (shared) {
+            cached = shared->lookup(key, &value);
+            fetch_us = static_cast<float>(average_fetch_us.load(std::memory_order_relaxed));
+        } else {
             std::shared_lock<std::shared_mutex> cache_lock(cache_mutex); // read lock
-            auto it = cache.find(key);
+            auto it = cache.find(probe(key));
             // cache hit
             if (it != cache.end()) {
-                return std::make_pair(it->first, it->second);
+                value.assign(it->second.value.data(), it->second.value.size());
+                noteRead(it->second);
+                fetch_us = it->second.fetch_us;
+                cached = true;
+            }
+        }
+        if (!cached && large) {
+            cached = large->lookup(key, &value, &fetch_us);
+        }
+        if (cached) {
+            countHit(value.size(), fetch_us);
+            recordRead(key);
+            if (near) {
+                l0Fill(key, hash, epoch, value, fetch_us);
             }
+            return std::make_pair(key, std::move(value));
         }
 
         // Check DB
+        std::pair<bool, std::string> value_opt;
         {
-            auto value_opt = db.get_from_db(key);
-            // db hit
-            if (value_opt.first) {
-                std::string value = value_opt.second;
-                insertToCache(key, value);
-                return std::make_pair(key, value);
+            misses++;
+            std::lock_guard<StripeLock> key_lock(lockFor(key));
+            value_opt = lookupLocked(key);
+        }
+        // db hit
+        if (value_opt.first) {
+            recordRead(key);
+            if (near) {
+                l0Fill(key, hash, epoch, value_opt.second,
+                       static_cast<float>(average_fetch_us.load(std::memory_order_relaxed)));
             }
+            return std::make_pair(key, std::move(value_opt.second));
         }
         
         return {"", ""};
     }
-    
+
+    /// GET without copying the value out of the cache
+    /// fn(std::string_view value) runs under the cache read lock on a hit, so it must be short and
+    /// must not call back into the cache
+    /// @returns true if the key was found
+    template <typename F>
+    bool visit(const std::string& key, F&& fn) {
+        uint64_t hash = 0, epoch = 0;
+        bool near = useL0();
+        if (near) {
+            hash = SharedCacheSegment::hashKey(key);
+            if (l0Lookup(key, hash, [&fn](const std::string& cached) { fn(std::string_view(cached)); })) {
+                recordRead(key);
+                return true;
+            }
+        }
+        if (expireIfDue(key)) {
+            misses++;
+            return false;
+        }
+        if (near) {
+            epoch = epochOf(hash % KEY_LOCK_STRIPES);
+        }
+        bool cached = false;
+        size_t bytes = 0;
+        float fetch_us = 0;
+        if (shared) {
+            std::string value; // seqlock readers must copy before they know the read is consistent
+            if (shared->lookup(key, &value)) {
+                fn(std::string_view(value));
+                bytes = value.size();
+                fetch_us = static_cast<float>(average_fetch_us.load(std::memory_order_relaxed));
+                cached = true;
+            }
+        } else {
+            std::shared_lock<std::shared_mutex> cache_lock(cache_mutex);
+            auto it = cache.find(probe(key));
+            if (it != cache.end()) {
+                fn(std::string_view(it->second.value));
+                noteRead(it->second);
+                bytes = it->second.value.size();
+                fetch_us = it->second.fetch_us;
+                if (near) {
+                    l0Fill(key, hash, epoch, it->second.value, fetch_us);
+                }
+                cached = true;
+            }
+        }
+        if (!cached && large) {
+            std::string value;
+            if (large->lookup(key, &value, &fetch_us)) {
+                fn(std::string_view(value));
+                bytes = value.size();
+                cached = true;
+            }
+        }
+        if (cached) {
+            countHit(bytes, fetch_us);
+            recordRead(key);
+            return true;
+        }
+
+        misses++;
+        std::pair<bool, std::string> value_opt;
+        {
+            std::lock_guard<StripeLock> key_lock(lockFor(key));
+            value_opt = lookupLocked(key);
+        }
+        if (value_opt.first) {
+            recordRead(key);
+            if (near) {
+                l0Fill(key, hash, epoch, value_opt.second,
+                       static_cast<float>(average_fetch_us.load(std::memory_order_relaxed)));
+            }
+            fn(std::string_view(value_opt.second));
+        }
+        return value_opt.first;
+    }
+
     /// PUT method for inserting and updating values
     /// Does not allow inserting empty strings as keys (values can be empty)
     /// Puts every new pair to database first then inserts to cache
+    /// Overwriting a key clears its TTL
     void put(const std::string& key, const std::string& value) {
         if(key == ""){
             return;
         }
-        db.put_to_db(key, value);
-        insertToCache(key, value);
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        storeLocked(key, value, 0);
+    }
+
+    /// PUT with a time to live: the value and its deadline are written together, so no reader in
+    /// this or another process sees the new value without its TTL, and watchers get one Put
+    /// A non-positive TTL stores the pair without one, like put()
+    /// new_version, when given, gets the compare-and-swap version of the stored value
+    void put_with_ttl(const std::string& key, const std::string& value, long long milliseconds,
+                      uint64_t* new_version = nullptr) {
+        if(key == ""){
+            return;
+        }
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        storeLocked(key, value, milliseconds);
+        if (new_version) {
+            *new_version = versionLocked(key);
+        }
+    }
+
+    /// GET that also returns the key's compare-and-swap version, 0 if the key is missing
+    /// The version changes with every write of the key, even one that stores the same value again
+    /// Hits and misses are counted like get()'s
+    std::pair<bool, std::string> get_versioned(const std::string& key, uint64_t& version) {
+        version = 0;
+        if (key.empty()) {
+            return {false, ""};
+        }
+        std::vector<uint64_t> versions;
+        auto results = get_many_versioned({key}, versions);
+        version = versions[0];
+        return std::move(results[0]);
+    }
+
+    enum class CasResult { Stored, Exists, NotFound };
+
+    /// Compare-and-swap: stores the pair like put_with_ttl() if the key's version is still `version`
+    /// A negative TTL removes the key instead, as if the new value expired at once
+    /// new_version, when given, gets the version of the stored value
+    CasResult compare_and_put(const std::string& key, const std::string& value, uint64_t version,
+                              long long milliseconds, uint64_t* new_version = nullptr) {
+        if (key.empty()) {
+            return CasResult::NotFound;
+        }
+        expireIfDue(key);
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (!lookupLocked(key).first) {
+            return CasResult::NotFound;
+        }
+        if (versionLocked(key) != version) {
+            return CasResult::Exists;
+        }
+        if (milliseconds < 0) {
+            removeLocked(key);
+            return CasResult::Stored;
+        }
+        storeLocked(key, value, milliseconds);
+        if (new_version) {
+            *new_version = versionLocked(key);
+        }
+        return CasResult::Stored;
+    }
+
+    /// Batched PUT, all pairs are written to the database in one transaction
+    /// Pairs with empty keys are skipped
+    void put_many(const std::vector<std::pair<std::string, std::string>>& pairs) {
+        std::vector<std::pair<std::string, std::string>> valid;
+        valid.reserve(pairs.size());
+        for (const auto& pair : pairs) {
+            if (!pair.first.empty()) {
+                valid.push_back(pair);
+            }
+        }
+        if (valid.empty()) {
+            return;
+        }
+
+        MultiKeyLock locks(*this, valid, [](const auto& pair) -> const std::string& { return pair.first; });
+        db.put_many_to_db(valid);
+        for (const auto& [key, value] : valid) {
+            clearExpiry(key);
+            insertToCache(key, value);
+            bumpEpoch(key);
+            notifyChange(key, ChangeOp::Put);
+        }
+    }
+
+    /// Batched GET, cache hits are served under one read lock and all misses
+    /// are fetched from the database with a single query
+    /// @returns one (found, value) pair per requested key, in request order
+    std::vector<std::pair<bool, std::string>> get_many(const std::vector<std::string>& keys) {
+        std::vector<bool> expired(keys.size(), false);
+        for (size_t i = 0; i < keys.size(); i++) {
+            expired[i] = expireIfDue(keys[i]);
+        }
+
+        return lookupMany(keys, expired, false);
+    }
+
+    /// get_many() that also returns each key's compare-and-swap version, 0 for missing keys
+    /// Every key's lock is held for the whole lookup, so each version belongs to the value returned
+    std::vector<std::pair<bool, std::string>> get_many_versioned(const std::vector<std::string>& keys,
+                                                                 std::vector<uint64_t>& versions) {
+        std::vector<bool> expired(keys.size(), false);
+        for (size_t i = 0; i < keys.size(); i++) {
+            expired[i] = expireIfDue(keys[i]);
+        }
+
+        MultiKeyLock locks(*this, keys, [](const std::string& key) -> const std::string& { return key; });
+        auto results = lookupMany(keys, expired, true);
+        versions.assign(keys.size(), 0);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (results[i].first) {
+                versions[i] = versionLocked(keys[i]);
+            }
+        }
+        return results;
     }
     
+    /// Streaming PUT for values too big to build in memory, see SQLiteDB::put_stream_to_db
+    /// The value is written straight to the database and not cached; a cached older value is dropped.
+    /// Overwriting a key clears its TTL
+    /// @returns true if the value was written
+    bool put_stream(const std::string& key, size_t size, const std::function<bool(char*, size_t)>& fill) {
+        if (key.empty()) {
+            return false;
+        }
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (!db.put_stream_to_db(key, size, fill)) {
+            return false;
+        }
+        clearExpiry(key);
+        dropCachedLocked(key);
+        bumpEpoch(key);
+        notifyChange(key, ChangeOp::Put);
+        return true;
+    }
+
+    /// Streaming GET, passes the value to sink(data, length) in pieces, see SQLiteDB::get_stream_from_db
+    /// Reads the database directly and doesn't fill the cache
+    /// @returns true if the key was found and the whole value was delivered
+    bool get_stream(const std::string& key, const std::function<bool(const char*, size_t)>& sink) {
+        if (expireIfDue(key)) {
+            return false;
+        }
+        if (!db.get_stream_from_db(key, sink)) {
+            return false;
+        }
+        recordRead(key);
+        return true;
+    }
+
     /// DELETE method for removing a key-value pair from cache and DB
     /// @returns true if remove successful, false otherwise
     bool remove(const std::string& key) {
-        bool removed_from_db = db.remove_from_db(key); // remove from DB
-        bool removed_from_cache = false;
-        
-        // Remove from cache
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        return removeLocked(key);
+    }
+
+    /// Atomic read-modify-write of a single key
+    /// fn(found, current, updated) is called under the key lock and returns true to store `updated`
+    /// The key's TTL is kept, like redis INCR
+    /// new_version, when given, gets the compare-and-swap version of the stored value
+    /// @returns true if a new value was stored
+    template <typename F>
+    bool update(const std::string& key, F&& fn, uint64_t* new_version = nullptr) {
+        if (key.empty()) {
+            return false;
+        }
+        expireIfDue(key);
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+
+        auto value_opt = lookupLocked(key);
+        std::string updated;
+        if (!fn(value_opt.first, static_cast<const std::string&>(value_opt.second), updated)) {
+            return false;
+        }
+        db.put_to_db(key, updated);
+        insertToCache(key, updated);
+        bumpEpoch(key);
+        notifyChange(key, ChangeOp::Put);
+        if (new_version) {
+            *new_version = versionLocked(key);
+        }
+        return true;
+    }
+
+    /// Atomically adds delta to an integer value, missing keys count as 0
+    /// @returns (true, new value), or (false, 0) if the value is not an integer or would overflow
+    std::pair<bool, long long> incr(const std::string& key, long long delta = 1) {
+        long long result = 0;
+        bool stored = update(key, [&](bool found, const std::string& current, std::string& updated) {
+            long long number = 0;
+            if (found && !parseInteger(current, number)) {
+                return false;
+            }
+            if (__builtin_add_overflow(number, delta, &result)) {
+                return false;
+            }
+            updated = std::to_string(result);
+            return true;
+        });
+        return stored ? std::make_pair(true, result) : std::make_pair(false, 0LL);
+    }
+
+    /// Sets a time to live on an existing key, a non-positive TTL deletes it
+    /// @returns true if the key exists
+    bool expire(const std::string& key, long long seconds) {
+        return expire_ms(key, seconds > LLONG_MAX / 1000 ? LLONG_MAX : seconds * 1000);
+    }
+
+    bool expire_ms(const std::string& key, long long milliseconds) {
+        if (expireIfDue(key)) {
+            return false;
+        }
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (!lookupLocked(key).first) {
+            return false;
+        }
+        if (milliseconds <= 0) {
+            removeLocked(key);
+            return true;
+        }
+
+        int64_t now = nowMillis();
+        setDeadlineLocked(key, milliseconds > INT64_MAX - now ? INT64_MAX : now + milliseconds);
+        return true;
+    }
+
+    /// Remaining time to live in milliseconds, like Redis PTTL
+    /// @returns -1 if the key has no TTL, -2 if it doesn't exist
+    long long ttl_ms(const std::string& key) {
+        if (expireIfDue(key)) {
+            return -2;
+        }
+        std::lock_guard<StripeLock> key_lock(lockFor(key));
+        if (!lookupLocked(key).first) {
+            return -2;
+        }
+        int64_t deadline = db.get_expiry(key); // kept for every mode, other processes' TTLs included
+        return deadline == 0 ? -1 : std::max<long long>(deadline - nowMillis(), 1);
+    }
+
+    /// Runs one poll of the followed database (CacheConfig::follow_db_path) instead of waiting for
+    /// the follower thread
+    /// @returns true if every change the source had logged is applied
+    bool catch_up() {
+        if (!source) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(replication_mutex);
+        return pollSourceLocked();
+    }
+
+    /// Drops what other processes changed in the database since the last check, instead of
+    /// waiting for the invalidation thread (CacheConfig::invalidate_interval_ms)
+    /// @returns false if invalidation is off
+    bool sync_invalidations() {
+        if (invalidated_seq.empty()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(invalidation_mutex);
+        pollInvalidationsLocked();
+        return true;
+    }
+
+    /// True if the cache follows another database, clients should not write to it then
+    bool is_follower() const { return source != nullptr; }
+
+    /// Calls callback(events, missed) on a dispatcher thread with batches of the puts, removes and
+    /// TTL changes of key, or of every key starting with it if prefix is set, made through this cache
+    /// from now on (a follower's replicated changes included). Callbacks may read the cache; missed
+    /// means changes were dropped before the dispatcher got to them. Needs CacheConfig::watch_buffer_events.
+    /// Writes of other processes sharing the database are seen with CacheConfig::invalidate_interval_ms only.
+    /// @returns the id for unwatch(), 0 if watching is off
+    uint64_t watch(const std::string& key, ChangeFeed::Callback callback, bool prefix = false) {
+        return feed ? feed->watch(key, std::move(callback), prefix) : 0;
+    }
+
+    bool unwatch(uint64_t id) {
+        return feed && feed->unwatch(id);
+    }
+
+    /// Cursor of the latest change, for a consumer that starts reading changes now
+    uint64_t change_cursor() const {
+        return feed ? feed->cursor() : 0;
+    }
+
+    /// Pull-based alternative to watch(): changes after cursor, at most limit of them scanned and
+    /// those of keys starting with prefix returned. Pass page.next on the next call. The last
+    /// watch_buffer_events changes are kept; page.missed tells a consumer that fell further behind to
+    /// re-read what it needs, e.g. with scan().
+    ChangePage read_changes(uint64_t cursor, size_t limit = 1000, const std::string& prefix = "") const {
+        return feed ? feed->read(cursor, limit, prefix) : ChangePage{{}, cursor, false};
+    }
+
+    /// Cursor based iteration over all stored keys (not only the cached ones)
+    /// Start with cursor 0, iteration is complete when the returned cursor is 0
+    /// @param pattern optional glob pattern keys must match
+    std::pair<uint64_t, std::vector<std::string>> scan(uint64_t cursor, size_t count, const std::string& pattern = "") {
+        auto result = db.scan_db(cursor, count, pattern);
+        auto& keys = result.second;
+        keys.erase(std::remove_if(keys.begin(), keys.end(),
+                                  [this](const std::string& key) { return isExpired(key); }),
+                   keys.end());
+        return result;
+    }
+
+    /// Writes the resident entries, oldest first, to a snapshot file (see cache_snapshot.hpp)
+    /// Writers are blocked while the snapshot is taken so it matches the database state it records
+    /// Not available in shared mode, where the segment already outlives the processes using it
+    /// @returns true if the snapshot was written
+    bool save_snapshot(const std::string& path) {
+        if (shared) {
+            return false;
+        }
+        snapshot::Writer writer(path);
+        if (!writer.isOpen()) {
+            return false;
+        }
+
+        for (auto& stripe : key_locks) {
+            stripe.lock();
+        }
+        snapshot::DbFingerprint fingerprint = dbFingerprint();
         {
-            std::unique_lock<std::shared_mutex> cache_lock(cache_mutex); // write lock
-            auto it = cache.find(key);
-            if (it != cache.end()) {
-                current_size -= (it->first.size() + it->second.size()); 
-                cache.erase(it); // remove from cache
-                removed_from_cache = true; 
+            std::shared_lock<std::shared_mutex> cache_lock(cache_mutex);
+            if (greedyDual()) {
+                // cheapest first, so the most valuable entries are kept if not everything fits
+                std::vector<const CostSlot*> order;
+                order.reserve(cost_heap.size());
+                for (const CostSlot& slot : cost_heap.slots()) {
+                    order.push_back(&slot);
+                }
+                std::sort(order.begin(), order.end(),
+                          [](const CostSlot* a, const CostSlot* b) { return a->priority < b->priority; });
+                for (const CostSlot* slot : order) {
+                    auto it = cache.find(slot->key);
+                    if (it != cache.end() && it->second.priority == slot->priority && !isExpired(it->first)) {
+                        writer.add(it->first, it->second.value);
+                    }
+                }
+            }
+            // with the adaptive policy the frequency clock goes last, so it is kept if not everything fits
+            for (Segment segment : {Segment::Recent, Segment::Frequent}) {
+                KeyQueue order = segment == Segment::Recent ? queue : frequent;
+                while (!order.empty()) {
+                    if (!staleLocked(order.front()) && !isExpired(order.front().key)) {
+                        auto it = cache.find(order.front().key);
+                        writer.add(it->first, it->second.value);
+                    }
+                    order.pop();
+                }
+            }
+        }
+        for (auto it = key_locks.rbegin(); it != key_locks.rend(); ++it) {
+            it->unlock();
+        }
+        return writer.finish(fingerprint);
+    }
+
+    /// Copies the database to `path` while the cache keeps serving reads and writes
+    /// See SQLiteDB::backup_to, on_progress gets (remaining pages, total pages)
+    /// @returns true once the copy is complete
+    bool backup(const std::string& path, const std::function<void(int, int)>& on_progress = nullptr,
+                int pages_per_step = 256) {
+        return db.backup_to(path, pages_per_step, on_progress);
+    }
+
+    /// Exports all unexpired pairs to a text file that kv_bulk_load can load
+    /// Works on an online backup (path + ".db", removed afterwards), so writers are not blocked while
+    /// `threads` connections export it in parallel chunks. Partitions are exported one after the
+    /// other and appended to the file.
+    backup::ExportResult export_to(const std::string& path, size_t threads = std::thread::hardware_concurrency()) {
+        std::string copy_path = path + ".db";
+        if (!backup(copy_path)) {
+            return {};
+        }
+        size_t count = db.partitions();
+        backup::ExportResult result;
+        result.ok = true;
+        FILE* out = nullptr;
+        for (size_t i = 0; i < count; i++) {
+            std::string copy = PartitionedDB::partitionPath(copy_path, i, count);
+            std::string part_path = count == 1 ? path : path + ".part";
+            backup::ExportResult part = result.ok ? backup::exportDatabase(copy, part_path, threads)
+                                                  : backup::ExportResult{};
+            std::remove(copy.c_str());
+            ValueLog::removeFiles(copy + ".vlog.");
+            if (count == 1) {
+                return part;
             }
-            
-            // extract all elements to a vector first
-            std::vector<std::string> queue_elements;
-            while (!queue.empty()) {
-                queue_elements.push_back(queue.front());
-                queue.pop();
+            if (!part.ok) {
+                result.ok = false;
+                continue;
             }
-            
-            // rebuild queue excluding the removed key
-            for (const auto& elem : queue_elements) {
-                if (elem != key) {
-                    queue.push(elem);
+            // the parts are appended to path + ".tmp", which is renamed into place at the end
+            if (!out && !(out = std::fopen((path + ".tmp").c_str(), "wb"))) {
+                result.ok = false;
+            }
+            FILE* in = result.ok ? std::fopen(part_path.c_str(), "rb") : nullptr;
+            if (in) {
+                std::vector<char> buffer(1 << 20);
+                size_t read;
+                while (result.ok && (read = std::fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+                    result.ok = std::fwrite(buffer.data(), 1, read, out) == read;
                 }
+                std::fclose(in);
+            } else {
+                result.ok = false;
             }
+            std::remove(part_path.c_str());
+            result.rows += part.rows;
+            result.bytes += part.bytes;
+            result.seconds += part.seconds;
         }
-        
-        return removed_from_db || removed_from_cache; // a record can only be in db (not in cache) or both 
+        if (out) {
+            result.ok = std::fclose(out) == 0 && result.ok;
+        }
+        if (!result.ok || std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+            std::cerr << "Cannot write " << path << std::endl;
+            std::remove((path + ".tmp").c_str());
+            return {};
+        }
+        return result;
+    }
+
+    /// Loads a snapshot written by save_snapshot, keeping its FIFO order
+    /// Entries already cached win over the snapshot. If the snapshot holds more than fits, the
+    /// newest entries are kept. Meant for startup, before the cache serves requests.
+    /// @returns false if there is no usable snapshot, e.g. the database changed since it was taken
+    bool load_snapshot(const std::string& path) {
+        if (shared) {
+            return false;
+        }
+        // decoded with the default resource, so in the default configuration the strings move into the cache
+        std::vector<std::pair<CacheString, CacheString>> entries;
+        if (!snapshot::read(path, dbFingerprint(), std::thread::hardware_concurrency(), entries)) {
+            return false;
+        }
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [this](const auto& entry) { return isExpired(entry.first); }),
+                      entries.end());
+
+        std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+        size_t available = MAX_SIZE > usedLocked() ? MAX_SIZE - usedLocked() : 0;
+        size_t first = entries.size();
+        size_t total = 0;
+        while (first > 0) {
+            size_t size = chargeOf(entries[first - 1].first.size(), entries[first - 1].second.size());
+            if (total + size > available) {
+                break;
+            }
+            total += size;
+            first--;
+        }
+
+        cache.reserve(cache.size() + entries.size() - first);
+        for (size_t i = first; i < entries.size(); i++) {
+            auto& [key, value] = entries[i];
+            auto [it, inserted] = cache.emplace(key, std::move(value));
+            if (inserted) {
+                linkLocked(it, Segment::Recent, -1, &key);
+            }
+        }
+        trimLocked();
+        return true;
+    }
+
+    /// Streams up to max_rows rows into the cache on a background thread, highest ranked first
+    /// (see WarmupOrder). Rows already cached are skipped and nothing is evicted: the warm-up stops
+    /// once the next row doesn't fit. on_progress is called from the warm-up thread after every
+    /// batch and once more with done set.
+    /// @returns false if a warm-up is still running
+    bool start_warmup(size_t max_rows, WarmupOrder order = WarmupOrder::RecentlyWritten,
+                      std::function<void(const WarmupProgress&)> on_progress = nullptr) {
+        if (warmup_thread.joinable()) {
+            if (!warmup_done.load()) {
+                return false;
+            }
+            warmup_thread.join();
+        }
+        warmup_cancel = false;
+        warmup_done = false;
+        warmup_rows_loaded = 0;
+        warmup_bytes_loaded = 0;
+        warmup_target = max_rows;
+        warmup_thread = std::thread(&FIFOCache::runWarmup, this, max_rows, order, std::move(on_progress));
+        return true;
+    }
+
+    WarmupProgress warmup_progress() const {
+        WarmupProgress progress;
+        progress.rows_loaded = warmup_rows_loaded.load();
+        progress.bytes_loaded = warmup_bytes_loaded.load();
+        progress.target_rows = warmup_target.load();
+        progress.done = warmup_done.load();
+        return progress;
+    }
+
+    /// Blocks until the current warm-up, if any, has finished
+    void wait_for_warmup() {
+        if (warmup_thread.joinable()) {
+            warmup_thread.join();
+        }
+    }
+
+    /// Writes the read counts gathered so far to the database, they are otherwise written in batches
+    void flush_read_stats() {
+        flushReads();
+    }
+
+    /// Collects value log garbage now instead of waiting for the background collector
+    /// @returns the number of segments dropped
+    size_t collect_value_log_garbage(double garbage_ratio = -1) {
+        return db.collect_value_log_garbage(garbage_ratio);
+    }
+
+    CacheStats stats() const {
+        CacheStats result;
+        ValueLogStats log_stats = db.value_log_stats();
+        result.value_log_bytes = log_stats.bytes;
+        result.value_log_garbage_bytes = log_stats.garbage_bytes;
+        result.hits = hits.load();
+        result.misses = misses.load();
+        result.hit_bytes = hit_bytes.load();
+        result.miss_bytes = miss_bytes.load();
+        result.fetch_micros = fetch_ns.load() / 1000;
+        uint64_t saved_ns = saved_fetch_ns.load();
+        if (shared) {
+            result.evictions = shared->evictions();
+            result.entries = shared->entries();
+            result.current_size = shared->currentSize();
+            result.max_size = shared->maxSize();
+            result.saved_fetch_micros = saved_ns / 1000;
+            return result;
+        }
+        std::shared_lock<std::shared_mutex> cache_lock(cache_mutex);
+        result.evictions = evictions;
+        result.background_evictions = background_evictions;
+        result.inline_evictions = evictions - background_evictions;
+        result.max_inline_evict_loop = max_inline_evict_loop;
+        result.recency_bytes = recent_bytes;
+        result.frequency_bytes = frequent_bytes;
+        result.recency_target = recent_target;
+        result.ghost_hits = ghost_hits;
+        result.entries = cache.size();
+        result.current_size = usedLocked();
+        result.max_size = MAX_SIZE;
+        result.huge_page_bytes = huge_memory ? huge_memory->bytesMapped() : 0;
+        if (large) {
+            result.large_entries = large->entries();
+            result.large_bytes = large->bytes();
+            result.large_evictions = large->evictions();
+        }
+        if (flash) {
+            FlashCache::Stats flash_stats = flash->stats();
+            result.flash_entries = flash_stats.entries;
+            result.flash_hits = flash_stats.hits;
+            result.flash_bytes_written = flash_stats.bytes_written;
+            result.flash_dropped = flash_stats.dropped;
+        }
+        if (victims) {
+            VictimCache::Stats victim_stats = victims->stats();
+            result.victim_entries = victim_stats.entries;
+            result.victim_bytes = victim_stats.bytes;
+            result.victim_raw_bytes = victim_stats.raw_bytes;
+            result.victim_hits = victim_stats.hits;
+        }
+        if (source) {
+            result.replication_applied_seq = std::max<int64_t>(0, applied_seq.load());
+            result.replication_source_seq = source_seq.load();
+            result.replication_lag_ms = lag_ms.load();
+        }
+        result.invalidated_keys = invalidated_keys.load();
+        result.invalidation_resets = invalidation_resets.load();
+        std::lock_guard<std::mutex> lock(l0_mutex);
+        for (const auto& table : l0_tables) {
+            result.l0_hits += table->hits.load(std::memory_order_relaxed);
+            result.hit_bytes += table->hit_bytes.load(std::memory_order_relaxed);
+            saved_ns += table->saved_fetch_ns.load(std::memory_order_relaxed);
+        }
+        result.hits += result.l0_hits;
+        result.saved_fetch_micros = saved_ns / 1000;
+        return result;
     }
     
     /// Helper method for GET and PUT
     /// Inserts new records to cache
-    /// If cache is full, evicts oldest element then inserts new
-    void insertToCache(const std::string& key, const std::string& value) {
-        std::unique_lock<std::shared_mutex> cache_lock(cache_mutex); // write lock
-        
-        size_t value_size = key.size() + value.size();
-        if(value_size > MAX_SIZE){
-            return; // can not cache 
+    /// If cache is full, evicts oldest element then inserts new (with the evictor running this only
+    /// happens when it falls behind)
+    /// fetch_us is how long reading the value from the DB took, < 0 if it was written instead
+    void insertToCache(const std::string& key, const std::string& value, float fetch_us = -1) {
+        if (shared) {
+            shared->insert(key, value);
+            return;
+        }
+        if (isLarge(key.size(), value.size())) {
+            {
+                std::unique_lock<std::shared_mutex> cache_lock(cache_mutex);
+                auto stale = cache.find(probe(key));
+                if (stale != cache.end()) {
+                    unlinkLocked(stale); // the value grew out of the small-entry cache
+                }
+                forgetDemotedLocked(key);
+            }
+            large->insert(key, value, fetch_us < 0 ? static_cast<float>(average_fetch_us.load()) : fetch_us);
+            return;
         }
+        if (large) {
+            large->erase(key); // the value shrank, it moves to the small-entry cache
+        }
+        std::unique_lock<std::shared_mutex> cache_lock(cache_mutex); // write lock
 
-        // if key exists
-        auto it = cache.find(key);
-        if(it != cache.end()){
-            current_size -= (it->first.size() + it->second.size()); 
+        size_t charge = chargeOf(key.size(), value.size());
+        if(charge > MAX_SIZE){
+            // can not cache, drop the old value so it isn't served instead (its queue slot goes stale)
+            auto stale = cache.find(probe(key));
+            if (stale != cache.end()) {
+                unlinkLocked(stale);
+            }
+            forgetDemotedLocked(key);
+            return;
         }
 
-        // evict until cache have enough space
-        while (current_size + value_size > MAX_SIZE && !queue.empty()) {
-            std::string oldest = queue.front();
-            queue.pop();
+        // if key exists, its old value's bytes are reused
+        auto it = cache.find(probe(key));
+        size_t old_charge = it != cache.end() ? chargeOf(it->first.size(), it->second.value.size()) : 0;
+        Segment segment = it == cache.end() ? adaptLocked(key) : Segment::Recent;
 
-            //check if oldest exists (to prevent seg. fault if another thread deletes it in the meantime)
-            auto oldest_it = cache.find(oldest);
-            if(oldest_it != cache.end()){
-                current_size -= (oldest.size() + cache[oldest].size());
-                cache.erase(oldest);
+        // evict until cache have enough space
+        uint64_t evicted = 0;
+        while (usedLocked() + charge > MAX_SIZE + old_charge && canEvictLocked()) {
+            if (evictOneLocked()) {
+                evicted++;
+                if (old_charge > 0 && cache.find(probe(key)) == cache.end()) {
+                    old_charge = 0; // the key itself was evicted, with its old value
+                }
             }
         }
+        forgetDemotedLocked(key); // after the loop, which may have demoted the old value
         
         // add new entry to queue and cache
-        if (cache.find(key) == cache.end()) {
-            queue.push(key);
+        it = cache.find(probe(key));
+        if (it == cache.end()) {
+            linkLocked(cache.emplace(key, value).first, segment, fetch_us);
+        } else {
+            CacheEntry& entry = it->second;
+            current_size -= entry.value.size();
+            segmentBytes(entry.segment) -= chargeOf(key.size(), entry.value.size());
+            entry.value.assign(value.data(), value.size());
+            current_size += value.size();
+            segmentBytes(entry.segment) += charge;
+            if (fetch_us >= 0) {
+                entry.fetch_us = fetch_us;
+            }
+            noteRead(entry);
+            if (greedyDual()) {
+                priceLocked(it); // the old slot goes stale
+            }
         }
-        cache[key] = value;
-        current_size += value_size;
+        evicted += trimLocked(); // with bound_memory, in case the entry or the containers grew more than expected
+        max_inline_evict_loop = std::max(max_inline_evict_loop, evicted);
+        size_t size_after_insert = usedLocked();
+        cache_lock.unlock();
+        requestHeadroom(size_after_insert);
     }
-
     void displayCache() {
+        if (shared) {
+            std::cout << "--- Shared Cache State ---" << std::endl;
+            std::cout << "Entries: " << shared->entries() << std::endl;
+            std::cout << "Current Size: " << shared->currentSize() << " bytes" << std::endl << std::endl;
+            return;
+        }
         std::shared_lock<std::shared_mutex> cache_lock(cache_mutex);
         
         std::cout << "--- Cache State ---" << std::endl;
@@ -141,14 +2709,16 @@ public:
         std::cout << "Current Size: " << current_size << " bytes" << std::endl;
         std::cout << "Cache Contents:" << std::endl;
         
-        for (const auto& [key, value] : cache) {
-            std::cout << "  " << key << " -> " << value << std::endl;
+        for (const auto& [key, entry] : cache) {
+            std::cout << "  " << key << " -> " << entry.value << std::endl;
         }
         
         std::cout << "FIFO Queue Order: ";
-        std::queue<std::string> temp_queue = queue;
+        KeyQueue temp_queue = queue;
         while (!temp_queue.empty()) {
-            std::cout << temp_queue.front() << " ";
+            if (!staleLocked(temp_queue.front())) {
+                std::cout << temp_queue.front().key << " ";
+            }
             temp_queue.pop();
         }
         std::cout << std::endl << std::endl;
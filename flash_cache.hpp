@@ -0,0 +1,292 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// Second cache level on local flash, between FIFOCache's memory and the database (see
+/// CacheConfig::flash_path). Entries evicted from memory are appended here and looked up before a
+/// database read.
+///
+/// The file is cut into regions of region_size bytes. Entries are packed into an in-memory region
+/// buffer (u32 key length, u32 value length, key, value); a full buffer is handed to a writer thread
+/// that writes it with one aligned pwrite. With direct_io the file bypasses the page cache (O_DIRECT,
+/// where the file system supports it) and reads go through an aligned bounce buffer. Regions
+/// are reused in FIFO order: reusing one drops every index entry that points into it. The index keeps
+/// 16 bytes of location per key hash; the stored key is compared on read, so a hash collision is a miss.
+/// Inserts never wait for the disk: while the writer is still busy with the previous region, entries
+/// that don't fit the active buffer are dropped. The index lives in memory only, the file starts out
+/// empty after every restart.
+class FlashCache {
+public:
+    static constexpr size_t ALIGNMENT = 4096;
+    static constexpr size_t RECORD_HEADER = 2 * sizeof(uint32_t);
+
+    struct Stats {
+        size_t entries = 0;
+        uint64_t hits = 0;
+        uint64_t bytes_written = 0; // region writes
+        uint64_t dropped = 0;       // inserts dropped while the writer was busy, or too large for a region
+    };
+
+private:
+    struct Location {
+        uint32_t region;
+        uint32_t offset; // of the record in its region
+        uint32_t length; // of the record
+        uint32_t generation; // of the region when the record was written
+    };
+
+    struct Region {
+        uint32_t generation = 0;
+        std::vector<uint64_t> hashes; // of the records written to it, checked when it is reused
+        char* buffer = nullptr;       // while the region is filled or written, else its records are on disk
+        bool on_disk = false;
+    };
+
+    struct AlignedFree {
+        void operator()(char* buffer) const { std::free(buffer); }
+    };
+    using AlignedBuffer = std::unique_ptr<char, AlignedFree>;
+
+    const size_t region_size;
+    int fd = -1;
+    bool direct = false;
+    std::vector<Region> regions;
+    std::unordered_map<uint64_t, Location> index;
+    AlignedBuffer buffers[2];   // the active region's buffer and the one being written
+    uint32_t active = 0;        // region being filled
+    uint32_t fill = 0;          // bytes used in the active buffer
+    int active_buffer = 0;
+    int writing = -1;           // region the writer is writing, -1 if idle
+    uint64_t hits = 0, bytes_written = 0, dropped = 0;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread writer;
+    bool stop = false;
+
+    static AlignedBuffer allocate(size_t size) {
+        return AlignedBuffer(static_cast<char*>(std::aligned_alloc(ALIGNMENT, size)));
+    }
+
+    /// Reads `length` bytes at `offset` of the file, through an aligned bounce buffer with O_DIRECT
+    bool readFile(uint64_t offset, size_t length, std::string& out) const {
+        uint64_t start = direct ? offset & ~uint64_t(ALIGNMENT - 1) : offset;
+        size_t span = direct ? (offset + length - start + ALIGNMENT - 1) & ~(ALIGNMENT - 1) : length;
+        AlignedBuffer bounce = allocate(span);
+        size_t done = 0;
+        while (done < span) {
+            ssize_t n = pread(fd, bounce.get() + done, span - done, static_cast<off_t>(start + done));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        out.assign(bounce.get() + (offset - start), length);
+        return true;
+    }
+
+    /// Moves the index off a region that is about to be refilled, caller must hold mutex
+    void recycleLocked(uint32_t id) {
+        Region& region = regions[id];
+        for (uint64_t hash : region.hashes) {
+            auto it = index.find(hash);
+            if (it != index.end() && it->second.region == id && it->second.generation == region.generation) {
+                index.erase(it);
+            }
+        }
+        region.hashes.clear();
+        region.generation++;
+        region.on_disk = false;
+    }
+
+    /// Hands the full active buffer to the writer and starts the next region, caller must hold mutex
+    /// @returns false if the writer is still busy with the previous region
+    bool sealLocked() {
+        if (writing >= 0) {
+            return false;
+        }
+        std::memset(buffers[active_buffer].get() + fill, 0, region_size - fill);
+        writing = static_cast<int>(active);
+        active_buffer ^= 1;
+        active = static_cast<uint32_t>((active + 1) % regions.size());
+        fill = 0;
+        recycleLocked(active);
+        regions[active].buffer = buffers[active_buffer].get();
+        wake.notify_one();
+        return true;
+    }
+
+    void runWriter() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this]() { return stop || writing >= 0; });
+            if (writing < 0) {
+                return;
+            }
+            uint32_t id = static_cast<uint32_t>(writing);
+            const char* buffer = regions[id].buffer;
+            lock.unlock();
+            size_t done = 0;
+            while (done < region_size) {
+                ssize_t n = pwrite(fd, buffer + done, region_size - done, static_cast<off_t>(id * region_size + done));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+            lock.lock();
+            if (done < region_size) {
+                std::cerr << "Cannot write flash cache region " << id << ": " << std::strerror(errno) << std::endl;
+                recycleLocked(id);
+            } else {
+                regions[id].on_disk = true;
+                bytes_written += region_size;
+            }
+            regions[id].buffer = nullptr;
+            writing = -1;
+        }
+    }
+
+public:
+    /// @param size bytes of flash to use, rounded down to whole regions (at least two)
+    /// @param direct_io keeps the file out of the page cache, for caches larger than spare memory
+    FlashCache(const std::string& path, size_t size, size_t region_size = 1 << 20, bool direct_io = false)
+        : region_size(std::max(ALIGNMENT, region_size & ~(ALIGNMENT - 1))) {
+        size_t count = std::max<size_t>(2, size / this->region_size);
+        if (direct_io) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+        if (fd < 0) {
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644); // e.g. tmpfs has no O_DIRECT
+        }
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(count * this->region_size)) != 0) {
+            std::cerr << "Cannot open flash cache " << path << ": " << std::strerror(errno) << std::endl;
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            return;
+        }
+        regions.resize(count);
+        buffers[0] = allocate(this->region_size);
+        buffers[1] = allocate(this->region_size);
+        regions[0].buffer = buffers[0].get();
+        writer = std::thread(&FlashCache::runWriter, this);
+    }
+
+    ~FlashCache() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake.notify_one();
+            writer.join();
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    FlashCache(const FlashCache&) = delete;
+    FlashCache& operator=(const FlashCache&) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    /// Copies an entry into the active region, never waits for the disk
+    void insert(std::string_view key, uint64_t hash, std::string_view value) {
+        size_t size = RECORD_HEADER + key.size() + value.size();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) {
+            return;
+        }
+        if (size > region_size || (fill + size > region_size && !sealLocked())) {
+            dropped++;
+            return;
+        }
+        char* record = buffers[active_buffer].get() + fill;
+        uint32_t header[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+        std::memcpy(record, header, sizeof(header));
+        std::memcpy(record + sizeof(header), key.data(), key.size());
+        std::memcpy(record + sizeof(header) + key.size(), value.data(), value.size());
+        index[hash] = Location{active, fill, static_cast<uint32_t>(size), regions[active].generation};
+        regions[active].hashes.push_back(hash);
+        fill += static_cast<uint32_t>(size);
+    }
+
+    /// Copies key's value to out
+    /// @returns true on a hit; false on a miss, including a record lost to region reuse during the read
+    bool lookup(const std::string& key, uint64_t hash, std::string& out) {
+        std::string record;
+        Location location;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(hash);
+            if (it == index.end()) {
+                return false;
+            }
+            location = it->second;
+            const Region& region = regions[location.region];
+            if (region.buffer) {
+                record.assign(region.buffer + location.offset, location.length); // not on disk yet
+            } else if (!region.on_disk) {
+                return false;
+            }
+        }
+        if (record.empty() &&
+            !readFile(static_cast<uint64_t>(location.region) * region_size + location.offset, location.length, record)) {
+            return false;
+        }
+        uint32_t header[2];
+        std::memcpy(header, record.data(), sizeof(header));
+        if (header[0] != key.size() || RECORD_HEADER + header[0] + header[1] != record.size() ||
+            std::memcmp(record.data() + RECORD_HEADER, key.data(), key.size()) != 0) {
+            return false; // another key with the same hash
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (regions[location.region].generation != location.generation) {
+            return false; // the region was reused while it was read
+        }
+        out.assign(record, RECORD_HEADER + header[0], header[1]);
+        hits++;
+        return true;
+    }
+
+    /// Forgets key, its record stays in its region until the region is reused
+    void erase(uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.erase(hash);
+    }
+
+    /// Forgets every key, the regions are reused as usual
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Stats{index.size(), hits, bytes_written, dropped};
+    }
+};
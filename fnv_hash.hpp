@@ -0,0 +1,27 @@
+#pragma once
+#include <string_view>
+#include <cstdint>
+
+/// 64-bit FNV-1a, the one hash for anything several processes or clients must agree on
+///
+/// Unlike std::hash it is identical in every process and build, so shared memory buckets, key
+/// lock stripes, database partitions and router ring points computed by different processes
+/// match. Changing it moves keys that are already placed.
+namespace fnv {
+
+inline uint64_t hash(std::string_view data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/// hash() with its bits spread, for placement by the high bits: FNV leaves those skewed for
+/// short, similar keys
+inline uint64_t mixed(std::string_view data) {
+    return hash(data) * 0x9E3779B97F4A7C15ULL;
+}
+
+} // namespace fnv
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "bulk_loader.hpp"
+
+// Loads key/value pairs into a cache database, one "key TAB value" line per pair (see
+// BulkLoader::parseLine for escapes), reading standard input when no file or "-" is given
+// Usage: kv_bulk_load --db PATH [--sorted] [--threads N] [--memory-mb N] [--batch-rows N] [--temp-dir DIR] [INPUT]
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " --db PATH [--sorted] [--threads N] [--memory-mb N] [--batch-rows N] [--temp-dir DIR] [INPUT]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    BulkLoadConfig config;
+    std::string input = "-";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sorted") {
+            config.input_sorted = true;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            input = arg;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--db") config.db_path = value;
+            else if (arg == "--threads") config.threads = std::stoul(value);
+            else if (arg == "--memory-mb") config.memory_bytes = std::stoull(value) << 20;
+            else if (arg == "--batch-rows") config.rows_per_transaction = std::max<size_t>(1, std::stoull(value));
+            else if (arg == "--temp-dir") config.temp_dir = value;
+            else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    std::ifstream file;
+    if (input != "-") {
+        file.open(input);
+        if (!file) {
+            std::cerr << "Cannot open " << input << std::endl;
+            return 1;
+        }
+    }
+    std::istream& in = input == "-" ? std::cin : file;
+    std::ios::sync_with_stdio(false);
+
+    BulkLoader loader(config);
+    std::string line, key, value;
+    uint64_t line_number = 0;
+    uint64_t rejected = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!BulkLoader::parseLine(line, key, value)) {
+            if (rejected++ < 10) {
+                std::cerr << "Skipping malformed line " << line_number << std::endl;
+            }
+            continue;
+        }
+        loader.add(std::move(key), std::move(value));
+    }
+
+    BulkLoadResult result = loader.finish();
+    if (!result.ok) {
+        std::cerr << "Bulk load failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Loaded " << result.rows << " rows (" << result.bytes << " bytes) from " << line_number
+              << " lines in " << result.total_seconds << " s" << std::endl;
+    std::cout << "  read and sort: " << result.sort_seconds << " s, " << result.runs << " runs spilled" << std::endl;
+    std::cout << "  throughput: " << static_cast<uint64_t>(result.rowsPerSecond()) << " rows/s, "
+              << result.megabytesPerSecond() << " MB/s" << std::endl;
+    if (rejected > 0) {
+        std::cout << "  skipped " << rejected << " malformed lines" << std::endl;
+    }
+    return 0;
+}
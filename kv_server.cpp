@@ -0,0 +1,227 @@
+#include <iostream>
+#include <string>
+#include <memory>
+#include <csignal>
+#include <pthread.h>
+#include "fifo_cache.hpp"
+#include "kv_server.hpp"
+#include "resp_handler.hpp"
+#include "memcached_handler.hpp"
+#include "shm_server.hpp"
+#ifdef KVS_HAVE_IO_URING
+#include "uring_server.hpp"
+#endif
+
+// Serves a FIFOCache over the RESP protocol, and optionally over the memcached protocol on a second port
+// and to same-host processes over shared memory
+// Usage: kv_server [--bind ADDR] [--port N] [--memcached-port N] [--shm NAME] [--threads N] [--db PATH]
+//                  [--max-bytes N] [--shared-cache NAME] [--snapshot PATH] [--warmup-rows N]
+//                  [--warmup-order written|reads|recent] [--backup PATH] [--huge-pages] [--numa-node N]
+//                  [--l0-entries N] [--evict-low-bytes N] [--evict-high-bytes N] [--bound-memory]
+//                  [--policy fifo|adaptive|greedy-dual] [--large-segment-bytes N] [--large-value-bytes N]
+//                  [--value-log-threshold N] [--value-log-segment-bytes N] [--flash-path PATH]
+//                  [--flash-bytes N] [--flash-direct-io] [--victim-bytes N] [--change-log-rows N]
+//                  [--follow PATH] [--db-partitions N] [--invalidate-ms N] [--io-uring]
+// With --backup, SIGUSR1 copies the database to PATH while the server keeps running
+// With --follow, the server replicates the database at PATH into --db and serves reads over RESP only
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--bind ADDR] [--port N] [--memcached-port N] [--shm NAME] [--threads N] [--db PATH] [--max-bytes N]"
+              << " [--shared-cache NAME] [--snapshot PATH] [--warmup-rows N] [--warmup-order written|reads|recent]"
+              << " [--backup PATH] [--huge-pages] [--numa-node N] [--l0-entries N]"
+              << " [--evict-low-bytes N] [--evict-high-bytes N] [--bound-memory] [--policy fifo|adaptive|greedy-dual]"
+              << " [--large-segment-bytes N] [--large-value-bytes N] [--value-log-threshold N] [--value-log-segment-bytes N]"
+              << " [--flash-path PATH] [--flash-bytes N] [--flash-direct-io] [--victim-bytes N]"
+              << " [--change-log-rows N] [--follow PATH] [--db-partitions N] [--invalidate-ms N] [--io-uring]" << std::endl;
+}
+
+/// Starts a listener for `handler`, preferring io_uring when requested and available
+/// @returns nullptr if no backend could be started
+static std::unique_ptr<NetworkServer> startServer(ProtocolHandler& handler, const ServerConfig& config,
+                                                  bool use_io_uring) {
+    std::unique_ptr<NetworkServer> server;
+#ifdef KVS_HAVE_IO_URING
+    if (use_io_uring) {
+        server = std::make_unique<UringServer>(handler, config);
+        if (!server->start()) {
+            std::cerr << "io_uring unavailable, falling back to epoll" << std::endl;
+            server.reset();
+        }
+    }
+#else
+    if (use_io_uring) {
+        std::cerr << "Built without io_uring support, using epoll" << std::endl;
+    }
+#endif
+    if (!server) {
+        server = std::make_unique<EpollServer>(handler, config);
+        if (!server->start()) {
+            return nullptr;
+        }
+    }
+    return server;
+}
+
+int main(int argc, char** argv) {
+    ServerConfig server_config;
+    CacheConfig cache_config;
+    cache_config.max_size = 64 * 1024 * 1024;
+    bool use_io_uring = false;
+    int memcached_port = -1;
+    std::string shm_name;
+    size_t warmup_rows = 0;
+    WarmupOrder warmup_order = WarmupOrder::RecentlyWritten;
+    std::string backup_path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--io-uring") {
+            use_io_uring = true;
+            continue;
+        }
+        if (arg == "--huge-pages") {
+            cache_config.huge_pages = true;
+            continue;
+        }
+        if (arg == "--bound-memory") {
+            cache_config.bound_memory = true;
+            continue;
+        }
+        if (arg == "--flash-direct-io") {
+            cache_config.flash_direct_io = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        try {
+            if (arg == "--bind") server_config.bind_address = value;
+            else if (arg == "--port") server_config.port = static_cast<uint16_t>(std::stoul(value));
+            else if (arg == "--memcached-port") memcached_port = static_cast<uint16_t>(std::stoul(value));
+            else if (arg == "--shm") shm_name = value;
+            else if (arg == "--threads") server_config.reactors = std::stoul(value);
+            else if (arg == "--db") cache_config.db_path = value;
+            else if (arg == "--max-bytes") cache_config.max_size = std::stoull(value);
+            else if (arg == "--shared-cache") cache_config.shared_segment = value;
+            else if (arg == "--snapshot") cache_config.snapshot_path = value;
+            else if (arg == "--backup") backup_path = value;
+            else if (arg == "--numa-node") cache_config.numa_node = std::stoi(value);
+            else if (arg == "--l0-entries") cache_config.l0_entries = std::stoull(value);
+            else if (arg == "--evict-low-bytes") cache_config.evict_low_free_bytes = std::stoull(value);
+            else if (arg == "--evict-high-bytes") cache_config.evict_high_free_bytes = std::stoull(value);
+            else if (arg == "--large-segment-bytes") cache_config.large_segment_bytes = std::stoull(value);
+            else if (arg == "--large-value-bytes") cache_config.large_value_bytes = std::stoull(value);
+            else if (arg == "--value-log-threshold") cache_config.value_log_threshold = std::stoull(value);
+            else if (arg == "--value-log-segment-bytes") cache_config.value_log_segment_bytes = std::stoull(value);
+            else if (arg == "--flash-path") cache_config.flash_path = value;
+            else if (arg == "--flash-bytes") cache_config.flash_bytes = std::stoull(value);
+            else if (arg == "--victim-bytes") cache_config.victim_bytes = std::stoull(value);
+            else if (arg == "--change-log-rows") cache_config.change_log_rows = std::stoull(value);
+            else if (arg == "--follow") cache_config.follow_db_path = value;
+            else if (arg == "--db-partitions") cache_config.db_partitions = std::stoull(value);
+            else if (arg == "--invalidate-ms") cache_config.invalidate_interval_ms = static_cast<unsigned>(std::stoul(value));
+            else if (arg == "--warmup-rows") warmup_rows = std::stoull(value);
+            else if (arg == "--policy" && value == "fifo") cache_config.policy = EvictionPolicy::Fifo;
+            else if (arg == "--policy" && value == "adaptive") cache_config.policy = EvictionPolicy::Adaptive;
+            else if (arg == "--policy" && value == "greedy-dual") cache_config.policy = EvictionPolicy::GreedyDual;
+            else if (arg == "--warmup-order" && value == "written") warmup_order = WarmupOrder::RecentlyWritten;
+            else if (arg == "--warmup-order" && value == "reads") warmup_order = WarmupOrder::MostRead;
+            else if (arg == "--warmup-order" && value == "recent") warmup_order = WarmupOrder::RecentlyRead;
+            else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (!cache_config.follow_db_path.empty() && (memcached_port >= 0 || !shm_name.empty())) {
+        std::cerr << "--follow serves reads over RESP only, drop --memcached-port and --shm" << std::endl;
+        return 1;
+    }
+
+    // block termination signals before any thread starts so only sigwait() below sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    FIFOCache cache(cache_config);
+    if (warmup_rows > 0) {
+        // requests are served while the warm-up runs, misses just go to SQLite as usual
+        cache.start_warmup(warmup_rows, warmup_order, [](const WarmupProgress& progress) {
+            if (progress.done) {
+                std::cout << "Warm-up loaded " << progress.rows_loaded << " rows (" << progress.bytes_loaded
+                          << " bytes)" << std::endl;
+            }
+        });
+    }
+    RespHandler handler(cache);
+    std::unique_ptr<NetworkServer> server = startServer(handler, server_config, use_io_uring);
+    if (!server) {
+        return 1;
+    }
+    std::cout << "Listening on " << server_config.bind_address << ":" << server->port() << std::endl;
+
+    MemcachedHandler memcached_handler(cache);
+    std::unique_ptr<NetworkServer> memcached_server;
+    if (memcached_port >= 0) {
+        ServerConfig memcached_config = server_config;
+        memcached_config.port = static_cast<uint16_t>(memcached_port);
+        memcached_server = startServer(memcached_handler, memcached_config, use_io_uring);
+        if (!memcached_server) {
+            server->stop();
+            return 1;
+        }
+        std::cout << "Memcached protocol on " << memcached_config.bind_address << ":" << memcached_server->port()
+                  << std::endl;
+    }
+
+    std::unique_ptr<ShmServer> shm_server;
+    if (!shm_name.empty()) {
+        ShmServerConfig shm_config;
+        shm_config.name = shm_name;
+        shm_server = std::make_unique<ShmServer>(cache, shm_config);
+        if (!shm_server->start()) {
+            return 1;
+        }
+        std::cout << "Shared memory segment " << shm_name << std::endl;
+    }
+
+    std::thread backup_thread;
+    std::atomic<bool> backup_running{false};
+    int signal_number = 0;
+    while (sigwait(&signals, &signal_number) == 0 && signal_number == SIGUSR1) {
+        if (backup_path.empty() || backup_running) {
+            continue;
+        }
+        if (backup_thread.joinable()) {
+            backup_thread.join();
+        }
+        backup_running = true;
+        backup_thread = std::thread([&]() {
+            bool ok = cache.backup(backup_path);
+            std::cout << (ok ? "Backup written to " : "Backup failed: ") << backup_path << std::endl;
+            backup_running = false;
+        });
+    }
+    if (backup_thread.joinable()) {
+        backup_thread.join();
+    }
+    std::cout << "Shutting down" << std::endl;
+    if (shm_server) {
+        shm_server->stop();
+    }
+    if (memcached_server) {
+        memcached_server->stop();
+    }
+    server->stop();
+    return 0;
+}
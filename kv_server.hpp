@@ -0,0 +1,388 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+/// Interface between the network front end and a wire protocol
+/// Implementations must be thread safe, every reactor thread calls handle() concurrently
+class ProtocolHandler {
+public:
+    virtual ~ProtocolHandler() = default;
+
+    /// Parses as many complete requests as data holds and appends their replies to out
+    /// @param close_connection set to true to close the connection once out is flushed
+    /// @returns number of bytes consumed, trailing partial requests are left for the next call
+    virtual size_t handle(const char* data, size_t len, std::string& out, bool& close_connection) = 0;
+};
+
+struct ServerConfig {
+    std::string bind_address = "127.0.0.1";
+    uint16_t port = 6379; // 0 picks a free port, see NetworkServer::port()
+    size_t reactors = 0;  // event loop threads, 0 means one per core
+    bool pin_threads = true; // pin reactor i to core i
+};
+
+/// Opens a non-blocking SO_REUSEPORT listening socket, so every event loop can own one on the same port
+/// @returns the socket, or -1 on error
+inline int openListenSocket(const std::string& bind_address, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_address.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "Invalid bind address: " << bind_address << std::endl;
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::cerr << "bind/listen: " << std::strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @returns the local port a socket is bound to
+inline uint16_t localPort(int fd) {
+    sockaddr_in addr{};
+    socklen_t addr_len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    return ntohs(addr.sin_port);
+}
+
+/// Pins a thread to one core, best effort
+inline void pinThread(std::thread& thread, size_t index) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cores, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+/// Common interface of the network front ends
+class NetworkServer {
+public:
+    virtual ~NetworkServer() = default;
+
+    /// Binds the listening sockets and launches the event loop threads
+    /// @returns false if the address could not be bound or the backend is unavailable
+    virtual bool start() = 0;
+
+    /// Stops all event loops and closes every connection
+    virtual void stop() = 0;
+
+    /// @returns the port the server listens on, resolved after start() when configured as 0
+    virtual uint16_t port() const = 0;
+};
+
+/// Multi-reactor TCP server
+/// Every reactor thread owns an epoll instance and its own SO_REUSEPORT listening socket, so the
+/// kernel spreads new connections across reactors and a connection never changes threads.
+/// Replies to all requests parsed from one read are written back with a single send (pipelining).
+class EpollServer : public NetworkServer {
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        size_t in_pos = 0; // bytes of `in` already consumed by the handler
+        std::string out;
+        size_t out_pos = 0; // bytes of `out` already sent
+        bool closing = false;
+        bool want_write = false; // registered for EPOLLOUT instead of EPOLLIN
+    };
+
+    struct Reactor {
+        int epoll_fd = -1;
+        int listen_fd = -1;
+        int wake_fd = -1;
+        std::thread thread;
+        std::unordered_map<int, Connection> connections;
+    };
+
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr size_t MAX_EVENTS = 256;
+    static constexpr size_t COMPACT_THRESHOLD = 64 * 1024;
+
+    ProtocolHandler& handler;
+    ServerConfig config;
+    uint16_t bound_port = 0;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> connected_clients{0};
+
+    void closeConnection(Reactor& reactor, int fd) {
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        reactor.connections.erase(fd);
+        connected_clients--;
+    }
+
+    void acceptConnections(Reactor& reactor) {
+        while (true) {
+            int fd = accept4(reactor.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return; // EAGAIN or a transient error, epoll will report the next one
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+            reactor.connections[fd].fd = fd;
+            connected_clients++;
+        }
+    }
+
+    /// Sends as much pending output as the socket takes
+    /// @returns false if the connection broke
+    bool flush(Reactor& reactor, Connection& conn) {
+        while (conn.out_pos < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            conn.out_pos += n;
+        }
+
+        bool pending = conn.out_pos < conn.out.size();
+        if (!pending) {
+            conn.out.clear();
+            conn.out_pos = 0;
+        }
+
+        // while output is pending, stop reading from the client so a slow reader can't make us
+        // buffer unbounded replies
+        if (pending != conn.want_write) {
+            epoll_event ev{};
+            ev.events = pending ? EPOLLOUT : EPOLLIN;
+            ev.data.fd = conn.fd;
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev);
+            conn.want_write = pending;
+        }
+        return true;
+    }
+
+    /// @returns false if the connection should be closed
+    bool readAndHandle(Connection& conn) {
+        char buffer[READ_CHUNK];
+        bool peer_closed = false;
+        while (true) {
+            ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn.in.append(buffer, n);
+                if (static_cast<size_t>(n) < sizeof(buffer)) {
+                    break;
+                }
+                continue;
+            }
+            if (n == 0) {
+                peer_closed = true;
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+
+        size_t consumed = handler.handle(conn.in.data() + conn.in_pos, conn.in.size() - conn.in_pos,
+                                         conn.out, conn.closing);
+        conn.in_pos += consumed;
+        if (conn.in_pos == conn.in.size()) {
+            conn.in.clear();
+            conn.in_pos = 0;
+        } else if (conn.in_pos > COMPACT_THRESHOLD) {
+            conn.in.erase(0, conn.in_pos);
+            conn.in_pos = 0;
+        }
+
+        if (peer_closed) {
+            conn.closing = true;
+        }
+        return true;
+    }
+
+    void run(Reactor& reactor) {
+        epoll_event events[MAX_EVENTS];
+        while (running.load(std::memory_order_relaxed)) {
+            int n = epoll_wait(reactor.epoll_fd, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == reactor.wake_fd) {
+                    continue; // stop() was called, the loop condition handles it
+                }
+                if (fd == reactor.listen_fd) {
+                    acceptConnections(reactor);
+                    continue;
+                }
+
+                auto it = reactor.connections.find(fd);
+                if (it == reactor.connections.end()) {
+                    continue;
+                }
+                Connection& conn = it->second;
+
+                bool ok = true;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    ok = false;
+                }
+                if (ok && (events[i].events & EPOLLIN)) {
+                    ok = readAndHandle(conn);
+                }
+                if (ok) {
+                    ok = flush(reactor, conn);
+                }
+                if (!ok || (conn.closing && conn.out.empty())) {
+                    closeConnection(reactor, fd);
+                }
+            }
+        }
+
+        for (auto& [fd, conn] : reactor.connections) {
+            close(fd);
+            connected_clients--;
+        }
+        reactor.connections.clear();
+    }
+
+public:
+    EpollServer(ProtocolHandler& handler, const ServerConfig& config = ServerConfig{})
+        : handler(handler), config(config) {}
+
+    ~EpollServer() override {
+        stop();
+    }
+
+    EpollServer(const EpollServer&) = delete;
+    EpollServer& operator=(const EpollServer&) = delete;
+
+    bool start() override {
+        if (running) {
+            return true;
+        }
+        size_t count = config.reactors;
+        if (count == 0) {
+            count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        uint16_t port = config.port;
+        for (size_t i = 0; i < count; i++) {
+            auto reactor = std::make_unique<Reactor>();
+            reactor->listen_fd = openListenSocket(config.bind_address, port);
+            reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (reactor->listen_fd < 0 || reactor->epoll_fd < 0 || reactor->wake_fd < 0) {
+                for (int fd : {reactor->listen_fd, reactor->epoll_fd, reactor->wake_fd}) {
+                    if (fd >= 0) close(fd);
+                }
+                closeReactors();
+                return false;
+            }
+
+            if (port == 0) {
+                // the first listener picked an ephemeral port, the others must share it
+                port = localPort(reactor->listen_fd);
+            }
+
+            for (int fd : {reactor->listen_fd, reactor->wake_fd}) {
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+            }
+            reactors.push_back(std::move(reactor));
+        }
+        bound_port = port;
+
+        running = true;
+        for (size_t i = 0; i < reactors.size(); i++) {
+            Reactor& reactor = *reactors[i];
+            reactor.thread = std::thread([this, &reactor]() { run(reactor); });
+            if (config.pin_threads) {
+                pinThread(reactor.thread, i);
+            }
+        }
+        return true;
+    }
+
+    void stop() override {
+        if (!running.exchange(false)) {
+            return;
+        }
+        for (auto& reactor : reactors) {
+            uint64_t one = 1;
+            ssize_t ignored = write(reactor->wake_fd, &one, sizeof(one));
+            (void)ignored;
+        }
+        for (auto& reactor : reactors) {
+            if (reactor->thread.joinable()) {
+                reactor->thread.join();
+            }
+        }
+        closeReactors();
+    }
+
+    uint16_t port() const override {
+        return bound_port;
+    }
+
+    size_t clients() const {
+        return connected_clients.load();
+    }
+
+private:
+    void closeReactors() {
+        for (auto& reactor : reactors) {
+            for (int fd : {reactor->listen_fd, reactor->epoll_fd, reactor->wake_fd}) {
+                if (fd >= 0) close(fd);
+            }
+        }
+        reactors.clear();
+    }
+};
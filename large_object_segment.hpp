@@ -0,0 +1,186 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+
+/// Cache for values too large for the small-entry segment (see CacheConfig::large_segment_bytes)
+///
+/// Values are stored in fixed size chunks carved from slabs mapped outside the malloc heap and
+/// recycled through a free list, so caching and evicting big values neither fragments the heap nor
+/// pushes small entries out of their segment. The segment never maps more than its budget, rounded
+/// down to whole chunks. Least recently read objects are evicted first.
+/// Thread safe, one mutex guards the segment; copying a large value dominates the time it is held.
+class LargeObjectSegment {
+public:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t SLAB_CHUNKS = 64; // chunks mapped at a time
+
+private:
+    struct Object {
+        std::vector<char*> chunks;
+        size_t size = 0;
+        float fetch_us = 0;
+        std::list<const std::string*>::iterator lru_slot;
+    };
+
+    const size_t max_chunks;
+    std::vector<std::pair<void*, size_t>> slabs;
+    std::vector<char*> free_chunks;
+    size_t mapped_chunks = 0;
+
+    std::unordered_map<std::string, Object> objects;
+    std::list<const std::string*> lru; // least recently read first
+    size_t used_bytes = 0;             // value bytes stored
+    uint64_t evicted = 0;
+    mutable std::mutex mutex;
+
+    static size_t chunksFor(size_t size) {
+        return std::max<size_t>(1, (size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    }
+
+    size_t usedChunks() const {
+        return mapped_chunks - free_chunks.size();
+    }
+
+    /// Maps another slab, at most up to the budget
+    /// @returns false if the budget is used up or the mapping fails
+    bool grow() {
+        size_t count = std::min(SLAB_CHUNKS, max_chunks - mapped_chunks);
+        if (count == 0) {
+            return false;
+        }
+        size_t size = count * CHUNK_SIZE;
+        void* slab = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            std::cerr << "Cannot map large object slab" << std::endl;
+            return false;
+        }
+        slabs.emplace_back(slab, size);
+        for (size_t i = count; i-- > 0;) {
+            free_chunks.push_back(static_cast<char*>(slab) + i * CHUNK_SIZE);
+        }
+        mapped_chunks += count;
+        return true;
+    }
+
+    void eraseLocked(std::unordered_map<std::string, Object>::iterator it) {
+        free_chunks.insert(free_chunks.end(), it->second.chunks.begin(), it->second.chunks.end());
+        used_bytes -= it->second.size;
+        lru.erase(it->second.lru_slot);
+        objects.erase(it);
+    }
+
+public:
+    explicit LargeObjectSegment(size_t budget_bytes) : max_chunks(budget_bytes / CHUNK_SIZE) {}
+
+    ~LargeObjectSegment() {
+        for (auto& [address, size] : slabs) {
+            munmap(address, size);
+        }
+    }
+
+    LargeObjectSegment(const LargeObjectSegment&) = delete;
+    LargeObjectSegment& operator=(const LargeObjectSegment&) = delete;
+
+    /// Stores a copy of value under key, evicting the least recently read objects to make room
+    /// @returns false if the value is larger than the whole segment, a previous value is dropped then
+    bool insert(const std::string& key, std::string_view value, float fetch_us = 0) {
+        size_t needed = chunksFor(value.size());
+        std::lock_guard<std::mutex> lock(mutex);
+        auto existing = objects.find(key);
+        if (existing != objects.end()) {
+            eraseLocked(existing);
+        }
+        if (needed > max_chunks) {
+            return false;
+        }
+        while (free_chunks.size() < needed && !grow()) {
+            if (lru.empty()) {
+                return false; // a slab could not be mapped
+            }
+            eraseLocked(objects.find(*lru.front()));
+            evicted++;
+        }
+
+        auto [it, inserted] = objects.try_emplace(key);
+        Object& object = it->second;
+        object.size = value.size();
+        object.fetch_us = fetch_us;
+        object.chunks.assign(free_chunks.end() - needed, free_chunks.end());
+        free_chunks.resize(free_chunks.size() - needed);
+        for (size_t i = 0, offset = 0; offset < value.size(); i++, offset += CHUNK_SIZE) {
+            std::memcpy(object.chunks[i], value.data() + offset, std::min(CHUNK_SIZE, value.size() - offset));
+        }
+        object.lru_slot = lru.insert(lru.end(), &it->first);
+        used_bytes += value.size();
+        return true;
+    }
+
+    /// Copies the value of key to out and marks it recently read
+    /// @returns true if the key is cached, fetch_us (if given) gets the time reading it from the DB took
+    bool lookup(const std::string& key, std::string* out, float* fetch_us = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = objects.find(key);
+        if (it == objects.end()) {
+            return false;
+        }
+        const Object& object = it->second;
+        out->resize(object.size);
+        for (size_t i = 0, offset = 0; offset < object.size; i++, offset += CHUNK_SIZE) {
+            std::memcpy(&(*out)[offset], object.chunks[i], std::min(CHUNK_SIZE, object.size - offset));
+        }
+        lru.splice(lru.end(), lru, object.lru_slot);
+        if (fetch_us) {
+            *fetch_us = object.fetch_us;
+        }
+        return true;
+    }
+
+    bool erase(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = objects.find(key);
+        if (it == objects.end()) {
+            return false;
+        }
+        eraseLocked(it);
+        return true;
+    }
+
+    /// Drops every value
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!objects.empty()) {
+            eraseLocked(objects.begin());
+        }
+    }
+
+    size_t entries() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return objects.size();
+    }
+
+    /// Value bytes stored
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used_bytes;
+    }
+
+    /// Memory held by stored values, whole chunks
+    size_t occupiedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return usedChunks() * CHUNK_SIZE;
+    }
+
+    uint64_t evictions() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evicted;
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+/// Byte-oriented LZ77 codec in the style of LZ4, for the victim cache (see victim_cache.hpp)
+///
+/// A block is a series of sequences: a token (literal count in the high nibble, match length - 4 in
+/// the low one; 15 means more length bytes follow, each adding up to 255), the literals, and a 16-bit
+/// little-endian offset back to the match. The last sequence only has literals. Matches are found
+/// through a hash table of 4-byte prefixes, one candidate per slot, which favours speed over ratio.
+/// The format carries no sizes, the caller stores the decompressed size.
+namespace lz {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr size_t HASH_BITS = 12;
+static constexpr size_t LAST_LITERALS = 5; // a match never covers the end of the input
+
+inline uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hashOf(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+inline void putLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline void putSequence(std::string& out, const char* literals, size_t literal_count, size_t offset, size_t match_length) {
+    size_t extra = match_length >= MIN_MATCH ? match_length - MIN_MATCH : 0;
+    out.push_back(static_cast<char>((std::min<size_t>(literal_count, 15) << 4) | std::min<size_t>(extra, 15)));
+    if (literal_count >= 15) {
+        putLength(out, literal_count - 15);
+    }
+    out.append(literals, literal_count);
+    if (match_length == 0) {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (extra >= 15) {
+        putLength(out, extra - 15);
+    }
+}
+
+/// Compresses input into out, replacing its contents
+/// @returns false if the result isn't smaller than the input, out is then unspecified
+inline bool compress(std::string_view input, std::string& out) {
+    out.clear();
+    if (input.size() < MIN_MATCH + LAST_LITERALS) {
+        return false;
+    }
+    out.reserve(input.size());
+    thread_local std::vector<uint32_t> table;
+    table.assign(size_t(1) << HASH_BITS, UINT32_MAX);
+
+    const char* base = input.data();
+    size_t end = input.size();
+    size_t match_limit = end - LAST_LITERALS;
+    size_t anchor = 0; // first literal not written yet
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= match_limit) {
+        uint32_t sequence = read32(base + pos);
+        uint32_t& slot = table[hashOf(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos);
+        if (candidate == UINT32_MAX || pos - candidate > MAX_OFFSET || read32(base + candidate) != sequence) {
+            pos++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (pos + length < match_limit && base[candidate + length] == base[pos + length]) {
+            length++;
+        }
+        putSequence(out, base + anchor, pos - anchor, pos - candidate, length);
+        if (out.size() >= input.size()) {
+            return false;
+        }
+        pos += length;
+        anchor = pos;
+    }
+    putSequence(out, base + anchor, end - anchor, 0, 0);
+    return out.size() < input.size();
+}
+
+/// Decompresses a block made by compress() into out, which must end up exactly `size` bytes long
+/// @returns false on a corrupt block
+inline bool decompress(std::string_view block, size_t size, std::string& out) {
+    out.resize(size);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(block.data());
+    const unsigned char* in_end = in + block.size();
+    size_t written = 0;
+    auto readLength = [&](size_t length) -> size_t {
+        if (length != 15) {
+            return length;
+        }
+        unsigned char byte;
+        do {
+            if (in == in_end) {
+                return SIZE_MAX;
+            }
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return length;
+    };
+    while (in < in_end) {
+        unsigned char token = *in++;
+        size_t literal_count = readLength(token >> 4);
+        if (literal_count > size_t(in_end - in) || literal_count > size - written) {
+            return false;
+        }
+        std::memcpy(&out[written], in, literal_count);
+        in += literal_count;
+        written += literal_count;
+        if (in == in_end) {
+            break; // last sequence
+        }
+        if (in_end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        size_t length = readLength(token & 0x0F);
+        if (length == SIZE_MAX || offset == 0 || offset > written || (length += MIN_MATCH) > size - written) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++, written++) { // byte by byte, matches may overlap their source
+            out[written] = out[written - offset];
+        }
+    }
+    return written == size;
+}
+
+} // namespace lz
@@ -0,0 +1,528 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <charconv>
+#include <ctime>
+#include <climits>
+#include "fifo_cache.hpp"
+#include "kv_server.hpp"
+
+/// Executes memcached protocol requests against a FIFOCache
+/// Both the text and the binary protocol are accepted on the same connection, a request starting
+/// with the 0x80 magic byte is parsed as binary.
+/// Text: get, gets, set, cas, delete, incr, decr, touch, stats, version, quit
+/// Binary: GET(K)(Q), SET(Q) (with CAS), DELETE(Q), INCREMENT/DECREMENT(Q), QUIT, NOOP, VERSION
+///
+/// Limitations: item flags are not stored (always reported as 0). CAS tokens are per-key versions from
+/// the cache's version map: a key gets one when it is read with its token, and every write drops it,
+/// so a value changed and changed back (A -> B -> A) no longer matches. The map lives in this process,
+/// so in shared_segment mode a cas does not see another process's writes and is not safe across processes.
+class MemcachedHandler : public ProtocolHandler {
+private:
+    FIFOCache& cache;
+
+    static constexpr size_t MAX_KEY_LENGTH = 250;
+    static constexpr size_t MAX_LINE_LENGTH = 2048;
+    static constexpr size_t MAX_VALUE_LENGTH = 64 * 1024 * 1024;
+    static constexpr long long RELATIVE_EXPIRY_LIMIT = 60 * 60 * 24 * 30; // memcached treats larger values as unix time
+    static constexpr const char* VERSION = "1.6.0-kvs";
+
+    // binary protocol
+    static constexpr uint8_t REQUEST_MAGIC = 0x80;
+    static constexpr uint8_t RESPONSE_MAGIC = 0x81;
+    static constexpr size_t HEADER_SIZE = 24;
+
+    enum Opcode : uint8_t {
+        OP_GET = 0x00, OP_SET = 0x01, OP_DELETE = 0x04, OP_INCREMENT = 0x05, OP_DECREMENT = 0x06,
+        OP_QUIT = 0x07, OP_GETQ = 0x09, OP_NOOP = 0x0a, OP_VERSION = 0x0b, OP_GETK = 0x0c,
+        OP_GETKQ = 0x0d, OP_SETQ = 0x11, OP_DELETEQ = 0x14, OP_INCREMENTQ = 0x15, OP_DECREMENTQ = 0x16,
+    };
+
+    enum Status : uint16_t {
+        STATUS_OK = 0x00, STATUS_KEY_NOT_FOUND = 0x01, STATUS_KEY_EXISTS = 0x02, STATUS_INVALID_ARGUMENTS = 0x04,
+        STATUS_NON_NUMERIC = 0x06, STATUS_UNKNOWN_COMMAND = 0x81,
+    };
+
+    struct BinaryHeader {
+        uint8_t opcode;
+        uint16_t key_length;
+        uint8_t extras_length;
+        uint32_t body_length;
+        uint32_t opaque;
+        uint64_t cas;
+    };
+
+    static bool parseUnsigned(const std::string& text, uint64_t& out) {
+        if (text.empty()) {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    static bool parseSigned(const std::string& text, long long& out) {
+        if (text.empty()) {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    static uint16_t readU16(const unsigned char* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+    static uint32_t readU32(const unsigned char* p) {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+    static uint64_t readU64(const unsigned char* p) {
+        return (static_cast<uint64_t>(readU32(p)) << 32) | readU32(p + 4);
+    }
+    static void appendU16(std::string& out, uint16_t v) {
+        out += static_cast<char>(v >> 8);
+        out += static_cast<char>(v & 0xff);
+    }
+    static void appendU32(std::string& out, uint32_t v) {
+        appendU16(out, static_cast<uint16_t>(v >> 16));
+        appendU16(out, static_cast<uint16_t>(v & 0xffff));
+    }
+    static void appendU64(std::string& out, uint64_t v) {
+        appendU32(out, static_cast<uint32_t>(v >> 32));
+        appendU32(out, static_cast<uint32_t>(v & 0xffffffff));
+    }
+
+    /// A memcached exptime as a TTL in milliseconds: 0 keeps the key forever, values above 30 days
+    /// are unix timestamps; -1 if the time has already passed
+    static long long ttlMillis(long long exptime) {
+        if (exptime == 0) {
+            return 0;
+        }
+        long long seconds = exptime;
+        if (exptime > RELATIVE_EXPIRY_LIMIT) {
+            seconds = exptime - static_cast<long long>(std::time(nullptr));
+        }
+        if (seconds <= 0) {
+            return -1;
+        }
+        return seconds > LLONG_MAX / 1000 ? LLONG_MAX : seconds * 1000;
+    }
+
+    /// Applies a memcached exptime to an existing key, one in the past expires it immediately
+    void applyExpiry(const std::string& key, long long exptime) {
+        long long ttl = ttlMillis(exptime);
+        if (ttl != 0) {
+            cache.expire_ms(key, ttl < 0 ? 0 : ttl);
+        }
+    }
+
+    enum class StoreResult { Stored, Exists, NotFound };
+
+    /// set, or cas when cas_token is non zero; the value and its exptime are written together
+    /// version, when given, gets the CAS token of the stored value
+    StoreResult store(const std::string& key, const std::string& value, long long exptime, uint64_t cas_token,
+                      uint64_t* version = nullptr) {
+        long long ttl = ttlMillis(exptime);
+        if (cas_token == 0) {
+            if (ttl < 0) {
+                cache.remove(key); // stored and expired at once
+            } else {
+                cache.put_with_ttl(key, value, ttl, version);
+            }
+            return StoreResult::Stored;
+        }
+
+        switch (cache.compare_and_put(key, value, cas_token, ttl, version)) {
+        case FIFOCache::CasResult::Stored:
+            return StoreResult::Stored;
+        case FIFOCache::CasResult::Exists:
+            return StoreResult::Exists;
+        default:
+            return StoreResult::NotFound;
+        }
+    }
+
+    enum class ArithmeticResult { Ok, NotFound, NonNumeric };
+
+    /// memcached incr/decr: unsigned 64-bit, incr wraps around, decr stops at 0
+    /// version, when given, gets the CAS token of the stored value
+    ArithmeticResult arithmetic(const std::string& key, bool increment, uint64_t delta, uint64_t& value,
+                                bool create, uint64_t initial, uint64_t* version = nullptr) {
+        ArithmeticResult result = ArithmeticResult::Ok;
+        cache.update(key, [&](bool found, const std::string& current, std::string& updated) {
+            if (!found) {
+                if (!create) {
+                    result = ArithmeticResult::NotFound;
+                    return false;
+                }
+                value = initial;
+            } else {
+                uint64_t number;
+                if (!parseUnsigned(current, number)) {
+                    result = ArithmeticResult::NonNumeric;
+                    return false;
+                }
+                value = increment ? number + delta : (delta > number ? 0 : number - delta);
+            }
+            updated = std::to_string(value);
+            return true;
+        }, version);
+        return result;
+    }
+
+    // ---- text protocol ----
+
+    static std::vector<std::string> splitTokens(const char* begin, const char* end) {
+        std::vector<std::string> tokens;
+        const char* p = begin;
+        while (p < end) {
+            while (p < end && *p == ' ') p++;
+            const char* start = p;
+            while (p < end && *p != ' ') p++;
+            if (p > start) {
+                tokens.emplace_back(start, p - start);
+            }
+        }
+        return tokens;
+    }
+
+    void textGet(const std::vector<std::string>& tokens, bool with_cas, std::string& out) {
+        std::vector<std::string> keys(tokens.begin() + 1, tokens.end());
+        for (const auto& key : keys) {
+            if (key.size() > MAX_KEY_LENGTH) {
+                out += "CLIENT_ERROR bad command line format\r\n";
+                return;
+            }
+        }
+        // one lookup for all keys of the request
+        std::vector<uint64_t> versions;
+        auto results = with_cas ? cache.get_many_versioned(keys, versions) : cache.get_many(keys);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (!results[i].first) {
+                continue;
+            }
+            const std::string& value = results[i].second;
+            out += "VALUE ";
+            out += keys[i];
+            out += " 0 ";
+            out += std::to_string(value.size());
+            if (with_cas) {
+                out += ' ';
+                out += std::to_string(versions[i]);
+            }
+            out += "\r\n";
+            out += value;
+            out += "\r\n";
+        }
+        out += "END\r\n";
+    }
+
+    /// @returns bytes consumed from data (command line + data block), 0 if the data block is incomplete
+    size_t textStore(const std::vector<std::string>& tokens, bool is_cas, const char* data, size_t len,
+                     size_t line_end, std::string& out, bool& close_connection) {
+        size_t expected = is_cas ? 6 : 5;
+        bool noreply = tokens.size() == expected + 1 && tokens.back() == "noreply";
+        uint64_t flags, bytes, cas_token = 0;
+        long long exptime;
+        if ((tokens.size() != expected && !noreply) || !parseUnsigned(tokens[2], flags) ||
+            !parseSigned(tokens[3], exptime) || !parseUnsigned(tokens[4], bytes) ||
+            (is_cas && !parseUnsigned(tokens[5], cas_token)) || tokens[1].size() > MAX_KEY_LENGTH ||
+            bytes > MAX_VALUE_LENGTH) {
+            out += "CLIENT_ERROR bad command line format\r\n";
+            close_connection = true; // the data block length is unknown, we can't resync
+            return len;
+        }
+
+        size_t needed = line_end + bytes + 2;
+        if (len < needed) {
+            return 0;
+        }
+        if (data[line_end + bytes] != '\r' || data[line_end + bytes + 1] != '\n') {
+            out += "CLIENT_ERROR bad data chunk\r\n";
+            return needed;
+        }
+
+        std::string value(data + line_end, bytes);
+        StoreResult result = store(tokens[1], value, exptime, is_cas ? (cas_token == 0 ? 1 : cas_token) : 0);
+        if (!noreply) {
+            switch (result) {
+            case StoreResult::Stored: out += "STORED\r\n"; break;
+            case StoreResult::Exists: out += "EXISTS\r\n"; break;
+            case StoreResult::NotFound: out += "NOT_FOUND\r\n"; break;
+            }
+        }
+        return needed;
+    }
+
+    void textDelete(const std::vector<std::string>& tokens, std::string& out) {
+        bool noreply = tokens.size() == 3 && tokens[2] == "noreply";
+        if (tokens.size() != 2 && !noreply) {
+            out += "CLIENT_ERROR bad command line format. Usage: delete <key> [noreply]\r\n";
+            return;
+        }
+        bool removed = cache.remove(tokens[1]);
+        if (!noreply) {
+            out += removed ? "DELETED\r\n" : "NOT_FOUND\r\n";
+        }
+    }
+
+    void textArithmetic(const std::vector<std::string>& tokens, bool increment, std::string& out) {
+        bool noreply = tokens.size() == 4 && tokens[3] == "noreply";
+        uint64_t delta;
+        if ((tokens.size() != 3 && !noreply) || !parseUnsigned(tokens[2], delta)) {
+            out += "CLIENT_ERROR invalid numeric delta argument\r\n";
+            return;
+        }
+        uint64_t value = 0;
+        ArithmeticResult result = arithmetic(tokens[1], increment, delta, value, false, 0);
+        if (noreply) {
+            return;
+        }
+        switch (result) {
+        case ArithmeticResult::Ok: out += std::to_string(value) + "\r\n"; break;
+        case ArithmeticResult::NotFound: out += "NOT_FOUND\r\n"; break;
+        case ArithmeticResult::NonNumeric:
+            out += "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n";
+            break;
+        }
+    }
+
+    void textTouch(const std::vector<std::string>& tokens, std::string& out) {
+        bool noreply = tokens.size() == 4 && tokens[3] == "noreply";
+        long long exptime;
+        if ((tokens.size() != 3 && !noreply) || !parseSigned(tokens[2], exptime)) {
+            out += "CLIENT_ERROR bad command line format\r\n";
+            return;
+        }
+        bool exists = !cache.get(tokens[1]).first.empty();
+        if (exists) {
+            applyExpiry(tokens[1], exptime);
+        }
+        if (!noreply) {
+            out += exists ? "TOUCHED\r\n" : "NOT_FOUND\r\n";
+        }
+    }
+
+    void textStats(std::string& out) {
+        CacheStats stats = cache.stats();
+        out += "STAT version " + std::string(VERSION) + "\r\n";
+        out += "STAT get_hits " + std::to_string(stats.hits) + "\r\n";
+        out += "STAT get_misses " + std::to_string(stats.misses) + "\r\n";
+        out += "STAT evictions " + std::to_string(stats.evictions) + "\r\n";
+        out += "STAT curr_items " + std::to_string(stats.entries) + "\r\n";
+        out += "STAT bytes " + std::to_string(stats.current_size) + "\r\n";
+        out += "STAT limit_maxbytes " + std::to_string(stats.max_size) + "\r\n";
+        out += "END\r\n";
+    }
+
+    /// Handles one text request at data[0..len)
+    /// @returns bytes consumed, 0 if the request is incomplete
+    size_t handleText(const char* data, size_t len, std::string& out, bool& close_connection) {
+        const char* nl = static_cast<const char*>(std::memchr(data, '\n', len));
+        if (!nl) {
+            if (len > MAX_LINE_LENGTH) {
+                out += "CLIENT_ERROR line too long\r\n";
+                close_connection = true;
+                return len;
+            }
+            return 0;
+        }
+        size_t line_end = (nl - data) + 1;
+        const char* end = (nl > data && nl[-1] == '\r') ? nl - 1 : nl;
+        std::vector<std::string> tokens = splitTokens(data, end);
+        if (tokens.empty()) {
+            out += "ERROR\r\n";
+            return line_end;
+        }
+
+        const std::string& command = tokens[0];
+        if ((command == "get" || command == "gets") && tokens.size() >= 2) {
+            textGet(tokens, command == "gets", out);
+        } else if (command == "set" || command == "cas") {
+            return textStore(tokens, command == "cas", data, len, line_end, out, close_connection);
+        } else if (command == "delete") {
+            textDelete(tokens, out);
+        } else if (command == "incr" || command == "decr") {
+            textArithmetic(tokens, command == "incr", out);
+        } else if (command == "touch") {
+            textTouch(tokens, out);
+        } else if (command == "stats") {
+            textStats(out);
+        } else if (command == "version") {
+            out += "VERSION " + std::string(VERSION) + "\r\n";
+        } else if (command == "quit") {
+            close_connection = true;
+        } else {
+            out += "ERROR\r\n";
+        }
+        return line_end;
+    }
+
+    // ---- binary protocol ----
+
+    static void binaryResponse(std::string& out, const BinaryHeader& request, uint16_t status,
+                               const std::string& extras, const std::string& key, const std::string& value,
+                               uint64_t cas = 0) {
+        out += static_cast<char>(RESPONSE_MAGIC);
+        out += static_cast<char>(request.opcode);
+        appendU16(out, static_cast<uint16_t>(key.size()));
+        out += static_cast<char>(extras.size());
+        out += '\0'; // data type
+        appendU16(out, status);
+        appendU32(out, static_cast<uint32_t>(extras.size() + key.size() + value.size()));
+        appendU32(out, request.opaque);
+        appendU64(out, cas);
+        out += extras;
+        out += key;
+        out += value;
+    }
+
+    static void binaryError(std::string& out, const BinaryHeader& request, uint16_t status) {
+        std::string message;
+        switch (status) {
+        case STATUS_KEY_NOT_FOUND: message = "Not found"; break;
+        case STATUS_KEY_EXISTS: message = "Data exists for key"; break;
+        case STATUS_NON_NUMERIC: message = "Non-numeric server-side value for incr or decr"; break;
+        case STATUS_UNKNOWN_COMMAND: message = "Unknown command"; break;
+        default: message = "Invalid arguments"; break;
+        }
+        binaryResponse(out, request, status, "", "", message);
+    }
+
+    /// Handles one binary request at data[0..len)
+    /// @returns bytes consumed, 0 if the request is incomplete
+    size_t handleBinary(const char* data, size_t len, std::string& out, bool& close_connection) {
+        if (len < HEADER_SIZE) {
+            return 0;
+        }
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+        BinaryHeader h;
+        h.opcode = p[1];
+        h.key_length = readU16(p + 2);
+        h.extras_length = p[4];
+        h.body_length = readU32(p + 8);
+        h.opaque = readU32(p + 12);
+        h.cas = readU64(p + 16);
+
+        if (h.body_length > MAX_VALUE_LENGTH + MAX_KEY_LENGTH + 64 ||
+            static_cast<size_t>(h.key_length) + h.extras_length > h.body_length) {
+            binaryError(out, h, STATUS_INVALID_ARGUMENTS);
+            close_connection = true;
+            return len;
+        }
+        size_t total = HEADER_SIZE + h.body_length;
+        if (len < total) {
+            return 0;
+        }
+
+        const unsigned char* extras = p + HEADER_SIZE;
+        std::string key(data + HEADER_SIZE + h.extras_length, h.key_length);
+        size_t value_offset = HEADER_SIZE + h.extras_length + h.key_length;
+        std::string value(data + value_offset, total - value_offset);
+
+        switch (h.opcode) {
+        case OP_GET:
+        case OP_GETQ:
+        case OP_GETK:
+        case OP_GETKQ: {
+            bool quiet = h.opcode == OP_GETQ || h.opcode == OP_GETKQ;
+            bool with_key = h.opcode == OP_GETK || h.opcode == OP_GETKQ;
+            uint64_t version;
+            auto result = cache.get_versioned(key, version);
+            if (!result.first) {
+                if (!quiet) {
+                    if (with_key) binaryResponse(out, h, STATUS_KEY_NOT_FOUND, "", key, "");
+                    else binaryError(out, h, STATUS_KEY_NOT_FOUND);
+                }
+                break;
+            }
+            std::string flags(4, '\0');
+            binaryResponse(out, h, STATUS_OK, flags, with_key ? key : "", result.second, version);
+            break;
+        }
+        case OP_SET:
+        case OP_SETQ: {
+            if (h.extras_length != 8 || key.empty() || key.size() > MAX_KEY_LENGTH) {
+                binaryError(out, h, STATUS_INVALID_ARGUMENTS);
+                break;
+            }
+            long long exptime = readU32(extras + 4);
+            uint64_t version = 0;
+            StoreResult result = store(key, value, exptime, h.cas, &version);
+            if (result == StoreResult::Stored) {
+                if (h.opcode == OP_SET) binaryResponse(out, h, STATUS_OK, "", "", "", version);
+            } else {
+                binaryError(out, h, result == StoreResult::Exists ? STATUS_KEY_EXISTS : STATUS_KEY_NOT_FOUND);
+            }
+            break;
+        }
+        case OP_DELETE:
+        case OP_DELETEQ: {
+            if (cache.remove(key)) {
+                if (h.opcode == OP_DELETE) binaryResponse(out, h, STATUS_OK, "", "", "");
+            } else {
+                binaryError(out, h, STATUS_KEY_NOT_FOUND);
+            }
+            break;
+        }
+        case OP_INCREMENT:
+        case OP_DECREMENT:
+        case OP_INCREMENTQ:
+        case OP_DECREMENTQ: {
+            if (h.extras_length != 20 || key.empty()) {
+                binaryError(out, h, STATUS_INVALID_ARGUMENTS);
+                break;
+            }
+            uint64_t delta = readU64(extras);
+            uint64_t initial = readU64(extras + 8);
+            uint32_t expiration = readU32(extras + 16);
+            bool increment = h.opcode == OP_INCREMENT || h.opcode == OP_INCREMENTQ;
+            bool quiet = h.opcode == OP_INCREMENTQ || h.opcode == OP_DECREMENTQ;
+            uint64_t result_value = 0;
+            uint64_t version = 0;
+            // an expiration of all ones means "fail if missing" instead of creating with `initial`
+            ArithmeticResult result = arithmetic(key, increment, delta, result_value,
+                                                 expiration != 0xffffffff, initial, &version);
+            if (result == ArithmeticResult::Ok) {
+                if (!quiet) {
+                    std::string body;
+                    appendU64(body, result_value);
+                    binaryResponse(out, h, STATUS_OK, "", "", body, version);
+                }
+            } else {
+                binaryError(out, h, result == ArithmeticResult::NotFound ? STATUS_KEY_NOT_FOUND : STATUS_NON_NUMERIC);
+            }
+            break;
+        }
+        case OP_QUIT:
+            binaryResponse(out, h, STATUS_OK, "", "", "");
+            close_connection = true;
+            break;
+        case OP_NOOP:
+            binaryResponse(out, h, STATUS_OK, "", "", "");
+            break;
+        case OP_VERSION:
+            binaryResponse(out, h, STATUS_OK, "", "", VERSION);
+            break;
+        default:
+            binaryError(out, h, STATUS_UNKNOWN_COMMAND);
+            break;
+        }
+        return total;
+    }
+
+public:
+    explicit MemcachedHandler(FIFOCache& cache) : cache(cache) {}
+
+    size_t handle(const char* data, size_t len, std::string& out, bool& close_connection) override {
+        size_t pos = 0;
+        while (pos < len && !close_connection) {
+            bool binary = static_cast<unsigned char>(data[pos]) == REQUEST_MAGIC;
+            size_t consumed = binary ? handleBinary(data + pos, len - pos, out, close_connection)
+                                     : handleText(data + pos, len - pos, out, close_connection);
+            if (consumed == 0) {
+                break; // incomplete request, wait for more bytes
+            }
+            pos += consumed;
+        }
+        return close_connection ? len : pos;
+    }
+};
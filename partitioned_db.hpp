@@ -0,0 +1,377 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <tuple>
+#include <cstdint>
+#include <cstdio>
+#include "persistent_db.hpp"
+#include "fnv_hash.hpp"
+
+/// SQLiteDB spread over several database files by key hash, see CacheConfig::db_partitions
+///
+/// SQLite runs one write transaction per file at a time, so a single file caps write throughput no
+/// matter how many threads write. With N > 1 partitions, partition i is the file
+/// partitionPath(db_path, i, N), with its own connection, value log and writer thread. Puts are
+/// queued to their partition's writer, which commits everything queued meanwhile in one transaction
+/// (group commit), so writers of different partitions run in parallel and writers of one partition
+/// share an fsync. The other calls run on the caller's thread against the key's partition, or against
+/// every partition in turn. With one partition the file is db_path itself and every call goes straight
+/// to it, as before partitioning.
+///
+/// Keys are placed by FNV-1a, stable across builds, but the placement depends on N: the files of one
+/// partition count don't serve another, which therefore starts out empty. put_many_to_db is atomic
+/// per partition only. The change log (SQLiteDB::set_change_log) is kept per partition, followers need
+/// an unpartitioned leader.
+class PartitionedDB {
+private:
+    static constexpr int CURSOR_SHIFT = 48; // scan cursors carry the partition above the rowid
+
+    struct Write {
+        const std::vector<std::pair<std::string, std::string>>* pairs = nullptr;
+        bool done = false;
+        bool ok = false;
+    };
+
+    struct Partition {
+        std::unique_ptr<SQLiteDB> db;
+        std::mutex queue_mutex;
+        std::condition_variable wake;      // the writer waits for writes
+        std::condition_variable committed; // submitters wait for their write
+        std::vector<Write*> queue;
+        std::thread writer;
+        bool stop = false;
+    };
+
+    std::vector<std::unique_ptr<Partition>> parts;
+
+    SQLiteDB& partitionOf(const std::string& key) {
+        return *parts[index(key)]->db;
+    }
+
+    /// Commits the queued writes of a partition in one transaction until the partition stops
+    void runWriter(Partition& part) {
+        std::vector<Write*> batch;
+        std::vector<std::pair<std::string, std::string>> pairs;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(part.queue_mutex);
+                part.wake.wait(lock, [&part]() { return part.stop || !part.queue.empty(); });
+                if (part.queue.empty()) {
+                    return;
+                }
+                batch.swap(part.queue);
+            }
+            bool ok;
+            if (batch.size() == 1) {
+                ok = part.db->put_many_to_db(*batch[0]->pairs);
+                batch[0]->ok = ok;
+            } else {
+                pairs.clear();
+                for (const Write* write : batch) {
+                    pairs.insert(pairs.end(), write->pairs->begin(), write->pairs->end());
+                }
+                ok = part.db->put_many_to_db(pairs);
+                for (Write* write : batch) {
+                    // a failed group is retried write by write, so one bad write doesn't fail the others
+                    write->ok = ok || part.db->put_many_to_db(*write->pairs);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(part.queue_mutex);
+                for (Write* write : batch) {
+                    write->done = true;
+                }
+            }
+            part.committed.notify_all();
+            batch.clear();
+        }
+    }
+
+    void submit(Partition& part, Write& write) {
+        {
+            std::lock_guard<std::mutex> lock(part.queue_mutex);
+            part.queue.push_back(&write);
+        }
+        part.wake.notify_one();
+    }
+
+    void await(Partition& part, Write& write) {
+        std::unique_lock<std::mutex> lock(part.queue_mutex);
+        part.committed.wait(lock, [&write]() { return write.done; });
+    }
+
+public:
+    /// File of partition `id` out of `count` for the database db_path
+    static std::string partitionPath(const std::string& db_path, size_t id, size_t count) {
+        if (count <= 1) {
+            return db_path;
+        }
+        return db_path + "." + std::to_string(id) + "-of-" + std::to_string(count);
+    }
+
+    /// @param partitions number of database files, 1 keeps everything in db_path
+    PartitionedDB(const std::string& db_path = "cache.db", size_t partitions = 1,
+                  const ValueLogOptions& value_log_options = {}) {
+        partitions = std::max<size_t>(1, partitions);
+        for (size_t i = 0; i < partitions; i++) {
+            auto part = std::make_unique<Partition>();
+            part->db = std::make_unique<SQLiteDB>(partitionPath(db_path, i, partitions), value_log_options);
+            parts.push_back(std::move(part));
+        }
+        if (partitions > 1) {
+            for (auto& part : parts) {
+                part->writer = std::thread(&PartitionedDB::runWriter, this, std::ref(*part));
+            }
+        }
+    }
+
+    ~PartitionedDB() {
+        for (auto& part : parts) {
+            if (part->writer.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(part->queue_mutex);
+                    part->stop = true;
+                }
+                part->wake.notify_one();
+                part->writer.join();
+            }
+        }
+    }
+
+    PartitionedDB(const PartitionedDB&) = delete;
+    PartitionedDB& operator=(const PartitionedDB&) = delete;
+
+    size_t partitions() const { return parts.size(); }
+
+    /// Partition holding key
+    size_t index(const std::string& key) const {
+        return parts.size() == 1 ? 0 : (fnv::mixed(key) >> 32) % parts.size();
+    }
+
+    /// The database of partition `id`, e.g. to read its change_log
+    SQLiteDB& partition(size_t id) { return *parts[id]->db; }
+
+    bool put_to_db(const std::string& key, const std::string& value) {
+        if (parts.size() == 1) {
+            return parts[0]->db->put_to_db(key, value);
+        }
+        std::vector<std::pair<std::string, std::string>> pairs{{key, value}};
+        Partition& part = *parts[index(key)];
+        Write write{&pairs};
+        submit(part, write);
+        await(part, write);
+        return write.ok;
+    }
+
+    /// Skips the writer queue: the caller holds the key lock, so no queued write of the key can pass it
+    bool put_with_expiry(const std::string& key, const std::string& value, int64_t expires_at) {
+        return partitionOf(key).put_with_expiry(key, value, expires_at);
+    }
+
+    /// Writes all pairs, each partition's share in one transaction, the partitions in parallel
+    /// @returns true if every row was written; on false, the shares of some partitions may be written
+    bool put_many_to_db(const std::vector<std::pair<std::string, std::string>>& pairs) {
+        if (parts.size() == 1) {
+            return parts[0]->db->put_many_to_db(pairs);
+        }
+        std::vector<std::vector<std::pair<std::string, std::string>>> shares(parts.size());
+        for (const auto& pair : pairs) {
+            shares[index(pair.first)].push_back(pair);
+        }
+        std::vector<Write> writes(parts.size());
+        for (size_t i = 0; i < parts.size(); i++) {
+            writes[i].pairs = &shares[i];
+            if (!shares[i].empty()) {
+                submit(*parts[i], writes[i]);
+            }
+        }
+        bool ok = true;
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!shares[i].empty()) {
+                await(*parts[i], writes[i]);
+                ok = ok && writes[i].ok;
+            }
+        }
+        return ok;
+    }
+
+    std::pair<bool, std::string> get_from_db(const std::string& key) {
+        return partitionOf(key).get_from_db(key);
+    }
+
+    std::unordered_map<std::string, std::string> get_many_from_db(const std::vector<std::string>& keys) {
+        if (parts.size() == 1) {
+            return parts[0]->db->get_many_from_db(keys);
+        }
+        std::vector<std::vector<std::string>> shares(parts.size());
+        for (const auto& key : keys) {
+            shares[index(key)].push_back(key);
+        }
+        std::unordered_map<std::string, std::string> result;
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!shares[i].empty()) {
+                result.merge(parts[i]->db->get_many_from_db(shares[i]));
+            }
+        }
+        return result;
+    }
+
+    bool remove_from_db(const std::string& key) {
+        return partitionOf(key).remove_from_db(key);
+    }
+
+    /// Iterates the partitions one after the other, see SQLiteDB::scan_db
+    std::pair<uint64_t, std::vector<std::string>> scan_db(uint64_t cursor, size_t count, const std::string& pattern = "") {
+        size_t id = cursor >> CURSOR_SHIFT;
+        uint64_t rowid = cursor & ((uint64_t(1) << CURSOR_SHIFT) - 1);
+        std::pair<uint64_t, std::vector<std::string>> result = {0, {}};
+        for (; id < parts.size(); id++, rowid = 0) {
+            auto page = parts[id]->db->scan_db(rowid, count - result.second.size(), pattern);
+            result.second.insert(result.second.end(), std::make_move_iterator(page.second.begin()),
+                                 std::make_move_iterator(page.second.end()));
+            if (page.first != 0) {
+                result.first = (static_cast<uint64_t>(id) << CURSOR_SHIFT) | page.first;
+                return result;
+            }
+        }
+        return result;
+    }
+
+    bool set_expiry(const std::string& key, int64_t expires_at) {
+        return partitionOf(key).set_expiry(key, expires_at);
+    }
+
+    bool clear_expiry(const std::string& key) {
+        return partitionOf(key).clear_expiry(key);
+    }
+
+    int64_t get_expiry(const std::string& key) {
+        return partitionOf(key).get_expiry(key);
+    }
+
+    std::vector<std::pair<std::string, int64_t>> load_expiries() {
+        std::vector<std::pair<std::string, int64_t>> result = parts[0]->db->load_expiries();
+        for (size_t i = 1; i < parts.size(); i++) {
+            auto more = parts[i]->db->load_expiries();
+            result.insert(result.end(), std::make_move_iterator(more.begin()), std::make_move_iterator(more.end()));
+        }
+        return result;
+    }
+
+    bool put_stream_to_db(const std::string& key, size_t size, const std::function<bool(char*, size_t)>& fill) {
+        return partitionOf(key).put_stream_to_db(key, size, fill);
+    }
+
+    bool get_stream_from_db(const std::string& key, const std::function<bool(const char*, size_t)>& sink) {
+        return partitionOf(key).get_stream_from_db(key, sink);
+    }
+
+    size_t collect_value_log_garbage(double garbage_ratio = -1) {
+        size_t dropped = 0;
+        for (auto& part : parts) {
+            dropped += part->db->collect_value_log_garbage(garbage_ratio);
+        }
+        return dropped;
+    }
+
+    ValueLogStats value_log_stats() const {
+        ValueLogStats stats;
+        for (const auto& part : parts) {
+            ValueLogStats partition = part->db->value_log_stats();
+            stats.segments += partition.segments;
+            stats.bytes += partition.bytes;
+            stats.garbage_bytes += partition.garbage_bytes;
+        }
+        return stats;
+    }
+
+    /// Backs up each partition to partitionPath(path, i, partitions()), see SQLiteDB::backup_to
+    /// The partitions are copied one after the other, the copy is no single point in time.
+    bool backup_to(const std::string& path, int pages_per_step = 256,
+                   const std::function<void(int, int)>& on_progress = nullptr) {
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!parts[i]->db->backup_to(partitionPath(path, i, parts.size()), pages_per_step, on_progress)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool set_change_log(size_t keep_rows) {
+        bool ok = true;
+        for (auto& part : parts) {
+            ok = part->db->set_change_log(keep_rows) && ok;
+        }
+        return ok;
+    }
+
+    bool drop_change_log() {
+        bool ok = true;
+        for (auto& part : parts) {
+            ok = part->db->drop_change_log() && ok;
+        }
+        return ok;
+    }
+
+    /// Kept in the first partition
+    int64_t get_replication_position(const std::string& source) {
+        return parts[0]->db->get_replication_position(source);
+    }
+
+    bool set_replication_position(const std::string& source, int64_t seq) {
+        return parts[0]->db->set_replication_position(source, seq);
+    }
+
+    bool record_reads(const std::vector<std::tuple<std::string, uint64_t, int64_t>>& reads) {
+        if (parts.size() == 1) {
+            return parts[0]->db->record_reads(reads);
+        }
+        std::vector<std::vector<std::tuple<std::string, uint64_t, int64_t>>> shares(parts.size());
+        for (const auto& read : reads) {
+            shares[index(std::get<0>(read))].push_back(read);
+        }
+        bool ok = true;
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (!shares[i].empty()) {
+                ok = parts[i]->db->record_reads(shares[i]) && ok;
+            }
+        }
+        return ok;
+    }
+
+    std::pair<uint64_t, int64_t> get_read_stats(const std::string& key) {
+        return partitionOf(key).get_read_stats(key);
+    }
+
+    /// Merges the partitions' pages, see SQLiteDB::warmup_batch
+    /// A row's rowid is its partition rowid * partitions() + partition, so the cursor stays unique.
+    std::vector<WarmupRow> warmup_batch(WarmupOrder order, int64_t after_sort_key, int64_t after_rowid, size_t limit) {
+        if (parts.size() == 1) {
+            return parts[0]->db->warmup_batch(order, after_sort_key, after_rowid, limit);
+        }
+        int64_t count = static_cast<int64_t>(parts.size());
+        std::vector<WarmupRow> rows;
+        for (int64_t i = 0; i < count; i++) {
+            // rows of this partition at after_sort_key come first if rowid * count + i < after_rowid
+            int64_t below = after_rowid <= i ? 0 : (after_rowid - i) / count + ((after_rowid - i) % count != 0);
+            for (auto& row : parts[i]->db->warmup_batch(order, after_sort_key, below, limit)) {
+                row.rowid = row.rowid * count + i;
+                rows.push_back(std::move(row));
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const WarmupRow& a, const WarmupRow& b) {
+            return std::tie(a.sort_key, a.rowid) > std::tie(b.sort_key, b.rowid);
+        });
+        if (rows.size() > limit) {
+            rows.resize(limit);
+        }
+        return rows;
+    }
+};
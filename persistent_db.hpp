@@ -1,31 +1,353 @@
+#pragma once
 #include <unordered_map>
 #include <queue>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <mutex>
 #include <thread>
+#include <cstdint>
+#include <climits>
+#include <chrono>
+#include <tuple>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <condition_variable>
 #include <sqlite3.h>
 #include <iostream>
+#include "value_log.hpp"
+
+/// Row order for SQLiteDB::warmup_batch
+enum class WarmupOrder {
+    RecentlyWritten, // written_at
+    MostRead,        // read_count
+    RecentlyRead,    // last_read
+};
+
+/// One row streamed by SQLiteDB::warmup_batch, sort_key and rowid are the paging cursor
+struct WarmupRow {
+    std::string key;
+    std::string value;
+    int64_t sort_key;
+    int64_t rowid;
+};
+
+/// Size of the value log, see SQLiteDB::value_log_stats
+struct ValueLogStats {
+    size_t segments = 0;
+    uint64_t bytes = 0;         // all segment files
+    uint64_t garbage_bytes = 0; // records no longer referenced, as counted by the table triggers
+};
+
+/// Kind of a change_log row, see SQLiteDB::set_change_log
+enum class ChangeOp {
+    Put = 1,    // the key's value was written
+    Remove = 2, // the key was removed
+    Expiry = 3, // the key's deadline was set or cleared
+};
+
+/// One change_log row. The row only names the key, a follower reads the key's current state
+struct Change {
+    int64_t seq;
+    std::string key;
+    ChangeOp op;
+    int64_t changed_at; // unix ms
+};
 
 // SQLite persistent storage
 class SQLiteDB {
 private:
     sqlite3* db;
     mutable std::mutex db_mutex;
+
+    // Key-value separation (ValueLogOptions::threshold): the row of a separated value has an empty
+    // value and points into the log with vlog_file, vlog_offset and vlog_length. Triggers add the
+    // record of every pointer that is replaced or deleted to value_log_garbage, per segment.
+    // The log is always opened for reads, so separated values stay readable with the mode off.
+    const ValueLogOptions log_options;
+    std::unique_ptr<ValueLog> value_log;
+    bool sync_value_log = true;          // guarded by db_mutex, off during bulk loads
+    std::mutex gc_mutex;                 // held by a garbage collection pass or a backup
+    std::thread gc_thread;
+    std::mutex gc_wait_mutex;
+    std::condition_variable gc_wake;
+    bool gc_stop = false;
+
+    // binds key, value and the write time, or an empty value and the pointer of a separated one
+    static constexpr const char* UPSERT_SQL =
+        "INSERT INTO cache_data (key, value, written_at, vlog_file, vlog_offset, vlog_length) VALUES (?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(key) DO UPDATE SET value = excluded.value, written_at = excluded.written_at, "
+        "vlog_file = excluded.vlog_file, vlog_offset = excluded.vlog_offset, vlog_length = excluded.vlog_length;";
+
+    static int64_t nowMillis() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool hasColumn(const char* table, const std::string& column) {
+        std::string sql = std::string("PRAGMA table_info(") + table + ");";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        bool found = false;
+        while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+            found = column == reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
+
+    /// Adds the access metadata columns to databases created before they existed
+    void migrate() {
+        static const char* const columns[][2] = {
+            {"written_at", "ALTER TABLE cache_data ADD COLUMN written_at INTEGER NOT NULL DEFAULT 0;"}, // unix ms
+            {"read_count", "ALTER TABLE cache_data ADD COLUMN read_count INTEGER NOT NULL DEFAULT 0;"},
+            {"last_read", "ALTER TABLE cache_data ADD COLUMN last_read INTEGER NOT NULL DEFAULT 0;"},  // unix ms
+            {"vlog_file", "ALTER TABLE cache_data ADD COLUMN vlog_file INTEGER;"}, // NULL unless the value is separated
+            {"vlog_offset", "ALTER TABLE cache_data ADD COLUMN vlog_offset INTEGER;"},
+            {"vlog_length", "ALTER TABLE cache_data ADD COLUMN vlog_length INTEGER;"},
+        };
+        for (const auto& column : columns) {
+            if (!hasColumn("cache_data", column[0])) {
+                char* err_msg = nullptr;
+                if (sqlite3_exec(db, column[1], nullptr, nullptr, &err_msg) != SQLITE_OK) {
+                    std::cerr << "SQL error: " << err_msg << std::endl;
+                    sqlite3_free(err_msg);
+                }
+            }
+        }
+
+        execOrReport("CREATE INDEX IF NOT EXISTS cache_data_written_at ON cache_data(written_at);"
+                     "CREATE INDEX IF NOT EXISTS cache_data_read_count ON cache_data(read_count);"
+                     "CREATE INDEX IF NOT EXISTS cache_data_last_read ON cache_data(last_read);");
+
+        // dead bytes = record header + key + value
+        execOrReport("CREATE TABLE IF NOT EXISTS value_log_garbage (file INTEGER PRIMARY KEY, dead_bytes INTEGER NOT NULL);"
+                     "CREATE TRIGGER IF NOT EXISTS value_log_replaced AFTER UPDATE OF vlog_file, vlog_offset ON cache_data "
+                     "WHEN OLD.vlog_file IS NOT NULL AND (NEW.vlog_file IS NOT OLD.vlog_file OR NEW.vlog_offset IS NOT OLD.vlog_offset) "
+                     "BEGIN INSERT INTO value_log_garbage VALUES (OLD.vlog_file, 8 + length(CAST(OLD.key AS BLOB)) + OLD.vlog_length) "
+                     "ON CONFLICT(file) DO UPDATE SET dead_bytes = dead_bytes + excluded.dead_bytes; END;"
+                     "CREATE TRIGGER IF NOT EXISTS value_log_deleted AFTER DELETE ON cache_data WHEN OLD.vlog_file IS NOT NULL "
+                     "BEGIN INSERT INTO value_log_garbage VALUES (OLD.vlog_file, 8 + length(CAST(OLD.key AS BLOB)) + OLD.vlog_length) "
+                     "ON CONFLICT(file) DO UPDATE SET dead_bytes = dead_bytes + excluded.dead_bytes; END;");
+    }
+
+    bool separates(const std::string& value) const {
+        return log_options.threshold > 0 && value.size() >= log_options.threshold;
+    }
+
+    /// Binds the parameters of UPSERT_SQL
+    static void bindPair(sqlite3_stmt* stmt, const std::string& key, const std::string& value, int64_t now,
+                         const ValueLog::Pointer* pointer) {
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+        if (pointer) {
+            sqlite3_bind_text(stmt, 2, "", 0, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 4, pointer->file);
+            sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(pointer->offset));
+            sqlite3_bind_int64(stmt, 6, pointer->length);
+        } else {
+            sqlite3_bind_text(stmt, 2, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_null(stmt, 4);
+            sqlite3_bind_null(stmt, 5);
+            sqlite3_bind_null(stmt, 6);
+        }
+        sqlite3_bind_int64(stmt, 3, now);
+    }
+
+    /// Reads the value at `column`, or from the value log if the pointer columns after it are set
+    bool columnValue(sqlite3_stmt* stmt, int column, std::string& out) {
+        if (sqlite3_column_type(stmt, column + 1) != SQLITE_NULL) {
+            ValueLog::Pointer pointer{static_cast<uint32_t>(sqlite3_column_int64(stmt, column + 1)),
+                                      static_cast<uint64_t>(sqlite3_column_int64(stmt, column + 2)),
+                                      static_cast<uint32_t>(sqlite3_column_int64(stmt, column + 3))};
+            return value_log->read(pointer, out);
+        }
+        // values are binary safe, so take the length from sqlite instead of the terminator
+        const char* value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+        out.assign(value ? value : "", value ? sqlite3_column_bytes(stmt, column) : 0);
+        return true;
+    }
+
+    /// Rewrites the still referenced records of a sealed segment to the active one, then drops it
+    /// Works in batches of a few MB, each one transaction, so writers get the connection in between.
+    /// A record is live if its key's row still points at it; that is checked under db_mutex, which
+    /// every writer holds while it appends and commits a pointer.
+    bool relocateSegment(uint32_t id) {
+        std::vector<std::tuple<std::string, std::string, ValueLog::Pointer>> batch;
+        size_t batch_bytes = 0;
+        auto flush = [&]() {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            sqlite3_stmt* check;
+            sqlite3_stmt* move;
+            if (sqlite3_prepare_v2(db, "SELECT 1 FROM cache_data WHERE key = ? AND vlog_file = ? AND vlog_offset = ?;",
+                                   -1, &check, nullptr) != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                return false;
+            }
+            if (sqlite3_prepare_v2(db, "UPDATE cache_data SET vlog_file = ?, vlog_offset = ? WHERE key = ?;",
+                                   -1, &move, nullptr) != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                sqlite3_finalize(check);
+                return false;
+            }
+            sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+            bool ok = true;
+            for (auto& [key, value, old_pointer] : batch) {
+                sqlite3_bind_text(check, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+                sqlite3_bind_int64(check, 2, old_pointer.file);
+                sqlite3_bind_int64(check, 3, static_cast<sqlite3_int64>(old_pointer.offset));
+                bool live = sqlite3_step(check) == SQLITE_ROW;
+                sqlite3_reset(check);
+                ValueLog::Pointer pointer;
+                if (!live) {
+                    continue;
+                }
+                if (!value_log->append(key, value, pointer)) {
+                    ok = false;
+                    break;
+                }
+                sqlite3_bind_int64(move, 1, pointer.file);
+                sqlite3_bind_int64(move, 2, static_cast<sqlite3_int64>(pointer.offset));
+                sqlite3_bind_text(move, 3, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+                ok = sqlite3_step(move) == SQLITE_DONE;
+                sqlite3_reset(move);
+                if (!ok) {
+                    break;
+                }
+            }
+            sqlite3_finalize(check);
+            sqlite3_finalize(move);
+            ok = ok && (!sync_value_log || value_log->sync());
+            sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+            batch.clear();
+            batch_bytes = 0;
+            return ok;
+        };
+
+        bool ok = value_log->scan(id, [&](const std::string& key, const std::string& value, const ValueLog::Pointer& pointer) {
+            batch.emplace_back(key, value, pointer);
+            batch_bytes += key.size() + value.size();
+            return batch_bytes < (4 << 20) || flush();
+        });
+        if (!ok || !flush()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(db_mutex);
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "DELETE FROM value_log_garbage WHERE file = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+        value_log->drop(id);
+        return true;
+    }
+
+    void runGarbageCollector() {
+        std::unique_lock<std::mutex> lock(gc_wait_mutex);
+        while (!gc_wake.wait_for(lock, std::chrono::milliseconds(log_options.gc_interval_ms), [this]() { return gc_stop; })) {
+            lock.unlock();
+            collect_value_log_garbage();
+            lock.lock();
+        }
+    }
+
+    /// @returns the rowid of key's row, or -1 if there is none. Caller must hold db_mutex
+    int64_t rowidOf(const std::string& key) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT rowid FROM cache_data WHERE key = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+        int64_t rowid = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+        sqlite3_finalize(stmt);
+        return rowid;
+    }
+
+    /// Reads one piece of a streamed inline value with a handle of its own. Caller must hold db_mutex
+    /// If the file changed since `version`, the row must still hold key's value of the same write time
+    /// and size, and `version` moves on
+    bool readBlobPieceLocked(const std::string& key, int64_t rowid, int64_t written_at, size_t size,
+                             unsigned int& version, size_t offset, char* out, size_t length) {
+        sqlite3_blob* blob = nullptr;
+        if (sqlite3_blob_open(db, "main", "cache_data", "value", rowid, 0, &blob) != SQLITE_OK) {
+            if (blob) {
+                sqlite3_blob_close(blob);
+            }
+            return false; // the row is gone
+        }
+        // the open handle holds the read transaction, so the check and the read see the same data
+        bool ok = static_cast<size_t>(sqlite3_blob_bytes(blob)) == size;
+        unsigned int current = 0;
+        sqlite3_file_control(db, "main", SQLITE_FCNTL_DATA_VERSION, &current);
+        if (ok && current != version) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT key = ? AND written_at = ? AND vlog_file IS NULL FROM cache_data WHERE rowid = ?;",
+                                   -1, &stmt, nullptr) != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                ok = false;
+            } else {
+                sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+                sqlite3_bind_int64(stmt, 2, written_at);
+                sqlite3_bind_int64(stmt, 3, rowid);
+                ok = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 0;
+                sqlite3_finalize(stmt);
+            }
+            version = current;
+        }
+        ok = ok && sqlite3_blob_read(blob, out, static_cast<int>(length), static_cast<int>(offset)) == SQLITE_OK;
+        sqlite3_blob_close(blob);
+        return ok;
+    }
+
+    bool execOrReport(const char* sql) {
+        char* err_msg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+            std::cerr << "SQL error: " << err_msg << std::endl;
+            sqlite3_free(err_msg);
+            return false;
+        }
+        return true;
+    }
+
+    bool dropChangeLogTriggers() {
+        return execOrReport("DROP TRIGGER IF EXISTS change_log_put;"
+                            "DROP TRIGGER IF EXISTS change_log_update;"
+                            "DROP TRIGGER IF EXISTS change_log_remove;"
+                            "DROP TRIGGER IF EXISTS change_log_expiry_set;"
+                            "DROP TRIGGER IF EXISTS change_log_expiry_update;"
+                            "DROP TRIGGER IF EXISTS change_log_expiry_cleared;"
+                            "DROP TRIGGER IF EXISTS change_log_trim;");
+    }
     
 public:
-    SQLiteDB(const std::string& db_path = "cache.db") {
+    static constexpr size_t STREAM_CHUNK = 64 * 1024; // bytes moved per step by the streaming calls
+
+    /// @param value_log_options with a threshold, large values are separated into db_path + ".vlog.N"
+    ///        files and a background thread collects their garbage
+    SQLiteDB(const std::string& db_path = "cache.db", const ValueLogOptions& value_log_options = {})
+        : log_options(value_log_options),
+          value_log(std::make_unique<ValueLog>(db_path + ".vlog.", value_log_options.segment_bytes)) {
         int rc = sqlite3_open(db_path.c_str(), &db);
         if (rc != SQLITE_OK) {
             std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
             db = nullptr;
             return;
         }
+        sqlite3_busy_timeout(db, 5000); // other processes may share the file (see CacheConfig::shared_segment)
         
-        // Create table if it doesn't exist
+        // Create tables if they don't exist
         const char* create_table_sql = 
             "CREATE TABLE IF NOT EXISTS cache_data ("
             "key TEXT PRIMARY KEY,"
             "value TEXT NOT NULL"
+            ");"
+            "CREATE TABLE IF NOT EXISTS cache_expiry ("
+            "key TEXT PRIMARY KEY,"
+            "expires_at INTEGER NOT NULL" // unix time in milliseconds
             ");";
         
         char* err_msg = nullptr;
@@ -34,9 +356,21 @@ public:
             std::cerr << "SQL error: " << err_msg << std::endl;
             sqlite3_free(err_msg);
         }
+        migrate();
+        if (log_options.threshold > 0) {
+            gc_thread = std::thread(&SQLiteDB::runGarbageCollector, this);
+        }
     }
     
     ~SQLiteDB() {
+        if (gc_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(gc_wait_mutex);
+                gc_stop = true;
+            }
+            gc_wake.notify_one();
+            gc_thread.join();
+        }
         if (db) {
             sqlite3_close(db);
         }
@@ -47,30 +381,123 @@ public:
 
         if(!db) return false;
         
-        const char* sql = "INSERT OR REPLACE INTO cache_data (key, value) VALUES (?, ?);";
+        // a separated value is durable in the log before its pointer commits
+        ValueLog::Pointer pointer;
+        bool separated = separates(value);
+        if (separated && (!value_log->append(key, value, pointer) || (sync_value_log && !value_log->sync()))) {
+            return false;
+        }
+
+        // upsert instead of INSERT OR REPLACE so the row keeps its read statistics
         sqlite3_stmt* stmt;
         
-        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        int rc = sqlite3_prepare_v2(db, UPSERT_SQL, -1, &stmt, nullptr);
         if (rc != SQLITE_OK) {
             std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
             return false;
         }
         
-        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+        bindPair(stmt, key, value, nowMillis(), separated ? &pointer : nullptr);
         
         rc = sqlite3_step(stmt);
         sqlite3_finalize(stmt);
         
         return rc == SQLITE_DONE;
     }
+
+    /// Writes the pair and its deadline (unix time in ms) in one transaction, so no other connection
+    /// sees the new value without its expiry
+    bool put_with_expiry(const std::string& key, const std::string& value, int64_t expires_at) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        ValueLog::Pointer pointer;
+        bool separated = separates(value);
+        if (separated && (!value_log->append(key, value, pointer) || (sync_value_log && !value_log->sync()))) {
+            return false;
+        }
+
+        sqlite3_stmt* put_stmt;
+        sqlite3_stmt* expiry_stmt;
+        if (sqlite3_prepare_v2(db, UPSERT_SQL, -1, &put_stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO cache_expiry (key, expires_at) VALUES (?, ?);", -1,
+                               &expiry_stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_finalize(put_stmt);
+            return false;
+        }
+
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+        bindPair(put_stmt, key, value, nowMillis(), separated ? &pointer : nullptr);
+        sqlite3_bind_text(expiry_stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_int64(expiry_stmt, 2, expires_at);
+        bool ok = sqlite3_step(put_stmt) == SQLITE_DONE && sqlite3_step(expiry_stmt) == SQLITE_DONE;
+        sqlite3_finalize(put_stmt);
+        sqlite3_finalize(expiry_stmt);
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+
+        return ok;
+    }
+
+    /// Writes all pairs in a single transaction
+    /// @returns true if every row was written, false if the batch was rolled back
+    bool put_many_to_db(const std::vector<std::pair<std::string, std::string>>& pairs) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        // separated values are appended first and synced once for the batch
+        std::vector<ValueLog::Pointer> pointers(pairs.size());
+        bool separated = false;
+        for (size_t i = 0; i < pairs.size(); i++) {
+            if (separates(pairs[i].second)) {
+                if (!value_log->append(pairs[i].first, pairs[i].second, pointers[i])) {
+                    return false;
+                }
+                separated = true;
+            }
+        }
+        if (separated && sync_value_log && !value_log->sync()) {
+            return false;
+        }
+
+        // upsert instead of INSERT OR REPLACE so the row keeps its read statistics
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, UPSERT_SQL, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+        bool ok = true;
+        int64_t now = nowMillis();
+        for (size_t i = 0; i < pairs.size(); i++) {
+            const auto& [key, value] = pairs[i];
+            bindPair(stmt, key, value, now, separates(value) ? &pointers[i] : nullptr);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                ok = false;
+                break;
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+
+        return ok;
+    }
     
     std::pair<bool, std::string> get_from_db(const std::string& key) {
         std::lock_guard<std::mutex> lock(db_mutex);
 
         if(!db) return {false, ""};
         
-        const char* sql = "SELECT value FROM cache_data WHERE key = ?;";
+        const char* sql = "SELECT value, vlog_file, vlog_offset, vlog_length FROM cache_data WHERE key = ?;";
         sqlite3_stmt* stmt;
         
         int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
@@ -79,23 +506,63 @@ public:
             return {false, ""};
         }
         
-        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
         
         std::pair<bool, std::string> result = {false, ""};
         if (sqlite3_step(stmt) == SQLITE_ROW) {
-            const unsigned char* value = sqlite3_column_text(stmt, 0);
-            if (value) {
-                result = {true, std::string(reinterpret_cast<const char*>(value))};
-            }
+            result.first = columnValue(stmt, 0, result.second);
         }
         
         sqlite3_finalize(stmt);
         return result;
     }
     
+    /// Looks up several keys with `key IN (...)` queries instead of one query per key
+    /// @returns the keys that were found, with their values
+    std::unordered_map<std::string, std::string> get_many_from_db(const std::vector<std::string>& keys) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        std::unordered_map<std::string, std::string> result;
+        if(!db) return result;
+
+        const size_t BATCH = 500; // stays below SQLITE_MAX_VARIABLE_NUMBER on old builds
+        for (size_t start = 0; start < keys.size(); start += BATCH) {
+            size_t n = std::min(BATCH, keys.size() - start);
+            std::string sql = "SELECT key, value, vlog_file, vlog_offset, vlog_length FROM cache_data WHERE key IN (?";
+            for (size_t i = 1; i < n; i++) {
+                sql += ",?";
+            }
+            sql += ");";
+
+            sqlite3_stmt* stmt;
+            int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+            if (rc != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                return result;
+            }
+            for (size_t i = 0; i < n; i++) {
+                const std::string& key = keys[start + i];
+                sqlite3_bind_text(stmt, static_cast<int>(i + 1), key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+            }
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+                std::string key_str(key, sqlite3_column_bytes(stmt, 0));
+                std::string value;
+                if (columnValue(stmt, 1, value)) {
+                    result[key_str] = std::move(value);
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+
+        return result;
+    }
+    
     bool remove_from_db(const std::string& key) {
         std::lock_guard<std::mutex> lock(db_mutex);
         
+        if(!db) return false;
+
         const char* sql = "DELETE FROM cache_data WHERE key = ?;";
         sqlite3_stmt* stmt;
         
@@ -105,7 +572,7 @@ public:
             return false;
         }
         
-        sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
         
         rc = sqlite3_step(stmt);
         int changes = sqlite3_changes(db);
@@ -113,4 +580,691 @@ public:
         
         return rc == SQLITE_DONE && changes > 0;
     }
-};
\ No newline at end of file
+
+    /// Iterates keys in rowid order, optionally filtered by a GLOB pattern
+    /// @returns (next cursor, keys); next cursor is 0 once the table is exhausted
+    std::pair<uint64_t, std::vector<std::string>> scan_db(uint64_t cursor, size_t count, const std::string& pattern = "") {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        std::pair<uint64_t, std::vector<std::string>> result = {0, {}};
+        if(!db) return result;
+
+        const char* sql = pattern.empty()
+            ? "SELECT rowid, key FROM cache_data WHERE rowid > ? ORDER BY rowid LIMIT ?;"
+            : "SELECT rowid, key FROM cache_data WHERE rowid > ? AND key GLOB ? ORDER BY rowid LIMIT ?;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return result;
+        }
+
+        int idx = 1;
+        sqlite3_bind_int64(stmt, idx++, static_cast<sqlite3_int64>(cursor));
+        if (!pattern.empty()) {
+            sqlite3_bind_text(stmt, idx++, pattern.data(), static_cast<int>(pattern.size()), SQLITE_TRANSIENT);
+        }
+        sqlite3_bind_int64(stmt, idx, static_cast<sqlite3_int64>(count));
+
+        uint64_t last_rowid = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            last_rowid = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0));
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            result.second.emplace_back(key, sqlite3_column_bytes(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+
+        // a short page means there is nothing after it
+        result.first = result.second.size() == count ? last_rowid : 0;
+        return result;
+    }
+
+    /// Stores the expiry deadline (unix time in ms) of a key
+    bool set_expiry(const std::string& key, int64_t expires_at) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        const char* sql = "INSERT OR REPLACE INTO cache_expiry (key, expires_at) VALUES (?, ?);";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, expires_at);
+
+        rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        return rc == SQLITE_DONE;
+    }
+
+    bool clear_expiry(const std::string& key) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        const char* sql = "DELETE FROM cache_expiry WHERE key = ?;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+
+        rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        return rc == SQLITE_DONE;
+    }
+
+    /// @returns the key's deadline (unix time in ms), or 0 if it has none
+    int64_t get_expiry(const std::string& key) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return 0;
+
+        const char* sql = "SELECT expires_at FROM cache_expiry WHERE key = ?;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return 0;
+        }
+
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+
+        int64_t deadline = 0;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            deadline = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        return deadline;
+    }
+
+    /// @returns every stored (key, deadline) pair
+    std::vector<std::pair<std::string, int64_t>> load_expiries() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        std::vector<std::pair<std::string, int64_t>> result;
+        if(!db) return result;
+
+        const char* sql = "SELECT key, expires_at FROM cache_expiry;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return result;
+        }
+
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            result.emplace_back(std::string(key, sqlite3_column_bytes(stmt, 0)), sqlite3_column_int64(stmt, 1));
+        }
+        sqlite3_finalize(stmt);
+
+        return result;
+    }
+
+    /// Writes a value of `size` bytes in STREAM_CHUNK pieces with incremental blob I/O, so neither the
+    /// caller nor SQLite holds the whole value. fill(buffer, length) must write exactly `length` bytes
+    /// and returns false to abort. The connection is held for the whole write, so fill should only
+    /// copy data that is at hand, e.g. read it from a file.
+    /// @returns true if the value was written, false if it was rolled back
+    bool put_stream_to_db(const std::string& key, size_t size, const std::function<bool(char*, size_t)>& fill) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        // the row gets a zero-filled value of the final size first, blob handles can't resize values
+        const char* sql = "INSERT INTO cache_data (key, value, written_at) VALUES (?, zeroblob(?), ?) "
+                          "ON CONFLICT(key) DO UPDATE SET value = excluded.value, written_at = excluded.written_at, "
+                          "vlog_file = NULL, vlog_offset = NULL, vlog_length = NULL;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(size));
+        sqlite3_bind_int64(stmt, 3, nowMillis());
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+
+        sqlite3_blob* blob = nullptr;
+        int64_t rowid = ok ? rowidOf(key) : -1;
+        ok = rowid >= 0 && sqlite3_blob_open(db, "main", "cache_data", "value", rowid, 1, &blob) == SQLITE_OK;
+        std::vector<char> buffer(std::min(size, STREAM_CHUNK));
+        for (size_t offset = 0; ok && offset < size; offset += buffer.size()) {
+            size_t length = std::min(buffer.size(), size - offset);
+            ok = fill(buffer.data(), length) &&
+                 sqlite3_blob_write(blob, buffer.data(), static_cast<int>(length), static_cast<int>(offset)) == SQLITE_OK;
+        }
+        if (blob) {
+            sqlite3_blob_close(blob);
+        }
+        if (!ok && sqlite3_errcode(db) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+        }
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+        return ok;
+    }
+
+    /// Reads a value in STREAM_CHUNK pieces with incremental blob I/O, passing each to sink(data, length)
+    /// Each piece is read under its own short read transaction: no blob handle or snapshot is held while
+    /// sink runs, so a slow sink neither holds up other callers nor pins the WAL. When the file changed
+    /// between pieces the row is checked again and the read stops if it was rewritten; a rewrite to the
+    /// same length within the same millisecond is not noticed. A separated value is read from its value
+    /// log segment, which keeps the old value readable across a rewrite.
+    /// @returns true if the key was found and every piece was delivered; false if the key is missing,
+    /// sink returned false, or the value changed during the read
+    bool get_stream_from_db(const std::string& key, const std::function<bool(const char*, size_t)>& sink) {
+        size_t size = 0;
+        int64_t rowid = -1;
+        int64_t written_at = 0;
+        unsigned int version = 0; // SQLITE_FCNTL_DATA_VERSION when the row was last checked
+        std::shared_ptr<ValueLog::Segment> segment; // set if the value is separated
+        ValueLog::Pointer pointer;
+        {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            if(!db) return false;
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT rowid, vlog_file, vlog_offset, vlog_length, written_at "
+                                       "FROM cache_data WHERE key = ?;",
+                                   -1, &stmt, nullptr) != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                return false;
+            }
+            sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                rowid = sqlite3_column_int64(stmt, 0);
+                written_at = sqlite3_column_int64(stmt, 4);
+                if (sqlite3_column_type(stmt, 1) != SQLITE_NULL) {
+                    pointer = {static_cast<uint32_t>(sqlite3_column_int64(stmt, 1)),
+                               static_cast<uint64_t>(sqlite3_column_int64(stmt, 2)),
+                               static_cast<uint32_t>(sqlite3_column_int64(stmt, 3))};
+                    segment = value_log->segment(pointer.file);
+                    if (!segment) {
+                        rowid = -1; // the log segment is missing
+                    }
+                }
+            }
+            sqlite3_finalize(stmt);
+            if (segment) {
+                size = pointer.length;
+            } else {
+                sqlite3_blob* blob = nullptr;
+                bool opened = rowid >= 0 && sqlite3_blob_open(db, "main", "cache_data", "value", rowid, 0, &blob) == SQLITE_OK;
+                if (opened) {
+                    size = static_cast<size_t>(sqlite3_blob_bytes(blob));
+                    sqlite3_file_control(db, "main", SQLITE_FCNTL_DATA_VERSION, &version);
+                }
+                if (blob) {
+                    sqlite3_blob_close(blob);
+                }
+                if (!opened) {
+                    return false;
+                }
+            }
+        }
+
+        std::vector<char> buffer(std::min(size, STREAM_CHUNK));
+        bool ok = true;
+        for (size_t offset = 0; ok && offset < size; offset += buffer.size()) {
+            size_t length = std::min(buffer.size(), size - offset);
+            if (segment) {
+                // the record outlives a rewrite of the key until the segment is collected and released
+                ok = segment->read(pointer.offset + offset, buffer.data(), length);
+            } else {
+                std::lock_guard<std::mutex> lock(db_mutex);
+                ok = db && readBlobPieceLocked(key, rowid, written_at, size, version, offset, buffer.data(), length);
+            }
+            ok = ok && sink(buffer.data(), length);
+        }
+        return ok;
+    }
+
+    /// Rewrites the live records of sealed value log segments that are at least `garbage_ratio` dead
+    /// and drops those segments; the background collector calls this with ValueLogOptions::gc_garbage_ratio
+    /// @returns the number of segments dropped
+    size_t collect_value_log_garbage(double garbage_ratio = -1) {
+        if (garbage_ratio < 0) {
+            garbage_ratio = log_options.gc_garbage_ratio;
+        }
+        std::lock_guard<std::mutex> gc_lock(gc_mutex);
+        std::unordered_map<uint32_t, uint64_t> garbage;
+        {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            if(!db) return 0;
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT file, dead_bytes FROM value_log_garbage;", -1, &stmt, nullptr) != SQLITE_OK) {
+                std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+                return 0;
+            }
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                garbage[static_cast<uint32_t>(sqlite3_column_int64(stmt, 0))] = sqlite3_column_int64(stmt, 1);
+            }
+            sqlite3_finalize(stmt);
+        }
+
+        std::vector<uint32_t> sealed = value_log->sealed();
+        size_t dropped = 0;
+        for (const auto& [id, size] : value_log->files()) {
+            if (std::find(sealed.begin(), sealed.end(), id) == sealed.end()) {
+                continue;
+            }
+            if (garbage[id] >= garbage_ratio * size && relocateSegment(id)) {
+                dropped++;
+            }
+        }
+        return dropped;
+    }
+
+    ValueLogStats value_log_stats() const {
+        ValueLogStats stats;
+        for (const auto& file : value_log->files()) {
+            stats.segments++;
+            stats.bytes += file.second;
+        }
+        std::lock_guard<std::mutex> lock(db_mutex);
+        if(!db) return stats;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT total(dead_bytes) FROM value_log_garbage;", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                stats.garbage_bytes = static_cast<uint64_t>(sqlite3_column_double(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+        }
+        return stats;
+    }
+
+    /// Online copy of the database to `path` with SQLite's backup API
+    /// Copies pages_per_step pages at a time and releases the connection between steps, so writers
+    /// are only held up for one step. Writes made through this connection meanwhile are applied to the
+    /// copy as well; writes by other processes make SQLite restart the copy. The copy is written to
+    /// path + ".tmp" and renamed into place once complete. Value log segments are copied next to it,
+    /// to path + ".vlog.N", with garbage collection paused so the copied pointers stay valid.
+    /// @param on_progress called after every step with (remaining pages, total pages)
+    bool backup_to(const std::string& path, int pages_per_step = 256,
+                   const std::function<void(int, int)>& on_progress = nullptr) {
+        std::lock_guard<std::mutex> gc_lock(gc_mutex);
+        std::string temp_path = path + ".tmp";
+        std::remove(temp_path.c_str());
+        sqlite3* dest;
+        if (sqlite3_open(temp_path.c_str(), &dest) != SQLITE_OK) {
+            std::cerr << "Cannot open database: " << sqlite3_errmsg(dest) << std::endl;
+            sqlite3_close(dest);
+            return false;
+        }
+
+        sqlite3_backup* backup;
+        {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            backup = db ? sqlite3_backup_init(dest, "main", db, "main") : nullptr;
+        }
+        if (!backup) {
+            std::cerr << "Failed: " << sqlite3_errmsg(dest) << std::endl;
+            sqlite3_close(dest);
+            std::remove(temp_path.c_str());
+            return false;
+        }
+
+        int rc;
+        do {
+            int remaining, total;
+            {
+                std::lock_guard<std::mutex> lock(db_mutex);
+                rc = sqlite3_backup_step(backup, pages_per_step);
+                remaining = sqlite3_backup_remaining(backup);
+                total = sqlite3_backup_pagecount(backup);
+            }
+            if (on_progress) {
+                on_progress(remaining, total);
+            }
+            if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10)); // another process is writing
+            } else if (rc == SQLITE_OK) {
+                std::this_thread::yield();
+            }
+        } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+        {
+            std::lock_guard<std::mutex> lock(db_mutex);
+            sqlite3_backup_finish(backup);
+        }
+        bool ok = rc == SQLITE_DONE;
+        if (!ok) {
+            std::cerr << "Backup failed: " << sqlite3_errstr(rc) << std::endl;
+        }
+        ok = sqlite3_close(dest) == SQLITE_OK && ok;
+        if (ok) {
+            ValueLog::removeFiles(path + ".vlog."); // segments of an older backup
+            ok = value_log->copyTo(path + ".vlog.");
+        }
+        if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /// Records every write, removal and deadline change of a key in change_log, for followers (see
+    /// FIFOCache's CacheConfig::follow_db_path). Triggers on cache_data and cache_expiry add the rows,
+    /// so writes of every process sharing the file are logged, and each trigger runs in its
+    /// statement's transaction. The oldest rows are trimmed so about keep_rows remain. The table is
+    /// created the first time logging is turned on.
+    /// Rewrites by the value log garbage collector are logged as puts of an unchanged value.
+    /// Logging stays on for every process sharing the file until drop_change_log() is called.
+    /// @param keep_rows 0 leaves the log as it is
+    bool set_change_log(size_t keep_rows) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        if (keep_rows == 0) {
+            return true;
+        }
+        const std::string now = "CAST((julianday('now') - 2440587.5) * 86400000 AS INTEGER)"; // unix ms
+        auto logRow = [&now](const char* row, ChangeOp op) {
+            return std::string("BEGIN INSERT INTO change_log (key, op, changed_at) VALUES (") + row + ".key, " +
+                   std::to_string(static_cast<int>(op)) + ", " + now + "); END;";
+        };
+        std::string sql =
+            "CREATE TABLE IF NOT EXISTS change_log (seq INTEGER PRIMARY KEY AUTOINCREMENT, key TEXT NOT NULL, "
+            "op INTEGER NOT NULL, changed_at INTEGER NOT NULL);"
+            "CREATE TRIGGER change_log_put AFTER INSERT ON cache_data " + logRow("NEW", ChangeOp::Put) +
+            "CREATE TRIGGER change_log_update AFTER UPDATE OF value, vlog_file, vlog_offset ON cache_data " +
+            logRow("NEW", ChangeOp::Put) +
+            "CREATE TRIGGER change_log_remove AFTER DELETE ON cache_data " + logRow("OLD", ChangeOp::Remove) +
+            "CREATE TRIGGER change_log_expiry_set AFTER INSERT ON cache_expiry " + logRow("NEW", ChangeOp::Expiry) +
+            "CREATE TRIGGER change_log_expiry_update AFTER UPDATE ON cache_expiry " + logRow("NEW", ChangeOp::Expiry) +
+            "CREATE TRIGGER change_log_expiry_cleared AFTER DELETE ON cache_expiry " + logRow("OLD", ChangeOp::Expiry) +
+            // trimming in steps of 256 rows keeps the cost off most writes
+            "CREATE TRIGGER change_log_trim AFTER INSERT ON change_log WHEN NEW.seq % 256 = 0 "
+            "BEGIN DELETE FROM change_log WHERE seq <= NEW.seq - " + std::to_string(keep_rows) + "; END;";
+        // replaced in one write transaction, so no other process commits a write while logging is off
+        sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+        bool ok = dropChangeLogTriggers() && execOrReport(sql.c_str());
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+        return ok;
+    }
+
+    /// Turns change logging off for every process sharing the file, the rows logged so far stay.
+    /// Followers and cross-process invalidation of other processes stop seeing changes.
+    bool drop_change_log() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        return dropChangeLogTriggers();
+    }
+
+    /// SQLite's PRAGMA data_version: changes whenever another connection, e.g. another process,
+    /// commits to the file, and not for this connection's own commits. Cheap enough to poll.
+    int64_t data_version() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return 0;
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return 0;
+        }
+        int64_t version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        return version;
+    }
+
+    /// @returns true if every change_log trigger is in place, i.e. no process turned logging off
+    bool change_log_enabled() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name IN "
+                                   "('change_log_put', 'change_log_update', 'change_log_remove', "
+                                   "'change_log_expiry_set', 'change_log_expiry_update', "
+                                   "'change_log_expiry_cleared', 'change_log_trim');",
+                               -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        bool enabled = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 7;
+        sqlite3_finalize(stmt);
+        return enabled;
+    }
+
+    /// @returns the oldest change_log seq still stored and the last one ever assigned; with no rows
+    /// stored the first is last + 1
+    std::pair<int64_t, int64_t> change_log_bounds() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db || !hasColumn("change_log", "seq")) return {1, 0}; // never logged
+
+        const char* sql = "SELECT (SELECT MIN(seq) FROM change_log), "
+                          "(SELECT seq FROM sqlite_sequence WHERE name = 'change_log');";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return {1, 0};
+        }
+        int64_t first = 0, last = 0;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            last = sqlite3_column_int64(stmt, 1); // NULL, so 0, before the first change
+            first = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? last + 1 : sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return {first, last};
+    }
+
+    /// @returns up to limit change_log rows after after_seq, oldest first
+    std::vector<Change> read_changes(int64_t after_seq, size_t limit) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        std::vector<Change> result;
+        if(!db || !hasColumn("change_log", "seq")) return result;
+
+        const char* sql = "SELECT seq, key, op, changed_at FROM change_log WHERE seq > ? ORDER BY seq LIMIT ?;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return result;
+        }
+        sqlite3_bind_int64(stmt, 1, after_seq);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(limit));
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            result.push_back(Change{sqlite3_column_int64(stmt, 0), std::string(key, sqlite3_column_bytes(stmt, 1)),
+                                    static_cast<ChangeOp>(sqlite3_column_int(stmt, 2)), sqlite3_column_int64(stmt, 3)});
+        }
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
+    /// @returns the last change of source applied to this database, -1 if it was never synced
+    int64_t get_replication_position(const std::string& source) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db || !hasColumn("replication_position", "seq")) return -1;
+
+        const char* sql = "SELECT seq FROM replication_position WHERE source = ?;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, source.data(), static_cast<int>(source.size()), SQLITE_TRANSIENT);
+        int64_t seq = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+        sqlite3_finalize(stmt);
+        return seq;
+    }
+
+    bool set_replication_position(const std::string& source, int64_t seq) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        // created by the first follower, the last change of each source applied here
+        if (!execOrReport("CREATE TABLE IF NOT EXISTS replication_position (source TEXT PRIMARY KEY, seq INTEGER NOT NULL);")) {
+            return false;
+        }
+        const char* sql = "INSERT OR REPLACE INTO replication_position (source, seq) VALUES (?, ?);";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, source.data(), static_cast<int>(source.size()), SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, seq);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        return rc == SQLITE_DONE;
+    }
+
+    /// Prepares the database for a bulk load (see bulk_loader.hpp) or restores normal operation
+    /// While on, the access metadata indexes are dropped, to be rebuilt in one pass afterwards, and
+    /// commits don't wait for fsync. A crash during a bulk load can therefore lose or corrupt the load.
+    bool set_bulk_mode(bool on) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        sync_value_log = !on;
+        if (on) {
+            return execOrReport("PRAGMA synchronous = OFF;"
+                                "PRAGMA cache_size = -262144;" // 256MB of pages, in KiB
+                                "DROP INDEX IF EXISTS cache_data_written_at;"
+                                "DROP INDEX IF EXISTS cache_data_read_count;"
+                                "DROP INDEX IF EXISTS cache_data_last_read;");
+        }
+        migrate();
+        return execOrReport("PRAGMA cache_size = -2000;"
+                            "PRAGMA synchronous = FULL;");
+    }
+
+    /// Adds batched read statistics, (key, reads, last read time in ms) per row, in one transaction
+    bool record_reads(const std::vector<std::tuple<std::string, uint64_t, int64_t>>& reads) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return false;
+
+        const char* sql = "UPDATE cache_data SET read_count = read_count + ?, last_read = MAX(last_read, ?) "
+                          "WHERE key = ?;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+
+        sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+        bool ok = true;
+        for (const auto& [key, count, last_read] : reads) {
+            sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(count));
+            sqlite3_bind_int64(stmt, 2, last_read);
+            sqlite3_bind_text(stmt, 3, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                ok = false;
+                break;
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+
+        return ok;
+    }
+
+    /// @returns (read_count, last_read) of a row, (0, 0) if it doesn't exist
+    std::pair<uint64_t, int64_t> get_read_stats(const std::string& key) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        if(!db) return {0, 0};
+
+        const char* sql = "SELECT read_count, last_read FROM cache_data WHERE key = ?;";
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return {0, 0};
+        }
+
+        sqlite3_bind_text(stmt, 1, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+
+        std::pair<uint64_t, int64_t> result{0, 0};
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            result = {static_cast<uint64_t>(sqlite3_column_int64(stmt, 0)), sqlite3_column_int64(stmt, 1)};
+        }
+        sqlite3_finalize(stmt);
+
+        return result;
+    }
+
+    /// Next page of rows in descending `order`, walking the matching index
+    /// Start with after_sort_key = after_rowid = INT64_MAX, then pass the last row's sort_key and rowid
+    std::vector<WarmupRow> warmup_batch(WarmupOrder order, int64_t after_sort_key, int64_t after_rowid, size_t limit) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+
+        std::vector<WarmupRow> rows;
+        if(!db) return rows;
+
+        const char* sql = nullptr;
+        switch (order) {
+        case WarmupOrder::RecentlyWritten:
+            sql = "SELECT key, value, vlog_file, vlog_offset, vlog_length, written_at, rowid FROM cache_data "
+                  "WHERE written_at < ?1 OR (written_at = ?1 AND rowid < ?2) "
+                  "ORDER BY written_at DESC, rowid DESC LIMIT ?3;";
+            break;
+        case WarmupOrder::MostRead:
+            sql = "SELECT key, value, vlog_file, vlog_offset, vlog_length, read_count, rowid FROM cache_data "
+                  "WHERE read_count < ?1 OR (read_count = ?1 AND rowid < ?2) "
+                  "ORDER BY read_count DESC, rowid DESC LIMIT ?3;";
+            break;
+        case WarmupOrder::RecentlyRead:
+            sql = "SELECT key, value, vlog_file, vlog_offset, vlog_length, last_read, rowid FROM cache_data "
+                  "WHERE last_read < ?1 OR (last_read = ?1 AND rowid < ?2) "
+                  "ORDER BY last_read DESC, rowid DESC LIMIT ?3;";
+            break;
+        }
+        sqlite3_stmt* stmt;
+
+        int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            std::cerr << "Failed: " << sqlite3_errmsg(db) << std::endl;
+            return rows;
+        }
+
+        sqlite3_bind_int64(stmt, 1, after_sort_key);
+        sqlite3_bind_int64(stmt, 2, after_rowid);
+        sqlite3_bind_int64(stmt, 3, static_cast<sqlite3_int64>(std::min<size_t>(limit, INT_MAX)));
+
+        rows.reserve(limit);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            int key_size = sqlite3_column_bytes(stmt, 0);
+            WarmupRow row{std::string(key, key_size), "", sqlite3_column_int64(stmt, 5), sqlite3_column_int64(stmt, 6)};
+            if (columnValue(stmt, 1, row.value)) {
+                rows.push_back(std::move(row));
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        return rows;
+    }
+};
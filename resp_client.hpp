@@ -0,0 +1,144 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "resp_protocol.hpp"
+
+/// Minimal blocking RESP client
+/// send() only buffers the request, so several sends followed by the same number of
+/// readReply() calls pipeline them over one round trip
+class RespClient {
+private:
+    int fd = -1;
+    std::string pending; // encoded requests not written yet
+    std::string buffer;  // received bytes not parsed yet
+    size_t buffer_pos = 0;
+
+    bool flushPending() {
+        size_t sent = 0;
+        while (sent < pending.size()) {
+            ssize_t n = ::send(fd, pending.data() + sent, pending.size() - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            sent += n;
+        }
+        pending.clear();
+        return true;
+    }
+
+public:
+    RespClient() = default;
+    ~RespClient() {
+        disconnect();
+    }
+
+    RespClient(const RespClient&) = delete;
+    RespClient& operator=(const RespClient&) = delete;
+
+    RespClient(RespClient&& other) noexcept
+        : fd(other.fd), pending(std::move(other.pending)), buffer(std::move(other.buffer)),
+          buffer_pos(other.buffer_pos) {
+        other.fd = -1;
+    }
+
+    bool connect(const std::string& host, uint16_t port) {
+        disconnect();
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+            ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            disconnect();
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    void disconnect() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        pending.clear();
+        buffer.clear();
+        buffer_pos = 0;
+    }
+
+    bool connected() const {
+        return fd >= 0;
+    }
+
+    /// Queues a command, it is written on the next readReply() or flush()
+    void send(const std::vector<std::string>& args) {
+        resp::appendCommand(pending, args);
+    }
+
+    /// Queues raw bytes, used to exercise inline commands and split frames
+    void sendRaw(const std::string& bytes) {
+        pending += bytes;
+    }
+
+    bool flush() {
+        return fd >= 0 && flushPending();
+    }
+
+    /// Flushes queued commands and blocks until the next reply arrives
+    /// @returns false if the connection failed or the reply was malformed
+    bool readReply(resp::Value& out) {
+        if (fd < 0 || !flushPending()) {
+            return false;
+        }
+        while (true) {
+            size_t pos = buffer_pos;
+            resp::ParseResult result = resp::parseReply(buffer.data(), buffer.size(), pos, out);
+            if (result == resp::ParseResult::Complete) {
+                buffer_pos = pos;
+                if (buffer_pos == buffer.size()) {
+                    buffer.clear();
+                    buffer_pos = 0;
+                }
+                return true;
+            }
+            if (result == resp::ParseResult::Error) {
+                return false;
+            }
+
+            char chunk[16 * 1024];
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, n);
+        }
+    }
+
+    /// Sends one command and waits for its reply
+    /// @returns the reply, or an Error value if the connection failed
+    resp::Value command(const std::vector<std::string>& args) {
+        send(args);
+        resp::Value reply;
+        if (!readReply(reply)) {
+            reply = resp::Value{};
+            reply.type = resp::Value::Type::Error;
+            reply.str = "ERR connection failed";
+        }
+        return reply;
+    }
+};
@@ -0,0 +1,277 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include "fifo_cache.hpp"
+#include "kv_server.hpp"
+#include "resp_protocol.hpp"
+
+/// Executes RESP commands against a FIFOCache
+/// Supported: GET, SET [EX|PX], DEL, MGET, MSET, EXPIRE, INCR, SCAN [MATCH] [COUNT], INFO, PING, QUIT
+/// A follower (CacheConfig::follow_db_path) answers writes with a READONLY error
+class RespHandler : public ProtocolHandler {
+private:
+    FIFOCache& cache;
+    std::atomic<uint64_t> commands_processed{0};
+
+    static constexpr size_t DEFAULT_SCAN_COUNT = 10;
+
+    static std::string toUpper(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::toupper(c); });
+        return s;
+    }
+
+    static bool parseInteger(const std::string& text, long long& out) {
+        if (text.empty()) {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && ptr == text.data() + text.size();
+    }
+
+    static void wrongArity(std::string& out, const std::string& command) {
+        resp::appendError(out, "ERR wrong number of arguments for '" + command + "' command");
+    }
+
+    void cmdGet(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() != 2) {
+            return wrongArity(out, "get");
+        }
+        auto result = cache.get(args[1]);
+        if (result.first.empty()) {
+            resp::appendNull(out);
+        } else {
+            resp::appendBulkString(out, result.second);
+        }
+    }
+
+    void cmdSet(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() != 3 && args.size() != 5) {
+            return wrongArity(out, "set");
+        }
+        long long ttl_ms = 0;
+        if (args.size() == 5) {
+            std::string option = toUpper(args[3]);
+            long long amount;
+            if (!parseInteger(args[4], amount) || amount <= 0) {
+                return resp::appendError(out, "ERR invalid expire time in 'set' command");
+            }
+            if (option == "EX") {
+                ttl_ms = amount > LLONG_MAX / 1000 ? LLONG_MAX : amount * 1000;
+            } else if (option == "PX") {
+                ttl_ms = amount;
+            } else {
+                return resp::appendError(out, "ERR syntax error");
+            }
+        }
+        if (args[1].empty()) {
+            return resp::appendError(out, "ERR empty keys are not supported");
+        }
+        cache.put_with_ttl(args[1], args[2], ttl_ms);
+        resp::appendSimpleString(out, "OK");
+    }
+
+    void cmdDel(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() < 2) {
+            return wrongArity(out, "del");
+        }
+        long long removed = 0;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (cache.remove(args[i])) {
+                removed++;
+            }
+        }
+        resp::appendInteger(out, removed);
+    }
+
+    void cmdMGet(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() < 2) {
+            return wrongArity(out, "mget");
+        }
+        std::vector<std::string> keys(args.begin() + 1, args.end());
+        auto results = cache.get_many(keys);
+        resp::appendArrayHeader(out, results.size());
+        for (const auto& [found, value] : results) {
+            if (found) {
+                resp::appendBulkString(out, value);
+            } else {
+                resp::appendNull(out);
+            }
+        }
+    }
+
+    void cmdMSet(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() < 3 || args.size() % 2 == 0) {
+            return wrongArity(out, "mset");
+        }
+        std::vector<std::pair<std::string, std::string>> pairs;
+        pairs.reserve(args.size() / 2);
+        for (size_t i = 1; i + 1 < args.size(); i += 2) {
+            if (args[i].empty()) {
+                return resp::appendError(out, "ERR empty keys are not supported");
+            }
+            pairs.emplace_back(args[i], args[i + 1]);
+        }
+        cache.put_many(pairs);
+        resp::appendSimpleString(out, "OK");
+    }
+
+    void cmdExpire(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() != 3) {
+            return wrongArity(out, "expire");
+        }
+        long long seconds;
+        if (!parseInteger(args[2], seconds)) {
+            return resp::appendError(out, "ERR value is not an integer or out of range");
+        }
+        resp::appendInteger(out, cache.expire(args[1], seconds) ? 1 : 0);
+    }
+
+    /// TTL in seconds, PTTL in milliseconds; -1 without a TTL, -2 for a missing key
+    void cmdTtl(const std::vector<std::string>& args, std::string& out, bool milliseconds) {
+        if (args.size() != 2) {
+            return wrongArity(out, milliseconds ? "pttl" : "ttl");
+        }
+        long long ttl = cache.ttl_ms(args[1]);
+        resp::appendInteger(out, ttl < 0 || milliseconds ? ttl : (ttl + 500) / 1000);
+    }
+
+    void cmdIncr(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() != 2) {
+            return wrongArity(out, "incr");
+        }
+        if (args[1].empty()) {
+            return resp::appendError(out, "ERR empty keys are not supported");
+        }
+        auto result = cache.incr(args[1]);
+        if (!result.first) {
+            return resp::appendError(out, "ERR value is not an integer or out of range");
+        }
+        resp::appendInteger(out, result.second);
+    }
+
+    void cmdScan(const std::vector<std::string>& args, std::string& out) {
+        if (args.size() < 2 || args.size() % 2 != 0) {
+            return wrongArity(out, "scan");
+        }
+        long long cursor;
+        if (!parseInteger(args[1], cursor) || cursor < 0) {
+            return resp::appendError(out, "ERR invalid cursor");
+        }
+
+        std::string pattern;
+        long long count = DEFAULT_SCAN_COUNT;
+        for (size_t i = 2; i + 1 < args.size(); i += 2) {
+            std::string option = toUpper(args[i]);
+            if (option == "MATCH") {
+                pattern = args[i + 1] == "*" ? "" : args[i + 1];
+            } else if (option == "COUNT") {
+                if (!parseInteger(args[i + 1], count) || count < 1) {
+                    return resp::appendError(out, "ERR value is not an integer or out of range");
+                }
+            } else {
+                return resp::appendError(out, "ERR syntax error");
+            }
+        }
+
+        auto result = cache.scan(static_cast<uint64_t>(cursor), static_cast<size_t>(count), pattern);
+        resp::appendArrayHeader(out, 2);
+        resp::appendBulkString(out, std::to_string(result.first));
+        resp::appendArrayHeader(out, result.second.size());
+        for (const auto& key : result.second) {
+            resp::appendBulkString(out, key);
+        }
+    }
+
+    void cmdInfo(std::string& out) {
+        CacheStats stats = cache.stats();
+        std::string info;
+        info += "# Server\r\n";
+        info += "redis_version:7.0.0\r\n"; // clients and benchmark tools parse this field
+        info += "kvs_mode:fifo-cache\r\n";
+        info += "\r\n# Stats\r\n";
+        info += "total_commands_processed:" + std::to_string(commands_processed.load()) + "\r\n";
+        info += "keyspace_hits:" + std::to_string(stats.hits) + "\r\n";
+        info += "keyspace_misses:" + std::to_string(stats.misses) + "\r\n";
+        info += "evicted_keys:" + std::to_string(stats.evictions) + "\r\n";
+        info += "kvs_background_evictions:" + std::to_string(stats.background_evictions) + "\r\n";
+        info += "kvs_max_inline_evict_loop:" + std::to_string(stats.max_inline_evict_loop) + "\r\n";
+        info += "kvs_hit_bytes:" + std::to_string(stats.hit_bytes) + "\r\n";
+        info += "kvs_miss_bytes:" + std::to_string(stats.miss_bytes) + "\r\n";
+        info += "kvs_db_read_micros:" + std::to_string(stats.fetch_micros) + "\r\n";
+        info += "kvs_saved_db_read_micros:" + std::to_string(stats.saved_fetch_micros) + "\r\n";
+        info += "\r\n# Memory\r\n";
+        info += "used_memory:" + std::to_string(stats.current_size) + "\r\n";
+        info += "maxmemory:" + std::to_string(stats.max_size) + "\r\n";
+        info += "cached_keys:" + std::to_string(stats.entries) + "\r\n";
+        info += "\r\n# Replication\r\n";
+        info += std::string("role:") + (cache.is_follower() ? "slave" : "master") + "\r\n";
+        if (cache.is_follower()) {
+            info += "kvs_replication_applied_seq:" + std::to_string(stats.replication_applied_seq) + "\r\n";
+            info += "kvs_replication_source_seq:" + std::to_string(stats.replication_source_seq) + "\r\n";
+            info += "kvs_replication_lag_ms:" + std::to_string(stats.replication_lag_ms) + "\r\n";
+        }
+        resp::appendBulkString(out, info);
+    }
+
+    /// @returns false if the connection should be closed after the reply
+    bool execute(const std::vector<std::string>& args, std::string& out) {
+        commands_processed++;
+        std::string command = toUpper(args[0]);
+        bool write = command == "SET" || command == "DEL" || command == "MSET" || command == "EXPIRE" || command == "INCR";
+
+        if (write && cache.is_follower()) {
+            resp::appendError(out, "READONLY You can't write against a read only replica.");
+        }
+        else if (command == "GET") cmdGet(args, out);
+        else if (command == "SET") cmdSet(args, out);
+        else if (command == "DEL") cmdDel(args, out);
+        else if (command == "MGET") cmdMGet(args, out);
+        else if (command == "MSET") cmdMSet(args, out);
+        else if (command == "EXPIRE") cmdExpire(args, out);
+        else if (command == "INCR") cmdIncr(args, out);
+        else if (command == "TTL") cmdTtl(args, out, false);
+        else if (command == "PTTL") cmdTtl(args, out, true);
+        else if (command == "SCAN") cmdScan(args, out);
+        else if (command == "INFO") cmdInfo(out);
+        else if (command == "PING") {
+            if (args.size() > 1) resp::appendBulkString(out, args[1]);
+            else resp::appendSimpleString(out, "PONG");
+        }
+        else if (command == "QUIT") {
+            resp::appendSimpleString(out, "OK");
+            return false;
+        }
+        else {
+            resp::appendError(out, "ERR unknown command '" + args[0] + "'");
+        }
+        return true;
+    }
+
+public:
+    explicit RespHandler(FIFOCache& cache) : cache(cache) {}
+
+    size_t handle(const char* data, size_t len, std::string& out, bool& close_connection) override {
+        size_t pos = 0;
+        std::vector<std::string> args;
+        while (!close_connection) {
+            resp::ParseResult result = resp::parseCommand(data, len, pos, args);
+            if (result == resp::ParseResult::Incomplete) {
+                break;
+            }
+            if (result == resp::ParseResult::Error) {
+                resp::appendError(out, "ERR Protocol error");
+                close_connection = true;
+                return len;
+            }
+            if (args.empty()) {
+                continue; // blank inline line
+            }
+            if (!execute(args, out)) {
+                close_connection = true;
+            }
+        }
+        return pos;
+    }
+};
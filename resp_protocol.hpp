@@ -0,0 +1,246 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+// Wire format helpers for the subset of RESP2 (REdis Serialization Protocol) we speak
+namespace resp {
+
+enum class ParseResult {
+    Complete,   // one full frame was parsed
+    Incomplete, // more bytes are needed, nothing was consumed
+    Error       // malformed input, the connection should be closed
+};
+
+constexpr size_t MAX_BULK_LENGTH = 512 * 1024 * 1024; // same limit as redis
+constexpr size_t MAX_ARGS = 1024 * 1024;
+constexpr size_t MAX_INLINE_LENGTH = 64 * 1024;
+
+/// Reads a CRLF terminated integer starting at pos
+/// @returns Incomplete if the line isn't terminated yet
+inline ParseResult parseLineInteger(const char* data, size_t len, size_t& pos, long long& out) {
+    const char* start = data + pos;
+    const char* end = static_cast<const char*>(std::memchr(start, '\r', len - pos));
+    if (!end || end + 1 >= data + len) {
+        return len - pos > 32 ? ParseResult::Error : ParseResult::Incomplete;
+    }
+    if (end[1] != '\n') {
+        return ParseResult::Error;
+    }
+    auto [ptr, ec] = std::from_chars(start, end, out);
+    if (ec != std::errc() || ptr != end) {
+        return ParseResult::Error;
+    }
+    pos = (end - data) + 2;
+    return ParseResult::Complete;
+}
+
+/// Parses one request: either a multibulk array of bulk strings or an inline command
+/// On success pos is advanced past the request, otherwise it is left untouched
+inline ParseResult parseCommand(const char* data, size_t len, size_t& pos, std::vector<std::string>& args) {
+    args.clear();
+    if (pos >= len) {
+        return ParseResult::Incomplete;
+    }
+
+    size_t p = pos;
+    if (data[p] != '*') {
+        // inline command, space separated and terminated by a newline (used by telnet / nc)
+        const char* nl = static_cast<const char*>(std::memchr(data + p, '\n', len - p));
+        if (!nl) {
+            return len - p > MAX_INLINE_LENGTH ? ParseResult::Error : ParseResult::Incomplete;
+        }
+        size_t line_end = nl - data;
+        size_t end = (line_end > p && data[line_end - 1] == '\r') ? line_end - 1 : line_end;
+        size_t i = p;
+        while (i < end) {
+            while (i < end && data[i] == ' ') i++;
+            size_t start = i;
+            while (i < end && data[i] != ' ') i++;
+            if (i > start) {
+                args.emplace_back(data + start, i - start);
+            }
+        }
+        pos = line_end + 1;
+        return ParseResult::Complete;
+    }
+
+    p++;
+    long long count;
+    ParseResult r = parseLineInteger(data, len, p, count);
+    if (r != ParseResult::Complete) {
+        return r;
+    }
+    if (count < 0 || static_cast<size_t>(count) > MAX_ARGS) {
+        return ParseResult::Error;
+    }
+
+    // the count is the client's claim, an unfinished frame must not make us allocate for it
+    args.reserve(std::min<size_t>(static_cast<size_t>(count), 64));
+    for (long long i = 0; i < count; i++) {
+        if (p >= len) {
+            return ParseResult::Incomplete;
+        }
+        if (data[p] != '$') {
+            return ParseResult::Error;
+        }
+        p++;
+        long long bulk_len;
+        r = parseLineInteger(data, len, p, bulk_len);
+        if (r != ParseResult::Complete) {
+            return r;
+        }
+        if (bulk_len < 0 || static_cast<size_t>(bulk_len) > MAX_BULK_LENGTH) {
+            return ParseResult::Error;
+        }
+        if (len - p < static_cast<size_t>(bulk_len) + 2) {
+            return ParseResult::Incomplete;
+        }
+        if (data[p + bulk_len] != '\r' || data[p + bulk_len + 1] != '\n') {
+            return ParseResult::Error;
+        }
+        args.emplace_back(data + p, bulk_len);
+        p += bulk_len + 2;
+    }
+
+    pos = p;
+    return ParseResult::Complete;
+}
+
+inline void appendSimpleString(std::string& out, const std::string& s) {
+    out += '+';
+    out += s;
+    out += "\r\n";
+}
+
+inline void appendError(std::string& out, const std::string& message) {
+    out += '-';
+    out += message;
+    out += "\r\n";
+}
+
+inline void appendInteger(std::string& out, long long value) {
+    out += ':';
+    out += std::to_string(value);
+    out += "\r\n";
+}
+
+inline void appendBulkString(std::string& out, const std::string& s) {
+    out += '$';
+    out += std::to_string(s.size());
+    out += "\r\n";
+    out += s;
+    out += "\r\n";
+}
+
+inline void appendNull(std::string& out) {
+    out += "$-1\r\n";
+}
+
+inline void appendArrayHeader(std::string& out, size_t count) {
+    out += '*';
+    out += std::to_string(count);
+    out += "\r\n";
+}
+
+/// Encodes a client request as a multibulk array
+inline void appendCommand(std::string& out, const std::vector<std::string>& args) {
+    appendArrayHeader(out, args.size());
+    for (const auto& arg : args) {
+        appendBulkString(out, arg);
+    }
+}
+
+/// A decoded server reply
+struct Value {
+    enum class Type { SimpleString, Error, Integer, BulkString, Null, Array };
+
+    Type type = Type::Null;
+    std::string str;       // SimpleString, Error and BulkString payload
+    long long integer = 0; // Integer payload
+    std::vector<Value> elements; // Array elements
+
+    bool isError() const { return type == Type::Error; }
+};
+
+/// Parses one reply frame starting at pos, advances pos on success
+inline ParseResult parseReply(const char* data, size_t len, size_t& pos, Value& out) {
+    if (pos >= len) {
+        return ParseResult::Incomplete;
+    }
+
+    size_t p = pos + 1;
+    char marker = data[pos];
+    out = Value{};
+
+    switch (marker) {
+    case '+':
+    case '-': {
+        const char* start = data + p;
+        const char* end = static_cast<const char*>(std::memchr(start, '\r', len - p));
+        if (!end || end + 1 >= data + len) {
+            return ParseResult::Incomplete;
+        }
+        out.type = marker == '+' ? Value::Type::SimpleString : Value::Type::Error;
+        out.str.assign(start, end);
+        pos = (end - data) + 2;
+        return ParseResult::Complete;
+    }
+    case ':': {
+        ParseResult r = parseLineInteger(data, len, p, out.integer);
+        if (r != ParseResult::Complete) {
+            return r;
+        }
+        out.type = Value::Type::Integer;
+        pos = p;
+        return ParseResult::Complete;
+    }
+    case '$': {
+        long long bulk_len;
+        ParseResult r = parseLineInteger(data, len, p, bulk_len);
+        if (r != ParseResult::Complete) {
+            return r;
+        }
+        if (bulk_len < 0) {
+            out.type = Value::Type::Null;
+            pos = p;
+            return ParseResult::Complete;
+        }
+        if (len - p < static_cast<size_t>(bulk_len) + 2) {
+            return ParseResult::Incomplete;
+        }
+        out.type = Value::Type::BulkString;
+        out.str.assign(data + p, bulk_len);
+        pos = p + bulk_len + 2;
+        return ParseResult::Complete;
+    }
+    case '*': {
+        long long count;
+        ParseResult r = parseLineInteger(data, len, p, count);
+        if (r != ParseResult::Complete) {
+            return r;
+        }
+        if (count < 0) {
+            out.type = Value::Type::Null;
+            pos = p;
+            return ParseResult::Complete;
+        }
+        out.type = Value::Type::Array;
+        out.elements.resize(count);
+        for (long long i = 0; i < count; i++) {
+            r = parseReply(data, len, p, out.elements[i]);
+            if (r != ParseResult::Complete) {
+                return r;
+            }
+        }
+        pos = p;
+        return ParseResult::Complete;
+    }
+    default:
+        return ParseResult::Error;
+    }
+}
+
+} // namespace resp
@@ -0,0 +1,363 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include "resp_client.hpp"
+#include "fnv_hash.hpp"
+
+/// Client that spreads keys over several kv_server instances with a consistent hash ring
+///
+/// Every node owns virtual_nodes points on a 64-bit ring, placed by hashing "host:port#i"; a key
+/// belongs to the first point at or after its hash. Adding a node therefore only moves the keys
+/// that land on its points, about 1/N of them, and removing one only moves its own keys. The hash is
+/// fnv::mixed, identical in every process and build, so independent clients agree on placement.
+/// Multi-key calls are split by node and sent to all nodes before any reply is read, so the nodes
+/// work on their share in parallel and the call costs one round trip. rebalance() moves stored keys
+/// to their owners after the node set changed. Like RespClient, an instance must not be used from
+/// several threads at once.
+class RespRouter {
+public:
+    struct Node {
+        std::string host;
+        uint16_t port;
+    };
+
+private:
+    struct Member {
+        Node node;
+        RespClient client;
+    };
+
+    const size_t virtual_nodes;
+    std::vector<std::unique_ptr<Member>> members;
+    std::vector<std::pair<uint64_t, size_t>> ring; // (point, member), sorted by point
+
+    static std::string nameOf(const Node& node) {
+        return node.host + ":" + std::to_string(node.port);
+    }
+
+    void buildRing() {
+        ring.clear();
+        for (size_t m = 0; m < members.size(); m++) {
+            std::string name = nameOf(members[m]->node) + "#";
+            for (size_t i = 0; i < virtual_nodes; i++) {
+                ring.emplace_back(fnv::mixed(name + std::to_string(i)), m);
+            }
+        }
+        std::sort(ring.begin(), ring.end());
+    }
+
+    /// The member's connection, reconnected if an earlier call lost it
+    RespClient* clientOf(size_t member) {
+        Member& m = *members[member];
+        if (!m.client.connected() && !m.client.connect(m.node.host, m.node.port)) {
+            return nullptr;
+        }
+        return &m.client;
+    }
+
+    /// Reads one reply, dropping the connection if it failed so the next call reconnects
+    bool readReply(size_t member, resp::Value& out) {
+        if (!members[member]->client.readReply(out)) {
+            members[member]->client.disconnect();
+            return false;
+        }
+        return !out.isError();
+    }
+
+    int findMember(const Node& node) const {
+        for (size_t m = 0; m < members.size(); m++) {
+            if (members[m]->node.host == node.host && members[m]->node.port == node.port) {
+                return static_cast<int>(m);
+            }
+        }
+        return -1;
+    }
+
+    /// Keys grouped by owner: positions into `keys` per member
+    template <typename Keys, typename KeyOf>
+    std::vector<std::vector<size_t>> groupByOwner(const Keys& keys, KeyOf key_of) const {
+        std::vector<std::vector<size_t>> groups(members.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            groups[owner(key_of(keys[i]))].push_back(i);
+        }
+        return groups;
+    }
+
+    /// Sends each command to the owner of its key, command[1], all before the first reply is read
+    /// @returns true if every command succeeded
+    bool sendToOwners(const std::vector<std::vector<std::string>>& commands) {
+        std::vector<size_t> counts(members.size(), 0);
+        for (const auto& command : commands) {
+            counts[owner(command[1])]++;
+        }
+        std::vector<RespClient*> sent(members.size(), nullptr);
+        bool ok = true;
+        for (size_t m = 0; m < members.size(); m++) {
+            if (counts[m] > 0 && !(sent[m] = clientOf(m))) {
+                ok = false;
+            }
+        }
+        for (const auto& command : commands) {
+            if (RespClient* client = sent[owner(command[1])]) {
+                client->send(command);
+            }
+        }
+        for (size_t m = 0; m < members.size(); m++) {
+            if (!sent[m]) {
+                continue;
+            }
+            sent[m]->flush();
+            for (size_t i = 0; i < counts[m]; i++) {
+                resp::Value reply;
+                if (!readReply(m, reply)) {
+                    ok = false;
+                    if (!members[m]->client.connected()) {
+                        break; // later replies can't come
+                    }
+                }
+            }
+        }
+        return ok;
+    }
+
+public:
+    explicit RespRouter(size_t virtual_nodes = 160) : virtual_nodes(std::max<size_t>(1, virtual_nodes)) {}
+
+    RespRouter(const RespRouter&) = delete;
+    RespRouter& operator=(const RespRouter&) = delete;
+
+    /// Adds a node to the ring, the connection is opened on first use
+    /// @returns false if the node is already a member
+    bool add_node(const std::string& host, uint16_t port) {
+        if (findMember(Node{host, port}) >= 0) {
+            return false;
+        }
+        members.push_back(std::make_unique<Member>(Member{Node{host, port}, RespClient()}));
+        buildRing();
+        return true;
+    }
+
+    /// Takes a node off the ring, its keys then belong to the remaining nodes
+    bool remove_node(const std::string& host, uint16_t port) {
+        int member = findMember(Node{host, port});
+        if (member < 0) {
+            return false;
+        }
+        members.erase(members.begin() + member);
+        buildRing();
+        return true;
+    }
+
+    size_t node_count() const { return members.size(); }
+
+    /// Member index owning key, the ring must not be empty
+    size_t owner(const std::string& key) const {
+        auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(fnv::mixed(key), size_t(0)));
+        return (it == ring.end() ? ring.front() : *it).second;
+    }
+
+    /// Node owning key
+    const Node& node_for(const std::string& key) const {
+        return members[owner(key)]->node;
+    }
+
+    bool put(const std::string& key, const std::string& value) {
+        if (members.empty()) {
+            return false;
+        }
+        size_t member = owner(key);
+        RespClient* client = clientOf(member);
+        resp::Value reply;
+        if (!client) {
+            return false;
+        }
+        client->send({"SET", key, value});
+        return readReply(member, reply);
+    }
+
+    /// @returns true if the key was found, its value in value
+    bool get(const std::string& key, std::string& value) {
+        if (members.empty()) {
+            return false;
+        }
+        size_t member = owner(key);
+        RespClient* client = clientOf(member);
+        resp::Value reply;
+        if (!client) {
+            return false;
+        }
+        client->send({"GET", key});
+        if (!readReply(member, reply) || reply.type != resp::Value::Type::BulkString) {
+            return false;
+        }
+        value = std::move(reply.str);
+        return true;
+    }
+
+    /// @returns true if the key existed
+    bool remove(const std::string& key) {
+        if (members.empty()) {
+            return false;
+        }
+        size_t member = owner(key);
+        RespClient* client = clientOf(member);
+        resp::Value reply;
+        if (!client) {
+            return false;
+        }
+        client->send({"DEL", key});
+        return readReply(member, reply) && reply.integer > 0;
+    }
+
+    /// One MGET per node, all sent before the first reply is read
+    /// @returns (found, value) per key, in the order of keys
+    std::vector<std::pair<bool, std::string>> get_many(const std::vector<std::string>& keys) {
+        std::vector<std::pair<bool, std::string>> result(keys.size());
+        if (members.empty()) {
+            return result;
+        }
+        auto groups = groupByOwner(keys, [](const std::string& key) -> const std::string& { return key; });
+        std::vector<RespClient*> sent(members.size(), nullptr);
+        for (size_t m = 0; m < members.size(); m++) {
+            if (groups[m].empty() || !(sent[m] = clientOf(m))) {
+                continue;
+            }
+            std::vector<std::string> args{"MGET"};
+            for (size_t i : groups[m]) {
+                args.push_back(keys[i]);
+            }
+            sent[m]->send(args);
+            if (!sent[m]->flush()) {
+                sent[m]->disconnect();
+                sent[m] = nullptr;
+            }
+        }
+        for (size_t m = 0; m < members.size(); m++) {
+            resp::Value reply;
+            if (!sent[m] || !readReply(m, reply) || reply.elements.size() != groups[m].size()) {
+                continue;
+            }
+            for (size_t j = 0; j < groups[m].size(); j++) {
+                resp::Value& element = reply.elements[j];
+                if (element.type == resp::Value::Type::BulkString) {
+                    result[groups[m][j]] = {true, std::move(element.str)};
+                }
+            }
+        }
+        return result;
+    }
+
+    /// One MSET per node, all sent before the first reply is read
+    /// @returns true if every node stored its share
+    bool put_many(const std::vector<std::pair<std::string, std::string>>& pairs) {
+        if (members.empty()) {
+            return pairs.empty();
+        }
+        auto groups = groupByOwner(pairs, [](const auto& pair) -> const std::string& { return pair.first; });
+        std::vector<RespClient*> sent(members.size(), nullptr);
+        bool ok = true;
+        for (size_t m = 0; m < members.size(); m++) {
+            if (groups[m].empty()) {
+                continue;
+            }
+            if (!(sent[m] = clientOf(m))) {
+                ok = false;
+                continue;
+            }
+            std::vector<std::string> args{"MSET"};
+            for (size_t i : groups[m]) {
+                args.push_back(pairs[i].first);
+                args.push_back(pairs[i].second);
+            }
+            sent[m]->send(args);
+            sent[m]->flush();
+        }
+        for (size_t m = 0; m < members.size(); m++) {
+            resp::Value reply;
+            if (sent[m] && !readReply(m, reply)) {
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    /// Moves every stored key that isn't on its owner to it, e.g. after add_node
+    /// Scans each node with SCAN, reads misplaced keys and their TTLs with one MGET and PTTLs per
+    /// page, copies them with MSET, or SET PX for keys with a TTL so they still expire, then
+    /// deletes them at the old node. A key written meanwhile through the router already goes to
+    /// its owner and is not overwritten: only keys the owner doesn't have yet are copied.
+    /// @returns the number of keys moved
+    size_t rebalance(size_t page_size = 500) {
+        size_t moved = 0;
+        for (size_t m = 0; m < members.size(); m++) {
+            std::string cursor = "0";
+            do {
+                RespClient* client = clientOf(m);
+                resp::Value reply;
+                if (!client) {
+                    break;
+                }
+                client->send({"SCAN", cursor, "COUNT", std::to_string(page_size)});
+                if (!readReply(m, reply) || reply.elements.size() != 2) {
+                    break;
+                }
+                cursor = reply.elements[0].str;
+                std::vector<std::string> misplaced;
+                for (const resp::Value& key : reply.elements[1].elements) {
+                    if (owner(key.str) != m) {
+                        misplaced.push_back(key.str);
+                    }
+                }
+                if (misplaced.empty()) {
+                    continue;
+                }
+                // values and TTLs at the old node, and whether the owners already have the keys
+                std::vector<std::string> args{"MGET"};
+                args.insert(args.end(), misplaced.begin(), misplaced.end());
+                client->send(args);
+                for (const std::string& key : misplaced) {
+                    client->send({"PTTL", key});
+                }
+                // every reply is read even after a failed one, so the connection stays in step
+                bool read_all = readReply(m, reply) && reply.elements.size() == misplaced.size();
+                std::vector<long long> ttls(misplaced.size());
+                for (long long& ttl : ttls) {
+                    resp::Value ttl_reply;
+                    bool ttl_read = readReply(m, ttl_reply);
+                    read_all = read_all && ttl_read;
+                    ttl = ttl_reply.integer;
+                }
+                if (!read_all) {
+                    break;
+                }
+                auto present = get_many(misplaced);
+                std::vector<std::pair<std::string, std::string>> copies;
+                std::vector<std::vector<std::string>> timed_copies;
+                std::vector<std::string> deletes{"DEL"};
+                for (size_t i = 0; i < misplaced.size(); i++) {
+                    if (!present[i].first && reply.elements[i].type == resp::Value::Type::BulkString) {
+                        if (ttls[i] > 0) {
+                            timed_copies.push_back({"SET", misplaced[i], std::move(reply.elements[i].str), "PX",
+                                                    std::to_string(ttls[i])});
+                        } else if (ttls[i] == -1) {
+                            copies.emplace_back(misplaced[i], std::move(reply.elements[i].str));
+                        }
+                    }
+                    deletes.push_back(misplaced[i]);
+                }
+                if (!put_many(copies) || !sendToOwners(timed_copies)) {
+                    break; // keep the old copies, a later rebalance retries
+                }
+                client->send(deletes);
+                if (readReply(m, reply)) {
+                    moved += copies.size() + timed_copies.size();
+                }
+            } while (cursor != "0");
+        }
+        return moved;
+    }
+};
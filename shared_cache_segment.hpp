@@ -0,0 +1,577 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fnv_hash.hpp"
+
+/// FIFO cache storage living in a POSIX shared memory segment
+/// Every process that opens the same name sees the same entries, so worker processes on one host
+/// share one warm cache instead of each keeping a cold private copy.
+///
+/// The segment only holds offsets, never pointers, so it can be mapped at a different address in
+/// every process. Readers are lock free: each hash bucket carries a sequence counter that writers
+/// make odd while they change the bucket, and a reader retries when the counter moved under it.
+/// Writers serialize on one process-shared robust mutex. If a process dies while holding it the
+/// next writer wipes the segment, which only costs a refill from the database.
+class SharedCacheSegment {
+public:
+    static constexpr size_t KEY_LOCK_STRIPES = 64;
+    static constexpr int64_t KEEP_DEADLINE = -1; // insert(): keep the deadline of the entry being replaced
+
+private:
+    static constexpr uint64_t MAGIC = 0x4b5653484152454dULL; // "KVSHAREM"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t SIZE_CLASSES = 48;
+    static constexpr size_t MIN_BLOCK = 64;
+    static constexpr size_t MAX_CHAIN = 4096;           // longer chains can only be torn reads
+    static constexpr size_t MAX_READ_ATTEMPTS = 100000; // a reader gives up (reports a miss) after this many retries
+
+    struct Header {
+        std::atomic<uint64_t> magic; // written last, once the rest of the header is valid
+        uint32_t version;
+        uint32_t bucket_count;
+        uint64_t buckets_offset;
+        uint64_t arena_offset;
+        uint64_t segment_size;
+        uint64_t max_size; // bytes of keys + values, like FIFOCache::MAX_SIZE
+        pthread_mutex_t writer_mutex;
+        pthread_mutex_t key_locks[KEY_LOCK_STRIPES];
+
+        // guarded by writer_mutex
+        uint64_t arena_top;
+        uint64_t free_lists[SIZE_CLASSES];
+        uint64_t fifo_head; // oldest entry
+        uint64_t fifo_tail; // newest entry
+
+        // written under writer_mutex, read anywhere
+        std::atomic<uint64_t> current_size;
+        std::atomic<uint64_t> entries;
+        std::atomic<uint64_t> evictions;
+        std::atomic<uint64_t> ttl_keys; // nonzero once any process stored a TTL
+    };
+
+    struct Bucket {
+        std::atomic<uint32_t> seq;
+        uint32_t reserved;
+        std::atomic<uint64_t> head;
+    };
+
+    struct Entry {
+        std::atomic<uint64_t> next; // bucket chain, or free list link once released
+        uint64_t fifo_prev;         // guarded by writer_mutex
+        uint64_t fifo_next;
+        std::atomic<int64_t> expires_at; // unix time in ms, 0 for none
+        std::atomic<uint64_t> hash;
+        std::atomic<uint32_t> key_length;
+        std::atomic<uint32_t> value_length;
+        uint32_t size_class;
+        uint32_t reserved;
+
+        char* data() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    std::string name;
+    char* base = nullptr;
+    size_t mapped_size = 0;
+    Header* header = nullptr;
+    bool was_created = false;
+
+    static size_t alignUp(size_t n, size_t alignment) {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    static uint64_t nextPowerOfTwo(uint64_t n) {
+        uint64_t power = 1;
+        while (power < n) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    static void initMutex(pthread_mutex_t* mutex) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    Entry* at(uint64_t offset) {
+        return reinterpret_cast<Entry*>(base + offset);
+    }
+
+    Bucket& bucketFor(uint64_t hash) {
+        return reinterpret_cast<Bucket*>(base + header->buckets_offset)[hash & (header->bucket_count - 1)];
+    }
+
+    bool validEntryOffset(uint64_t offset) const {
+        return offset >= header->arena_offset && offset + sizeof(Entry) <= header->segment_size &&
+               offset % alignof(Entry) == 0;
+    }
+
+    static void beginWrite(Bucket& bucket) {
+        bucket.seq.store(bucket.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void endWrite(Bucket& bucket) {
+        bucket.seq.store(bucket.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Holds writer_mutex, wiping the segment if the previous owner died mid-update
+    class WriterLock {
+    private:
+        SharedCacheSegment& segment;
+
+    public:
+        explicit WriterLock(SharedCacheSegment& segment) : segment(segment) {
+            if (lockRobust(&segment.header->writer_mutex)) {
+                segment.reset();
+            }
+        }
+
+        ~WriterLock() {
+            pthread_mutex_unlock(&segment.header->writer_mutex);
+        }
+
+        WriterLock(const WriterLock&) = delete;
+        WriterLock& operator=(const WriterLock&) = delete;
+    };
+
+    /// Drops every entry, caller holds writer_mutex
+    void reset() {
+        Bucket* buckets = reinterpret_cast<Bucket*>(base + header->buckets_offset);
+        for (uint32_t i = 0; i < header->bucket_count; i++) {
+            uint32_t seq = buckets[i].seq.load(std::memory_order_relaxed);
+            buckets[i].seq.store((seq | 1) + 1, std::memory_order_relaxed); // even again, and never equal to before
+            buckets[i].head.store(0, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        header->arena_top = header->arena_offset;
+        std::memset(header->free_lists, 0, sizeof(header->free_lists));
+        header->fifo_head = 0;
+        header->fifo_tail = 0;
+        header->current_size.store(0, std::memory_order_relaxed);
+        header->entries.store(0, std::memory_order_relaxed);
+    }
+
+    static uint32_t sizeClass(size_t bytes) {
+        uint32_t size_class = 0;
+        while ((MIN_BLOCK << size_class) < bytes) {
+            size_class++;
+        }
+        return size_class;
+    }
+
+    /// @returns offset of a block of at least `bytes`, or 0 if the arena is exhausted
+    uint64_t allocate(size_t bytes) {
+        uint32_t size_class = sizeClass(bytes);
+        if (size_class >= SIZE_CLASSES) {
+            return 0;
+        }
+        uint64_t offset = header->free_lists[size_class];
+        if (offset != 0) {
+            header->free_lists[size_class] = at(offset)->next.load(std::memory_order_relaxed);
+        } else {
+            size_t block = MIN_BLOCK << size_class;
+            if (header->arena_top + block > header->segment_size) {
+                return 0;
+            }
+            offset = header->arena_top;
+            header->arena_top += block;
+        }
+        at(offset)->size_class = size_class;
+        return offset;
+    }
+
+    void release(uint64_t offset) {
+        Entry* entry = at(offset);
+        entry->next.store(header->free_lists[entry->size_class], std::memory_order_relaxed);
+        header->free_lists[entry->size_class] = offset;
+    }
+
+    /// Writer side lookup
+    /// @returns offset of the entry, or 0
+    uint64_t findLocked(uint64_t hash, const std::string& key) {
+        uint64_t offset = bucketFor(hash).head.load(std::memory_order_relaxed);
+        while (offset != 0) {
+            Entry* entry = at(offset);
+            if (entry->hash.load(std::memory_order_relaxed) == hash &&
+                entry->key_length.load(std::memory_order_relaxed) == key.size() &&
+                std::memcmp(entry->data(), key.data(), key.size()) == 0) {
+                return offset;
+            }
+            offset = entry->next.load(std::memory_order_relaxed);
+        }
+        return 0;
+    }
+
+    /// Replaces `old_offset` in its bucket chain with `new_offset` (0 unlinks it)
+    void relinkInBucket(uint64_t old_offset, uint64_t new_offset) {
+        Entry* old_entry = at(old_offset);
+        Bucket& bucket = bucketFor(old_entry->hash.load(std::memory_order_relaxed));
+        uint64_t replacement = new_offset != 0 ? new_offset : old_entry->next.load(std::memory_order_relaxed);
+        if (new_offset != 0) {
+            at(new_offset)->next.store(old_entry->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        beginWrite(bucket);
+        uint64_t offset = bucket.head.load(std::memory_order_relaxed);
+        if (offset == old_offset) {
+            bucket.head.store(replacement, std::memory_order_relaxed);
+        } else {
+            while (offset != 0) {
+                Entry* entry = at(offset);
+                if (entry->next.load(std::memory_order_relaxed) == old_offset) {
+                    entry->next.store(replacement, std::memory_order_relaxed);
+                    break;
+                }
+                offset = entry->next.load(std::memory_order_relaxed);
+            }
+        }
+        endWrite(bucket);
+    }
+
+    void fifoUnlink(uint64_t offset) {
+        Entry* entry = at(offset);
+        if (entry->fifo_prev != 0) at(entry->fifo_prev)->fifo_next = entry->fifo_next;
+        else header->fifo_head = entry->fifo_next;
+        if (entry->fifo_next != 0) at(entry->fifo_next)->fifo_prev = entry->fifo_prev;
+        else header->fifo_tail = entry->fifo_prev;
+    }
+
+    void fifoAppend(uint64_t offset) {
+        Entry* entry = at(offset);
+        entry->fifo_prev = header->fifo_tail;
+        entry->fifo_next = 0;
+        if (header->fifo_tail != 0) at(header->fifo_tail)->fifo_next = offset;
+        else header->fifo_head = offset;
+        header->fifo_tail = offset;
+    }
+
+    /// Puts `new_offset` at the FIFO position of `old_offset`
+    void fifoReplace(uint64_t old_offset, uint64_t new_offset) {
+        Entry* old_entry = at(old_offset);
+        Entry* new_entry = at(new_offset);
+        new_entry->fifo_prev = old_entry->fifo_prev;
+        new_entry->fifo_next = old_entry->fifo_next;
+        if (new_entry->fifo_prev != 0) at(new_entry->fifo_prev)->fifo_next = new_offset;
+        else header->fifo_head = new_offset;
+        if (new_entry->fifo_next != 0) at(new_entry->fifo_next)->fifo_prev = new_offset;
+        else header->fifo_tail = new_offset;
+    }
+
+    static size_t logicalSize(Entry* entry) {
+        return entry->key_length.load(std::memory_order_relaxed) + entry->value_length.load(std::memory_order_relaxed);
+    }
+
+    /// Unlinks and frees an entry, caller holds writer_mutex
+    void removeEntry(uint64_t offset) {
+        relinkInBucket(offset, 0);
+        fifoUnlink(offset);
+        header->current_size.fetch_sub(logicalSize(at(offset)), std::memory_order_relaxed);
+        header->entries.fetch_sub(1, std::memory_order_relaxed);
+        release(offset);
+    }
+
+    /// Evicts the oldest entry, caller holds writer_mutex
+    /// @returns offset of the evicted entry (already freed), or 0 if the cache is empty
+    uint64_t evictOldest() {
+        uint64_t oldest = header->fifo_head;
+        if (oldest != 0) {
+            removeEntry(oldest);
+            header->evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        return oldest;
+    }
+
+    bool create(size_t max_size, size_t arena_bytes) {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        if (arena_bytes == 0) {
+            arena_bytes = 2 * max_size + (1 << 20); // power of two size classes waste up to half a block
+        }
+        uint32_t bucket_count = static_cast<uint32_t>(nextPowerOfTwo(std::max<uint64_t>(1024, arena_bytes / 256)));
+        size_t buckets_offset = alignUp(sizeof(Header), 64);
+        size_t arena_offset = alignUp(buckets_offset + bucket_count * sizeof(Bucket), 4096);
+        size_t size = arena_offset + alignUp(arena_bytes, 4096);
+
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(fd, size)) {
+            std::cerr << "Cannot create shared cache segment " << name << ": " << std::strerror(errno) << std::endl;
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        close(fd);
+
+        // ftruncate zero-fills: empty buckets, empty lists, zero counters
+        header->version = VERSION;
+        header->bucket_count = bucket_count;
+        header->buckets_offset = buckets_offset;
+        header->arena_offset = arena_offset;
+        header->segment_size = size;
+        header->max_size = max_size;
+        header->arena_top = arena_offset;
+        initMutex(&header->writer_mutex);
+        for (auto& mutex : header->key_locks) {
+            initMutex(&mutex);
+        }
+        header->magic.store(MAGIC, std::memory_order_release);
+        was_created = true;
+        return true;
+    }
+
+    bool attach() {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Cannot open shared cache segment " << name << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        // the creating process may still be sizing and initializing the segment
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        struct stat st{};
+        while (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < sizeof(Header) &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        bool mapped = static_cast<size_t>(st.st_size) >= sizeof(Header) && map(fd, static_cast<size_t>(st.st_size));
+        close(fd);
+        if (!mapped) {
+            std::cerr << "Cannot map shared cache segment " << name << std::endl;
+            return false;
+        }
+        while (header->magic.load(std::memory_order_acquire) != MAGIC && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (header->magic.load(std::memory_order_acquire) != MAGIC || header->version != VERSION ||
+            header->segment_size > mapped_size) {
+            std::cerr << "Shared cache segment " << name << " is not compatible" << std::endl;
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    bool map(int fd, size_t size) {
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        madvise(address, size, MADV_HUGEPAGE); // takes effect where shmem THP is set to advise
+        base = static_cast<char*>(address);
+        mapped_size = size;
+        header = reinterpret_cast<Header*>(base);
+        return true;
+    }
+
+    void unmap() {
+        if (base) {
+            munmap(base, mapped_size);
+            base = nullptr;
+            header = nullptr;
+        }
+    }
+
+public:
+    /// Opens the segment `name`, creating it with room for `max_size` bytes of keys and values if it
+    /// doesn't exist yet. A segment that already exists keeps the size it was created with.
+    /// @param arena_bytes memory for entries when creating, 0 picks 2 * max_size + 1MB
+    SharedCacheSegment(const std::string& name, size_t max_size, size_t arena_bytes = 0) : name(name) {
+        if (!create(max_size, arena_bytes) && errno == EEXIST) {
+            attach();
+        }
+    }
+
+    ~SharedCacheSegment() {
+        unmap(); // the segment outlives us, other processes may still use it
+    }
+
+    SharedCacheSegment(const SharedCacheSegment&) = delete;
+    SharedCacheSegment& operator=(const SharedCacheSegment&) = delete;
+
+    /// Identical in every process and build unlike std::hash
+    static uint64_t hashKey(const std::string& key) {
+        return fnv::hash(key);
+    }
+
+    /// Removes the segment name, processes that have it mapped keep using it
+    static bool unlink(const std::string& name) {
+        return shm_unlink(name.c_str()) == 0;
+    }
+
+    /// Locks a process-shared robust mutex
+    /// @returns true if its previous owner died while holding it
+    static bool lockRobust(pthread_mutex_t* mutex) {
+        if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+            pthread_mutex_consistent(mutex);
+            return true;
+        }
+        return false;
+    }
+
+    bool isOpen() const { return header != nullptr; }
+    bool created() const { return was_created; }
+
+    pthread_mutex_t* keyLock(size_t stripe) {
+        return &header->key_locks[stripe % KEY_LOCK_STRIPES];
+    }
+
+    /// Lock free lookup
+    /// @param value receives a copy of the value if not null
+    /// @param expires_at receives the deadline (unix time in ms, 0 for none) if not null
+    /// @returns true if the key is cached
+    bool lookup(const std::string& key, std::string* value = nullptr, int64_t* expires_at = nullptr) {
+        uint64_t hash = hashKey(key);
+        Bucket& bucket = bucketFor(hash);
+        for (size_t attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+            uint32_t seq = bucket.seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                if (attempt % 64 == 63) std::this_thread::yield();
+                continue; // a writer is changing this bucket
+            }
+
+            bool found = false;
+            bool torn = false;
+            uint64_t offset = bucket.head.load(std::memory_order_relaxed);
+            for (size_t steps = 0; offset != 0; steps++) {
+                if (steps > MAX_CHAIN || !validEntryOffset(offset)) {
+                    torn = true;
+                    break;
+                }
+                Entry* entry = at(offset);
+                uint32_t key_length = entry->key_length.load(std::memory_order_relaxed);
+                uint32_t value_length = entry->value_length.load(std::memory_order_relaxed);
+                if (offset + sizeof(Entry) + key_length + value_length > header->segment_size) {
+                    torn = true;
+                    break;
+                }
+                if (entry->hash.load(std::memory_order_relaxed) == hash && key_length == key.size() &&
+                    std::memcmp(entry->data(), key.data(), key_length) == 0) {
+                    found = true;
+                    if (value) value->assign(entry->data() + key_length, value_length);
+                    if (expires_at) *expires_at = entry->expires_at.load(std::memory_order_relaxed);
+                    break;
+                }
+                offset = entry->next.load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!torn && bucket.seq.load(std::memory_order_relaxed) == seq) {
+                return found;
+            }
+        }
+        return false; // a writer died mid-update, the next write repairs the segment
+    }
+
+    /// Inserts or overwrites a key, evicting the oldest entries as needed
+    /// An overwritten key keeps its place in the FIFO order, like in a private FIFOCache
+    /// @param expires_at deadline for the entry, KEEP_DEADLINE keeps the one of the replaced entry
+    /// @returns false if the pair can't be cached (then no stale copy is left behind)
+    bool insert(const std::string& key, const std::string& value, int64_t expires_at = KEEP_DEADLINE) {
+        WriterLock lock(*this);
+        uint64_t hash = hashKey(key);
+        uint64_t existing = findLocked(hash, key);
+        size_t size = key.size() + value.size();
+        if (size > header->max_size || size > UINT32_MAX) {
+            if (existing != 0) removeEntry(existing);
+            return false;
+        }
+        if (expires_at == KEEP_DEADLINE) {
+            expires_at = existing != 0 ? at(existing)->expires_at.load(std::memory_order_relaxed) : 0;
+        }
+
+        auto sizeWithoutExisting = [&]() {
+            uint64_t current = header->current_size.load(std::memory_order_relaxed);
+            return existing != 0 ? current - logicalSize(at(existing)) : current;
+        };
+        while (sizeWithoutExisting() + size > header->max_size && header->fifo_head != 0) {
+            if (evictOldest() == existing) {
+                existing = 0;
+            }
+        }
+        uint64_t offset = allocate(sizeof(Entry) + size);
+        while (offset == 0 && header->fifo_head != 0) {
+            if (evictOldest() == existing) {
+                existing = 0;
+            }
+            offset = allocate(sizeof(Entry) + size);
+        }
+        if (offset == 0) {
+            if (existing != 0) removeEntry(existing);
+            return false;
+        }
+
+        Entry* entry = at(offset);
+        entry->hash.store(hash, std::memory_order_relaxed);
+        entry->key_length.store(static_cast<uint32_t>(key.size()), std::memory_order_relaxed);
+        entry->value_length.store(static_cast<uint32_t>(value.size()), std::memory_order_relaxed);
+        entry->expires_at.store(expires_at, std::memory_order_relaxed);
+        std::memcpy(entry->data(), key.data(), key.size());
+        std::memcpy(entry->data() + key.size(), value.data(), value.size());
+
+        if (existing != 0) {
+            size_t old_size = logicalSize(at(existing));
+            relinkInBucket(existing, offset);
+            fifoReplace(existing, offset);
+            header->current_size.fetch_sub(old_size, std::memory_order_relaxed);
+            release(existing);
+        } else {
+            Bucket& bucket = bucketFor(hash);
+            entry->next.store(bucket.head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            beginWrite(bucket);
+            bucket.head.store(offset, std::memory_order_relaxed);
+            endWrite(bucket);
+            fifoAppend(offset);
+            header->entries.fetch_add(1, std::memory_order_relaxed);
+        }
+        header->current_size.fetch_add(size, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// @returns true if the key was cached
+    bool erase(const std::string& key) {
+        WriterLock lock(*this);
+        uint64_t offset = findLocked(hashKey(key), key);
+        if (offset == 0) {
+            return false;
+        }
+        removeEntry(offset);
+        return true;
+    }
+
+    /// Sets the deadline of a cached entry (0 clears it)
+    /// @returns true if the key is cached
+    bool setDeadline(const std::string& key, int64_t expires_at) {
+        WriterLock lock(*this);
+        uint64_t offset = findLocked(hashKey(key), key);
+        if (offset != 0) {
+            at(offset)->expires_at.store(expires_at, std::memory_order_relaxed);
+        }
+        return offset != 0;
+    }
+
+    /// TTLs are rare, so FIFOCache skips expiry bookkeeping until some process has used one
+    void noteTtl() { header->ttl_keys.store(1, std::memory_order_relaxed); }
+    bool hasTtls() const { return header->ttl_keys.load(std::memory_order_relaxed) != 0; }
+
+    size_t currentSize() const { return header->current_size.load(std::memory_order_relaxed); }
+    size_t entries() const { return header->entries.load(std::memory_order_relaxed); }
+    uint64_t evictions() const { return header->evictions.load(std::memory_order_relaxed); }
+    size_t maxSize() const { return header->max_size; }
+};
@@ -0,0 +1,216 @@
+#pragma once
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shm_ring.hpp"
+
+/// Same-host client of ShmServer
+/// Claims one slot of the server's shared memory segment for its lifetime. Requests are synchronous:
+/// the calling thread spins on the response ring for a short while, then sleeps until the server
+/// signals the slot's response futex. An instance must not be used from several threads at once,
+/// open one client per thread instead.
+class ShmClient {
+private:
+    void* segment = nullptr;
+    size_t segment_size = 0;
+    shm::SegmentHeader* header = nullptr;
+    shm::SlotHeader* slot = nullptr;
+    shm::ByteRing requests;
+    shm::ByteRing responses;
+
+    const uint32_t spin_limit = shm::spinLimit(4096);
+
+    /// Waits until the response ring holds a message
+    /// @returns false if the server stopped or the ring is corrupt
+    bool waitForResponse(const char*& payload, size_t& length) {
+        for (uint32_t spins = 0; spins < spin_limit; spins++) {
+            shm::Peek peeked = responses.peek(payload, length);
+            if (peeked != shm::Peek::Empty) {
+                return peeked == shm::Peek::Message;
+            }
+            shm::cpuRelax();
+        }
+        while (true) {
+            // a response published after we read the sequence changes it, so the futex won't sleep
+            uint32_t seq = slot->response_seq.load(std::memory_order_acquire);
+            slot->client_waiting.store(1, std::memory_order_seq_cst);
+            shm::Peek peeked = responses.peek(payload, length);
+            if (peeked != shm::Peek::Empty) {
+                slot->client_waiting.store(0, std::memory_order_relaxed);
+                return peeked == shm::Peek::Message;
+            }
+            if (!header->server_running.load(std::memory_order_acquire)) {
+                slot->client_waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+            shm::futexWait(&slot->response_seq, seq, 100);
+            slot->client_waiting.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// Publishes a request and waits for its response
+    /// @returns false if the request doesn't fit a ring or the server went away
+    bool roundTrip(uint8_t op, const std::string& key, const char* value, size_t value_length,
+                   const char*& payload, size_t& length) {
+        if (!slot) {
+            return false;
+        }
+        char* out = requests.reserve(sizeof(shm::MessageHeader) + key.size() + value_length);
+        if (!out) {
+            return false; // the ring is empty between calls, so only an oversized request gets here
+        }
+        shm::MessageHeader request{};
+        request.op_or_status = op;
+        request.key_length = static_cast<uint32_t>(key.size());
+        std::memcpy(out, &request, sizeof(request));
+        std::memcpy(out + sizeof(request), key.data(), key.size());
+        if (value_length > 0) {
+            std::memcpy(out + sizeof(request) + key.size(), value, value_length);
+        }
+        requests.commit();
+
+        header->doorbell.fetch_add(1, std::memory_order_seq_cst);
+        if (header->server_waiting.load(std::memory_order_seq_cst)) {
+            shm::futexWakeAll(&header->doorbell);
+        }
+
+        if (!waitForResponse(payload, length)) {
+            return false;
+        }
+        if (length < sizeof(shm::MessageHeader)) {
+            responses.consume();
+            return false;
+        }
+        return true;
+    }
+
+    static uint8_t statusOf(const char* payload) {
+        shm::MessageHeader reply;
+        std::memcpy(&reply, payload, sizeof(reply));
+        return reply.op_or_status;
+    }
+
+public:
+    ShmClient() = default;
+
+    ~ShmClient() {
+        disconnect();
+    }
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    /// Maps the server's segment and claims a free slot
+    /// @returns false if the segment doesn't exist or every slot is taken
+    bool connect(const std::string& name) {
+        disconnect();
+        int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shm::SegmentHeader)) {
+            close(fd);
+            return false;
+        }
+        segment_size = static_cast<size_t>(st.st_size);
+        segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment == MAP_FAILED) {
+            segment = nullptr;
+            return false;
+        }
+
+        header = static_cast<shm::SegmentHeader*>(segment);
+        if (header->magic.load(std::memory_order_acquire) != shm::SEGMENT_MAGIC ||
+            header->version != shm::SEGMENT_VERSION ||
+            shm::segmentSize(header->slot_count, header->ring_capacity) > segment_size) {
+            disconnect();
+            return false;
+        }
+
+        for (uint32_t i = 0; i < header->slot_count; i++) {
+            shm::SlotHeader* candidate = shm::slotAt(segment, i);
+            uint32_t expected = static_cast<uint32_t>(shm::SlotState::Free);
+            if (candidate->state.compare_exchange_strong(expected, static_cast<uint32_t>(shm::SlotState::Claimed),
+                                                         std::memory_order_acq_rel)) {
+                slot = candidate;
+                requests = shm::ByteRing(&slot->request,
+                                         shm::ringData(segment, header->slot_count, header->ring_capacity, i, 0),
+                                         header->ring_capacity);
+                responses = shm::ByteRing(&slot->response,
+                                          shm::ringData(segment, header->slot_count, header->ring_capacity, i, 1),
+                                          header->ring_capacity);
+                slot->owner_pid.store(getpid(), std::memory_order_relaxed);
+                slot->state.store(static_cast<uint32_t>(shm::SlotState::Ready), std::memory_order_release);
+                return true;
+            }
+        }
+        disconnect();
+        return false;
+    }
+
+    /// Releases the slot and unmaps the segment
+    void disconnect() {
+        if (slot) {
+            slot->state.store(static_cast<uint32_t>(shm::SlotState::Free), std::memory_order_release);
+            slot = nullptr;
+        }
+        if (segment) {
+            munmap(segment, segment_size);
+            segment = nullptr;
+            header = nullptr;
+        }
+    }
+
+    bool connected() const {
+        return slot != nullptr;
+    }
+
+    /// Largest key + value a single request can carry
+    size_t maxMessageSize() const {
+        return slot ? requests.maxPayload() - sizeof(shm::MessageHeader) : 0;
+    }
+
+    /// @returns true and the value if the key exists
+    bool get(const std::string& key, std::string& value) {
+        const char* payload;
+        size_t length;
+        if (!roundTrip(shm::OP_GET, key, nullptr, 0, payload, length)) {
+            return false;
+        }
+        bool found = statusOf(payload) == shm::STATUS_OK;
+        if (found) {
+            value.assign(payload + sizeof(shm::MessageHeader), length - sizeof(shm::MessageHeader));
+        }
+        responses.consume();
+        return found;
+    }
+
+    /// @returns true once the server has stored the pair
+    bool put(const std::string& key, const std::string& value) {
+        const char* payload;
+        size_t length;
+        if (!roundTrip(shm::OP_SET, key, value.data(), value.size(), payload, length)) {
+            return false;
+        }
+        bool ok = statusOf(payload) == shm::STATUS_OK;
+        responses.consume();
+        return ok;
+    }
+
+    /// @returns true if the key existed
+    bool remove(const std::string& key) {
+        const char* payload;
+        size_t length;
+        if (!roundTrip(shm::OP_DELETE, key, nullptr, 0, payload, length)) {
+            return false;
+        }
+        bool removed = statusOf(payload) == shm::STATUS_OK;
+        responses.consume();
+        return removed;
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <ctime>
+#include <thread>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/// Shared memory layout and lock-free rings used by ShmServer and ShmClient
+///
+/// The segment holds a header followed by a fixed number of client slots. Every slot owns two
+/// single-producer single-consumer byte rings: requests (client -> server) and responses
+/// (server -> client). A client claims a free slot, so each ring has exactly one producer and
+/// one consumer and needs no locks.
+namespace shm {
+
+static constexpr uint64_t SEGMENT_MAGIC = 0x4b56534d454d3031ULL; // "KVSMEM01"
+static constexpr uint32_t SEGMENT_VERSION = 1;
+static constexpr size_t CACHE_LINE = 64;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory needs lock free 32-bit atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock free 64-bit atomics");
+
+enum class SlotState : uint32_t { Free = 0, Claimed = 1, Ready = 2 };
+
+enum Op : uint8_t { OP_GET = 1, OP_SET = 2, OP_DELETE = 3 };
+enum class Peek : uint8_t { Empty, Message, Corrupt };
+enum Status : uint8_t { STATUS_OK = 0, STATUS_NOT_FOUND = 1, STATUS_ERROR = 2 };
+
+/// Every message starts with this 8 byte header, the payload follows
+/// Requests: key then value, responses: value
+struct MessageHeader {
+    uint8_t op_or_status;
+    uint8_t reserved[3];
+    uint32_t key_length;
+};
+
+struct SegmentHeader {
+    std::atomic<uint64_t> magic; // written last, once the rest of the header is valid
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t ring_capacity; // bytes per ring, power of two
+    alignas(CACHE_LINE) std::atomic<uint32_t> doorbell; // bumped by clients after every request
+    std::atomic<uint32_t> server_waiting;               // server is (about to be) asleep on the doorbell
+    std::atomic<uint32_t> server_running;
+};
+
+/// head is advanced by the consumer, tail by the producer; both only ever grow
+struct RingControl {
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+};
+
+struct SlotHeader {
+    alignas(CACHE_LINE) std::atomic<uint32_t> state;
+    std::atomic<int32_t> owner_pid;
+    std::atomic<uint32_t> response_seq;   // bumped by the server after publishing responses
+    std::atomic<uint32_t> client_waiting; // client is (about to be) asleep on response_seq
+    RingControl request;
+    RingControl response;
+};
+
+inline size_t alignUp(size_t n, size_t alignment) {
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+inline size_t slotsOffset() {
+    return alignUp(sizeof(SegmentHeader), CACHE_LINE);
+}
+
+inline size_t ringsOffset(uint32_t slot_count) {
+    return alignUp(slotsOffset() + sizeof(SlotHeader) * slot_count, 4096);
+}
+
+inline size_t segmentSize(uint32_t slot_count, uint64_t ring_capacity) {
+    return ringsOffset(slot_count) + 2 * ring_capacity * slot_count;
+}
+
+inline SlotHeader* slotAt(void* segment, uint32_t index) {
+    return reinterpret_cast<SlotHeader*>(static_cast<char*>(segment) + slotsOffset()) + index;
+}
+
+/// Data area of a slot's request (0) or response (1) ring
+inline char* ringData(void* segment, uint32_t slot_count, uint64_t ring_capacity, uint32_t index, int which) {
+    return static_cast<char*>(segment) + ringsOffset(slot_count) + (2 * index + which) * ring_capacity;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/// Spinning only pays off when the other side runs on another core
+inline uint32_t spinLimit(uint32_t multi_core_limit) {
+    return std::thread::hardware_concurrency() > 1 ? multi_core_limit : 0;
+}
+
+/// Process-shared futex wait, returns on wake, timeout, or when *word != expected
+inline void futexWait(std::atomic<uint32_t>* word, uint32_t expected, long timeout_ms) {
+    timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+inline void futexWakeAll(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+/// View of one SPSC byte ring in the shared segment
+/// Messages are 8 byte aligned. A message that doesn't fit before the end of the buffer is preceded
+/// by a wrap marker and written at offset 0, so the consumer always sees it contiguous.
+class ByteRing {
+private:
+    static constexpr uint32_t WRAP_MARKER = 0xffffffffu;
+
+    RingControl* control = nullptr;
+    char* data = nullptr;
+    uint64_t capacity = 0;
+    uint64_t pending = 0; // producer: tail after the reserved message, consumer: head after the peeked one
+
+public:
+    ByteRing() = default;
+    ByteRing(RingControl* control, char* data, uint64_t capacity) : control(control), data(data), capacity(capacity) {}
+
+    /// Largest payload a single message can carry
+    size_t maxPayload() const {
+        return capacity / 2 - sizeof(uint64_t);
+    }
+
+    /// Producer: reserves room for a message of `length` bytes
+    /// @returns where to write the payload, or nullptr if the ring is currently full
+    char* reserve(size_t length) {
+        if (length > maxPayload()) {
+            return nullptr;
+        }
+        size_t needed = alignUp(sizeof(uint64_t) + length, sizeof(uint64_t));
+        uint64_t tail = control->tail.load(std::memory_order_relaxed);
+        uint64_t head = control->head.load(std::memory_order_acquire);
+        size_t offset = tail & (capacity - 1);
+        size_t padding = capacity - offset < needed ? capacity - offset : 0;
+        if (tail + padding + needed - head > capacity) {
+            return nullptr;
+        }
+        if (padding > 0) {
+            std::memcpy(data + offset, &WRAP_MARKER, sizeof(WRAP_MARKER));
+            tail += padding;
+            offset = 0;
+        }
+        uint32_t length32 = static_cast<uint32_t>(length);
+        std::memcpy(data + offset, &length32, sizeof(length32));
+        pending = tail + needed;
+        return data + offset + sizeof(uint64_t);
+    }
+
+    /// Producer: publishes the message returned by the last reserve()
+    void commit() {
+        control->tail.store(pending, std::memory_order_release);
+    }
+
+    /// Consumer: looks at the oldest message without removing it
+    /// The producer's tail and lengths come from another process, so they are checked: a message
+    /// that doesn't lie within the published part of the ring is reported as Corrupt.
+    Peek peek(const char*& payload, size_t& length) {
+        uint64_t head = control->head.load(std::memory_order_relaxed);
+        uint64_t tail = control->tail.load(std::memory_order_acquire);
+        if (head == tail) {
+            return Peek::Empty;
+        }
+        const uint64_t start = head;
+        if (tail - head > capacity || tail - head < sizeof(uint64_t)) {
+            return Peek::Corrupt;
+        }
+        size_t offset = head & (capacity - 1);
+        uint32_t length32;
+        std::memcpy(&length32, data + offset, sizeof(length32));
+        if (length32 == WRAP_MARKER) {
+            head += capacity - offset;
+            offset = 0;
+            if (tail - head > capacity || tail - head < sizeof(uint64_t)) {
+                return Peek::Corrupt;
+            }
+            std::memcpy(&length32, data, sizeof(length32));
+        }
+        if (length32 > maxPayload() || sizeof(uint64_t) + length32 > capacity - offset) {
+            return Peek::Corrupt;
+        }
+        uint64_t next = head + alignUp(sizeof(uint64_t) + length32, sizeof(uint64_t));
+        if (next - start > tail - start) {
+            return Peek::Corrupt;
+        }
+        payload = data + offset + sizeof(uint64_t);
+        length = length32;
+        pending = next;
+        return Peek::Message;
+    }
+
+    /// Consumer: releases the message returned by the last peek()
+    void consume() {
+        control->head.store(pending, std::memory_order_release);
+    }
+
+    /// Consumer: drops everything published so far
+    void clear() {
+        control->head.store(control->tail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    bool empty() const {
+        return control->head.load(std::memory_order_acquire) == control->tail.load(std::memory_order_acquire);
+    }
+};
+
+} // namespace shm
@@ -0,0 +1,301 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fifo_cache.hpp"
+#include "shm_ring.hpp"
+
+struct ShmServerConfig {
+    std::string name = "/kvs";      // POSIX shared memory object, clients open it by the same name
+    uint32_t slots = 64;            // maximum number of concurrently connected clients
+    uint64_t ring_bytes = 1 << 20;  // per ring, rounded up to a power of two
+    uint32_t spin_iterations = 20000; // empty polls before sleeping on the doorbell, ignored on one core
+};
+
+/// Serves a FIFOCache to processes on the same host through a shared memory segment
+/// (see shm_ring.hpp), without sockets or syscalls on the request path.
+///
+/// One thread polls the request rings of all claimed slots. GET hits are copied straight from the
+/// cache into the client's response ring. When there is no work for a while the thread parks on a
+/// futex in the segment header and clients wake it after publishing a request.
+class ShmServer {
+private:
+    FIFOCache& cache;
+    ShmServerConfig config;
+    void* segment = nullptr;
+    size_t segment_size = 0;
+    shm::SegmentHeader* header = nullptr;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    static constexpr uint32_t RECLAIM_CHECK_POLLS = 4096; // passes between clock reads while busy
+
+    static uint64_t roundUpPowerOfTwo(uint64_t n) {
+        uint64_t power = 4096;
+        while (power < n) {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    shm::ByteRing requestRing(uint32_t index) {
+        return shm::ByteRing(&shm::slotAt(segment, index)->request,
+                             shm::ringData(segment, config.slots, config.ring_bytes, index, 0), config.ring_bytes);
+    }
+
+    shm::ByteRing responseRing(uint32_t index) {
+        return shm::ByteRing(&shm::slotAt(segment, index)->response,
+                             shm::ringData(segment, config.slots, config.ring_bytes, index, 1), config.ring_bytes);
+    }
+
+    static bool writeStatus(shm::ByteRing& responses, uint8_t status) {
+        char* out = responses.reserve(sizeof(shm::MessageHeader));
+        if (!out) {
+            return false;
+        }
+        shm::MessageHeader reply{};
+        reply.op_or_status = status;
+        std::memcpy(out, &reply, sizeof(reply));
+        return true;
+    }
+
+    /// Executes one request and reserves its response
+    /// @returns false if the response ring is full, the request is then retried on a later pass
+    bool execute(const char* payload, size_t length, shm::ByteRing& responses) {
+        shm::MessageHeader request;
+        if (length < sizeof(request)) {
+            return writeStatus(responses, shm::STATUS_ERROR);
+        }
+        std::memcpy(&request, payload, sizeof(request));
+        if (request.key_length > length - sizeof(request)) {
+            return writeStatus(responses, shm::STATUS_ERROR);
+        }
+        std::string key(payload + sizeof(request), request.key_length);
+        const char* value = payload + sizeof(request) + request.key_length;
+        size_t value_length = length - sizeof(request) - request.key_length;
+
+        switch (request.op_or_status) {
+        case shm::OP_GET: {
+            bool reserved = true;
+            bool found = cache.visit(key, [&](std::string_view cached) {
+                if (cached.size() > responses.maxPayload() - sizeof(shm::MessageHeader)) {
+                    reserved = writeStatus(responses, shm::STATUS_ERROR);
+                    return;
+                }
+                char* out = responses.reserve(sizeof(shm::MessageHeader) + cached.size());
+                if (!out) {
+                    reserved = false;
+                    return;
+                }
+                shm::MessageHeader reply{};
+                reply.op_or_status = shm::STATUS_OK;
+                std::memcpy(out, &reply, sizeof(reply));
+                std::memcpy(out + sizeof(reply), cached.data(), cached.size());
+            });
+            return found ? reserved : writeStatus(responses, shm::STATUS_NOT_FOUND);
+        }
+        case shm::OP_SET:
+            if (!responses.reserve(sizeof(shm::MessageHeader))) {
+                return false; // check for room first so the write isn't applied twice
+            }
+            cache.put(key, std::string(value, value_length));
+            return writeStatus(responses, key.empty() ? shm::STATUS_ERROR : shm::STATUS_OK);
+        case shm::OP_DELETE:
+            if (!responses.reserve(sizeof(shm::MessageHeader))) {
+                return false;
+            }
+            return writeStatus(responses, cache.remove(key) ? shm::STATUS_OK : shm::STATUS_NOT_FOUND);
+        default:
+            return writeStatus(responses, shm::STATUS_ERROR);
+        }
+    }
+
+    /// Serves up to `budget` requests of one slot
+    /// @returns number of requests served
+    size_t serveSlot(uint32_t index, size_t budget) {
+        shm::ByteRing requests = requestRing(index);
+        shm::ByteRing responses = responseRing(index);
+        size_t served = 0;
+        const char* payload;
+        size_t length;
+        shm::Peek peeked = shm::Peek::Empty;
+        while (served < budget && (peeked = requests.peek(payload, length)) == shm::Peek::Message) {
+            if (!execute(payload, length, responses)) {
+                break; // client isn't reading its responses, move on
+            }
+            // release the request before publishing the response: once the client sees its last
+            // response it may give the slot up, and we must not touch the rings after that
+            requests.consume();
+            responses.commit();
+            served++;
+        }
+        if (served < budget && peeked == shm::Peek::Corrupt) {
+            // a broken or hostile client; its pending requests can't be framed, so drop them
+            std::cerr << "Shared memory slot " << index << ": corrupt request ring, pending requests dropped" << std::endl;
+            requests.clear();
+        }
+        if (served > 0) {
+            shm::SlotHeader* slot = shm::slotAt(segment, index);
+            slot->response_seq.fetch_add(1, std::memory_order_seq_cst);
+            if (slot->client_waiting.load(std::memory_order_seq_cst)) {
+                shm::futexWakeAll(&slot->response_seq);
+            }
+        }
+        return served;
+    }
+
+    /// Frees slots whose client process exited without releasing them
+    void reclaimDeadSlots() {
+        for (uint32_t i = 0; i < config.slots; i++) {
+            shm::SlotHeader* slot = shm::slotAt(segment, i);
+            if (slot->state.load(std::memory_order_acquire) != static_cast<uint32_t>(shm::SlotState::Ready)) {
+                continue;
+            }
+            pid_t pid = slot->owner_pid.load(std::memory_order_relaxed);
+            if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+                requestRing(i).clear();
+                responseRing(i).clear();
+                slot->state.store(static_cast<uint32_t>(shm::SlotState::Free), std::memory_order_release);
+            }
+        }
+    }
+
+    size_t pollOnce() {
+        size_t served = 0;
+        for (uint32_t i = 0; i < config.slots; i++) {
+            shm::SlotHeader* slot = shm::slotAt(segment, i);
+            if (slot->state.load(std::memory_order_acquire) == static_cast<uint32_t>(shm::SlotState::Ready)) {
+                served += serveSlot(i, 64);
+            }
+        }
+        return served;
+    }
+
+    void run() {
+        const uint32_t spin_limit = shm::spinLimit(config.spin_iterations);
+        uint32_t idle = 0;
+        uint32_t polls = 0;
+        auto last_reclaim = std::chrono::steady_clock::now();
+        auto reclaimIfDue = [&]() {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_reclaim > std::chrono::seconds(1)) {
+                reclaimDeadSlots();
+                last_reclaim = now;
+            }
+        };
+        while (running.load(std::memory_order_relaxed)) {
+            if (++polls % RECLAIM_CHECK_POLLS == 0) {
+                reclaimIfDue(); // live clients may keep us busy forever, dead ones still hold slots
+            }
+            if (pollOnce() > 0) {
+                idle = 0;
+                continue;
+            }
+            if (++idle < spin_limit) {
+                if (idle % 64 == 0) {
+                    sched_yield(); // let a client on the same core run
+                } else {
+                    shm::cpuRelax();
+                }
+                continue;
+            }
+
+            reclaimIfDue();
+
+            // a request published after we read the doorbell changes it, so the futex won't sleep
+            uint32_t doorbell = header->doorbell.load(std::memory_order_acquire);
+            header->server_waiting.store(1, std::memory_order_seq_cst);
+            if (pollOnce() == 0 && running.load(std::memory_order_relaxed)) {
+                shm::futexWait(&header->doorbell, doorbell, 100);
+            }
+            header->server_waiting.store(0, std::memory_order_relaxed);
+            idle = 0;
+        }
+    }
+
+public:
+    ShmServer(FIFOCache& cache, const ShmServerConfig& config) : cache(cache), config(config) {
+        this->config.ring_bytes = roundUpPowerOfTwo(config.ring_bytes);
+    }
+
+    ~ShmServer() {
+        stop();
+    }
+
+    ShmServer(const ShmServer&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+
+    /// Creates the shared memory segment (replacing a stale one of the same name) and starts polling
+    bool start() {
+        if (running) {
+            return true;
+        }
+        if (config.slots == 0) {
+            return false;
+        }
+        shm_unlink(config.name.c_str());
+        int fd = shm_open(config.name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            std::cerr << "shm_open " << config.name << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        segment_size = shm::segmentSize(config.slots, config.ring_bytes);
+        if (ftruncate(fd, static_cast<off_t>(segment_size)) != 0) {
+            std::cerr << "ftruncate: " << std::strerror(errno) << std::endl;
+            close(fd);
+            shm_unlink(config.name.c_str());
+            return false;
+        }
+        segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment == MAP_FAILED) {
+            std::cerr << "mmap: " << std::strerror(errno) << std::endl;
+            segment = nullptr;
+            shm_unlink(config.name.c_str());
+            return false;
+        }
+
+        // ftruncate zero-fills, which is a valid initial state for every atomic in the segment
+        header = static_cast<shm::SegmentHeader*>(segment);
+        header->slot_count = config.slots;
+        header->ring_capacity = config.ring_bytes;
+        header->version = shm::SEGMENT_VERSION;
+        header->server_running.store(1, std::memory_order_relaxed);
+        header->magic.store(shm::SEGMENT_MAGIC, std::memory_order_release);
+
+        running = true;
+        thread = std::thread([this]() { run(); });
+        return true;
+    }
+
+    /// Stops polling and removes the segment name; connected clients see server_running drop to 0
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        header->server_running.store(0, std::memory_order_release);
+        header->doorbell.fetch_add(1, std::memory_order_seq_cst);
+        shm::futexWakeAll(&header->doorbell);
+        if (thread.joinable()) {
+            thread.join();
+        }
+        munmap(segment, segment_size);
+        segment = nullptr;
+        header = nullptr;
+        shm_unlink(config.name.c_str());
+    }
+
+    const std::string& name() const {
+        return config.name;
+    }
+};
@@ -6,7 +6,12 @@
 #include <iomanip>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 #include "../fifo_cache.hpp"
+#include "../bulk_loader.hpp"
 
 class PerformanceTest {
 private:
@@ -321,6 +326,447 @@ public:
                    duration, num_threads * ops_per_thread, all_latencies);
     }
     
+    // Cache inserts that evict, inline versus with the background evictor keeping headroom
+    void testEvictionWatermarks(size_t num_operations, size_t low_free, size_t high_free) {
+        const char* db_path = "evictor_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 4 * 1024 * 1024;
+        config.evict_low_free_bytes = low_free;
+        config.evict_high_free_bytes = high_free;
+        FIFOCache evicting_cache(config);
+        auto data = generateTestData(num_operations, 10, 100);
+        std::string large(16 * 1024, 'x');
+        std::vector<double> latencies;
+        latencies.reserve(num_operations);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < data.size(); ++i) {
+            auto op_start = std::chrono::high_resolution_clock::now();
+            evicting_cache.insertToCache(data[i].first, i % 100 == 0 ? large : data[i].second);
+            auto op_end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::milli>(op_end - op_start).count());
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        CacheStats stats = evicting_cache.stats();
+        printStats("Evicting Inserts (" + std::string(low_free > 0 ? "background evictor" : "inline only") + ", " +
+                       std::to_string(stats.inline_evictions) + " inline evictions, longest loop " +
+                       std::to_string(stats.max_inline_evict_loop) + ")",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_operations, latencies);
+        std::remove(db_path);
+    }
+    
+    // Skewed reads of mixed size values through a cache smaller than the data, per eviction policy
+    void testEvictionPolicy(EvictionPolicy policy, const std::string& name, size_t num_reads) {
+        const char* db_path = "policy_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.policy = policy;
+        auto data = generateTestData(5000, 10, 100);
+        for (size_t i = 0; i < data.size(); i += 10) {
+            data[i].second = generateRandomString(32 * 1024); // large values span overflow pages, costlier to read
+        }
+        FIFOCache(config).put_many(data);
+        FIFOCache policy_cache(config); // starts cold
+        
+        // zipf(0.9) over the keys, same sequence for every policy
+        std::vector<double> cdf(data.size());
+        double total = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            total += 1.0 / std::pow(i + 1, 0.9);
+            cdf[i] = total;
+        }
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<> dis(0, total);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < num_reads; ++i) {
+            size_t rank = std::lower_bound(cdf.begin(), cdf.end(), dis(gen)) - cdf.begin();
+            policy_cache.get(data[(rank * 7919) % data.size()].first); // spread the hot keys over both sizes
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        CacheStats stats = policy_cache.stats();
+        printStats("Skewed Reads (" + name + ")", std::chrono::duration<double, std::milli>(end - start).count(), num_reads);
+        std::cout << "Hit Ratio: " << std::setprecision(4) << double(stats.hits) / (stats.hits + stats.misses) << std::endl;
+        std::cout << "Byte Hit Ratio: " << double(stats.hit_bytes) / std::max<uint64_t>(1, stats.hit_bytes + stats.miss_bytes)
+                  << std::endl;
+        std::cout << "DB Read Time: " << std::setprecision(2) << stats.fetch_micros / 1000.0 << " ms, saved "
+                  << stats.saved_fetch_micros / 1000.0 << " ms" << std::endl;
+        std::remove(db_path);
+    }
+    
+    // One large value written and read whole, then in streamed pieces
+    void testLargeValue(size_t value_size) {
+        const char* db_path = "large_value_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        FIFOCache large_cache(config);
+        std::string chunk = generateRandomString(SQLiteDB::STREAM_CHUNK);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            std::string value;
+            value.reserve(value_size);
+            while (value.size() < value_size) {
+                value.append(chunk, 0, std::min(chunk.size(), value_size - value.size()));
+            }
+            large_cache.put("whole", value);
+        }
+        large_cache.get("whole");
+        auto end = std::chrono::high_resolution_clock::now();
+        printStats("Large Value put/get (" + std::to_string(value_size >> 20) + " MB)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), 2);
+        
+        start = std::chrono::high_resolution_clock::now();
+        large_cache.put_stream("streamed", value_size, [&chunk](char* buffer, size_t length) {
+            std::memcpy(buffer, chunk.data(), length);
+            return true;
+        });
+        size_t read = 0;
+        large_cache.get_stream("streamed", [&read](const char*, size_t length) {
+            read += length;
+            return true;
+        });
+        end = std::chrono::high_resolution_clock::now();
+        printStats("Large Value put_stream/get_stream (" + std::to_string(read >> 20) + " MB)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), 2);
+        std::remove(db_path);
+    }
+    
+    // Overwrites of 8KB values, stored in the table or separated into the value log
+    void testValueUpdates(size_t num_operations, size_t value_log_threshold) {
+        const char* db_path = "value_log_perf.db";
+        std::remove(db_path);
+        ValueLog::removeFiles(std::string(db_path) + ".vlog.");
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.value_log_threshold = value_log_threshold;
+        config.track_reads = false;
+        FIFOCache update_cache(config);
+        auto data = generateTestData(1000, 10, 8 * 1024);
+        update_cache.put_many(data);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < num_operations; ++i) {
+            std::vector<std::pair<std::string, std::string>> batch(data.begin() + (i * 100) % data.size(),
+                                                                   data.begin() + (i * 100) % data.size() + 100);
+            update_cache.put_many(batch);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        update_cache.collect_value_log_garbage();
+        
+        std::ifstream db_file(db_path, std::ios::binary | std::ios::ate);
+        CacheStats stats = update_cache.stats();
+        printStats("Value Updates (" + std::string(value_log_threshold > 0 ? "value log" : "in table") + ", " +
+                       std::to_string(static_cast<size_t>(db_file.tellg()) >> 10) + " KB table, " +
+                       std::to_string(stats.value_log_bytes >> 10) + " KB log)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_operations * 100);
+        std::remove(db_path);
+        ValueLog::removeFiles(std::string(db_path) + ".vlog.");
+    }
+    
+    // Random reads over 4x the memory budget, misses served by the flash cache or the DB
+    void testFlashTier(size_t num_reads, bool use_flash) {
+        const char* db_path = "flash_perf.db";
+        const char* flash_path = "flash_perf.flash";
+        std::remove(db_path);
+        std::remove(flash_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.track_reads = false;
+        if (use_flash) {
+            config.flash_path = flash_path;
+            config.flash_bytes = 16 << 20;
+        }
+        FIFOCache flash_cache(config);
+        auto data = generateTestData(4000, 10, 1000);
+        flash_cache.put_many(data);
+        
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<size_t> pick(0, data.size() - 1);
+        for (size_t i = 0; i < data.size(); ++i) { // every key passes through memory once
+            flash_cache.get(data[pick(gen)].first);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < num_reads; ++i) {
+            flash_cache.get(data[pick(gen)].first);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        CacheStats stats = flash_cache.stats();
+        printStats("Reads Past Memory (" + std::string(use_flash ? "flash cache" : "DB only") + ", " +
+                       std::to_string(stats.flash_hits) + " flash hits)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_reads);
+        std::remove(db_path);
+        std::remove(flash_path);
+    }
+    
+    // Random reads over 3x the memory budget of JSON-like values, misses served by the compressed
+    // victim cache or the DB
+    void testVictimTier(size_t num_reads, size_t victim_bytes) {
+        const char* db_path = "victim_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.victim_bytes = victim_bytes;
+        config.track_reads = false;
+        FIFOCache victim_cache(config);
+        std::vector<std::pair<std::string, std::string>> data;
+        for (size_t i = 0; i < 3000; ++i) {
+            std::string value = "{\"id\":" + std::to_string(i) + ",\"name\":\"" + generateRandomString(12) + "\",\"events\":[";
+            while (value.size() < 1000) {
+                value += "{\"type\":\"page_view\",\"path\":\"/items/" + std::to_string(value.size() % 97) + "\",\"ok\":true},";
+            }
+            data.emplace_back("key_" + std::to_string(i), value + "]}");
+        }
+        victim_cache.put_many(data);
+        
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<size_t> pick(0, data.size() - 1);
+        for (size_t i = 0; i < data.size(); ++i) {
+            victim_cache.get(data[pick(gen)].first);
+        }
+        CacheStats before = victim_cache.stats();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < num_reads; ++i) {
+            victim_cache.get(data[pick(gen)].first);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        CacheStats stats = victim_cache.stats();
+        uint64_t db_reads = (stats.misses - before.misses) - (stats.victim_hits - before.victim_hits);
+        std::ostringstream label;
+        label << "Reads Past Memory (" << (victim_bytes > 0 ? "victim cache" : "no victim cache") << ", "
+              << std::fixed << std::setprecision(2) << 1.0 - double(db_reads) / num_reads << " hit ratio";
+        if (victim_bytes > 0) {
+            label << ", " << std::setprecision(1) << double(stats.victim_raw_bytes) / std::max<size_t>(1, stats.victim_bytes)
+                  << "x compression";
+        }
+        printStats(label.str() + ")", std::chrono::duration<double, std::milli>(end - start).count(), num_reads);
+        std::remove(db_path);
+    }
+    
+    // A leader writing batches while a follower tails its change log, reports the follower's lag
+    void testReplication(size_t num_operations) {
+        const char* leader_path = "leader_perf.db";
+        const char* follower_path = "follower_perf.db";
+        std::remove(leader_path);
+        std::remove(follower_path);
+        
+        CacheConfig leader_config;
+        leader_config.db_path = leader_path;
+        leader_config.max_size = 1024 * 1024;
+        leader_config.change_log_rows = 100000;
+        FIFOCache leader(leader_config);
+        CacheConfig follower_config;
+        follower_config.db_path = follower_path;
+        follower_config.max_size = 1024 * 1024;
+        follower_config.follow_db_path = leader_path;
+        follower_config.follow_interval_ms = 5;
+        FIFOCache follower(follower_config);
+        auto data = generateTestData(num_operations, 10, 100);
+        
+        int64_t max_lag_ms = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < data.size(); i += 100) {
+            leader.put_many(std::vector<std::pair<std::string, std::string>>(
+                data.begin() + i, data.begin() + std::min(data.size(), i + 100)));
+            max_lag_ms = std::max(max_lag_ms, follower.stats().replication_lag_ms);
+        }
+        while (!follower.catch_up()) {
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        printStats("Replicated Writes (max lag " + std::to_string(max_lag_ms) + " ms)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_operations);
+        std::remove(leader_path);
+        std::remove(follower_path);
+    }
+    
+    // Concurrent puts, each a database write, over one or several database files
+    void testPartitionedWrites(size_t num_threads, size_t ops_per_thread, size_t partitions) {
+        const char* db_path = "partitioned_perf.db";
+        for (size_t i = 0; i < partitions; i++) {
+            std::remove(PartitionedDB::partitionPath(db_path, i, partitions).c_str());
+        }
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.db_partitions = partitions;
+        FIFOCache partitioned_cache(config);
+        auto data = generateTestData(num_threads * ops_per_thread, 10, 100);
+        
+        std::vector<std::thread> threads;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&partitioned_cache, &data, ops_per_thread, t]() {
+                for (size_t i = t * ops_per_thread; i < (t + 1) * ops_per_thread; ++i) {
+                    partitioned_cache.put(data[i].first, data[i].second);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        printStats("Concurrent Writes (" + std::to_string(num_threads) + " threads, " + std::to_string(partitions) +
+                       (partitions == 1 ? " database file)" : " database files)"),
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_threads * ops_per_thread);
+        for (size_t i = 0; i < partitions; i++) {
+            std::remove(PartitionedDB::partitionPath(db_path, i, partitions).c_str());
+        }
+    }
+    
+    // Puts with and without a prefix watcher, whose callback runs on the dispatcher thread
+    void testWatchedPuts(size_t num_operations, bool watched) {
+        const char* db_path = "watch_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.watch_buffer_events = watched ? 65536 : 0;
+        FIFOCache watched_cache(config);
+        std::atomic<size_t> notified{0};
+        std::atomic<size_t> batches{0};
+        watched_cache.watch("", [&](const std::vector<WatchEvent>& events, bool) {
+            notified += events.size();
+            batches++;
+        }, true);
+        auto data = generateTestData(num_operations, 10, 100);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < data.size(); i += 100) {
+            watched_cache.put_many(std::vector<std::pair<std::string, std::string>>(
+                data.begin() + i, data.begin() + std::min(data.size(), i + 100)));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        printStats(watched ? "Watched Puts (" + std::to_string(notified.load()) + " events in " +
+                                 std::to_string(batches.load()) + " batches so far)"
+                           : std::string("Unwatched Puts"),
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_operations);
+        std::remove(db_path);
+    }
+    
+    // Hot key reads, with and without the per-thread near cache
+    void testHotKeyReads(size_t num_threads, size_t ops_per_thread, size_t l0_entries) {
+        const char* db_path = "hot_keys_perf.db";
+        std::remove(db_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        config.l0_entries = l0_entries;
+        FIFOCache hot_cache(config);
+        auto data = generateTestData(256, 10, 100);
+        hot_cache.put_many(data);
+        
+        std::vector<std::thread> threads;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&hot_cache, &data, ops_per_thread, t]() {
+                for (size_t i = 0; i < ops_per_thread; ++i) {
+                    hot_cache.get(data[(i + t) % data.size()].first);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        
+        printStats("Hot Key Reads (" + std::to_string(num_threads) + " threads, " +
+                       (l0_entries > 0 ? "near cache " + std::to_string(hot_cache.stats().l0_hits) + " hits)" : "no near cache)"),
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_threads * ops_per_thread);
+        std::remove(db_path);
+    }
+    
+    // Snapshot save and load (warm restart)
+    void testSnapshot(size_t num_entries) {
+        const char* db_path = "snapshot_perf.db";
+        const char* snapshot_path = "snapshot_perf.snap";
+        std::remove(db_path);
+        std::remove(snapshot_path);
+        
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 256 * 1024 * 1024;
+        auto data = generateTestData(num_entries, 10, 100);
+        double save_ms = 0;
+        {
+            FIFOCache source(config);
+            source.put_many(data);
+            auto start = std::chrono::high_resolution_clock::now();
+            source.save_snapshot(snapshot_path);
+            auto end = std::chrono::high_resolution_clock::now();
+            save_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        printStats("Snapshot Save", save_ms, num_entries);
+        
+        FIFOCache restored(config);
+        auto start = std::chrono::high_resolution_clock::now();
+        restored.load_snapshot(snapshot_path);
+        auto end = std::chrono::high_resolution_clock::now();
+        printStats("Snapshot Load (" + std::to_string(restored.stats().entries) + " entries restored)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_entries);
+        
+        std::remove(db_path);
+        std::remove(snapshot_path);
+    }
+    
+    void testBulkLoad(size_t num_entries) {
+        const char* db_path = "bulk_perf.db";
+        std::remove(db_path);
+        auto data = generateTestData(num_entries, 10, 100);
+        
+        {
+            CacheConfig config;
+            config.db_path = db_path;
+            config.max_size = 1024 * 1024;
+            FIFOCache cache(config);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < data.size(); i += 1000) {
+                cache.put_many({data.begin() + i, data.begin() + std::min(i + 1000, data.size())});
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            printStats("put_many, 1000 per batch", std::chrono::duration<double, std::milli>(end - start).count(), num_entries);
+        }
+        std::remove(db_path);
+        
+        BulkLoadConfig config;
+        config.db_path = db_path;
+        config.memory_bytes = 8 << 20; // a few spilled runs
+        BulkLoader loader(config);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto& [key, value] : data) {
+            loader.add(key, value);
+        }
+        BulkLoadResult result = loader.finish();
+        auto end = std::chrono::high_resolution_clock::now();
+        printStats("BulkLoader (" + std::to_string(result.runs) + " runs)",
+                   std::chrono::duration<double, std::milli>(end - start).count(), num_entries);
+        std::remove(db_path);
+    }
+    
     void runAllTests() {
         std::cout << "\n" << std::string(80, '=') << std::endl;
         std::cout << "FIFO CACHE PERFORMANCE TESTS" << std::endl;
@@ -342,6 +788,53 @@ public:
         testConcurrentReads(8, 125);
         testConcurrentMixed(8, 125);
         
+        std::cout << "\n--- EVICTION ---" << std::endl;
+        testEvictionWatermarks(200000, 0, 0);
+        testEvictionWatermarks(200000, 256 * 1024, 512 * 1024);
+        
+        std::cout << "\n--- EVICTION POLICIES ---" << std::endl;
+        testEvictionPolicy(EvictionPolicy::Fifo, "fifo", 100000);
+        testEvictionPolicy(EvictionPolicy::Adaptive, "adaptive", 100000);
+        testEvictionPolicy(EvictionPolicy::GreedyDual, "greedy-dual", 100000);
+        
+        std::cout << "\n--- LARGE VALUES ---" << std::endl;
+        testLargeValue(50 * 1024 * 1024);
+        
+        testValueUpdates(200, 0);
+        testValueUpdates(200, 1024);
+        
+        std::cout << "\n--- FLASH TIER ---" << std::endl;
+        testFlashTier(20000, false);
+        testFlashTier(20000, true);
+        
+        std::cout << "\n--- VICTIM CACHE ---" << std::endl;
+        testVictimTier(20000, 0);
+        testVictimTier(20000, 1024 * 1024);
+        
+        std::cout << "\n--- REPLICATION ---" << std::endl;
+        testReplication(20000);
+        
+        std::cout << "\n--- WATCH ---" << std::endl;
+        testWatchedPuts(50000, false);
+        testWatchedPuts(50000, true);
+        
+        std::cout << "\n--- PARTITIONED WRITES ---" << std::endl;
+        for (size_t partitions : {1, 4}) {
+            for (size_t threads : {1, 2, 4, 8}) {
+                testPartitionedWrites(threads, 500, partitions);
+            }
+        }
+        
+        std::cout << "\n--- HOT KEYS ---" << std::endl;
+        testHotKeyReads(4, 200000, 0);
+        testHotKeyReads(4, 200000, 4096);
+        
+        std::cout << "\n--- WARM RESTART ---" << std::endl;
+        testSnapshot(200000);
+        
+        std::cout << "\n--- BULK LOAD ---" << std::endl;
+        testBulkLoad(200000);
+        
         std::cout << "\n" << std::string(80, '=') << std::endl;
         std::cout << "ALL TESTS COMPLETED" << std::endl;
         std::cout << std::string(80, '=') << std::endl;
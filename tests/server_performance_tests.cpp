@@ -0,0 +1,211 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include "../fifo_cache.hpp"
+#include "../kv_server.hpp"
+#include "../resp_handler.hpp"
+#include "../resp_client.hpp"
+#include "../shm_server.hpp"
+#include "../shm_client.hpp"
+#ifdef KVS_HAVE_IO_URING
+#include "../uring_server.hpp"
+#endif
+
+// Loopback benchmark of the network front ends: requests/sec and batch latency percentiles
+// for the same RESP workload served by EpollServer and UringServer
+class ServerPerformanceTest {
+private:
+    static constexpr const char* DB_PATH = "server_perf.db";
+    static constexpr size_t KEY_SPACE = 1000;
+
+    struct Result {
+        double requests_per_sec = 0;
+        double p50_us = 0;
+        double p99_us = 0;
+    };
+
+    static void populate(NetworkServer& server) {
+        RespClient client;
+        client.connect("127.0.0.1", server.port());
+        for (size_t i = 0; i < KEY_SPACE; i++) {
+            client.send({"SET", "key:" + std::to_string(i), "value_" + std::to_string(i)});
+        }
+        for (size_t i = 0; i < KEY_SPACE; i++) {
+            resp::Value reply;
+            client.readReply(reply);
+        }
+    }
+
+    /// Every connection sends `pipeline` GETs of resident keys per round trip, so the numbers
+    /// measure the front end rather than SQLite. Latency is measured per pipelined batch.
+    static Result runLoad(NetworkServer& server, size_t connections, size_t pipeline, size_t batches) {
+        std::vector<std::thread> threads;
+        std::vector<double> all_latencies;
+        std::mutex latency_mutex;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t c = 0; c < connections; c++) {
+            threads.emplace_back([&, c]() {
+                RespClient client;
+                if (!client.connect("127.0.0.1", server.port())) {
+                    return;
+                }
+                std::vector<double> latencies;
+                latencies.reserve(batches);
+                size_t n = c * 7919;
+                for (size_t b = 0; b < batches; b++) {
+                    auto op_start = std::chrono::high_resolution_clock::now();
+                    for (size_t p = 0; p < pipeline; p++, n++) {
+                        client.send({"GET", "key:" + std::to_string(n % KEY_SPACE)});
+                    }
+                    for (size_t p = 0; p < pipeline; p++) {
+                        resp::Value reply;
+                        client.readReply(reply);
+                    }
+                    auto op_end = std::chrono::high_resolution_clock::now();
+                    latencies.push_back(std::chrono::duration<double, std::micro>(op_end - op_start).count());
+                }
+                std::lock_guard<std::mutex> lock(latency_mutex);
+                all_latencies.insert(all_latencies.end(), latencies.begin(), latencies.end());
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        Result result;
+        if (all_latencies.empty()) {
+            return result;
+        }
+        std::sort(all_latencies.begin(), all_latencies.end());
+        result.requests_per_sec = all_latencies.size() * pipeline / seconds;
+        result.p50_us = all_latencies[all_latencies.size() / 2];
+        result.p99_us = all_latencies[all_latencies.size() * 99 / 100];
+        return result;
+    }
+
+    template <typename Server>
+    static Result benchmark(size_t connections, size_t pipeline, size_t batches) {
+        std::remove(DB_PATH);
+        Result result;
+        {
+            CacheConfig cache_config;
+            cache_config.db_path = DB_PATH;
+            cache_config.max_size = 64 * 1024 * 1024;
+            FIFOCache cache(cache_config);
+            RespHandler handler(cache);
+
+            ServerConfig server_config;
+            server_config.port = 0;
+            Server server(handler, server_config);
+            if (!server.start()) {
+                std::cout << "  backend unavailable" << std::endl;
+                return result;
+            }
+            populate(server);
+            result = runLoad(server, connections, pipeline, batches);
+        }
+        std::remove(DB_PATH);
+        return result;
+    }
+
+    static void printRow(const std::string& backend, const Result& r) {
+        std::cout << "  " << std::left << std::setw(10) << backend << std::right
+                  << std::fixed << std::setprecision(0)
+                  << std::setw(14) << r.requests_per_sec << " req/s"
+                  << std::setprecision(1)
+                  << "   p50 " << std::setw(9) << r.p50_us << " us"
+                  << "   p99 " << std::setw(9) << r.p99_us << " us" << std::endl;
+    }
+
+    /// Single client GET round trip over the shared memory transport
+    static Result benchmarkSharedMemory(size_t requests) {
+        std::remove(DB_PATH);
+        Result result;
+        {
+            CacheConfig cache_config;
+            cache_config.db_path = DB_PATH;
+            cache_config.max_size = 64 * 1024 * 1024;
+            FIFOCache cache(cache_config);
+            ShmServerConfig config;
+            config.name = "/kvs_perf_test";
+            ShmServer server(cache, config);
+            if (!server.start()) {
+                std::cout << "  shared memory unavailable" << std::endl;
+                return result;
+            }
+            ShmClient client;
+            client.connect(config.name);
+            for (size_t i = 0; i < KEY_SPACE; i++) {
+                client.put("key:" + std::to_string(i), "value_" + std::to_string(i));
+            }
+
+            std::vector<std::string> keys;
+            for (size_t i = 0; i < KEY_SPACE; i++) {
+                keys.push_back("key:" + std::to_string(i));
+            }
+            std::vector<double> latencies;
+            latencies.reserve(requests);
+            std::string value;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t n = 0; n < requests; n++) {
+                auto op_start = std::chrono::high_resolution_clock::now();
+                client.get(keys[n % KEY_SPACE], value);
+                auto op_end = std::chrono::high_resolution_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(op_end - op_start).count());
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            std::sort(latencies.begin(), latencies.end());
+            result.requests_per_sec = requests / seconds;
+            result.p50_us = latencies[latencies.size() / 2];
+            result.p99_us = latencies[latencies.size() * 99 / 100];
+        }
+        std::remove(DB_PATH);
+        return result;
+    }
+
+public:
+    void compare(size_t connections, size_t pipeline, size_t batches) {
+        std::cout << "\n=== " << connections << " connections, pipeline depth " << pipeline << " ===" << std::endl;
+        printRow("epoll", benchmark<EpollServer>(connections, pipeline, batches));
+#ifdef KVS_HAVE_IO_URING
+        printRow("io_uring", benchmark<UringServer>(connections, pipeline, batches));
+#else
+        std::cout << "  io_uring  not built" << std::endl;
+#endif
+    }
+
+    void runAllTests() {
+        std::cout << "\n" << std::string(80, '=') << std::endl;
+        std::cout << "SERVER PERFORMANCE TESTS (loopback)" << std::endl;
+        std::cout << std::string(80, '=') << std::endl;
+
+        compare(1, 1, 2000);
+        compare(8, 1, 500);
+        compare(8, 16, 200);
+        compare(64, 1, 100);
+        compare(64, 16, 50);
+
+        std::cout << "\n=== same host, 1 client, GET round trip ===" << std::endl;
+        printRow("epoll", benchmark<EpollServer>(1, 1, 20000));
+        printRow("shm", benchmarkSharedMemory(200000));
+
+        std::cout << "\n" << std::string(80, '=') << std::endl;
+        std::cout << "ALL TESTS COMPLETED" << std::endl;
+        std::cout << std::string(80, '=') << std::endl;
+    }
+};
+
+int main() {
+    ServerPerformanceTest test;
+    test.runAllTests();
+    return 0;
+}
@@ -0,0 +1,941 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "../fifo_cache.hpp"
+#include "../kv_server.hpp"
+#include "../resp_handler.hpp"
+#include "../resp_client.hpp"
+#include "../resp_router.hpp"
+#include "../memcached_handler.hpp"
+#include "../shm_server.hpp"
+#include "../shm_client.hpp"
+#ifdef KVS_HAVE_IO_URING
+#include "../uring_server.hpp"
+#endif
+
+class ServerTests {
+private:
+    int passed = 0;
+    int failed = 0;
+
+public:
+    void assert_true(bool condition, const std::string& test_name) {
+        if (condition) {
+            std::cout << "[PASS] " << test_name << std::endl;
+            passed++;
+        } else {
+            std::cout << "[FAIL] " << test_name << std::endl;
+            failed++;
+        }
+    }
+
+    void assert_equal(const std::string& expected, const std::string& actual,
+                     const std::string& test_name) {
+        if (expected == actual) {
+            std::cout << "[PASS] " << test_name << std::endl;
+            passed++;
+        } else {
+            std::cout << "[FAIL] " << test_name << " - Expected: '" << expected
+                      << "', Got: '" << actual << "'" << std::endl;
+            failed++;
+        }
+    }
+
+    void print_summary() {
+        std::cout << "\n---------- TEST SUMMARY ----------" << std::endl;
+        std::cout << "Passed: " << passed << std::endl;
+        std::cout << "Failed: " << failed << std::endl;
+        std::cout << "Total:  " << (passed + failed) << std::endl;
+        std::cout << "----------------------------------" << std::endl;
+    }
+};
+
+static const char* TEST_DB = "server_test.db";
+
+// Cache + RESP and memcached servers on free loopback ports, torn down with their database file
+template <typename Server>
+struct TestServer {
+    FIFOCache cache;
+    RespHandler handler;
+    MemcachedHandler memcached_handler;
+    Server server;
+    Server memcached_server;
+
+    static CacheConfig cacheConfig() {
+        std::remove(TEST_DB);
+        CacheConfig config;
+        config.db_path = TEST_DB;
+        config.max_size = 1024 * 1024;
+        return config;
+    }
+
+    static ServerConfig serverConfig() {
+        ServerConfig config;
+        config.port = 0;
+        config.reactors = 2;
+        return config;
+    }
+
+    TestServer()
+        : cache(cacheConfig()), handler(cache), memcached_handler(cache), server(handler, serverConfig()),
+          memcached_server(memcached_handler, serverConfig()) {
+        server.start();
+        memcached_server.start();
+    }
+
+    ~TestServer() {
+        memcached_server.stop();
+        server.stop();
+    }
+};
+
+// Minimal blocking connection for the memcached tests, which speak raw text and binary frames
+class RawConnection {
+private:
+    int fd = -1;
+    std::string buffer;
+
+    bool fill() {
+        char chunk[4096];
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, n);
+        return true;
+    }
+
+public:
+    ~RawConnection() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool connect(uint16_t port) {
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+
+    void write(const std::string& data) {
+        ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    }
+
+    /// Reads until `terminator` has been received, returns everything up to and including it
+    std::string readUntil(const std::string& terminator) {
+        size_t pos;
+        while ((pos = buffer.find(terminator)) == std::string::npos) {
+            if (!fill()) {
+                return "";
+            }
+        }
+        std::string result = buffer.substr(0, pos + terminator.size());
+        buffer.erase(0, pos + terminator.size());
+        return result;
+    }
+
+    std::string readBytes(size_t n) {
+        while (buffer.size() < n) {
+            if (!fill()) {
+                return "";
+            }
+        }
+        std::string result = buffer.substr(0, n);
+        buffer.erase(0, n);
+        return result;
+    }
+
+    bool closed() {
+        return buffer.empty() && !fill();
+    }
+};
+
+// Builds a binary protocol request frame
+static std::string binaryRequest(uint8_t opcode, const std::string& key, const std::string& extras = "",
+                                 const std::string& value = "", uint64_t cas = 0, uint32_t opaque = 0) {
+    std::string frame(24, '\0');
+    frame[0] = static_cast<char>(0x80);
+    frame[1] = static_cast<char>(opcode);
+    frame[2] = static_cast<char>(key.size() >> 8);
+    frame[3] = static_cast<char>(key.size() & 0xff);
+    frame[4] = static_cast<char>(extras.size());
+    uint32_t body = static_cast<uint32_t>(extras.size() + key.size() + value.size());
+    for (int i = 0; i < 4; i++) frame[8 + i] = static_cast<char>(body >> (24 - 8 * i));
+    for (int i = 0; i < 4; i++) frame[12 + i] = static_cast<char>(opaque >> (24 - 8 * i));
+    for (int i = 0; i < 8; i++) frame[16 + i] = static_cast<char>(cas >> (56 - 8 * i));
+    return frame + extras + key + value;
+}
+
+struct BinaryResponse {
+    uint8_t opcode = 0;
+    uint16_t status = 0xffff;
+    uint32_t opaque = 0;
+    uint64_t cas = 0;
+    std::string extras;
+    std::string key;
+    std::string value;
+};
+
+static BinaryResponse readBinaryResponse(RawConnection& conn) {
+    BinaryResponse response;
+    std::string header = conn.readBytes(24);
+    if (header.size() != 24) {
+        return response;
+    }
+    auto byte = [&](size_t i) { return static_cast<uint64_t>(static_cast<unsigned char>(header[i])); };
+    response.opcode = static_cast<uint8_t>(byte(1));
+    uint16_t key_length = static_cast<uint16_t>(byte(2) << 8 | byte(3));
+    uint8_t extras_length = static_cast<uint8_t>(byte(4));
+    response.status = static_cast<uint16_t>(byte(6) << 8 | byte(7));
+    uint32_t body = static_cast<uint32_t>(byte(8) << 24 | byte(9) << 16 | byte(10) << 8 | byte(11));
+    response.opaque = static_cast<uint32_t>(byte(12) << 24 | byte(13) << 16 | byte(14) << 8 | byte(15));
+    for (int i = 0; i < 8; i++) response.cas = response.cas << 8 | byte(16 + i);
+    std::string rest = conn.readBytes(body);
+    response.extras = rest.substr(0, extras_length);
+    response.key = rest.substr(extras_length, key_length);
+    response.value = rest.substr(extras_length + key_length);
+    return response;
+}
+
+void test_get_set(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing GET/SET over loopback ---" << std::endl;
+    RespClient client;
+    runner.assert_true(client.connect("127.0.0.1", server.port()), "Client connects");
+
+    resp::Value reply = client.command({"SET", "name", "value1"});
+    runner.assert_equal("OK", reply.str, "SET replies OK");
+
+    reply = client.command({"GET", "name"});
+    runner.assert_equal("value1", reply.str, "GET returns stored value");
+
+    reply = client.command({"GET", "missing"});
+    runner.assert_true(reply.type == resp::Value::Type::Null, "GET of missing key returns null");
+
+    std::string binary("a\0b\r\nc", 6);
+    client.command({"SET", "binary", binary});
+    reply = client.command({"GET", "binary"});
+    runner.assert_equal(binary, reply.str, "Binary safe values round trip");
+
+    reply = client.command({"NOSUCHCOMMAND"});
+    runner.assert_true(reply.isError(), "Unknown command returns an error");
+}
+
+void test_del_mget_mset(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing DEL/MGET/MSET ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    resp::Value reply = client.command({"MSET", "m1", "v1", "m2", "v2", "m3", "v3"});
+    runner.assert_equal("OK", reply.str, "MSET replies OK");
+
+    reply = client.command({"MGET", "m1", "nope", "m3"});
+    runner.assert_true(reply.type == resp::Value::Type::Array && reply.elements.size() == 3, "MGET returns array");
+    runner.assert_equal("v1", reply.elements[0].str, "MGET first value");
+    runner.assert_true(reply.elements[1].type == resp::Value::Type::Null, "MGET missing key is null");
+    runner.assert_equal("v3", reply.elements[2].str, "MGET third value");
+
+    reply = client.command({"DEL", "m1", "m2", "nope"});
+    runner.assert_true(reply.integer == 2, "DEL returns number of removed keys");
+
+    reply = client.command({"GET", "m1"});
+    runner.assert_true(reply.type == resp::Value::Type::Null, "Deleted key is gone");
+}
+
+void test_incr(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing INCR ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    resp::Value reply = client.command({"INCR", "counter"});
+    runner.assert_true(reply.integer == 1, "INCR of missing key starts at 1");
+    client.command({"INCR", "counter"});
+    reply = client.command({"GET", "counter"});
+    runner.assert_equal("2", reply.str, "INCR updates stored value");
+
+    client.command({"SET", "text", "abc"});
+    reply = client.command({"INCR", "text"});
+    runner.assert_true(reply.isError(), "INCR of non integer fails");
+
+    // concurrent increments from several connections must not lose updates
+    const int num_clients = 4;
+    const int increments = 50;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_clients; i++) {
+        threads.emplace_back([&server, increments]() {
+            RespClient c;
+            c.connect("127.0.0.1", server.port());
+            for (int j = 0; j < increments; j++) {
+                c.command({"INCR", "shared_counter"});
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    reply = client.command({"GET", "shared_counter"});
+    runner.assert_equal(std::to_string(num_clients * increments), reply.str, "Concurrent INCR is atomic");
+}
+
+void test_expire(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing EXPIRE ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    client.command({"SET", "temp", "soon gone"});
+    resp::Value reply = client.command({"EXPIRE", "temp", "1"});
+    runner.assert_true(reply.integer == 1, "EXPIRE on existing key returns 1");
+
+    reply = client.command({"EXPIRE", "missing", "1"});
+    runner.assert_true(reply.integer == 0, "EXPIRE on missing key returns 0");
+
+    client.command({"SET", "px", "value", "PX", "100"});
+    reply = client.command({"PTTL", "px"});
+    runner.assert_true(reply.integer > 0 && reply.integer <= 100, "PTTL reports the remaining milliseconds");
+    reply = client.command({"TTL", "missing"});
+    runner.assert_true(reply.integer == -2, "TTL of a missing key is -2");
+
+    reply = client.command({"GET", "temp"});
+    runner.assert_equal("soon gone", reply.str, "Key readable before TTL");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    reply = client.command({"GET", "temp"});
+    runner.assert_true(reply.type == resp::Value::Type::Null, "Key gone after TTL");
+    reply = client.command({"GET", "px"});
+    runner.assert_true(reply.type == resp::Value::Type::Null, "SET PX expires key");
+
+    client.command({"SET", "persist", "v"});
+    client.command({"EXPIRE", "persist", "1"});
+    client.command({"SET", "persist", "v2"});
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    reply = client.command({"GET", "persist"});
+    runner.assert_equal("v2", reply.str, "SET clears the TTL");
+}
+
+void test_scan(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing SCAN ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    for (int i = 0; i < 25; i++) {
+        client.command({"SET", "scan:" + std::to_string(i), "v"});
+    }
+
+    std::set<std::string> seen;
+    std::string cursor = "0";
+    int rounds = 0;
+    do {
+        resp::Value reply = client.command({"SCAN", cursor, "MATCH", "scan:*", "COUNT", "7"});
+        if (reply.type != resp::Value::Type::Array || reply.elements.size() != 2) {
+            break;
+        }
+        cursor = reply.elements[0].str;
+        for (const auto& key : reply.elements[1].elements) {
+            seen.insert(key.str);
+        }
+        rounds++;
+    } while (cursor != "0" && rounds < 100);
+
+    runner.assert_true(seen.size() == 25, "SCAN visits every matching key");
+    runner.assert_true(rounds > 1, "SCAN pages with COUNT");
+}
+
+void test_info(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing INFO ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    resp::Value reply = client.command({"INFO"});
+    runner.assert_true(reply.str.find("keyspace_hits:") != std::string::npos, "INFO reports hits");
+    runner.assert_true(reply.str.find("used_memory:") != std::string::npos, "INFO reports memory");
+}
+
+void test_pipelining(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing Pipelining ---" << std::endl;
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+
+    const int depth = 200;
+    for (int i = 0; i < depth; i++) {
+        client.send({"SET", "pipe" + std::to_string(i), "v" + std::to_string(i)});
+    }
+    for (int i = 0; i < depth; i++) {
+        client.send({"GET", "pipe" + std::to_string(i)});
+    }
+
+    int ok = 0;
+    for (int i = 0; i < depth; i++) {
+        resp::Value reply;
+        if (client.readReply(reply) && reply.str == "OK") ok++;
+    }
+    int matched = 0;
+    for (int i = 0; i < depth; i++) {
+        resp::Value reply;
+        if (client.readReply(reply) && reply.str == "v" + std::to_string(i)) matched++;
+    }
+    runner.assert_true(ok == depth, "Pipelined SETs all acknowledged in order");
+    runner.assert_true(matched == depth, "Pipelined GETs all answered in order");
+
+    // a frame split across writes must be reassembled
+    client.sendRaw("*2\r\n$3\r\nGET\r\n$5\r\npi");
+    client.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    client.sendRaw("pe7\r\n");
+    resp::Value reply;
+    client.readReply(reply);
+    runner.assert_equal("v7", reply.str, "Split frame is reassembled");
+
+    client.sendRaw("PING\r\n");
+    client.readReply(reply);
+    runner.assert_equal("PONG", reply.str, "Inline commands are accepted");
+}
+
+static size_t residentBytes() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    long pages = 0, resident = 0;
+    if (file) {
+        if (std::fscanf(file, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(file);
+    }
+    return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+void test_slow_reader(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing Slow Reader ---" << std::endl;
+    const std::string value(64 * 1024, 'r');
+    RespClient client;
+    client.connect("127.0.0.1", server.port());
+    client.command({"SET", "slow_reader", value});
+
+    // 1000 pipelined GETs ask for 64MB of replies; the server must stop reading, not buffer them
+    RawConnection reader;
+    reader.connect(server.port());
+    std::string requests;
+    const int batch = 50, depth = 1000;
+    for (int i = 0; i < batch; i++) {
+        requests += "*2\r\n$3\r\nGET\r\n$11\r\nslow_reader\r\n";
+    }
+    size_t before = residentBytes();
+    for (int i = 0; i < depth / batch; i++) {
+        reader.write(requests);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    size_t growth = residentBytes() - std::min(before, residentBytes());
+    runner.assert_true(growth < 16 * 1024 * 1024, "Replies a client doesn't read are not buffered without limit");
+
+    const std::string reply = "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+    int matched = 0;
+    for (int i = 0; i < depth; i++) {
+        if (reader.readBytes(reply.size()) == reply) matched++;
+    }
+    runner.assert_true(matched == depth, "Every reply arrives once the client reads");
+}
+
+void test_many_clients(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing Many Clients ---" << std::endl;
+    const int num_clients = 16;
+    std::vector<RespClient> clients(num_clients);
+    int connected = 0;
+    for (auto& c : clients) {
+        if (c.connect("127.0.0.1", server.port())) connected++;
+    }
+    runner.assert_true(connected == num_clients, "All clients connect");
+
+    for (int i = 0; i < num_clients; i++) {
+        clients[i].send({"SET", "client" + std::to_string(i), std::to_string(i)});
+    }
+    int ok = 0;
+    for (int i = 0; i < num_clients; i++) {
+        resp::Value reply;
+        if (clients[i].readReply(reply) && reply.str == "OK") ok++;
+    }
+    runner.assert_true(ok == num_clients, "Every client gets its reply");
+
+    resp::Value reply = clients[0].command({"QUIT"});
+    runner.assert_equal("OK", reply.str, "QUIT replies OK");
+    resp::Value after;
+    runner.assert_true(!clients[0].readReply(after), "Connection closed after QUIT");
+}
+
+void test_memcached_text(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing memcached text protocol ---" << std::endl;
+    RawConnection conn;
+    runner.assert_true(conn.connect(server.port()), "memcached client connects");
+
+    conn.write("set mc1 0 0 5\r\nhello\r\n");
+    runner.assert_equal("STORED\r\n", conn.readUntil("\r\n"), "set stores value");
+
+    conn.write("get mc1 mc_missing\r\n");
+    runner.assert_equal("VALUE mc1 0 5\r\nhello\r\nEND\r\n", conn.readUntil("END\r\n"),
+                        "get returns hits and skips misses");
+
+    conn.write("gets mc1\r\n");
+    std::string gets = conn.readUntil("END\r\n");
+    std::string header = gets.substr(0, gets.find("\r\n"));
+    std::string cas = header.substr(header.rfind(' ') + 1);
+    runner.assert_true(header.rfind("VALUE mc1 0 5 ", 0) == 0 && !cas.empty(), "gets returns a CAS token");
+
+    conn.write("cas mc1 0 0 3 12345\r\nbad\r\n");
+    runner.assert_equal("EXISTS\r\n", conn.readUntil("\r\n"), "cas with stale token fails");
+    conn.write("cas mc1 0 0 5 " + cas + "\r\nworld\r\n");
+    runner.assert_equal("STORED\r\n", conn.readUntil("\r\n"), "cas with current token stores");
+    conn.write("gets mc1\r\n");
+    gets = conn.readUntil("END\r\n");
+    header = gets.substr(0, gets.find("\r\n"));
+    cas = header.substr(header.rfind(' ') + 1);
+    conn.write("set mc1 0 0 5\r\nother\r\nset mc1 0 0 5\r\nworld\r\n"); // A -> B -> A
+    runner.assert_equal("STORED\r\nSTORED\r\n", conn.readUntil("STORED\r\nSTORED\r\n"), "value written back");
+    conn.write("cas mc1 0 0 3 " + cas + "\r\nnew\r\n");
+    runner.assert_equal("EXISTS\r\n", conn.readUntil("\r\n"), "cas fails after the value was rewritten to the same bytes");
+    conn.write("cas mc_missing 0 0 1 1\r\nx\r\n");
+    runner.assert_equal("NOT_FOUND\r\n", conn.readUntil("\r\n"), "cas of missing key is NOT_FOUND");
+
+    conn.write("set num 0 0 2\r\n10\r\nincr num 5\r\ndecr num 100\r\nincr mc1 1\r\n");
+    runner.assert_equal("STORED\r\n", conn.readUntil("\r\n"), "pipelined set");
+    runner.assert_equal("15\r\n", conn.readUntil("\r\n"), "incr adds delta");
+    runner.assert_equal("0\r\n", conn.readUntil("\r\n"), "decr stops at zero");
+    runner.assert_true(conn.readUntil("\r\n").rfind("CLIENT_ERROR", 0) == 0, "incr of non numeric value fails");
+
+    // the data block arrives in a separate segment
+    conn.write("set split 0 0 6\r\nab");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    conn.write("cdef\r\nget split\r\n");
+    runner.assert_equal("STORED\r\n", conn.readUntil("\r\n"), "split data block is reassembled");
+    runner.assert_equal("VALUE split 0 6\r\nabcdef\r\nEND\r\n", conn.readUntil("END\r\n"), "split value reads back");
+
+    conn.write("delete mc1\r\ndelete mc1\r\nset quiet 0 0 1 noreply\r\nq\r\nget quiet\r\n");
+    runner.assert_equal("DELETED\r\n", conn.readUntil("\r\n"), "delete removes key");
+    runner.assert_equal("NOT_FOUND\r\n", conn.readUntil("\r\n"), "second delete is NOT_FOUND");
+    runner.assert_equal("VALUE quiet 0 1\r\nq\r\nEND\r\n", conn.readUntil("END\r\n"), "noreply suppresses reply");
+
+    conn.write("set ttl 0 1 1\r\nt\r\n");
+    conn.readUntil("\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    conn.write("get ttl\r\n");
+    runner.assert_equal("END\r\n", conn.readUntil("END\r\n"), "exptime expires key");
+
+    conn.write("stats\r\n");
+    runner.assert_true(conn.readUntil("END\r\n").find("STAT get_hits ") != std::string::npos, "stats reports hits");
+
+    conn.write("bogus\r\n");
+    runner.assert_equal("ERROR\r\n", conn.readUntil("\r\n"), "unknown command is ERROR");
+
+    // both protocols share the cache
+    conn.write("set shared 0 0 3\r\nabc\r\n");
+    conn.readUntil("\r\n");
+    conn.write("quit\r\n");
+    runner.assert_true(conn.closed(), "quit closes the connection");
+}
+
+void test_memcached_binary(ServerTests& runner, NetworkServer& server) {
+    std::cout << "\n--- Testing memcached binary protocol ---" << std::endl;
+    RawConnection conn;
+    conn.connect(server.port());
+
+    const uint8_t GET = 0x00, SET = 0x01, DELETE = 0x04, INCREMENT = 0x05, QUIT = 0x07, GETQ = 0x09,
+                  NOOP = 0x0a, VERSION = 0x0b, GETK = 0x0c;
+    std::string set_extras(8, '\0');
+
+    conn.write(binaryRequest(SET, "bin", set_extras, "payload", 0, 42));
+    BinaryResponse response = readBinaryResponse(conn);
+    runner.assert_true(response.opcode == SET && response.status == 0 && response.opaque == 42, "binary SET succeeds");
+    uint64_t cas = response.cas;
+
+    conn.write(binaryRequest(GETK, "bin"));
+    response = readBinaryResponse(conn);
+    runner.assert_equal("payload", response.value, "binary GETK returns value");
+    runner.assert_equal("bin", response.key, "binary GETK returns key");
+    runner.assert_true(response.extras.size() == 4 && response.cas == cas, "binary GET returns flags and CAS");
+
+    conn.write(binaryRequest(SET, "bin", set_extras, "other", cas + 1));
+    runner.assert_true(readBinaryResponse(conn).status == 0x02, "binary SET with stale CAS is KEY_EXISTS");
+    conn.write(binaryRequest(SET, "bin", set_extras, "other", cas));
+    runner.assert_true(readBinaryResponse(conn).status == 0, "binary SET with current CAS succeeds");
+
+    // quiet misses produce no response, NOOP flushes the batch
+    conn.write(binaryRequest(GETQ, "nope", "", "", 0, 1) + binaryRequest(GETQ, "bin", "", "", 0, 2) +
+               binaryRequest(NOOP, "", "", "", 0, 3));
+    response = readBinaryResponse(conn);
+    runner.assert_true(response.opaque == 2 && response.value == "other", "GETQ hit is answered");
+    response = readBinaryResponse(conn);
+    runner.assert_true(response.opcode == NOOP && response.opaque == 3, "GETQ miss is silent");
+
+    std::string incr_extras;
+    auto append64 = [&](uint64_t v) { for (int i = 0; i < 8; i++) incr_extras += static_cast<char>(v >> (56 - 8 * i)); };
+    append64(3);  // delta
+    append64(10); // initial
+    incr_extras += std::string(4, '\0');
+    conn.write(binaryRequest(INCREMENT, "bincounter", incr_extras));
+    response = readBinaryResponse(conn);
+    runner.assert_true(response.status == 0 && response.value.size() == 8 && response.value[7] == 10,
+                       "binary INCREMENT creates with initial value");
+    conn.write(binaryRequest(INCREMENT, "bincounter", incr_extras));
+    response = readBinaryResponse(conn);
+    runner.assert_true(response.value.size() == 8 && response.value[7] == 13, "binary INCREMENT adds delta");
+
+    conn.write(binaryRequest(DELETE, "bin"));
+    runner.assert_true(readBinaryResponse(conn).status == 0, "binary DELETE succeeds");
+    conn.write(binaryRequest(GET, "bin"));
+    runner.assert_true(readBinaryResponse(conn).status == 0x01, "binary GET of deleted key is KEY_NOT_FOUND");
+
+    conn.write(binaryRequest(VERSION, ""));
+    runner.assert_true(!readBinaryResponse(conn).value.empty(), "binary VERSION");
+    conn.write(binaryRequest(0x7f, ""));
+    runner.assert_true(readBinaryResponse(conn).status == 0x81, "unknown binary opcode is rejected");
+
+    conn.write(binaryRequest(QUIT, ""));
+    readBinaryResponse(conn);
+    runner.assert_true(conn.closed(), "binary QUIT closes the connection");
+}
+
+template <typename Server>
+void run_suite(ServerTests& runner, const std::string& backend) {
+    std::cout << "\n========== " << backend << " backend ==========" << std::endl;
+    {
+        TestServer<Server> ts;
+        NetworkServer& server = ts.server;
+        runner.assert_true(server.port() != 0, "Server listens on loopback (" + backend + ")");
+
+        test_get_set(runner, server);
+        test_del_mget_mset(runner, server);
+        test_incr(runner, server);
+        test_expire(runner, server);
+        test_scan(runner, server);
+        test_info(runner, server);
+        test_pipelining(runner, server);
+        test_slow_reader(runner, server);
+        test_many_clients(runner, server);
+
+        NetworkServer& memcached_server = ts.memcached_server;
+        test_memcached_text(runner, memcached_server);
+        test_memcached_binary(runner, memcached_server);
+
+        RespClient client;
+        client.connect("127.0.0.1", server.port());
+        runner.assert_equal("abc", client.command({"GET", "shared"}).str, "RESP and memcached share the cache");
+    }
+    std::remove(TEST_DB);
+}
+
+void test_shared_memory(ServerTests& runner) {
+    std::cout << "\n========== shared memory transport ==========" << std::endl;
+    {
+        CacheConfig cache_config;
+        std::remove(TEST_DB);
+        cache_config.db_path = TEST_DB;
+        cache_config.max_size = 1024 * 1024;
+        FIFOCache cache(cache_config);
+
+        ShmServerConfig config;
+        config.name = "/kvs_server_test";
+        config.slots = 4;
+        config.ring_bytes = 64 * 1024;
+        ShmServer server(cache, config);
+        runner.assert_true(server.start(), "Shared memory server starts");
+
+        ShmClient client;
+        runner.assert_true(client.connect(config.name), "Client maps the segment");
+        runner.assert_true(client.put("shm_key", "shm_value"), "put over shared memory");
+        std::string value;
+        runner.assert_true(client.get("shm_key", value) && value == "shm_value", "get over shared memory");
+        runner.assert_true(!client.get("shm_missing", value), "get of missing key");
+        runner.assert_equal("shm_value", cache.get("shm_key").second, "Writes reach the shared cache");
+
+        std::string binary("x\0y", 3);
+        client.put("shm_binary", binary);
+        runner.assert_true(client.get("shm_binary", value) && value == binary, "Binary safe values round trip");
+
+        // enough traffic to wrap the 64KB rings many times, with sizes that force wrap markers
+        bool all_matched = true;
+        for (int i = 0; i < 2000 && all_matched; i++) {
+            std::string v(static_cast<size_t>(i * 37 % 3000), static_cast<char>('a' + i % 26));
+            client.put("wrap" + std::to_string(i % 50), v);
+            all_matched = client.get("wrap" + std::to_string(i % 50), value) && value == v;
+        }
+        runner.assert_true(all_matched, "Rings wrap around correctly");
+
+        std::string too_big(client.maxMessageSize() + 1, 'z');
+        runner.assert_true(!client.put("too_big", too_big), "Oversized request is rejected");
+
+        runner.assert_true(client.remove("shm_key") && !client.get("shm_key", value), "remove over shared memory");
+
+        // a client publishing a length that runs past its ring must not crash the server
+        {
+            int fd = shm_open(config.name.c_str(), O_RDWR, 0);
+            struct stat st {};
+            fstat(fd, &st);
+            void* segment = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            auto* header = static_cast<shm::SegmentHeader*>(segment);
+            for (uint32_t i = 0; i < header->slot_count; i++) {
+                shm::SlotHeader* slot = shm::slotAt(segment, i);
+                if (slot->state.load() != static_cast<uint32_t>(shm::SlotState::Ready)) {
+                    continue; // only the client above is connected
+                }
+                shm::ByteRing ring(&slot->request,
+                                   shm::ringData(segment, header->slot_count, header->ring_capacity, i, 0),
+                                   header->ring_capacity);
+                char* out = ring.reserve(16);
+                uint32_t corrupt_length = 0x7ffffff0;
+                std::memcpy(out - sizeof(uint64_t), &corrupt_length, sizeof(corrupt_length));
+                ring.commit();
+            }
+            header->doorbell.fetch_add(1);
+            shm::futexWakeAll(&header->doorbell);
+            munmap(segment, st.st_size);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        runner.assert_true(client.put("after_corrupt", "ok") && client.get("after_corrupt", value) && value == "ok",
+                           "Corrupt request length is dropped, the slot keeps working");
+
+        // every slot can be claimed once, the next client is refused until one disconnects
+        std::vector<std::unique_ptr<ShmClient>> extra;
+        for (int i = 0; i < 3; i++) {
+            extra.push_back(std::make_unique<ShmClient>());
+            extra.back()->connect(config.name);
+        }
+        ShmClient overflow;
+        runner.assert_true(!overflow.connect(config.name), "Connect fails when all slots are taken");
+        extra.pop_back();
+        runner.assert_true(overflow.connect(config.name), "Released slot can be claimed again");
+        extra.clear();
+        overflow.disconnect();
+
+        const int threads_count = 3; // the main client keeps the fourth slot
+        const int operations = 500;
+        std::atomic<int> mismatches{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threads_count; t++) {
+            threads.emplace_back([&, t]() {
+                ShmClient c;
+                if (!c.connect(config.name)) {
+                    mismatches++;
+                    return;
+                }
+                std::string v;
+                for (int i = 0; i < operations; i++) {
+                    std::string key = "t" + std::to_string(t) + "_" + std::to_string(i % 20);
+                    c.put(key, std::to_string(i));
+                    if (!c.get(key, v) || v != std::to_string(i)) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        runner.assert_true(mismatches == 0, "Concurrent clients each see their own writes");
+
+        // a client that dies holding its slot is reclaimed while the server stays busy
+        pid_t dead = fork();
+        if (dead == 0) {
+            ShmClient c;
+            _exit(c.connect(config.name) ? 0 : 1); // exits without releasing the slot
+        }
+        int dead_status = 0;
+        waitpid(dead, &dead_status, 0);
+        std::atomic<bool> busy{true};
+        std::thread load([&]() {
+            std::string v;
+            while (busy) {
+                client.get("after_corrupt", v);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        std::vector<std::unique_ptr<ShmClient>> remaining;
+        bool all_connected = true;
+        for (int i = 0; i < 3; i++) {
+            remaining.push_back(std::make_unique<ShmClient>());
+            all_connected = remaining.back()->connect(config.name) && all_connected;
+        }
+        busy = false;
+        load.join();
+        remaining.clear();
+        runner.assert_true(all_connected, "Dead client's slot is reclaimed under load");
+
+        // a separate process shares the same segment
+        client.disconnect();
+        pid_t child = fork();
+        if (child == 0) {
+            ShmClient c;
+            bool ok = c.connect(config.name) && c.put("from_child", "hello");
+            _exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        runner.assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Child process writes over shared memory");
+        runner.assert_equal("hello", cache.get("from_child").second, "Child process write is visible");
+
+        server.stop();
+        runner.assert_true(!client.connect(config.name), "Segment is removed on stop");
+    }
+    std::remove(TEST_DB);
+}
+
+// One kv_server instance of a routed cluster, with its own cache and database file
+struct RouterNode {
+    std::string db_path;
+    FIFOCache cache;
+    RespHandler handler;
+    EpollServer server;
+
+    static CacheConfig cacheConfig(const std::string& db_path) {
+        std::remove(db_path.c_str());
+        CacheConfig config;
+        config.db_path = db_path;
+        config.max_size = 1024 * 1024;
+        return config;
+    }
+
+    explicit RouterNode(const std::string& path)
+        : db_path(path), cache(cacheConfig(path)), handler(cache), server(handler, TestServer<EpollServer>::serverConfig()) {
+        server.start();
+    }
+
+    ~RouterNode() {
+        server.stop();
+        std::remove(db_path.c_str());
+    }
+};
+
+void test_router(ServerTests& runner) {
+    std::cout << "\n========== consistent hash router ==========" << std::endl;
+    std::vector<std::unique_ptr<RouterNode>> nodes;
+    for (int i = 0; i < 4; i++) {
+        nodes.push_back(std::make_unique<RouterNode>("router_test" + std::to_string(i) + ".db"));
+    }
+    RespRouter router;
+    for (int i = 0; i < 3; i++) {
+        router.add_node("127.0.0.1", nodes[i]->server.port());
+    }
+    runner.assert_true(!router.add_node("127.0.0.1", nodes[0]->server.port()), "Node is added once");
+
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (int i = 0; i < 600; i++) {
+        pairs.emplace_back("user:" + std::to_string(i), "v" + std::to_string(i));
+    }
+    runner.assert_true(router.put_many(pairs), "put_many stores every node's share");
+    router.put("single", "value");
+    std::string value;
+    runner.assert_true(router.get("single", value) && value == "value", "get reads from the owner");
+
+    std::vector<size_t> per_node(3);
+    bool on_owner_only = true;
+    for (size_t i = 0; i < pairs.size(); i += 50) {
+        size_t owner = router.owner(pairs[i].first);
+        for (size_t n = 0; n < 3; n++) {
+            bool stored = !nodes[n]->cache.get(pairs[i].first).first.empty();
+            on_owner_only = on_owner_only && stored == (n == owner);
+        }
+    }
+    for (const auto& pair : pairs) {
+        per_node[router.owner(pair.first)]++;
+    }
+    runner.assert_true(on_owner_only, "Each key is stored on its owner only");
+    runner.assert_true(*std::min_element(per_node.begin(), per_node.end()) > 100, "Keys spread over the nodes");
+
+    std::vector<std::string> keys{"user:1", "missing", "user:599"};
+    auto found = router.get_many(keys);
+    runner.assert_true(found[0] == std::make_pair(true, std::string("v1")) && !found[1].first &&
+                           found[2] == std::make_pair(true, std::string("v599")),
+                       "get_many returns values in key order across nodes");
+
+    std::vector<size_t> before;
+    for (const auto& pair : pairs) {
+        before.push_back(router.owner(pair.first));
+    }
+    std::vector<std::string> timed;
+    for (int i = 0; i < 40; i++) {
+        std::string key = "timed:" + std::to_string(i);
+        nodes[router.owner(key)]->cache.put_with_ttl(key, "short lived", 1000);
+        timed.push_back(key);
+    }
+    router.add_node("127.0.0.1", nodes[3]->server.port());
+    size_t remapped = 0;
+    bool only_to_new = true;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        size_t owner = router.owner(pairs[i].first);
+        if (owner != before[i]) {
+            remapped++;
+            only_to_new = only_to_new && owner == 3;
+        }
+    }
+    runner.assert_true(only_to_new && remapped > 60 && remapped < 240, "Adding a node moves about a quarter of the keys");
+
+    size_t timed_moved = std::count_if(timed.begin(), timed.end(), [&](const std::string& key) { return router.owner(key) == 3; });
+    router.put("user:7", "written after the add"); // lands on the new owner before the move
+    size_t moved = router.rebalance(64);
+    runner.assert_true(moved + (router.owner("user:7") == 3 ? 1 : 0) == remapped + (router.owner("single") == 3) + timed_moved,
+                       "Rebalance moves exactly the remapped keys");
+    auto all = router.get_many([&]() {
+        std::vector<std::string> all_keys;
+        for (const auto& pair : pairs) {
+            all_keys.push_back(pair.first);
+        }
+        return all_keys;
+    }());
+    bool all_found = true;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        all_found = all_found && all[i].first && (pairs[i].first == "user:7" || all[i].second == pairs[i].second);
+    }
+    runner.assert_true(all_found, "Every key is readable after the rebalance");
+    bool ttl_kept = true;
+    for (const auto& key : timed) {
+        if (router.owner(key) == 3) {
+            long long ttl = nodes[3]->cache.ttl_ms(key);
+            ttl_kept = ttl_kept && ttl > 0 && ttl <= 1000;
+        }
+    }
+    runner.assert_true(timed_moved > 0 && ttl_kept, "Rebalance copies the remaining TTL of moved keys");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    bool timed_expired = true;
+    for (const auto& key : timed) {
+        timed_expired = timed_expired && !router.get(key, value);
+    }
+    runner.assert_true(timed_expired, "Moved keys still expire");
+    runner.assert_true(router.get("user:7", value) && value == "written after the add",
+                       "Rebalance keeps writes made at the new owner");
+    runner.assert_true(router.remove("user:1") && !router.get("user:1", value), "remove deletes at the owner");
+
+    size_t owner = router.owner("user:2");
+    uint16_t port = nodes[owner]->server.port();
+    runner.assert_true(router.remove_node("127.0.0.1", port) && router.node_count() == 3 &&
+                           router.node_for("user:2").port != port,
+                       "Node is taken off the ring");
+    runner.assert_true(!router.get("user:2", value), "Keys of a removed node are gone until rebalanced elsewhere");
+}
+
+int main() {
+    ServerTests runner;
+
+    run_suite<EpollServer>(runner, "epoll");
+#ifdef KVS_HAVE_IO_URING
+    run_suite<UringServer>(runner, "io_uring");
+#endif
+    test_shared_memory(runner);
+    test_router(runner);
+
+    runner.print_summary();
+
+    return 0;
+}
@@ -1,11 +1,20 @@
 #include <iostream>
 #include <cassert>
+#include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <vector>
 #include <chrono>
 #include <random>
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../fifo_cache.hpp"
+#include "../bulk_loader.hpp"
 
 class PerformanceTests {
 private:
@@ -315,6 +324,1233 @@ void test_rapid_insertions(PerformanceTests& runner) {
     runner.assert_equal("val500", result.second, "Rapid insertion test");
 }
 
+// Shared segment tests
+void test_shared_segment(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Shared Cache Segment ---" << std::endl;
+    const std::string segment = "/kvs_unit_test_segment";
+    SharedCacheSegment::unlink(segment);
+    std::remove("shared_test.db");
+
+    CacheConfig config;
+    config.db_path = "shared_test.db";
+    config.max_size = 50;
+    config.shared_segment = segment;
+    {
+        FIFOCache first(config);
+        FIFOCache second(config); // stands in for a second worker process
+
+        first.put("shared_key", "value1");
+        CacheStats before = second.stats();
+        runner.assert_equal("value1", second.get("shared_key").second, "Write is visible to other cache");
+        CacheStats after = second.stats();
+        runner.assert_true(after.hits == before.hits + 1 && after.misses == before.misses,
+                           "Other cache is served from shared memory, not the DB");
+
+        // FIFO eviction is shared too: 3 x 20 bytes don't fit into 50
+        first.put("A", std::string(19, 'A'));
+        first.put("B", std::string(19, 'B'));
+        second.put("C", std::string(19, 'C'));
+        CacheStats stats = first.stats();
+        runner.assert_true(stats.current_size <= 50 && stats.evictions >= 1, "Shared FIFO eviction");
+        runner.assert_equal(std::string(19, 'A'), second.get("A").second, "Evicted entry is reloaded from DB");
+
+        second.remove("B");
+        runner.assert_equal("", first.get("B").second, "Remove is visible to other cache");
+
+        first.put("ttl", "x");
+        first.expire_ms("ttl", 50);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        runner.assert_equal("", second.get("ttl").second, "TTL set by one cache expires in the other");
+
+        pid_t child = fork();
+        if (child == 0) {
+            FIFOCache child_cache(config);
+            child_cache.put("from_child", "hello");
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        before = first.stats();
+        runner.assert_equal("hello", first.get("from_child").second, "Write from another process is visible");
+        runner.assert_true(first.stats().hits == before.hits + 1, "Other process filled the shared cache");
+
+        const int num_threads = 4;
+        std::vector<std::thread> threads;
+        std::atomic<int> mismatches{0};
+        for (int t = 0; t < num_threads; t++) {
+            threads.emplace_back([&, t]() {
+                FIFOCache& cache = t % 2 == 0 ? first : second;
+                for (int i = 0; i < 100; i++) {
+                    std::string key = "c" + std::to_string(t) + "_" + std::to_string(i % 5);
+                    cache.put(key, std::to_string(i));
+                    if (cache.get(key).second != std::to_string(i)) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        runner.assert_true(mismatches == 0, "Concurrent writers through two caches stay consistent");
+    }
+    SharedCacheSegment::unlink(segment);
+    std::remove("shared_test.db");
+}
+
+// Snapshot tests
+void test_snapshot(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Snapshots ---" << std::endl;
+    std::remove("snapshot_test.db");
+    std::remove("snapshot_test.snap");
+
+    CacheConfig config;
+    config.db_path = "snapshot_test.db";
+    config.max_size = 100;
+    {
+        FIFOCache cache(config);
+        for (int i = 0; i < 10; i++) {
+            cache.put("snap" + std::to_string(i), std::string(15, static_cast<char>('a' + i))); // 20 bytes each
+        }
+        runner.assert_true(cache.save_snapshot("snapshot_test.snap"), "Snapshot is written");
+    }
+    {
+        FIFOCache cache(config);
+        runner.assert_true(cache.load_snapshot("snapshot_test.snap"), "Snapshot is loaded");
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.entries == 5 && stats.current_size == 100, "Snapshot restores the resident entries");
+        runner.assert_equal(std::string(15, 'j'), cache.get("snap9").second, "Restored entry is readable");
+        runner.assert_true(cache.stats().misses == 0, "Restored entry is served from memory");
+
+        // FIFO order survives: snap5 was the oldest resident entry and is evicted first
+        cache.put("new", std::string(17, 'n'));
+        CacheStats before = cache.stats();
+        cache.get("snap6");
+        runner.assert_true(cache.stats().hits == before.hits + 1, "Second oldest entry is still cached");
+        cache.get("snap5");
+        runner.assert_true(cache.stats().misses == before.misses + 1, "Oldest entry was evicted first");
+    }
+    {
+        FIFOCache cache(config);
+        runner.assert_true(!cache.load_snapshot("snapshot_test.snap"), "Snapshot older than the DB is rejected");
+    }
+
+    // automatic save on destruction and load on construction
+    config.snapshot_path = "snapshot_test.snap";
+    {
+        FIFOCache cache(config);
+        cache.put("auto", "saved");
+    }
+    {
+        FIFOCache cache(config);
+        runner.assert_true(cache.stats().entries > 0, "Snapshot is loaded on construction");
+        runner.assert_equal("saved", cache.get("auto").second, "Automatic snapshot round trip");
+        runner.assert_true(cache.stats().misses == 0, "Automatically restored entry is served from memory");
+    }
+    runner.assert_true(!std::ifstream("snapshot_test.snap.tmp").good(), "No temporary file is left behind");
+    std::remove("snapshot_test.db");
+    std::remove("snapshot_test.snap");
+}
+
+void test_warmup(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Cache Warm-up ---" << std::endl;
+    std::remove("warmup_test.db");
+
+    CacheConfig config;
+    config.db_path = "warmup_test.db";
+    config.max_size = 100;
+    config.read_sample_rate = 1; // count every read
+    {
+        FIFOCache cache(config);
+        for (int i = 0; i < 20; i++) {
+            cache.put("warm" + std::to_string(i), std::string(14, static_cast<char>('a' + i))); // 19 or 20 bytes
+        }
+        for (int i = 0; i < 5; i++) {
+            cache.get("warm3");
+        }
+        for (int i = 0; i < 3; i++) {
+            cache.get("warm7");
+        }
+        cache.get("warm11");
+        cache.flush_read_stats();
+    }
+    {
+        SQLiteDB db("warmup_test.db");
+        runner.assert_true(db.get_read_stats("warm3").first == 5, "Reads are counted per row");
+        runner.assert_true(db.get_read_stats("warm3").second > 0, "Last read time is recorded");
+    }
+    {
+        FIFOCache cache(config);
+        size_t callbacks = 0;
+        bool saw_done = false;
+        runner.assert_true(cache.start_warmup(3, WarmupOrder::MostRead, [&](const WarmupProgress& progress) {
+            callbacks++;
+            saw_done = progress.done;
+        }), "Warm-up starts");
+        cache.wait_for_warmup();
+        WarmupProgress progress = cache.warmup_progress();
+        runner.assert_true(progress.done && progress.rows_loaded == 3 && progress.bytes_loaded == 58,
+                           "Warm-up stops at the requested row count");
+        runner.assert_true(callbacks > 0 && saw_done, "Warm-up reports its progress");
+        cache.get("warm3");
+        cache.get("warm7");
+        cache.get("warm11");
+        runner.assert_true(cache.stats().misses == 0, "Most read rows are warmed up");
+    }
+    {
+        FIFOCache cache(config);
+        cache.start_warmup(1000, WarmupOrder::RecentlyWritten);
+        cache.wait_for_warmup();
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.entries == 5 && stats.evictions == 0, "Warm-up fills the cache without evicting");
+        cache.get("warm19");
+        cache.get("warm15");
+        runner.assert_true(cache.stats().misses == 0, "Most recently written rows are warmed up");
+    }
+
+    // databases created before the access metadata existed are migrated
+    std::remove("warmup_test.db");
+    {
+        sqlite3* raw;
+        sqlite3_open("warmup_test.db", &raw);
+        sqlite3_exec(raw, "CREATE TABLE cache_data (key TEXT PRIMARY KEY, value TEXT NOT NULL);"
+                          "INSERT INTO cache_data VALUES ('legacy', 'row');", nullptr, nullptr, nullptr);
+        sqlite3_close(raw);
+    }
+    {
+        config.warmup_rows = 10;
+        FIFOCache cache(config);
+        cache.wait_for_warmup();
+        runner.assert_equal("row", cache.get("legacy").second, "Legacy database is readable");
+        runner.assert_true(cache.stats().misses == 0, "Legacy database is warmed up on construction");
+    }
+    std::remove("warmup_test.db");
+}
+
+void test_bulk_load(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Bulk Load ---" << std::endl;
+    std::remove("bulk_test.db");
+
+    std::string key, value;
+    runner.assert_true(BulkLoader::parseLine("a\\tb\tline\\none", key, value) && key == "a\tb" && value == "line\none",
+                       "Bulk load lines are unescaped");
+    runner.assert_true(!BulkLoader::parseLine("no tab", key, value), "Line without a value is rejected");
+
+    CacheConfig cache_config;
+    cache_config.db_path = "bulk_test.db";
+    cache_config.max_size = 1000;
+    {
+        FIFOCache cache(cache_config);
+        cache.put("existing", "old");
+    }
+
+    BulkLoadConfig config;
+    config.db_path = "bulk_test.db";
+    config.memory_bytes = 4096; // forces several sorted runs
+    config.rows_per_transaction = 100;
+    config.threads = 2;
+    BulkLoader loader(config);
+    for (int i = 999; i >= 0; i--) {
+        loader.add("bulk" + std::to_string(i), "v" + std::to_string(i));
+    }
+    loader.add("bulk5", "overwritten");
+    loader.add("existing", "new");
+    loader.add("", "skipped");
+    BulkLoadResult result = loader.finish();
+    runner.assert_true(result.ok && result.runs > 1, "Bulk load spills and merges sorted runs");
+    runner.assert_true(result.rows == 1001, "Duplicate keys are written once");
+
+    FIFOCache cache(cache_config);
+    runner.assert_equal("v0", cache.get("bulk0").second, "Bulk loaded row is readable");
+    runner.assert_equal("v999", cache.get("bulk999").second, "Last bulk loaded row is readable");
+    runner.assert_equal("overwritten", cache.get("bulk5").second, "Last occurrence of a key wins");
+    runner.assert_equal("new", cache.get("existing").second, "Bulk load replaces existing rows");
+
+    size_t keys = 0;
+    uint64_t cursor = 0;
+    do {
+        auto page = cache.scan(cursor, 500);
+        keys += page.second.size();
+        cursor = page.first;
+    } while (cursor != 0);
+    runner.assert_true(keys == 1001, "Bulk load writes every key");
+    std::remove("bulk_test.db");
+}
+
+void test_backup(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Online Backup and Export ---" << std::endl;
+    std::remove("backup_test.db");
+    std::remove("backup_copy.db");
+    std::remove("backup_export.tsv");
+
+    CacheConfig config;
+    config.db_path = "backup_test.db";
+    config.max_size = 1000;
+    FIFOCache cache(config);
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (int i = 0; i < 5000; i++) {
+        pairs.emplace_back("backup" + std::to_string(i), "value\t" + std::to_string(i) + "\n");
+    }
+    cache.put_many(pairs);
+    cache.put("expiring", "gone");
+    cache.expire_ms("expiring", 1);
+
+    // writers keep going while the copy is taken one page at a time
+    std::atomic<bool> done{false};
+    std::atomic<int> writes{0};
+    std::thread writer([&]() {
+        while (!done) {
+            cache.put("concurrent" + std::to_string(writes % 100), "x");
+            writes++;
+        }
+    });
+    int steps = 0;
+    bool copied = cache.backup("backup_copy.db", [&](int, int) { steps++; }, 4);
+    done = true;
+    writer.join();
+    runner.assert_true(copied && steps > 1, "Backup completes in steps");
+
+    {
+        CacheConfig copy_config;
+        copy_config.db_path = "backup_copy.db";
+        copy_config.max_size = 1000;
+        FIFOCache copy(copy_config);
+        runner.assert_equal("value\t4999\n", copy.get("backup4999").second, "Backup holds the data");
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    backup::ExportResult exported = cache.export_to("backup_export.tsv", 3);
+    runner.assert_true(exported.ok && exported.rows >= 5000, "Export writes every row");
+    runner.assert_true(!std::ifstream("backup_export.tsv.db").good(), "Export removes its database copy");
+
+    std::ifstream in("backup_export.tsv");
+    std::string line, key, value;
+    size_t lines = 0;
+    bool parsed = true, found = false, expired = false;
+    while (std::getline(in, line)) {
+        lines++;
+        parsed = parsed && BulkLoader::parseLine(line, key, value);
+        found = found || (key == "backup123" && value == "value\t123\n");
+        expired = expired || key == "expiring";
+    }
+    runner.assert_true(parsed && lines == exported.rows, "Export is in the bulk load format");
+    runner.assert_true(found && !expired, "Export round trips values and skips expired keys");
+
+    std::remove("backup_test.db");
+    std::remove("backup_copy.db");
+    std::remove("backup_export.tsv");
+}
+
+void test_huge_page_memory(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Huge Page Entry Memory ---" << std::endl;
+    std::remove("hugepage_test.db");
+
+    CacheConfig config;
+    config.db_path = "hugepage_test.db";
+    config.max_size = 1000;
+    config.huge_pages = true;
+    FIFOCache cache(config);
+    for (int i = 0; i < 100; i++) {
+        cache.put("huge" + std::to_string(i), std::string(40, static_cast<char>('a' + i % 26))); // 46 or 47 bytes
+    }
+    CacheStats stats = cache.stats();
+    runner.assert_true(stats.huge_page_bytes >= memory::HUGE_PAGE_SIZE, "Entries live in huge page mappings");
+    runner.assert_true(stats.current_size <= 1000 && stats.evictions > 0, "Eviction works with huge page memory");
+    runner.assert_equal(std::string(40, 'v'), cache.get("huge99").second, "Entry is readable");
+    cache.put("huge99", std::string(2 << 20, 'x')); // too large to cache, stored in the DB only
+    runner.assert_true(cache.get("huge99").second.size() == (2u << 20), "Large values still round trip");
+    cache.remove("huge98");
+    runner.assert_true(cache.get("huge98").first.empty(), "Removed entry is gone");
+    std::remove("hugepage_test.db");
+}
+
+void test_near_cache(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Per-thread Near Cache ---" << std::endl;
+    std::remove("near_cache_test.db");
+
+    CacheConfig config;
+    config.db_path = "near_cache_test.db";
+    config.max_size = 1000;
+    config.l0_entries = 64;
+    FIFOCache cache(config);
+    cache.put("hot", "v1");
+    cache.get("hot"); // copied into this thread's near cache
+    for (int i = 0; i < 10; i++) {
+        cache.get("hot");
+    }
+    CacheStats stats = cache.stats();
+    runner.assert_true(stats.l0_hits == 10 && stats.hits == 11, "Repeated reads are served by the near cache");
+
+    cache.put("hot", "v2");
+    runner.assert_equal("v2", cache.get("hot").second, "Put invalidates the near cache");
+    cache.incr("counter");
+    cache.get("counter");
+    cache.incr("counter");
+    runner.assert_equal("2", cache.get("counter").second, "Update invalidates the near cache");
+
+    std::string seen;
+    runner.assert_true(cache.visit("hot", [&seen](std::string_view value) { seen = value; }) && seen == "v2",
+                       "Visit reads through the near cache");
+
+    std::thread other([&cache]() { cache.put("hot", "v3"); });
+    other.join();
+    runner.assert_equal("v3", cache.get("hot").second, "Writes from other threads invalidate it");
+
+    cache.remove("hot");
+    runner.assert_true(cache.get("hot").first.empty(), "Remove invalidates the near cache");
+
+    cache.put("ttl", "short");
+    cache.get("ttl");
+    cache.expire_ms("ttl", 20);
+    cache.get("ttl");
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    runner.assert_true(cache.get("ttl").first.empty(), "Near cache copies expire with their key");
+
+    std::remove("near_cache_test.db");
+}
+
+void test_background_evictor(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Background Evictor ---" << std::endl;
+    std::remove("evictor_test.db");
+
+    {
+        // updating the oldest key evicts it rather than counting its bytes twice
+        CacheConfig small_config;
+        small_config.db_path = "evictor_test.db";
+        small_config.max_size = 30;
+        FIFOCache cache(small_config);
+        cache.put("a", std::string(9, 'a'));
+        cache.put("b", std::string(9, 'b'));
+        cache.put("c", std::string(9, 'c'));
+        cache.put("a", std::string(19, 'A'));
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.current_size == 30 && stats.entries == 2, "Update of the oldest key keeps sizes exact");
+        runner.assert_true(stats.max_inline_evict_loop == 2, "Inline eviction loop length is reported");
+    }
+
+    CacheConfig config;
+    config.db_path = "evictor_test.db";
+    config.max_size = 1000;
+    config.evict_low_free_bytes = 200;
+    config.evict_high_free_bytes = 400;
+    FIFOCache cache(config);
+    for (int i = 0; i < 200; i++) {
+        cache.put("evict" + std::to_string(1000 + i), std::string(11, 'x')); // 20 bytes
+    }
+    CacheStats stats = cache.stats();
+    for (int i = 0; i < 100 && stats.current_size > 800; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stats = cache.stats();
+    }
+    runner.assert_true(stats.current_size <= 800, "Evictor keeps the low watermark free");
+    runner.assert_true(stats.background_evictions > 0 && stats.inline_evictions < stats.background_evictions &&
+                       stats.background_evictions + stats.inline_evictions == stats.evictions,
+                       "Background evictions are counted");
+    runner.assert_equal(std::string(11, 'x'), cache.get("evict1000").second, "Evicted keys are read from the DB");
+    std::remove("evictor_test.db");
+}
+
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void test_memory_bound(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Memory Bound ---" << std::endl;
+    std::remove("memory_bound_test.db");
+
+    CacheConfig config;
+    config.db_path = "memory_bound_test.db";
+    config.max_size = 16 << 20;
+    config.bound_memory = true;
+    size_t before = residentBytes();
+    {
+        FIFOCache cache(config);
+        for (int i = 0; i < 600000; i++) {
+            // small entries, where per-entry overhead is several times the key and value bytes
+            cache.insertToCache("memory" + std::to_string(1000000 + i), std::string(20 + i % 40, 'v'));
+        }
+        size_t growth = residentBytes() - before;
+        CacheStats stats = cache.stats();
+        std::cout << "  " << stats.entries << " entries, " << stats.current_size << " bytes accounted, RSS grew "
+                  << growth << " bytes" << std::endl;
+        runner.assert_true(stats.current_size <= config.max_size && stats.evictions > 0, "Accounted memory stays in budget");
+        runner.assert_true(growth <= config.max_size + config.max_size / 4, "RSS stays close to the budget");
+        runner.assert_equal(std::string(20 + 599999 % 40, 'v'), cache.get("memory1599999").second, "Newest entry is cached");
+    }
+    std::remove("memory_bound_test.db");
+}
+
+void test_adaptive_policy(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Adaptive Eviction Policy ---" << std::endl;
+
+    // a few hot keys read repeatedly, then a scan of keys read once
+    auto run = [](EvictionPolicy policy) {
+        std::remove("adaptive_test.db");
+        CacheConfig config;
+        config.db_path = "adaptive_test.db";
+        config.max_size = 200;
+        config.policy = policy;
+        auto cache = std::make_unique<FIFOCache>(config);
+        for (int i = 0; i < 5; i++) {
+            cache->put("hot" + std::to_string(i), std::string(16, 'h')); // 20 bytes
+        }
+        for (int round = 0; round < 2; round++) {
+            for (int i = 0; i < 5; i++) {
+                cache->get("hot" + std::to_string(i));
+            }
+        }
+        for (int i = 0; i < 50; i++) {
+            cache->put("scan" + std::to_string(10 + i), std::string(14, 's')); // 20 bytes
+        }
+        uint64_t misses = cache->stats().misses;
+        for (int i = 0; i < 5; i++) {
+            cache->get("hot" + std::to_string(i));
+        }
+        return std::make_pair(cache->stats().misses - misses, std::move(cache));
+    };
+
+    auto fifo = run(EvictionPolicy::Fifo);
+    runner.assert_true(fifo.first == 5, "FIFO loses the hot keys to a scan");
+    fifo.second.reset();
+
+    auto adaptive = run(EvictionPolicy::Adaptive);
+    FIFOCache& cache = *adaptive.second;
+    CacheStats stats = cache.stats();
+    runner.assert_true(adaptive.first == 0, "Adaptive policy keeps the hot keys through a scan");
+    runner.assert_true(stats.frequency_bytes == 100 && stats.current_size <= 200, "Hot keys moved to the frequency segment");
+
+    // a miss on a key the scan pushed out recently grows the recency segment
+    runner.assert_equal(std::string(14, 's'), cache.get("scan54").second, "Evicted key is read from the DB");
+    stats = cache.stats();
+    runner.assert_true(stats.ghost_hits == 1 && stats.recency_target > 0, "Ghost hit moves capacity to recency");
+    size_t frequency_bytes = stats.frequency_bytes;
+    runner.assert_true(cache.remove("hot0"), "Remove works with the adaptive policy");
+    runner.assert_true(cache.stats().frequency_bytes == frequency_bytes - 20, "Segment sizes follow removals");
+    adaptive.second.reset();
+    std::remove("adaptive_test.db");
+}
+
+void test_greedy_dual_policy(PerformanceTests& runner) {
+    std::cout << "\n--- Testing GreedyDual Eviction Policy ---" << std::endl;
+    std::remove("greedy_dual_test.db");
+    CacheConfig config;
+    config.db_path = "greedy_dual_test.db";
+    config.max_size = 100;
+    config.policy = EvictionPolicy::GreedyDual;
+    {
+        FIFOCache cache(config);
+        // 20 byte entries, then record how long each took to read from the DB
+        float fetch_us[] = {10, 1000, 100, 100, 100};
+        for (int i = 0; i < 5; i++) {
+            std::string key = "key" + std::to_string(i);
+            cache.put(key, std::string(16, 'v'));
+            cache.insertToCache(key, std::string(16, 'v'), fetch_us[i]);
+        }
+        cache.put("key5", std::string(16, 'v'));
+        uint64_t misses = cache.stats().misses;
+        cache.get("key1");
+        runner.assert_true(cache.stats().misses == misses, "Expensive entry is kept");
+        cache.get("key0");
+        runner.assert_true(cache.stats().misses == misses + 1, "Cheapest entry is evicted first");
+
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.hit_bytes == 16 && stats.miss_bytes == 16, "Hit and miss bytes are counted");
+        runner.assert_true(stats.saved_fetch_micros == 1000, "Hits count the DB time they saved");
+    }
+    std::remove("greedy_dual_test.db");
+    {
+        FIFOCache cache(config);
+        for (char c : std::string("abcde")) {
+            std::string key(1, c);
+            cache.put(key, std::string(19, 'v'));
+            cache.insertToCache(key, std::string(19, 'v'), 100);
+        }
+        for (int i = 0; i < 3; i++) {
+            cache.get("a");
+        }
+        for (char c : std::string("fghi")) {
+            cache.put(std::string(1, c), std::string(19, 'v'));
+        }
+        uint64_t misses = cache.stats().misses;
+        cache.get("a");
+        runner.assert_true(cache.stats().misses == misses, "Frequently read entry outlives equally priced ones");
+        cache.get("b");
+        runner.assert_true(cache.stats().misses == misses + 1, "Unread entries are evicted");
+    }
+    std::remove("greedy_dual_test.db");
+}
+
+void test_large_object_segment(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Large Object Segment ---" << std::endl;
+    std::remove("large_object_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "large_object_test.db";
+        config.max_size = 100;
+        config.large_segment_bytes = 4 * LargeObjectSegment::CHUNK_SIZE;
+        config.large_value_bytes = 1000;
+        FIFOCache cache(config);
+
+        std::string big(20000, 'b');
+        cache.put("big", big);
+        for (int i = 0; i < 10; i++) {
+            cache.put("small" + std::to_string(i), std::string(14, 's')); // 20 bytes
+        }
+        uint64_t misses = cache.stats().misses;
+        runner.assert_equal(big, cache.get("big").second, "Large value is served");
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.misses == misses && stats.large_entries == 1 && stats.large_bytes == big.size(),
+                           "Large value is cached outside the small-entry budget");
+        runner.assert_true(stats.current_size == 100 && stats.entries == 5, "Small entries keep their whole budget");
+
+        cache.put("bigger", std::string(40000, 'B')); // 3 chunks, only 2 are free
+        stats = cache.stats();
+        runner.assert_true(stats.large_evictions == 1 && stats.large_entries == 1, "Least recently read large value is evicted");
+        runner.assert_equal(big, cache.get("big").second, "Evicted large value is read from the DB");
+        runner.assert_true(cache.stats().misses == misses + 1, "Large value miss is counted");
+
+        cache.put("big", "small again");
+        runner.assert_equal(std::string("small again"), cache.get("big").second, "Shrunk value moves to the small-entry cache");
+        runner.assert_true(cache.stats().large_entries == 0, "Shrunk value leaves the large-object segment");
+        cache.put("bigger", big);
+        runner.assert_true(cache.remove("bigger") && cache.stats().large_entries == 0, "Remove drops large values");
+        runner.assert_true(cache.get("bigger").first.empty(), "Removed large value is gone");
+    }
+    std::remove("large_object_test.db");
+}
+
+void test_streaming_values(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Streaming Put/Get ---" << std::endl;
+    std::remove("stream_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "stream_test.db";
+        config.max_size = 1000;
+        FIFOCache cache(config);
+        auto byteAt = [](size_t offset) { return static_cast<char>('a' + offset % 26); };
+
+        size_t size = 5 * SQLiteDB::STREAM_CHUNK + 123;
+        size_t written = 0;
+        size_t largest_piece = 0;
+        bool stored = cache.put_stream("stream", size, [&](char* buffer, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                buffer[i] = byteAt(written + i);
+            }
+            written += length;
+            largest_piece = std::max(largest_piece, length);
+            return true;
+        });
+        runner.assert_true(stored && written == size, "Streamed value is written");
+        runner.assert_true(largest_piece <= SQLiteDB::STREAM_CHUNK, "Value is written in bounded pieces");
+
+        size_t read = 0;
+        bool intact = true;
+        bool foreign_seen = false;
+        bool found = cache.get_stream("stream", [&](const char* data, size_t length) {
+            if (read == 0) {
+                cache.put("other", "written mid-stream"); // the connection is free between pieces
+                SQLiteDB(config.db_path).put_to_db("foreign", "another connection");
+                foreign_seen = cache.get("foreign").second == "another connection"; // no snapshot is held
+            }
+            for (size_t i = 0; i < length; i++) {
+                intact = intact && data[i] == byteAt(read + i);
+            }
+            read += length;
+            return true;
+        });
+        runner.assert_true(found && intact && read == size, "Streamed value reads back intact");
+        runner.assert_equal(std::string("written mid-stream"), cache.get("other").second, "Writes proceed during a streamed read");
+        runner.assert_true(foreign_seen, "Other connections' commits are visible during a streamed read");
+        read = 0;
+        found = cache.get_stream("stream", [&](const char*, size_t length) {
+            if (read == 0) {
+                cache.put("stream", std::string(size, 'x')); // same length, new value
+            }
+            read += length;
+            return true;
+        });
+        runner.assert_true(!found && read < size, "A streamed read stops when the value is rewritten");
+        runner.assert_true(cache.get("stream").second.size() == size, "Streamed value is readable with get");
+        runner.assert_true(!cache.get_stream("missing", [](const char*, size_t) { return true; }), "Missing key is not streamed");
+
+        // a streamed overwrite drops the cached value
+        cache.put("small", "old");
+        stored = cache.put_stream("small", 3, [](char* buffer, size_t) { std::memcpy(buffer, "new", 3); return true; });
+        runner.assert_equal(std::string("new"), cache.get("small").second, "Streamed overwrite replaces the cached value");
+
+        // an aborted write leaves the old value
+        stored = cache.put_stream("small", 3, [](char*, size_t) { return false; });
+        runner.assert_true(!stored && cache.get("small").second == "new", "Aborted stream is rolled back");
+    }
+    std::remove("stream_test.db");
+    {
+        // a dropped entry's clock slot doesn't evict the key once it is cached again
+        CacheConfig config;
+        config.db_path = "stream_test.db";
+        config.max_size = 30;
+        FIFOCache cache(config);
+        cache.put("a", std::string(9, 'a'));
+        cache.put("b", std::string(9, 'b'));
+        cache.put_stream("a", 9, [](char* buffer, size_t length) { std::memset(buffer, 'A', length); return true; });
+        cache.get("a"); // cached again, after b
+        cache.put("c", std::string(9, 'c'));
+        cache.put("d", std::string(9, 'd'));
+        uint64_t misses = cache.stats().misses;
+        runner.assert_true(cache.get("a").second == std::string(9, 'A') && cache.stats().misses == misses,
+                           "Entry cached again after a drop keeps its FIFO place");
+        cache.get("b");
+        runner.assert_true(cache.stats().misses == misses + 1, "Older entry is evicted first");
+    }
+    std::remove("stream_test.db");
+}
+
+void test_value_log(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Value Log ---" << std::endl;
+    std::remove("vlog_test.db");
+    ValueLog::removeFiles("vlog_test.db.vlog.");
+    CacheConfig config;
+    config.db_path = "vlog_test.db";
+    config.max_size = 100; // large values are read from the database
+    config.value_log_threshold = 1000;
+    config.value_log_segment_bytes = 32 * 1024;
+    auto valueOf = [](int key, char fill) { return std::to_string(key) + std::string(4000, fill); };
+    {
+        FIFOCache cache(config);
+        for (int i = 0; i < 20; i++) {
+            cache.put("key" + std::to_string(i), valueOf(i, 'a'));
+        }
+        cache.put("tiny", "inline");
+        bool intact = true;
+        for (int i = 0; i < 20; i++) {
+            intact = intact && cache.get("key" + std::to_string(i)).second == valueOf(i, 'a');
+        }
+        runner.assert_true(intact && cache.get("tiny").second == "inline", "Separated values read back");
+        std::ifstream db_file("vlog_test.db", std::ios::binary | std::ios::ate);
+        runner.assert_true(cache.stats().value_log_bytes >= 80000 && db_file.tellg() < 40000,
+                           "Large values are kept out of the table");
+
+        for (int i = 0; i < 20; i++) {
+            cache.put("key" + std::to_string(i), valueOf(i, 'b'));
+        }
+        runner.assert_true(cache.remove("key0"), "Separated value is removed");
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.value_log_garbage_bytes >= 21 * 4000, "Overwritten and removed values count as garbage");
+
+        runner.assert_true(cache.collect_value_log_garbage() >= 2, "Mostly dead segments are collected");
+        CacheStats collected = cache.stats();
+        runner.assert_true(collected.value_log_bytes < stats.value_log_bytes &&
+                           collected.value_log_garbage_bytes < stats.value_log_garbage_bytes,
+                           "Collection reclaims log space");
+
+        backup::ExportResult exported = cache.export_to("vlog_test.tsv", 2);
+        std::ifstream export_file("vlog_test.tsv");
+        std::string exported_text((std::istreambuf_iterator<char>(export_file)), std::istreambuf_iterator<char>());
+        runner.assert_true(exported.ok && exported.rows == 20 && exported_text.find(valueOf(7, 'b')) != std::string::npos,
+                           "Export reads separated values");
+    }
+    {
+        FIFOCache cache(config);
+        bool intact = cache.get("key0").first.empty();
+        for (int i = 1; i < 20; i++) {
+            intact = intact && cache.get("key" + std::to_string(i)).second == valueOf(i, 'b');
+        }
+        runner.assert_true(intact, "Values survive collection and reopening");
+        size_t streamed = 0;
+        cache.get_stream("key5", [&streamed](const char*, size_t length) { streamed += length; return true; });
+        runner.assert_true(streamed == valueOf(5, 'b').size(), "Separated values can be streamed");
+    }
+    std::remove("vlog_test.db");
+    std::remove("vlog_test.tsv");
+    ValueLog::removeFiles("vlog_test.db.vlog.");
+}
+
+void test_flash_cache(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Flash Cache ---" << std::endl;
+    std::remove("flash_test.db");
+    std::remove("flash_test.flash");
+    {
+        // regions of one page, the third region reuses the first
+        FlashCache flash("flash_test.flash", 2 * FlashCache::ALIGNMENT, FlashCache::ALIGNMENT);
+        std::string value(1000, 'v');
+        auto waitForWrites = [&flash](uint64_t bytes) {
+            for (int i = 0; i < 1000 && flash.stats().bytes_written < bytes; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+        for (int i = 0; i < 5; i++) { // 4 records fill a region, the fifth seals it
+            flash.insert("key" + std::to_string(i), i, value + std::to_string(i));
+        }
+        waitForWrites(FlashCache::ALIGNMENT);
+        std::string out;
+        runner.assert_true(flash.lookup("key0", 0, out) && out == value + "0", "Flash record is read back from disk");
+        runner.assert_true(flash.lookup("key4", 4, out) && out == value + "4", "Flash record is read from the open region");
+        runner.assert_true(!flash.lookup("other", 1, out), "Hash collision is a flash miss");
+        for (int i = 5; i < 8; i++) {
+            flash.insert("key" + std::to_string(i), i, value);
+        }
+        flash.insert("key8", 8, value); // seals the second region, the first is reused
+        runner.assert_true(!flash.lookup("key0", 0, out) && flash.lookup("key4", 4, out),
+                           "Reusing a region drops its records only");
+        flash.erase(4);
+        runner.assert_true(!flash.lookup("key4", 4, out), "Erased flash record is gone");
+    }
+    std::remove("flash_test.flash");
+    {
+        CacheConfig config;
+        config.db_path = "flash_test.db";
+        config.max_size = 100;
+        config.flash_path = "flash_test.flash";
+        FIFOCache cache(config);
+        for (int i = 0; i < 10; i++) {
+            cache.put("key" + std::to_string(i), "value" + std::to_string(i) + "xxxxxxxxx"); // 20 bytes
+        }
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.evictions == 5 && stats.flash_entries == 5, "Evicted entries go to the flash cache");
+        runner.assert_equal(std::string("value0xxxxxxxxx"), cache.get("key0").second, "Evicted entry is served");
+        runner.assert_true(cache.stats().flash_hits == 1, "Evicted entry is read from flash, not the DB");
+
+        cache.put("key1", "updated");
+        for (int i = 10; i < 20; i++) {
+            cache.put("key" + std::to_string(i), "value" + std::to_string(i) + "xxxxxxxx");
+        }
+        runner.assert_equal(std::string("updated"), cache.get("key1").second, "Overwritten value is not served from flash");
+        runner.assert_true(cache.remove("key2") && cache.get("key2").first.empty(), "Removed key is not served from flash");
+    }
+    std::remove("flash_test.db");
+    std::remove("flash_test.flash");
+}
+
+void test_victim_cache(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Victim Cache ---" << std::endl;
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += "user:" + std::to_string(i % 17) + ",status=active;";
+    }
+    std::string packed, restored;
+    runner.assert_true(lz::compress(text, packed) && packed.size() < text.size() / 2, "Repetitive value compresses");
+    runner.assert_true(lz::decompress(packed, text.size(), restored) && restored == text, "Compressed value round-trips");
+    runner.assert_true(!lz::decompress(packed, text.size() + 1, restored), "Wrong size is rejected");
+    std::string noise;
+    std::mt19937 gen(7);
+    for (int i = 0; i < 1000; i++) {
+        noise.push_back(static_cast<char>(gen()));
+    }
+    runner.assert_true(!lz::compress(noise, packed), "Random bytes are stored uncompressed");
+
+    std::remove("victim_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "victim_test.db";
+        config.max_size = 2000;
+        config.victim_bytes = 2000;
+        FIFOCache cache(config);
+        std::string value(500, 'a');
+        for (int i = 0; i < 10; i++) {
+            cache.put("key" + std::to_string(i), value + std::to_string(i)); // 505 bytes, 3 fit in memory
+        }
+        CacheStats stats = cache.stats();
+        runner.assert_true(stats.victim_entries == 7 && stats.victim_bytes < stats.victim_raw_bytes / 10,
+                           "Evicted entries are kept compressed");
+        runner.assert_equal(value + "0", cache.get("key0").second, "Victim is served");
+        stats = cache.stats();
+        runner.assert_true(stats.victim_hits == 1 && stats.victim_entries == 7, "Victim hit moves the entry back to memory");
+
+        cache.put("key1", "updated");
+        runner.assert_true(cache.stats().victim_entries == 6, "Overwrite drops the victim");
+        runner.assert_equal(std::string("updated"), cache.get("key1").second, "Overwritten value is served");
+        runner.assert_true(cache.remove("key2") && cache.get("key2").first.empty(), "Removed key is not served from victims");
+    }
+    std::remove("victim_test.db");
+}
+
+void test_change_log_follower(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Change Log Follower ---" << std::endl;
+    for (const char* path : {"leader_test.db", "follower_test.db"}) {
+        std::remove(path);
+    }
+    CacheConfig leader_config;
+    leader_config.db_path = "leader_test.db";
+    leader_config.change_log_rows = 300;
+    {
+        FIFOCache leader(leader_config);
+        leader.put("existing", "before the follower");
+    }
+    CacheConfig follower_config;
+    follower_config.db_path = "follower_test.db";
+    follower_config.follow_db_path = "leader_test.db";
+    follower_config.follow_interval_ms = 60000; // polls once at start, the test drives the rest
+    {
+        FIFOCache follower(follower_config);
+        runner.assert_true(follower.catch_up() && follower.is_follower(), "Follower catches up");
+        runner.assert_equal(std::string("before the follower"), follower.get("existing").second,
+                            "First sync copies the existing table");
+
+        pid_t child = fork();
+        if (child == 0) {
+            {
+                FIFOCache leader(leader_config);
+                leader.put("a", "1");
+                leader.put_many({{"b", "2"}, {"c", "3"}});
+                leader.put("a", "updated");
+                leader.remove("existing");
+                leader.put("ttl", "x");
+                leader.expire("ttl", 100);
+            }
+            CacheConfig plain_config; // a process that doesn't ask for logging
+            plain_config.db_path = "leader_test.db";
+            FIFOCache plain(plain_config);
+            plain.put("plain", "y");
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        runner.assert_true(follower.catch_up(), "Follower applies another process's changes");
+        runner.assert_true(follower.get("a").second == "updated" && follower.get("b").second == "2" &&
+                               follower.get("c").second == "3",
+                           "Replicated writes are served");
+        runner.assert_true(follower.get("existing").first.empty(), "Replicated remove is applied");
+        runner.assert_equal(std::string("y"), follower.get("plain").second,
+                            "Opening the leader without change_log_rows keeps the log on");
+        CacheStats stats = follower.stats();
+        runner.assert_true(stats.replication_applied_seq == stats.replication_source_seq &&
+                               stats.replication_source_seq > 0 && stats.replication_lag_ms == 0,
+                           "Caught-up follower reports no lag");
+        follower.put("local_only", "x"); // a write the leader never made
+    }
+    {
+        FIFOCache leader(leader_config);
+        for (int i = 0; i < 1000; i++) { // the change_log keeps about 300 rows
+            leader.put("bulk" + std::to_string(i), std::to_string(i));
+        }
+    }
+    {
+        FIFOCache follower(follower_config);
+        runner.assert_true(follower.catch_up(), "Follower resumes from its saved position");
+        runner.assert_true(follower.get("bulk0").second == "0" && follower.get("bulk999").second == "999",
+                           "Follower behind the trimmed log copies the table again");
+        runner.assert_true(follower.get("local_only").first.empty(), "Full copy drops keys the source doesn't have");
+        runner.assert_equal(std::string("updated"), follower.get("a").second, "Full copy keeps replicated keys");
+    }
+    for (const char* path : {"leader_test.db", "follower_test.db"}) {
+        std::remove(path);
+    }
+}
+
+void test_partitioned_db(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Partitioned Database ---" << std::endl;
+    auto removeFiles = []() {
+        for (size_t i = 0; i < 4; i++) {
+            std::remove(PartitionedDB::partitionPath("partitioned_test.db", i, 4).c_str());
+        }
+        std::remove("partitioned_test.txt");
+    };
+    removeFiles();
+    CacheConfig config;
+    config.db_path = "partitioned_test.db";
+    config.db_partitions = 4;
+    config.max_size = 1000; // most reads go to the database
+    {
+        FIFOCache cache(config);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++) {
+            writers.emplace_back([&cache, t]() {
+                for (int i = 0; i < 100; i++) {
+                    cache.put("key" + std::to_string(t * 100 + i), std::to_string(t * 100 + i));
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        cache.put_many({{"many1", "1"}, {"many2", "2"}, {"many3", "3"}, {"many4", "4"}});
+        runner.assert_true(cache.remove("key0") && cache.get("key0").first.empty(), "Remove reaches the key's partition");
+    }
+    PartitionedDB db("partitioned_test.db", 4);
+    std::vector<size_t> per_partition(4);
+    for (int i = 0; i < 400; i++) {
+        per_partition[db.index("key" + std::to_string(i))]++;
+    }
+    runner.assert_true(*std::min_element(per_partition.begin(), per_partition.end()) > 50, "Keys spread over the partitions");
+    size_t home = db.index("key7");
+    runner.assert_true(db.partition(home).get_from_db("key7").first &&
+                           !db.partition((home + 1) % 4).get_from_db("key7").first,
+                       "A key is stored in its own partition only");
+    {
+        FIFOCache cache(config);
+        bool all = true;
+        for (int i = 1; i < 400; i++) {
+            all = all && cache.get("key" + std::to_string(i)).second == std::to_string(i);
+        }
+        runner.assert_true(all && cache.get("many3").second == "3", "Concurrent writes survive a restart");
+
+        size_t scanned = 0;
+        uint64_t cursor = 0;
+        do {
+            auto page = cache.scan(cursor, 37);
+            scanned += page.second.size();
+            cursor = page.first;
+        } while (cursor != 0);
+        runner.assert_true(scanned == 403, "Scan visits every partition once");
+        runner.assert_true(cache.export_to("partitioned_test.txt").rows == 403, "Export joins the partitions");
+    }
+    removeFiles();
+}
+
+void test_watch(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Watch ---" << std::endl;
+    std::remove("watch_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "watch_test.db";
+        config.watch_buffer_events = 8;
+        FIFOCache cache(config);
+
+        std::mutex mutex;
+        std::condition_variable arrived;
+        std::vector<WatchEvent> config_events, key_events;
+        uint64_t prefix_watch = cache.watch("config/", [&](const std::vector<WatchEvent>& events, bool) {
+            std::lock_guard<std::mutex> lock(mutex);
+            config_events.insert(config_events.end(), events.begin(), events.end());
+            cache.get("config/a"); // callbacks may read the cache
+            arrived.notify_all();
+        }, true);
+        cache.watch("exact", [&](const std::vector<WatchEvent>& events, bool) {
+            std::lock_guard<std::mutex> lock(mutex);
+            key_events.insert(key_events.end(), events.begin(), events.end());
+            arrived.notify_all();
+        });
+        runner.assert_true(prefix_watch != 0, "Watch is registered");
+
+        cache.put("config/a", "1");
+        cache.put("other", "x");
+        cache.put_many({{"config/b", "2"}, {"exact", "e"}});
+        cache.expire("config/b", 100);
+        cache.remove("config/a");
+        cache.remove("missing"); // nothing changed
+        auto waitFor = [&](const std::vector<WatchEvent>& events, size_t count) {
+            std::unique_lock<std::mutex> lock(mutex);
+            return arrived.wait_for(lock, std::chrono::seconds(5), [&]() { return events.size() >= count; });
+        };
+        runner.assert_true(waitFor(config_events, 4) && config_events.size() == 4, "Prefix watcher sees its keys only");
+        runner.assert_true(config_events[0].key == "config/a" && config_events[0].op == ChangeOp::Put &&
+                               config_events[2].op == ChangeOp::Expiry && config_events[3].op == ChangeOp::Remove &&
+                               config_events[0].seq < config_events[1].seq,
+                           "Events arrive in order with their kind");
+        runner.assert_true(waitFor(key_events, 1) && key_events.size() == 1 && key_events[0].key == "exact",
+                           "Key watcher sees its key only");
+
+        runner.assert_true(cache.unwatch(prefix_watch) && !cache.unwatch(prefix_watch), "Unwatch removes the watcher");
+        cache.put("config/c", "3");
+        cache.put("exact", "again");
+        waitFor(key_events, 2);
+        runner.assert_true(config_events.size() == 4, "Removed watcher gets no more events");
+
+        // a callback removes a watcher that comes later in the same batch
+        std::atomic<uint64_t> later_watch{0};
+        std::atomic<int> later_calls{0};
+        std::atomic<bool> removed{false};
+        uint64_t remover = cache.watch("pair", [&](const std::vector<WatchEvent>&, bool) {
+            removed = cache.unwatch(later_watch);
+        });
+        later_watch = cache.watch("pair", [&](const std::vector<WatchEvent>&, bool) { later_calls++; });
+        cache.put("pair", "1");
+        cache.put("exact", "third");
+        waitFor(key_events, 3);
+        runner.assert_true(removed && later_calls == 0, "Watcher removed by a callback is skipped for the rest of the batch");
+        cache.unwatch(remover);
+
+        uint64_t cursor = cache.change_cursor();
+        cache.put("config/d", "4");
+        cache.put("other", "y");
+        ChangePage page = cache.read_changes(cursor, 100, "config/");
+        runner.assert_true(!page.missed && page.events.size() == 1 && page.events[0].key == "config/d" &&
+                               page.next == cursor + 2,
+                           "Cursor reads the changes after it");
+        page = cache.read_changes(page.next);
+        runner.assert_true(page.events.empty() && page.next == cursor + 2, "Caught-up cursor stays put");
+        for (int i = 0; i < 20; i++) {
+            cache.put("flood" + std::to_string(i), "v");
+        }
+        page = cache.read_changes(cursor, 3);
+        runner.assert_true(page.missed && page.events.size() == 3 && page.events[0].key == "flood12",
+                           "Cursor behind the buffer is told it missed changes");
+    }
+    std::remove("watch_test.db");
+}
+
+void test_cross_process_invalidation(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Cross-Process Invalidation ---" << std::endl;
+    std::remove("invalidation_test.db");
+    CacheConfig config;
+    config.db_path = "invalidation_test.db";
+    config.max_size = 1024 * 1024;
+    config.invalidate_interval_ms = 60000; // the test drives the checks
+    config.change_log_rows = 300;
+    config.victim_bytes = 4096;
+    auto inOtherProcess = [](const CacheConfig& other_config, const std::function<void(FIFOCache&)>& writes) {
+        pid_t child = fork();
+        if (child == 0) {
+            FIFOCache other(other_config);
+            writes(other);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+    };
+    {
+        FIFOCache cache(config);
+        cache.put("a", "1");
+        cache.put("b", "2");
+        cache.put("c", "3");
+        runner.assert_true(cache.sync_invalidations() && cache.stats().invalidated_keys == 0,
+                           "Own writes don't trigger invalidation");
+
+        inOtherProcess(config, [](FIFOCache& other) {
+            other.put("a", "changed");
+            other.remove("b");
+            other.expire_ms("c", 100);
+        });
+        runner.assert_equal(std::string("1"), cache.get("a").second, "Stale until the next check");
+        cache.sync_invalidations();
+        runner.assert_equal(std::string("changed"), cache.get("a").second, "Other process's put is seen");
+        runner.assert_true(cache.get("b").first.empty(), "Other process's remove is seen");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        runner.assert_true(cache.get("c").first.empty(), "Other process's TTL is seen");
+        runner.assert_true(cache.stats().invalidated_keys >= 3, "Invalidated keys are counted");
+
+        cache.put("d", "old");
+        inOtherProcess(config, [](FIFOCache& other) {
+            for (int i = 0; i < 1000; i++) { // the change_log keeps about 300 rows
+                other.put("bulk" + std::to_string(i), std::to_string(i));
+            }
+            other.put("d", "new");
+        });
+        cache.sync_invalidations();
+        runner.assert_true(cache.stats().invalidation_resets == 1 && cache.get("d").second == "new",
+                           "Falling behind the trimmed log drops the whole cache");
+
+        CacheConfig plain_config; // a process that doesn't ask for logging or invalidation
+        plain_config.db_path = config.db_path;
+        cache.put("j", "w1");
+        cache.sync_invalidations();
+        inOtherProcess(plain_config, [](FIFOCache& other) { other.put("j", "w2"); });
+        cache.sync_invalidations();
+        runner.assert_equal(std::string("w2"), cache.get("j").second, "Write of a process with the default config is seen");
+
+        cache.put("k", "old");
+        cache.sync_invalidations();
+        CacheConfig reader_config = plain_config;
+        reader_config.read_sample_rate = 1;
+        inOtherProcess(reader_config, [](FIFOCache& other) {
+            other.get("k"); // read counts are committed without a change_log row
+        });
+        cache.sync_invalidations();
+        runner.assert_true(cache.stats().invalidation_resets == 1, "Commits that change no key don't drop the cache");
+
+        inOtherProcess(plain_config, [&config](FIFOCache& other) {
+            SQLiteDB(config.db_path).drop_change_log();
+            other.put("k", "new");
+        });
+        cache.sync_invalidations();
+        runner.assert_true(cache.stats().invalidation_resets == 2 && cache.get("k").second == "new",
+                           "Changes with the change log turned off drop the whole cache");
+    }
+    std::remove("invalidation_test.db");
+    {
+        // a key another process wrote is cached again at the back of the queue
+        CacheConfig small_config = config;
+        small_config.max_size = 30;
+        small_config.victim_bytes = 0;
+        FIFOCache cache(small_config);
+        cache.put("a", std::string(9, 'a'));
+        cache.put("b", std::string(9, 'b'));
+        inOtherProcess(small_config, [](FIFOCache& other) { other.put("a", std::string(9, 'A')); });
+        cache.sync_invalidations();
+        cache.get("a");
+        cache.put("c", std::string(9, 'c'));
+        cache.put("d", std::string(9, 'd'));
+        uint64_t misses = cache.stats().misses;
+        runner.assert_true(cache.get("a").second == std::string(9, 'A') && cache.stats().misses == misses,
+                           "Invalidated key read again keeps its FIFO place");
+        cache.get("b");
+        runner.assert_true(cache.stats().misses == misses + 1, "Older key is evicted before it");
+    }
+    std::remove("invalidation_test.db");
+    {
+        CacheConfig log_config = config;
+        log_config.value_log_threshold = 100;
+        FIFOCache cache(log_config);
+        cache.put("big", std::string(1000, 'v'));
+        runner.assert_true(cache.stats().value_log_bytes == 0 && cache.get("big").second.size() == 1000,
+                           "Processes sharing the file don't append to a value log");
+    }
+    std::remove("invalidation_test.db");
+    ValueLog::removeFiles("invalidation_test.db.vlog.");
+}
+
+void test_put_with_ttl(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Put With TTL ---" << std::endl;
+    std::remove("put_ttl_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "put_ttl_test.db";
+        config.max_size = 1024;
+        config.watch_buffer_events = 8;
+        FIFOCache cache(config);
+
+        uint64_t cursor = cache.change_cursor();
+        cache.put_with_ttl("t", "v", 100);
+        ChangePage page = cache.read_changes(cursor);
+        runner.assert_true(page.events.size() == 1 && page.events[0].op == ChangeOp::Put, "put_with_ttl is one change");
+        runner.assert_equal(std::string("v"), cache.get("t").second, "Value is served until it expires");
+        runner.assert_true(SQLiteDB("put_ttl_test.db").get_expiry("t") > 0, "Deadline is stored with the value");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        runner.assert_true(cache.get("t").first.empty(), "Value expires");
+
+        cache.put_with_ttl("u", "v", 100);
+        cache.put("u", "w");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        runner.assert_equal(std::string("w"), cache.get("u").second, "put clears the TTL");
+    }
+    std::remove("put_ttl_test.db");
+}
+
+void test_versioned_get(PerformanceTests& runner) {
+    std::cout << "\n--- Testing Versioned Get ---" << std::endl;
+    std::remove("versioned_test.db");
+    {
+        CacheConfig config;
+        config.db_path = "versioned_test.db";
+        config.max_size = 1024;
+        FIFOCache cache(config);
+        cache.put("a", "1");
+        cache.put("b", "2");
+
+        CacheStats before = cache.stats();
+        std::vector<uint64_t> versions;
+        auto results = cache.get_many_versioned({"a", "b", "missing"}, versions);
+        CacheStats after = cache.stats();
+        runner.assert_true(results[0].second == "1" && results[1].second == "2" && !results[2].first,
+                           "Versioned batch returns the values in key order");
+        runner.assert_true(versions[0] != 0 && versions[1] != 0 && versions[0] != versions[1] && versions[2] == 0,
+                           "Each found key has its own version");
+        runner.assert_true(after.hits == before.hits + 2 && after.misses == before.misses + 1,
+                           "Versioned reads count hits and misses");
+
+        uint64_t version = 0;
+        cache.get_versioned("a", version);
+        runner.assert_true(version == versions[0], "Version is stable until the key is written");
+        cache.put("a", "2");
+        cache.put("a", "1");
+        runner.assert_true(cache.compare_and_put("a", "3", version, 0) == FIFOCache::CasResult::Exists,
+                           "Rewriting the same value changes the version");
+    }
+    std::remove("versioned_test.db");
+}
+
 int main() {
     PerformanceTests runner;
     
@@ -343,6 +1579,32 @@ int main() {
     // Stress tests
     test_rapid_insertions(runner);
     
+    // Shared memory
+    test_shared_segment(runner);
+    
+    // Warm restart
+    test_snapshot(runner);
+    test_warmup(runner);
+    test_bulk_load(runner);
+    test_backup(runner);
+    test_huge_page_memory(runner);
+    test_near_cache(runner);
+    test_background_evictor(runner);
+    test_memory_bound(runner);
+    test_adaptive_policy(runner);
+    test_greedy_dual_policy(runner);
+    test_large_object_segment(runner);
+    test_streaming_values(runner);
+    test_value_log(runner);
+    test_flash_cache(runner);
+    test_victim_cache(runner);
+    test_change_log_follower(runner);
+    test_partitioned_db(runner);
+    test_watch(runner);
+    test_cross_process_invalidation(runner);
+    test_put_with_ttl(runner);
+    test_versioned_get(runner);
+    
     runner.print_summary();
     
     return 0;
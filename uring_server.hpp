@@ -0,0 +1,678 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+#include "kv_server.hpp"
+
+/// Thin wrapper over the raw io_uring syscalls (no liburing dependency)
+/// Not thread safe, every reactor owns one ring.
+class IoUring {
+private:
+    int ring_fd = -1;
+
+    void* sq_ptr = MAP_FAILED;
+    size_t sq_len = 0;
+    void* cq_ptr = MAP_FAILED;
+    size_t cq_len = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_len = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sqe_tail = 0;      // next free sqe, published to sq_tail on submit
+    unsigned submitted_tail = 0;
+
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    static int sysSetup(unsigned entries, io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int sysEnter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_len);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+        if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_len);
+        if (ring_fd >= 0) close(ring_fd);
+    }
+
+    /// Creates the ring and maps its queues
+    /// @returns false if io_uring is unavailable (old kernel, seccomp) or mapping failed
+    bool init(unsigned entries) {
+        io_uring_params params{};
+        // defer completion work to our io_uring_enter calls instead of interrupting the reactor
+        params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        ring_fd = sysSetup(entries, &params);
+        if (ring_fd < 0 && errno == EINVAL) {
+            params = io_uring_params{};
+            ring_fd = sysSetup(entries, &params);
+        }
+        if (ring_fd < 0) {
+            std::cerr << "io_uring_setup: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_len = cq_len = std::max(sq_len, cq_len);
+        }
+
+        sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            return false;
+        }
+        cq_ptr = single_mmap ? sq_ptr
+                             : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) {
+            return false;
+        }
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        unsigned* sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; i++) {
+            sq_array[i] = i; // sqe slots are used in ring order
+        }
+        sqe_tail = submitted_tail = *sq_tail;
+
+        char* cq = static_cast<char*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int fd() const {
+        return ring_fd;
+    }
+
+    /// @returns a zeroed sqe, submitting queued ones first if the queue is full
+    io_uring_sqe* getSqe() {
+        if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            submit(0);
+            if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+                return nullptr;
+            }
+        }
+        io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe_tail++;
+        return sqe;
+    }
+
+    /// Submits every queued sqe with one syscall and optionally waits for completions
+    /// @returns the io_uring_enter result, negative errno values are returned as -errno
+    int submit(unsigned wait_for) {
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = sqe_tail - submitted_tail;
+        submitted_tail = sqe_tail;
+        if (to_submit == 0 && wait_for == 0) {
+            return 0;
+        }
+        int rc = sysEnter(to_submit, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+        return rc < 0 ? -errno : rc;
+    }
+
+    /// Calls f for every available completion and releases them
+    /// @returns number of completions seen
+    template <typename F>
+    unsigned forEachCompletion(F&& f) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned seen = 0;
+        while (head != tail) {
+            f(cqes[head & cq_mask]);
+            head++;
+            seen++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return seen;
+    }
+};
+
+/// Fixed size receive buffers handed to the kernel with IORING_OP_PROVIDE_BUFFERS
+/// Multishot receives pick a free buffer themselves, so no memory is pinned per idle connection.
+/// Used buffers are returned in batches: recycle() only queues an sqe, which goes out with the next
+/// submit. A buffer that finds the submission queue full waits for retry() in the next loop
+/// iteration. (The newer mapped buffer ring would save those sqes but isn't usable on every kernel.)
+class ProvidedBuffers {
+private:
+    char* buffers = static_cast<char*>(MAP_FAILED);
+    size_t buffers_len = 0;
+    unsigned buffer_size = 0;
+    uint16_t group_id = 0;
+    std::vector<uint16_t> pending; // used buffers not handed back yet
+
+public:
+    ProvidedBuffers() = default;
+    ProvidedBuffers(const ProvidedBuffers&) = delete;
+    ProvidedBuffers& operator=(const ProvidedBuffers&) = delete;
+
+    ~ProvidedBuffers() {
+        if (buffers != MAP_FAILED) munmap(buffers, buffers_len);
+    }
+
+    bool init(IoUring& uring, uint16_t group, unsigned count, unsigned size) {
+        group_id = group;
+        buffer_size = size;
+        buffers_len = static_cast<size_t>(count) * size;
+        buffers = static_cast<char*>(
+            mmap(nullptr, buffers_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0));
+        if (buffers == MAP_FAILED) {
+            return false;
+        }
+
+        io_uring_sqe* sqe = uring.getSqe();
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int>(count);
+        sqe->addr = reinterpret_cast<uint64_t>(buffers);
+        sqe->len = size;
+        sqe->off = 0; // first buffer id
+        sqe->buf_group = group_id;
+        int rc = uring.submit(1);
+        bool ok = false;
+        uring.forEachCompletion([&](const io_uring_cqe& cqe) { ok = cqe.res >= 0; });
+        if (rc < 0 || !ok) {
+            std::cerr << "io_uring provide buffers failed" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    const char* data(uint16_t bid) const {
+        return buffers + static_cast<size_t>(bid) * buffer_size;
+    }
+
+    /// Queues the buffer to be handed back to the kernel with the next submit
+    void recycle(IoUring& uring, uint16_t bid) {
+        pending.push_back(bid);
+        retry(uring);
+    }
+
+    /// Queues the buffers recycle() found no free sqe for, those that still find none stay pending
+    void retry(IoUring& uring) {
+        while (!pending.empty()) {
+            io_uring_sqe* sqe = uring.getSqe();
+            if (!sqe) return;
+            uint16_t bid = pending.back();
+            pending.pop_back();
+            sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+            sqe->fd = 1;
+            sqe->addr = reinterpret_cast<uint64_t>(data(bid));
+            sqe->len = buffer_size;
+            sqe->off = bid;
+            sqe->buf_group = group_id;
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            sqe->user_data = 0;
+        }
+    }
+};
+
+/// io_uring based alternative to EpollServer with the same threading model
+/// - multishot accept: one sqe keeps accepting connections
+/// - multishot recv into kernel provided buffers: one sqe per connection keeps receiving
+/// - sends for all connections served in a loop iteration go out with the same io_uring_enter
+///   call that waits for the next completions, so a busy reactor makes one syscall per batch
+class UringServer : public NetworkServer {
+private:
+    enum Op : uint64_t { OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_WAKE = 4 };
+
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        size_t in_pos = 0;
+        std::string out;      // replies produced while a send is in flight
+        std::string inflight; // buffer owned by the kernel until the send completes
+        size_t inflight_pos = 0;
+        bool recv_armed = false;
+        bool recv_paused = false; // too much input waits for a send, reading resumes once it completed
+        bool send_inflight = false;
+        bool send_starved = false; // counted as in flight, but found no sqe; retried before the next submit
+        bool closing = false;
+        bool shut = false;
+    };
+
+    struct Reactor {
+        int listen_fd = -1;
+        int wake_fd = -1;
+        uint64_t wake_value = 0;
+        ProvidedBuffers buffers; // declared first so the ring is torn down before the buffers it uses
+        IoUring uring;
+        std::thread thread;
+        std::unordered_map<uint64_t, Connection> connections;
+        uint64_t next_id = 1;
+        bool accept_armed = false;
+        bool wake_armed = false;
+        std::vector<uint64_t> starved; // connections whose recv or send found no free sqe
+    };
+
+    static constexpr unsigned RING_ENTRIES = 4096;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    static constexpr unsigned BUFFER_COUNT = 1024; // power of two
+    static constexpr unsigned BUFFER_SIZE = 16 * 1024;
+    static constexpr size_t COMPACT_THRESHOLD = 64 * 1024;
+    static constexpr size_t INPUT_LIMIT = 64 * 1024; // input buffered behind a send before reading stops
+
+    ProtocolHandler& handler;
+    ServerConfig config;
+    uint16_t bound_port = 0;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::atomic<bool> running{false};
+
+    static uint64_t userData(Op op, uint64_t id) {
+        return (static_cast<uint64_t>(op) << 56) | id;
+    }
+
+    void armAccept(Reactor& reactor) {
+        io_uring_sqe* sqe = reactor.uring.getSqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = reactor.listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData(OP_ACCEPT, 0);
+        reactor.accept_armed = true;
+    }
+
+    void armRecv(Reactor& reactor, uint64_t id, Connection& conn) {
+        io_uring_sqe* sqe = reactor.uring.getSqe();
+        if (!sqe) {
+            reactor.starved.push_back(id); // nothing is pending for it, retryStarved() arms it
+            return;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = userData(OP_RECV, id);
+        conn.recv_armed = true;
+    }
+
+    /// Stops the multishot recv, its final completion clears recv_armed
+    void pauseRecv(Reactor& reactor, uint64_t id, Connection& conn) {
+        conn.recv_paused = true;
+        if (!conn.recv_armed) {
+            return;
+        }
+        io_uring_sqe* sqe = reactor.uring.getSqe();
+        if (!sqe) return; // the next completion of the recv tries again
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = userData(OP_RECV, id);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = 0;
+    }
+
+    void armWake(Reactor& reactor) {
+        io_uring_sqe* sqe = reactor.uring.getSqe();
+        reactor.wake_armed = sqe != nullptr; // the loop tries again, or stop() couldn't reach us
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = reactor.wake_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&reactor.wake_value);
+        sqe->len = sizeof(reactor.wake_value);
+        sqe->user_data = userData(OP_WAKE, 0);
+    }
+
+    void queueSend(Reactor& reactor, uint64_t id, Connection& conn) {
+        if (conn.send_inflight) {
+            return; // the completion handler sends what accumulated meanwhile
+        }
+        if (conn.out.empty()) {
+            return;
+        }
+        conn.inflight.swap(conn.out);
+        conn.out.clear();
+        conn.inflight_pos = 0;
+        submitSend(reactor, id, conn);
+    }
+
+    void submitSend(Reactor& reactor, uint64_t id, Connection& conn) {
+        io_uring_sqe* sqe = reactor.uring.getSqe();
+        if (!sqe) {
+            // keeps the connection from handling input or closing until retryStarved() sends it
+            conn.send_inflight = true;
+            conn.send_starved = true;
+            reactor.starved.push_back(id);
+            return;
+        }
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(conn.inflight.data() + conn.inflight_pos);
+        sqe->len = static_cast<uint32_t>(conn.inflight.size() - conn.inflight_pos);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData(OP_SEND, id);
+        conn.send_inflight = true;
+    }
+
+    /// Issues the recvs and sends that found the submission queue full, before the next submit
+    void retryStarved(Reactor& reactor) {
+        std::vector<uint64_t> ids;
+        ids.swap(reactor.starved);
+        for (uint64_t id : ids) {
+            auto it = reactor.connections.find(id);
+            if (it == reactor.connections.end()) {
+                continue;
+            }
+            Connection& conn = it->second;
+            if (conn.send_starved) {
+                conn.send_starved = false;
+                submitSend(reactor, id, conn);
+            }
+            if (!conn.recv_armed && !conn.recv_paused && !conn.closing) {
+                armRecv(reactor, id, conn);
+            }
+        }
+    }
+
+    /// Wakes pending operations on the socket, the connection is released once they completed
+    void shutdownConnection(Connection& conn) {
+        conn.closing = true;
+        if (!conn.shut) {
+            shutdown(conn.fd, SHUT_RDWR);
+            conn.shut = true;
+        }
+    }
+
+    void releaseIfDone(Reactor& reactor, uint64_t id, Connection& conn) {
+        if (!conn.closing) {
+            return;
+        }
+        if (!conn.send_inflight && !conn.out.empty() && !conn.shut) {
+            queueSend(reactor, id, conn); // flush the last replies (e.g. to QUIT)
+            return;
+        }
+        if (!conn.send_inflight && !conn.shut) {
+            shutdownConnection(conn);
+        }
+        if (!conn.recv_armed && !conn.send_inflight) {
+            close(conn.fd);
+            reactor.connections.erase(id);
+        }
+    }
+
+    void onAccept(Reactor& reactor, const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            reactor.accept_armed = false;
+        }
+        if (cqe.res < 0) {
+            return;
+        }
+        int fd = cqe.res;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint64_t id = reactor.next_id++;
+        Connection& conn = reactor.connections[id];
+        conn.fd = fd;
+        armRecv(reactor, id, conn);
+    }
+
+    void onRecv(Reactor& reactor, uint64_t id, const io_uring_cqe& cqe) {
+        bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+        auto it = reactor.connections.find(id);
+        if (it == reactor.connections.end()) {
+            if (has_buffer) reactor.buffers.recycle(reactor.uring, bid);
+            return;
+        }
+        Connection& conn = it->second;
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            conn.recv_armed = false;
+        }
+
+        if (cqe.res > 0 && has_buffer && !conn.closing) {
+            conn.in.append(reactor.buffers.data(bid), cqe.res);
+        }
+        if (has_buffer) {
+            reactor.buffers.recycle(reactor.uring, bid); // copied out, the kernel may reuse it
+        }
+
+        if (cqe.res > 0 && !conn.closing) {
+            if (!conn.send_inflight) {
+                handleInput(reactor, id, conn);
+            } else if (conn.in.size() - conn.in_pos >= INPUT_LIMIT) {
+                pauseRecv(reactor, id, conn); // again if data raced the cancel or it found no sqe
+            }
+        } else if (cqe.res == -ENOBUFS || (cqe.res == -ECANCELED && conn.recv_paused)) {
+            // all provided buffers were in use, they're recycled now so just re-arm; or paused
+        } else if (cqe.res <= 0) {
+            conn.closing = true;
+        }
+
+        if (!conn.recv_armed && !conn.recv_paused && !conn.closing) {
+            armRecv(reactor, id, conn);
+        }
+        releaseIfDone(reactor, id, conn);
+    }
+
+    /// Runs the handler over the buffered input and sends the replies. Like EpollServer, input is
+    /// only handled while no send is in flight, and reading stops once INPUT_LIMIT bytes wait, so
+    /// a client that doesn't read its replies can't make us buffer them without limit.
+    void handleInput(Reactor& reactor, uint64_t id, Connection& conn) {
+        if (conn.in_pos < conn.in.size()) {
+            size_t consumed = handler.handle(conn.in.data() + conn.in_pos, conn.in.size() - conn.in_pos,
+                                             conn.out, conn.closing);
+            conn.in_pos += consumed;
+            if (conn.in_pos == conn.in.size()) {
+                conn.in.clear();
+                conn.in_pos = 0;
+            } else if (conn.in_pos > COMPACT_THRESHOLD) {
+                conn.in.erase(0, conn.in_pos);
+                conn.in_pos = 0;
+            }
+        }
+        queueSend(reactor, id, conn);
+    }
+
+    void onSend(Reactor& reactor, uint64_t id, const io_uring_cqe& cqe) {
+        auto it = reactor.connections.find(id);
+        if (it == reactor.connections.end()) {
+            return;
+        }
+        Connection& conn = it->second;
+        conn.send_inflight = false;
+
+        if (cqe.res < 0) {
+            conn.out.clear();
+            shutdownConnection(conn);
+        } else {
+            conn.inflight_pos += cqe.res;
+            if (conn.inflight_pos < conn.inflight.size()) {
+                submitSend(reactor, id, conn); // short write, send the rest
+            } else {
+                conn.inflight.clear();
+                conn.inflight_pos = 0;
+                queueSend(reactor, id, conn);
+                if (!conn.send_inflight && !conn.closing) {
+                    handleInput(reactor, id, conn); // what arrived during the send
+                    if (conn.recv_paused) {
+                        conn.recv_paused = false;
+                        if (!conn.recv_armed) armRecv(reactor, id, conn);
+                    }
+                }
+            }
+        }
+        releaseIfDone(reactor, id, conn);
+    }
+
+    void run(Reactor& reactor) {
+        armAccept(reactor);
+        armWake(reactor);
+
+        bool stopping = false;
+        while (!stopping) {
+            reactor.buffers.retry(reactor.uring);
+            retryStarved(reactor);
+            if (!reactor.wake_armed) {
+                armWake(reactor);
+            }
+            int rc = reactor.uring.submit(1);
+            if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+                std::cerr << "io_uring_enter: " << std::strerror(-rc) << std::endl;
+                break;
+            }
+
+            reactor.uring.forEachCompletion([&](const io_uring_cqe& cqe) {
+                uint64_t op = cqe.user_data >> 56;
+                uint64_t id = cqe.user_data & ((1ULL << 56) - 1);
+                switch (op) {
+                case OP_ACCEPT: onAccept(reactor, cqe); break;
+                case OP_RECV: onRecv(reactor, id, cqe); break;
+                case OP_SEND: onSend(reactor, id, cqe); break;
+                case OP_WAKE: stopping = true; break;
+                default: break;
+                }
+            });
+
+            if (!reactor.accept_armed && !stopping) {
+                armAccept(reactor);
+            }
+        }
+
+        // wake every pending recv/send so no operation references connection memory after we return
+        std::vector<uint64_t> ids;
+        for (auto& [id, conn] : reactor.connections) {
+            shutdownConnection(conn);
+            ids.push_back(id);
+        }
+        for (uint64_t id : ids) {
+            releaseIfDone(reactor, id, reactor.connections[id]); // those with nothing pending go now
+        }
+        while (!reactor.connections.empty()) {
+            retryStarved(reactor);
+            if (reactor.uring.submit(1) < 0) {
+                break;
+            }
+            reactor.uring.forEachCompletion([&](const io_uring_cqe& cqe) {
+                uint64_t op = cqe.user_data >> 56;
+                uint64_t id = cqe.user_data & ((1ULL << 56) - 1);
+                if (op == OP_RECV) onRecv(reactor, id, cqe);
+                else if (op == OP_SEND) onSend(reactor, id, cqe);
+            });
+        }
+    }
+
+    void closeReactors() {
+        for (auto& reactor : reactors) {
+            if (reactor->listen_fd >= 0) close(reactor->listen_fd);
+            if (reactor->wake_fd >= 0) close(reactor->wake_fd);
+        }
+        reactors.clear();
+    }
+
+public:
+    UringServer(ProtocolHandler& handler, const ServerConfig& config = ServerConfig{})
+        : handler(handler), config(config) {}
+
+    ~UringServer() override {
+        stop();
+    }
+
+    UringServer(const UringServer&) = delete;
+    UringServer& operator=(const UringServer&) = delete;
+
+    bool start() override {
+        if (running) {
+            return true;
+        }
+        size_t count = config.reactors;
+        if (count == 0) {
+            count = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        uint16_t port = config.port;
+        for (size_t i = 0; i < count; i++) {
+            auto reactor = std::make_unique<Reactor>();
+            reactor->listen_fd = openListenSocket(config.bind_address, port);
+            reactor->wake_fd = eventfd(0, EFD_CLOEXEC);
+            bool ok = reactor->listen_fd >= 0 && reactor->wake_fd >= 0 &&
+                      reactor->uring.init(RING_ENTRIES) &&
+                      reactor->buffers.init(reactor->uring, BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE);
+            reactors.push_back(std::move(reactor));
+            if (!ok) {
+                closeReactors();
+                return false;
+            }
+            if (port == 0) {
+                port = localPort(reactors.back()->listen_fd);
+            }
+        }
+        bound_port = port;
+
+        running = true;
+        for (size_t i = 0; i < reactors.size(); i++) {
+            Reactor& reactor = *reactors[i];
+            reactor.thread = std::thread([this, &reactor]() { run(reactor); });
+            if (config.pin_threads) {
+                pinThread(reactor.thread, i);
+            }
+        }
+        return true;
+    }
+
+    void stop() override {
+        if (!running.exchange(false)) {
+            return;
+        }
+        for (auto& reactor : reactors) {
+            uint64_t one = 1;
+            ssize_t ignored = write(reactor->wake_fd, &one, sizeof(one));
+            (void)ignored;
+        }
+        for (auto& reactor : reactors) {
+            if (reactor->thread.joinable()) {
+                reactor->thread.join();
+            }
+        }
+        closeReactors();
+    }
+
+    uint16_t port() const override {
+        return bound_port;
+    }
+};
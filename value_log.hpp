@@ -0,0 +1,302 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/// Options of the value log behind SQLiteDB, see CacheConfig::value_log_threshold
+struct ValueLogOptions {
+    size_t threshold = 0;                // values of at least this many bytes go to the log, 0 disables it
+    size_t segment_bytes = 64 << 20;     // a segment is sealed once it grows past this
+    double gc_garbage_ratio = 0.5;       // sealed segments with at least this share of dead bytes are rewritten
+    unsigned gc_interval_ms = 1000;      // how often the garbage collector looks for such segments
+};
+
+/// Append-only files holding large values apart from the cache_data B-tree (WiscKey-style key-value
+/// separation). The table keeps a Pointer to each separated value.
+///
+/// The log is a series of segment files, path_prefix + id. Records are a u32 key length, a u32 value
+/// length, the key and the value, in host byte order; the key lets the garbage collector check whether
+/// a record is still referenced. Values are appended to the active segment and read with pread.
+/// Segments are reference counted, so a reader keeps a segment readable while it is dropped.
+/// Every open starts a new active segment, a torn record at the end of an older one is ignored.
+/// Thread safe. Only one process may append to a log.
+class ValueLog {
+public:
+    static constexpr size_t RECORD_HEADER = 2 * sizeof(uint32_t);
+
+    /// Where a value is stored: segment id, offset of the value bytes and their length
+    struct Pointer {
+        uint32_t file = 0;
+        uint64_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct Segment {
+        const uint32_t id;
+        const int fd;
+        std::string path;
+        bool dropped = false;
+
+        Segment(uint32_t id, int fd, std::string path) : id(id), fd(fd), path(std::move(path)) {}
+        ~Segment() {
+            close(fd);
+            if (dropped) {
+                unlink(path.c_str());
+            }
+        }
+
+        /// Reads length bytes at offset
+        bool read(uint64_t offset, char* out, size_t length) const {
+            while (length > 0) {
+                ssize_t n = pread(fd, out, length, static_cast<off_t>(offset));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                out += n;
+                offset += static_cast<uint64_t>(n);
+                length -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+    };
+
+private:
+    const std::string prefix;
+    const size_t segment_bytes;
+    mutable std::mutex mutex;
+    std::map<uint32_t, std::shared_ptr<Segment>> segments; // opened so far
+    std::shared_ptr<Segment> active;
+    uint64_t active_size = 0;
+    uint32_t next_id = 1;
+
+    std::string pathOf(uint32_t id) const {
+        return prefix + std::to_string(id);
+    }
+
+    /// Ids of the segment files on disk
+    static std::vector<uint32_t> listSegments(const std::string& prefix) {
+        std::vector<uint32_t> ids;
+        size_t slash = prefix.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : prefix.substr(0, slash + 1);
+        std::string name_prefix = slash == std::string::npos ? prefix : prefix.substr(slash + 1);
+        DIR* listing = opendir(dir.c_str());
+        if (!listing) {
+            return ids;
+        }
+        while (dirent* entry = readdir(listing)) {
+            std::string name = entry->d_name;
+            if (name.size() > name_prefix.size() && name.compare(0, name_prefix.size(), name_prefix) == 0 &&
+                name.find_first_not_of("0123456789", name_prefix.size()) == std::string::npos) {
+                ids.push_back(static_cast<uint32_t>(std::stoul(name.substr(name_prefix.size()))));
+            }
+        }
+        closedir(listing);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    std::shared_ptr<Segment> openLocked(uint32_t id) {
+        auto it = segments.find(id);
+        if (it != segments.end()) {
+            return it->second;
+        }
+        std::string path = pathOf(id);
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        auto segment = std::make_shared<Segment>(id, fd, path);
+        segments.emplace(id, segment);
+        return segment;
+    }
+
+    /// Seals the active segment and starts the next one, caller must hold mutex
+    bool rollLocked() {
+        if (active && fdatasync(active->fd) != 0) {
+            std::cerr << "Cannot sync value log " << active->path << std::endl;
+        }
+        std::string path = pathOf(next_id);
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Cannot create value log " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        active = std::make_shared<Segment>(next_id, fd, path);
+        segments[next_id] = active;
+        active_size = 0;
+        next_id++;
+        return true;
+    }
+
+public:
+    ValueLog(const std::string& path_prefix, size_t segment_bytes)
+        : prefix(path_prefix), segment_bytes(std::max<size_t>(1, segment_bytes)) {
+        std::vector<uint32_t> ids = listSegments(prefix);
+        if (!ids.empty()) {
+            next_id = ids.back() + 1;
+        }
+    }
+
+    ValueLog(const ValueLog&) = delete;
+    ValueLog& operator=(const ValueLog&) = delete;
+
+    /// Appends a record for key and value
+    /// @returns false if it could not be written
+    bool append(std::string_view key, std::string_view value, Pointer& pointer) {
+        uint32_t header[2] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+        std::lock_guard<std::mutex> lock(mutex);
+        if ((!active || active_size >= segment_bytes) && !rollLocked()) {
+            return false;
+        }
+        iovec parts[3] = {{header, sizeof(header)},
+                          {const_cast<char*>(key.data()), key.size()},
+                          {const_cast<char*>(value.data()), value.size()}};
+        size_t total = sizeof(header) + key.size() + value.size();
+        ssize_t written = pwritev(active->fd, parts, 3, static_cast<off_t>(active_size));
+        if (written != static_cast<ssize_t>(total)) {
+            // a short write leaves a torn record past active_size, the next append overwrites it
+            std::cerr << "Cannot append to value log " << active->path << std::endl;
+            return false;
+        }
+        pointer.file = active->id;
+        pointer.offset = active_size + sizeof(header) + key.size();
+        pointer.length = header[1];
+        active_size += total;
+        return true;
+    }
+
+    /// Makes the records appended so far durable
+    bool sync() {
+        std::shared_ptr<Segment> segment;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            segment = active;
+        }
+        return !segment || fdatasync(segment->fd) == 0;
+    }
+
+    /// @returns the segment holding pointer's value, or nullptr if it is gone
+    std::shared_ptr<Segment> segment(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return openLocked(id);
+    }
+
+    bool read(const Pointer& pointer, std::string& out) {
+        std::shared_ptr<Segment> segment = this->segment(pointer.file);
+        out.resize(pointer.length);
+        if (!segment || !segment->read(pointer.offset, out.data(), pointer.length)) {
+            std::cerr << "Cannot read value log segment " << pointer.file << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /// Ids of the segments on disk that are no longer appended to, oldest first
+    std::vector<uint32_t> sealed() const {
+        std::vector<uint32_t> ids = listSegments(prefix);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (active) {
+            ids.erase(std::remove(ids.begin(), ids.end(), active->id), ids.end());
+        }
+        return ids;
+    }
+
+    /// Ids and sizes of all segments on disk
+    std::vector<std::pair<uint32_t, uint64_t>> files() const {
+        std::vector<std::pair<uint32_t, uint64_t>> result;
+        for (uint32_t id : listSegments(prefix)) {
+            struct stat st;
+            if (stat(pathOf(id).c_str(), &st) == 0) {
+                result.emplace_back(id, static_cast<uint64_t>(st.st_size));
+            }
+        }
+        return result;
+    }
+
+    /// Removes a sealed segment, its file goes once no reader holds it anymore
+    void drop(uint32_t id) {
+        std::shared_ptr<Segment> segment;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            segment = openLocked(id);
+            segments.erase(id);
+        }
+        if (segment) {
+            segment->dropped = true;
+        } else {
+            unlink(pathOf(id).c_str());
+        }
+    }
+
+    /// Calls fn(key, value, pointer) for every complete record of a sealed segment, in file order
+    /// Stops early, returning false, if fn does
+    template <typename F>
+    bool scan(uint32_t id, F&& fn) {
+        std::shared_ptr<Segment> segment = this->segment(id);
+        if (!segment) {
+            return false;
+        }
+        std::string key, value;
+        uint64_t offset = 0;
+        uint32_t header[2];
+        while (segment->read(offset, reinterpret_cast<char*>(header), sizeof(header))) {
+            key.resize(header[0]);
+            value.resize(header[1]);
+            uint64_t value_offset = offset + sizeof(header) + header[0];
+            if (!segment->read(offset + sizeof(header), key.data(), key.size()) ||
+                !segment->read(value_offset, value.data(), value.size())) {
+                break; // torn record at the end of a segment that was active during a crash
+            }
+            if (!fn(key, value, Pointer{id, value_offset, header[1]})) {
+                return false;
+            }
+            offset = value_offset + header[1];
+        }
+        return true;
+    }
+
+    /// Copies every segment to new_prefix + id, e.g. next to a database backup
+    bool copyTo(const std::string& new_prefix) const {
+        std::vector<char> buffer(1 << 20);
+        for (uint32_t id : listSegments(prefix)) {
+            FILE* in = std::fopen(pathOf(id).c_str(), "rb");
+            FILE* out = in ? std::fopen((new_prefix + std::to_string(id)).c_str(), "wb") : nullptr;
+            bool ok = out != nullptr;
+            size_t n;
+            while (ok && (n = std::fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+                ok = std::fwrite(buffer.data(), 1, n, out) == n;
+            }
+            if (in) std::fclose(in);
+            ok = out && std::fclose(out) == 0 && ok;
+            if (!ok) {
+                std::cerr << "Cannot copy value log segment " << pathOf(id) << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Deletes the segment files of the log at path_prefix
+    static void removeFiles(const std::string& path_prefix) {
+        for (uint32_t id : listSegments(path_prefix)) {
+            std::remove((path_prefix + std::to_string(id)).c_str());
+        }
+    }
+};
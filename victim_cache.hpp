@@ -0,0 +1,132 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <cstdint>
+#include "lz_codec.hpp"
+
+/// Compressed copies of entries FIFOCache evicted recently (see CacheConfig::victim_bytes)
+///
+/// An evicted entry is compressed with lz::compress, or kept as is when that doesn't shrink it, and
+/// charged its key plus stored bytes against the budget. The oldest victims make room first. A hit
+/// takes the entry out, the caller caches it again. Thread safe, one mutex guards the tier.
+class VictimCache {
+public:
+    struct Stats {
+        size_t entries = 0;
+        size_t bytes = 0;     // keys and stored values, charged against the budget
+        size_t raw_bytes = 0; // keys and values before compression
+        uint64_t hits = 0;
+        uint64_t evictions = 0;
+    };
+
+private:
+    struct Victim {
+        std::string data;
+        uint32_t raw_size = 0;
+        bool compressed = false;
+        std::list<const std::string*>::iterator fifo_slot;
+    };
+
+    const size_t budget;
+    std::unordered_map<std::string, Victim> victims;
+    std::list<const std::string*> fifo; // oldest first
+    size_t used_bytes = 0;
+    size_t raw_bytes = 0;
+    uint64_t hits = 0, evicted = 0;
+    mutable std::mutex mutex;
+
+    void eraseLocked(std::unordered_map<std::string, Victim>::iterator it) {
+        used_bytes -= it->first.size() + it->second.data.size();
+        raw_bytes -= it->first.size() + it->second.raw_size;
+        fifo.erase(it->second.fifo_slot);
+        victims.erase(it);
+    }
+
+    static bool restore(const Victim& victim, std::string& out) {
+        if (!victim.compressed) {
+            out = victim.data;
+            return true;
+        }
+        return lz::decompress(victim.data, victim.raw_size, out);
+    }
+
+public:
+    explicit VictimCache(size_t budget_bytes) : budget(budget_bytes) {}
+
+    VictimCache(const VictimCache&) = delete;
+    VictimCache& operator=(const VictimCache&) = delete;
+
+    /// Stores a compressed copy of an evicted entry, dropping the oldest victims to make room
+    /// dropped(key, value), if given, gets each victim pushed out, e.g. to hand it to the next tier
+    template <typename Dropped>
+    void insert(std::string_view key, std::string_view value, Dropped&& dropped) {
+        thread_local std::string packed;
+        bool compressed = lz::compress(value, packed);
+        size_t charge = key.size() + (compressed ? packed.size() : value.size());
+        std::lock_guard<std::mutex> lock(mutex);
+        auto existing = victims.find(std::string(key));
+        if (existing != victims.end()) {
+            eraseLocked(existing);
+        }
+        if (charge > budget) {
+            return;
+        }
+        std::string restored;
+        while (used_bytes + charge > budget) {
+            auto oldest = victims.find(*fifo.front());
+            if (restore(oldest->second, restored)) {
+                dropped(oldest->first, restored);
+            }
+            eraseLocked(oldest);
+            evicted++;
+        }
+        auto [it, inserted] = victims.try_emplace(std::string(key));
+        Victim& victim = it->second;
+        victim.data.assign(compressed ? std::string_view(packed) : value);
+        victim.raw_size = static_cast<uint32_t>(value.size());
+        victim.compressed = compressed;
+        victim.fifo_slot = fifo.insert(fifo.end(), &it->first);
+        used_bytes += charge;
+        raw_bytes += key.size() + value.size();
+    }
+
+    /// Moves key's value out of the tier into out
+    /// @returns true on a hit
+    bool take(const std::string& key, std::string& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = victims.find(key);
+        if (it == victims.end()) {
+            return false;
+        }
+        bool restored = restore(it->second, out);
+        eraseLocked(it);
+        if (restored) {
+            hits++;
+        }
+        return restored;
+    }
+
+    void erase(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = victims.find(key);
+        if (it != victims.end()) {
+            eraseLocked(it);
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        victims.clear();
+        fifo.clear();
+        used_bytes = 0;
+        raw_bytes = 0;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Stats{victims.size(), used_bytes, raw_bytes, hits, evicted};
+    }
+};